@@ -15,6 +15,10 @@ gradlePlugin {
             id = "com.dokar.quickjs.native-build"
             implementationClass = "com.dokar.quickjs.QuickJsNativeBuildPlugin"
         }
+        create("quickJsBytecode") {
+            id = "com.dokar.quickjs.bytecode"
+            implementationClass = "com.dokar.quickjs.QuickJsBytecodePlugin"
+        }
         create("disableUnsupportedPlatformTasks") {
             id = "com.dokar.quickjs.disable-unsupported-platform-tasks"
             implementationClass = "com.dokar.quickjs.DisableUnsupportedPlatformTasksPlugin"
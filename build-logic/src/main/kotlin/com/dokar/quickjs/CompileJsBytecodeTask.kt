@@ -0,0 +1,44 @@
+package com.dokar.quickjs
+
+import org.gradle.api.file.DirectoryProperty
+import org.gradle.api.file.FileSystemOperations
+import org.gradle.api.tasks.InputDirectory
+import org.gradle.api.tasks.JavaExec
+import org.gradle.api.tasks.OutputDirectory
+import org.gradle.api.tasks.PathSensitive
+import org.gradle.api.tasks.PathSensitivity
+import org.gradle.api.tasks.TaskAction
+import org.gradle.process.CommandLineArgumentProvider
+import javax.inject.Inject
+
+/**
+ * Run the bytecode compiler of the library on [sourceDir], the bundles are written to
+ * [outputDir]. The output directory is cleared first, so bundles of deleted sources don't
+ * stay around.
+ */
+abstract class CompileJsBytecodeTask : JavaExec() {
+    @get:InputDirectory
+    @get:PathSensitive(PathSensitivity.RELATIVE)
+    abstract val sourceDir: DirectoryProperty
+
+    @get:OutputDirectory
+    abstract val outputDir: DirectoryProperty
+
+    @get:Inject
+    protected abstract val fileSystemOperations: FileSystemOperations
+
+    init {
+        argumentProviders.add(CommandLineArgumentProvider {
+            listOf(
+                sourceDir.get().asFile.absolutePath,
+                outputDir.get().asFile.absolutePath,
+            )
+        })
+    }
+
+    @TaskAction
+    override fun exec() {
+        fileSystemOperations.delete { delete(outputDir) }
+        super.exec()
+    }
+}
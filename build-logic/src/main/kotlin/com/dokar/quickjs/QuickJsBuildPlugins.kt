@@ -11,6 +11,12 @@ class QuickJsNativeBuildPlugin : Plugin<Project> {
     }
 }
 
+class QuickJsBytecodePlugin : Plugin<Project> {
+    override fun apply(project: Project) {
+        project.applyQuickJsBytecodeTasks()
+    }
+}
+
 class DisableUnsupportedPlatformTasksPlugin : Plugin<Project> {
     override fun apply(project: Project) {
         project.gradle.projectsEvaluated {
@@ -0,0 +1,90 @@
+package com.dokar.quickjs
+
+import org.gradle.api.Project
+import org.gradle.api.attributes.Attribute
+import org.gradle.api.attributes.Usage
+import org.gradle.api.tasks.SourceSetContainer
+import org.gradle.kotlin.dsl.findByType
+import org.gradle.kotlin.dsl.register
+import org.gradle.kotlin.dsl.withGroovyBuilder
+import java.io.File
+
+private const val COMPILER_CONFIGURATION = "quickJsCompiler"
+private const val COMPILER_MAIN_CLASS = "com.dokar.quickjs.BytecodeCompiler"
+
+private val kotlinPlatformTypeAttribute =
+    Attribute.of("org.jetbrains.kotlin.platform.type", String::class.java)
+
+/**
+ * Register a task for every `src/<source set>/js` directory to compile the scripts and the
+ * module graphs in it to version stamped bundles, and add the bundles to the resources of
+ * the source set.
+ *
+ * The compiler runs the JVM build of QuickJS, which loads the host native library. Add it
+ * to the `quickJsCompiler` configuration:
+ *
+ * ```kotlin
+ * dependencies {
+ *     quickJsCompiler(project(":quickjs"))
+ * }
+ * ```
+ */
+fun Project.applyQuickJsBytecodeTasks() {
+    val compilerClasspath = configurations.create(COMPILER_CONFIGURATION) {
+        isCanBeConsumed = false
+        isCanBeResolved = true
+        attributes {
+            attribute(Usage.USAGE_ATTRIBUTE, objects.named(Usage::class.java, Usage.JAVA_RUNTIME))
+            attribute(kotlinPlatformTypeAttribute, "jvm")
+        }
+    }
+
+    val sourceDirs = File(projectDir, "src").listFiles { file ->
+        File(file, "js").isDirectory
+    } ?: return
+
+    for (sourceSetDir in sourceDirs) {
+        val sourceSetName = sourceSetDir.name
+        val jsDir = File(sourceSetDir, "js")
+        val outputDir = layout.buildDirectory.dir("generated/quickjs/bytecode/$sourceSetName")
+
+        val compileTask = tasks.register<CompileJsBytecodeTask>(
+            "compile${sourceSetName.replaceFirstChar { it.uppercase() }}JsBytecode"
+        ) {
+            group = "build"
+            description = "Compiles JavaScript in '$jsDir' to QuickJS bytecode."
+
+            classpath = compilerClasspath
+            mainClass.set(COMPILER_MAIN_CLASS)
+
+            sourceDir.set(jsDir)
+            this.outputDir.set(outputDir)
+        }
+
+        // Source sets are declared after the plugin is applied
+        afterEvaluate {
+            addResourceDir(sourceSetName, compileTask)
+        }
+    }
+}
+
+private fun Project.addResourceDir(sourceSetName: String, dir: Any) {
+    // Kotlin Multiplatform projects, the Kotlin plugin is not on the classpath of build-logic
+    plugins.withId("org.jetbrains.kotlin.multiplatform") {
+        extensions.getByName("kotlin").withGroovyBuilder {
+            val sourceSet = getProperty("sourceSets").withGroovyBuilder {
+                "findByName"(sourceSetName)
+            } ?: return@withGroovyBuilder
+            sourceSet.withGroovyBuilder {
+                getProperty("resources").withGroovyBuilder { "srcDir"(dir) }
+            }
+        }
+    }
+    // Java and Kotlin/JVM projects
+    plugins.withId("java") {
+        extensions.findByType<SourceSetContainer>()
+            ?.findByName(sourceSetName)
+            ?.resources
+            ?.srcDir(dir)
+    }
+}
@@ -6,6 +6,7 @@ plugins {
     alias(libs.plugins.androidLibrary)
     alias(libs.plugins.mavenPublish)
     id("com.dokar.quickjs.native-build")
+    id("com.dokar.quickjs.bytecode")
     id("com.dokar.quickjs.disable-unsupported-platform-tasks")
 }
 
@@ -67,6 +68,7 @@ kotlin {
                         file("native/quickjs/quickjs.h"),
                         file("native/common/quickjs_version.h"),
                         file("native/common/quickjs_interrupt.h"),
+                        file("native/common/quickjs_slab_allocator.h"),
                     )
                     packageName("quickjs")
                 }
@@ -75,6 +77,11 @@ kotlin {
     }
 }
 
+dependencies {
+    // Compiles src/jvmTest/js with the JVM build of this project
+    quickJsCompiler(project(":quickjs"))
+}
+
 val cmakeFile = file("native/CMakeLists.txt")
 
 android {
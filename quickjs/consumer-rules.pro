@@ -1,4 +1,5 @@
 -keep,allowoptimization class com.dokar.quickjs.QuickJs { *; }
+-keep,allowoptimization class com.dokar.quickjs.SharedModuleCache { *; }
 -keep,allowoptimization class com.dokar.quickjs.QuickJsException { *; }
 -keep,allowoptimization class com.dokar.quickjs.binding.JsProperty { *; }
 -keep,allowoptimization class com.dokar.quickjs.binding.JsFunction { *; }
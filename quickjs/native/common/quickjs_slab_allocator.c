@@ -0,0 +1,256 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "quickjs.h"
+#include "quickjs_slab_allocator.h"
+
+#define SLAB_CLASS_COUNT 10
+#define SLAB_CHUNK_SIZE (64 * 1024)
+// Keeps payloads aligned like malloc() on all targets
+#define SLAB_HEADER_SIZE 16
+
+static const size_t slab_class_sizes[SLAB_CLASS_COUNT] = {
+        16, 32, 48, 64, 96, 128, 192, 256, 384, 512,
+};
+
+typedef struct SlabChunk {
+    struct SlabChunk *next;
+    // Bytes handed out from the chunk data
+    size_t used;
+    // Blocks currently allocated from this chunk
+    uint32_t live;
+    uint32_t class_index;
+} SlabChunk;
+
+#define SLAB_CHUNK_HEADER_SIZE ((sizeof(SlabChunk) + 15) & ~(size_t) 15)
+
+typedef struct SlabBlockHeader {
+    // NULL for large allocations
+    SlabChunk *chunk;
+    // Usable payload size
+    size_t size;
+} SlabBlockHeader;
+
+typedef struct QjsSlabAllocator {
+    // Free blocks by class, linked through their payloads
+    SlabBlockHeader *free_lists[SLAB_CLASS_COUNT];
+    // Chunks by class, only the head chunk has unused space
+    SlabChunk *chunks[SLAB_CLASS_COUNT];
+} QjsSlabAllocator;
+
+static int slab_class_of(size_t size) {
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        if (size <= slab_class_sizes[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline void *slab_payload(SlabBlockHeader *header) {
+    return (uint8_t *) header + SLAB_HEADER_SIZE;
+}
+
+static inline SlabBlockHeader *slab_header(const void *ptr) {
+    return (SlabBlockHeader *) ((uint8_t *) ptr - SLAB_HEADER_SIZE);
+}
+
+// Bytes counted in malloc_size for a block, both for limit checks and accounting
+static inline size_t slab_charge(size_t usable) {
+    return usable + SLAB_HEADER_SIZE;
+}
+
+static inline SlabBlockHeader **slab_next_free(SlabBlockHeader *header) {
+    return (SlabBlockHeader **) slab_payload(header);
+}
+
+static SlabBlockHeader *slab_alloc_block(QjsSlabAllocator *allocator, int class_index) {
+    SlabBlockHeader *header = allocator->free_lists[class_index];
+    if (header != NULL) {
+        allocator->free_lists[class_index] = *slab_next_free(header);
+        header->chunk->live++;
+        return header;
+    }
+
+    size_t block_size = SLAB_HEADER_SIZE + slab_class_sizes[class_index];
+    SlabChunk *chunk = allocator->chunks[class_index];
+    if (chunk == NULL ||
+        chunk->used + block_size > SLAB_CHUNK_SIZE - SLAB_CHUNK_HEADER_SIZE) {
+        chunk = malloc(SLAB_CHUNK_SIZE);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = allocator->chunks[class_index];
+        chunk->used = 0;
+        chunk->live = 0;
+        chunk->class_index = class_index;
+        allocator->chunks[class_index] = chunk;
+    }
+
+    header = (SlabBlockHeader *) ((uint8_t *) chunk + SLAB_CHUNK_HEADER_SIZE + chunk->used);
+    chunk->used += block_size;
+    chunk->live++;
+    header->chunk = chunk;
+    header->size = slab_class_sizes[class_index];
+    return header;
+}
+
+static void *slab_malloc(JSMallocState *s, size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    int class_index = slab_class_of(size);
+    size_t usable = class_index < 0 ? size : slab_class_sizes[class_index];
+    if (s->malloc_size + slab_charge(usable) > s->malloc_limit) {
+        return NULL;
+    }
+
+    SlabBlockHeader *header;
+    if (class_index < 0) {
+        header = malloc(SLAB_HEADER_SIZE + size);
+        if (header == NULL) {
+            return NULL;
+        }
+        header->chunk = NULL;
+        header->size = size;
+    } else {
+        header = slab_alloc_block((QjsSlabAllocator *) s->opaque, class_index);
+        if (header == NULL) {
+            return NULL;
+        }
+    }
+
+    s->malloc_count++;
+    s->malloc_size += slab_charge(usable);
+    return slab_payload(header);
+}
+
+static void slab_free_ptr(JSMallocState *s, void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    SlabBlockHeader *header = slab_header(ptr);
+    s->malloc_count--;
+    s->malloc_size -= slab_charge(header->size);
+
+    SlabChunk *chunk = header->chunk;
+    if (chunk == NULL) {
+        free(header);
+        return;
+    }
+    QjsSlabAllocator *allocator = (QjsSlabAllocator *) s->opaque;
+    chunk->live--;
+    *slab_next_free(header) = allocator->free_lists[chunk->class_index];
+    allocator->free_lists[chunk->class_index] = header;
+}
+
+static void *slab_realloc(JSMallocState *s, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return slab_malloc(s, size);
+    }
+    if (size == 0) {
+        slab_free_ptr(s, ptr);
+        return NULL;
+    }
+
+    SlabBlockHeader *header = slab_header(ptr);
+    size_t old_size = header->size;
+    if (header->chunk != NULL && size <= old_size) {
+        // Still fits the size class
+        return ptr;
+    }
+    if (header->chunk == NULL && slab_class_of(size) < 0) {
+        size_t old_charge = slab_charge(old_size);
+        size_t new_charge = slab_charge(size);
+        if (new_charge > old_charge && s->malloc_size - old_charge + new_charge > s->malloc_limit) {
+            return NULL;
+        }
+        SlabBlockHeader *new_header = realloc(header, SLAB_HEADER_SIZE + size);
+        if (new_header == NULL) {
+            return NULL;
+        }
+        s->malloc_size = s->malloc_size - old_charge + new_charge;
+        new_header->size = size;
+        return slab_payload(new_header);
+    }
+
+    void *new_ptr = slab_malloc(s, size);
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+    slab_free_ptr(s, ptr);
+    return new_ptr;
+}
+
+static size_t slab_malloc_usable_size(const void *ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    return slab_header(ptr)->size;
+}
+
+static const JSMallocFunctions slab_malloc_functions = {
+        slab_malloc,
+        slab_free_ptr,
+        slab_realloc,
+        slab_malloc_usable_size,
+};
+
+void *qjs_slab_new(void) {
+    return calloc(1, sizeof(QjsSlabAllocator));
+}
+
+JSRuntime *qjs_slab_new_runtime(void *allocator) {
+    if (allocator == NULL) {
+        return NULL;
+    }
+    return JS_NewRuntime2(&slab_malloc_functions, allocator);
+}
+
+void qjs_slab_trim(void *allocator) {
+    QjsSlabAllocator *slab = (QjsSlabAllocator *) allocator;
+    if (slab == NULL) {
+        return;
+    }
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        // Unlink the free blocks of empty chunks first
+        SlabBlockHeader **link = &slab->free_lists[i];
+        while (*link != NULL) {
+            SlabBlockHeader *header = *link;
+            if (header->chunk->live == 0) {
+                *link = *slab_next_free(header);
+            } else {
+                link = slab_next_free(header);
+            }
+        }
+
+        SlabChunk **chunk_link = &slab->chunks[i];
+        while (*chunk_link != NULL) {
+            SlabChunk *chunk = *chunk_link;
+            if (chunk->live == 0) {
+                *chunk_link = chunk->next;
+                free(chunk);
+            } else {
+                chunk_link = &chunk->next;
+            }
+        }
+    }
+}
+
+void qjs_slab_free(void *allocator) {
+    QjsSlabAllocator *slab = (QjsSlabAllocator *) allocator;
+    if (slab == NULL) {
+        return;
+    }
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        SlabChunk *chunk = slab->chunks[i];
+        while (chunk != NULL) {
+            SlabChunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+    }
+    free(slab);
+}
@@ -0,0 +1,26 @@
+#ifndef QJS_KT_QUICKJS_SLAB_ALLOCATOR_H
+#define QJS_KT_QUICKJS_SLAB_ALLOCATOR_H
+
+/*
+ * Size-class slab allocator for JS_NewRuntime2().
+ * Requires "quickjs.h" to be included first.
+ *
+ * Small allocations are carved from 64 KiB chunks owned by the allocator and
+ * recycled through per-class free lists, larger ones go to malloc(). The
+ * allocator is not thread-safe, it relies on the runtime being used by one
+ * thread at a time, which the JS lock already guarantees.
+ */
+
+/* Create an allocator. Returns the allocator handle, NULL on OOM. */
+void *qjs_slab_new(void);
+
+/* Create a runtime allocating from the allocator, NULL on OOM. */
+JSRuntime *qjs_slab_new_runtime(void *allocator);
+
+/* Release chunks without live allocations, e.g. after freeing a context. */
+void qjs_slab_trim(void *allocator);
+
+/* Free the allocator and its chunks. Call after JS_FreeRuntime(). */
+void qjs_slab_free(void *allocator);
+
+#endif // QJS_KT_QUICKJS_SLAB_ALLOCATOR_H
@@ -7,11 +7,26 @@
 #include "jobject_to_js_value.h"
 #include "js_value_util.h"
 #include "jni_types_util.h"
+#include "context_data.h"
 
 #define COMMON_FUNC_DATA_LEN 2
 
 #define GLOBAL_THIS_HANDLE -1
 
+/**
+ * Throw if the context was replaced by a reset, the bindings and their host refs
+ * may be released already.
+ *
+ * @return 1 if thrown.
+ */
+static int throw_if_context_released(JSContext *context) {
+    if (!context_is_released(context)) {
+        return 0;
+    }
+    JS_ThrowInternalError(context, "QuickJs context was reset or closed.");
+    return 1;
+}
+
 void set_eval_exception_to_caller(JNIEnv *env, jobject call_host, jthrowable exception) {
     jmethodID set_exception_method = method_quick_js_set_eval_exception(env);
     (*env)->CallVoidMethod(env, call_host, set_exception_method, exception);
@@ -39,7 +54,7 @@ JSValue jni_invoke_getter(JSContext *context, jobject call_host, int64_t object_
     if (result == NULL) {
         return JS_NULL;
     }
-    return jobject_to_js_value(env, context, NULL, result);
+    return jobject_to_js_value(env, context, result);
 }
 
 JSValue jni_invoke_setter(JSContext *context, jobject call_host, int64_t object_handle,
@@ -110,24 +125,22 @@ JSValue jni_invoke_function(JSContext *context, jobject call_host, int64_t objec
         (*env)->DeleteLocalRef(env, exception);
         return JS_EXCEPTION;
     }
-    return jobject_to_js_value(env, context, NULL, result);
+    return jobject_to_js_value(env, context, result);
 }
 
 JSValue jni_invoke_async_function(JSContext *context, jobject call_host,
                                   int64_t object_handle,
                                   const char *function_name,
-                                  uint64_t resolve_handle,
-                                  uint64_t reject_handle,
+                                  int64_t promise_handle,
                                   int argc, JSValueConst *argv) {
     JNIEnv *env = get_jni_env();
     if (env == NULL) {
         return JS_EXCEPTION;
     }
-    int args_len = argc + 2;
+    int args_len = argc + 1;
     jobjectArray args = (*env)->NewObjectArray(env, args_len, cls_object(env), NULL);
-    // Set promise handles
-    (*env)->SetObjectArrayElement(env, args, 0, java_boxed_long(env, resolve_handle));
-    (*env)->SetObjectArrayElement(env, args, 1, java_boxed_long(env, reject_handle));
+    // Set the promise handle
+    (*env)->SetObjectArrayElement(env, args, 0, java_boxed_long(env, promise_handle));
     // Fill args
     for (uint32_t i = 0; i < argc; i++) {
         jobject arg = js_value_to_jobject(env, context, argv[i]);
@@ -164,6 +177,9 @@ JSValue jni_invoke_async_function(JSContext *context, jobject call_host,
 JSValue
 property_getter(JSContext *context, JSValueConst this_val, int argc, JSValueConst *argv, int magic,
                 JSValue *func_data) {
+    if (throw_if_context_released(context)) {
+        return JS_EXCEPTION;
+    }
     int64_t host_address;
     JS_ToInt64Ext(context, &host_address, func_data[0]);
     jobject call_host = (jobject) host_address;
@@ -181,6 +197,9 @@ property_getter(JSContext *context, JSValueConst this_val, int argc, JSValueCons
 JSValue
 property_setter(JSContext *context, JSValueConst this_val, int argc, JSValueConst *argv, int magic,
                 JSValue *func_data) {
+    if (throw_if_context_released(context)) {
+        return JS_EXCEPTION;
+    }
     int64_t host_address;
     JS_ToInt64Ext(context, &host_address, func_data[0]);
     jobject call_host = (jobject) host_address;
@@ -198,6 +217,9 @@ property_setter(JSContext *context, JSValueConst this_val, int argc, JSValueCons
 JSValue
 function_invoke(JSContext *context, JSValueConst this_val, int argc, JSValueConst *argv, int magic,
                 JSValue *func_data) {
+    if (throw_if_context_released(context)) {
+        return JS_EXCEPTION;
+    }
     int64_t host_address;
     JS_ToInt64Ext(context, &host_address, func_data[0]);
     jobject call_host = (jobject) host_address;
@@ -215,6 +237,9 @@ function_invoke(JSContext *context, JSValueConst this_val, int argc, JSValueCons
 JSValue async_function_invoke(JSContext *context, JSValueConst this_val,
                               int argc, JSValueConst *argv, int magic,
                               JSValue *func_data) {
+    if (throw_if_context_released(context)) {
+        return JS_EXCEPTION;
+    }
     JNIEnv *env = get_jni_env();
     if (env == NULL) {
         return JS_EXCEPTION;
@@ -240,35 +265,42 @@ JSValue async_function_invoke(JSContext *context, JSValueConst this_val,
     int64_t globals_address = (globals_address_low & 0xFFFFFFFF) | globals_address_high << 32;
     Globals *globals = (Globals *) globals_address;
 
-    // Handles are the indices
-    int64_t resolve_handle = cvector_size(globals->created_js_functions);
-    int64_t reject_handle = resolve_handle + 1;
-
     JSValue promise_functions[2];
     JSValue promise = JS_NewPromiseCapability(context, promise_functions);
+    if (JS_IsException(promise)) {
+        JS_FreeCString(context, function_name);
+        return promise;
+    }
 
-    cvector_push_back(globals->managed_js_values, promise);
-    cvector_push_back(globals->created_js_functions, promise_functions[0]);
-    cvector_push_back(globals->created_js_functions, promise_functions[1]);
+    // The resolve and reject functions are kept until the promise is settled
+    int64_t promise_handle = handle_table_add(&globals->promise_capabilities,
+                                              promise_functions, 2);
+    if (promise_handle < 0) {
+        JS_FreeValue(context, promise_functions[0]);
+        JS_FreeValue(context, promise_functions[1]);
+        JS_FreeValue(context, promise);
+        JS_FreeCString(context, function_name);
+        return JS_ThrowInternalError(context, "Too many pending async calls.");
+    }
 
     // Call java function
     JSValue result = jni_invoke_async_function(context, call_host, object_handle,
-                                               function_name, resolve_handle, reject_handle,
+                                               function_name, promise_handle,
                                                argc, argv);
 
     JS_FreeCString(context, function_name);
 
     if (JS_IsException(result)) {
         // Error!
+        handle_table_remove(context, &globals->promise_capabilities, promise_handle);
+        JS_FreeValue(context, promise);
         return result;
     } else {
         // Ignore the async return
         JS_FreeValue(context, result);
     }
 
-    // Return the promise directly will cause a GC error:
-    // void gc_decref_child(JSRuntime *, JSGCObjectHeader *): assertion "p->ref_count > 0" failed
-    return JS_DupValue(context, promise);
+    return promise;
 }
 
 void define_async_js_function_on(JSContext *context,
@@ -289,9 +321,10 @@ void define_async_js_function_on(JSContext *context,
     async_func_data[func_data_len] = JS_NewBigInt64(context, globals_low);
     async_func_data[func_data_len + 1] = JS_NewBigInt64(context, globals_high);
 
+    ContextData *context_data = context_data_get(context);
     for (int i = func_data_len; i < async_func_data_len; ++i) {
         // Add to free
-        cvector_push_back(globals->managed_js_values, async_func_data[i]);
+        cvector_push_back(context_data->managed_js_values, async_func_data[i]);
     }
 
     JSValue invoke = JS_NewCFunctionData(context, async_function_invoke, 0, 0,
@@ -342,7 +375,7 @@ void define_js_functions_on(JNIEnv *env,
             func_data[j] = common_func_data[j];
         }
         JSValue js_func_name = JS_NewString(context, func_name);
-        cvector_push_back(globals->managed_js_values, js_func_name);
+        cvector_push_back(context_data_get(context)->managed_js_values, js_func_name);
         func_data[data_len - 1] = js_func_name;
 
         if (is_async) {
@@ -364,8 +397,9 @@ JSValue define_js_object(JNIEnv *env, JSContext *context,
                          jstring name,
                          jobjectArray properties,
                          jobjectArray functions) {
+    ContextData *context_data = context_data_get(context);
     jobject global_host = (*env)->NewGlobalRef(env, host);
-    cvector_push_back(globals->global_object_refs, global_host);
+    cvector_push_back(context_data->binding_host_refs, global_host);
 
     jsize prop_size = (*env)->GetArrayLength(env, properties);
 
@@ -376,7 +410,7 @@ JSValue define_js_object(JNIEnv *env, JSContext *context,
 
     // Free these values before freeing the runtime
     for (uint32_t i = 0; i < COMMON_FUNC_DATA_LEN; i++) {
-        cvector_push_back(globals->managed_js_values, common_func_data[i]);
+        cvector_push_back(context_data->managed_js_values, common_func_data[i]);
     }
 
     JSValue object = JS_NewObject(context);
@@ -400,7 +434,7 @@ JSValue define_js_object(JNIEnv *env, JSContext *context,
             func_data[j] = common_func_data[j];
         }
         JSValue js_prop_name = JS_NewString(context, prop_name);
-        cvector_push_back(globals->managed_js_values, js_prop_name);
+        cvector_push_back(context_data->managed_js_values, js_prop_name);
         func_data[data_len - 1] = js_prop_name;
 
         JSValue getter = JS_NewCFunctionData(context, property_getter, 0, 0, data_len, func_data);
@@ -465,8 +499,9 @@ void define_js_function(JNIEnv *env, JSContext *context,
                         jobject host,
                         jstring name,
                         jboolean is_async) {
+    ContextData *context_data = context_data_get(context);
     jobject global_host = (*env)->NewGlobalRef(env, host);
-    cvector_push_back(globals->global_object_refs, global_host);
+    cvector_push_back(context_data->binding_host_refs, global_host);
 
     const char *func_name = (*env)->GetStringUTFChars(env, name, NULL);
 
@@ -479,7 +514,7 @@ void define_js_function(JNIEnv *env, JSContext *context,
     };
 
     for (uint32_t i = 0; i < data_len; i++) {
-        cvector_push_back(globals->managed_js_values, func_data[i]);
+        cvector_push_back(context_data->managed_js_values, func_data[i]);
     }
 
     JSValue global_this = JS_GetGlobalObject(context);
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <string.h>
+#include "context_data.h"
+
+// Larger than the number of built-in classes
+#define MAX_BUILTIN_CLASS_ID 256
+
+/**
+ * Find the class id of an object.
+ *
+ * QuickJS does not expose class ids, but JS_GetOpaque() only returns the
+ * internal state of an object if the class id matches, and all the built-in
+ * types we check have one.
+ *
+ * @return 0 if not found.
+ */
+static JSClassID find_class_id(JSValue object) {
+    if (JS_VALUE_GET_TAG(object) != JS_TAG_OBJECT) {
+        return 0;
+    }
+    for (JSClassID class_id = 1; class_id < MAX_BUILTIN_CLASS_ID; class_id++) {
+        if (JS_GetOpaque(object, class_id) != NULL) {
+            return class_id;
+        }
+    }
+    return 0;
+}
+
+static JSClassID find_constructed_class_id(JSContext *context, JSValue constructor) {
+    JSValue instance = JS_CallConstructor(context, constructor, 0, NULL);
+    if (JS_IsException(instance)) {
+        JS_FreeValue(context, JS_GetException(context));
+        return 0;
+    }
+    JSClassID class_id = find_class_id(instance);
+    JS_FreeValue(context, instance);
+    return class_id;
+}
+
+static JSClassID find_promise_class_id(JSContext *context) {
+    JSValue resolving_funcs[2];
+    JSValue promise = JS_NewPromiseCapability(context, resolving_funcs);
+    if (JS_IsException(promise)) {
+        JS_FreeValue(context, JS_GetException(context));
+        return 0;
+    }
+    JSClassID class_id = find_class_id(promise);
+    JS_FreeValue(context, resolving_funcs[0]);
+    JS_FreeValue(context, resolving_funcs[1]);
+    JS_FreeValue(context, promise);
+    return class_id;
+}
+
+static void init_intrinsics(JSContext *context, JsIntrinsics *intrinsics) {
+    JSValue global_this = JS_GetGlobalObject(context);
+    intrinsics->promise_constructor = JS_GetPropertyStr(context, global_this, "Promise");
+    intrinsics->set_constructor = JS_GetPropertyStr(context, global_this, "Set");
+    intrinsics->map_constructor = JS_GetPropertyStr(context, global_this, "Map");
+    intrinsics->uint8array_constructor = JS_GetPropertyStr(context, global_this, "Uint8Array");
+    intrinsics->int8array_constructor = JS_GetPropertyStr(context, global_this, "Int8Array");
+    intrinsics->int32array_constructor = JS_GetPropertyStr(context, global_this, "Int32Array");
+    intrinsics->bigint64array_constructor = JS_GetPropertyStr(context, global_this,
+                                                              "BigInt64Array");
+    intrinsics->float32array_constructor = JS_GetPropertyStr(context, global_this,
+                                                             "Float32Array");
+    intrinsics->float64array_constructor = JS_GetPropertyStr(context, global_this,
+                                                             "Float64Array");
+    JS_FreeValue(context, global_this);
+
+    intrinsics->promise_class_id = find_promise_class_id(context);
+    intrinsics->set_class_id = find_constructed_class_id(context, intrinsics->set_constructor);
+    intrinsics->map_class_id = find_constructed_class_id(context, intrinsics->map_constructor);
+    intrinsics->uint8array_class_id = find_constructed_class_id(
+            context, intrinsics->uint8array_constructor);
+    intrinsics->int8array_class_id = find_constructed_class_id(
+            context, intrinsics->int8array_constructor);
+    intrinsics->int32array_class_id = find_constructed_class_id(
+            context, intrinsics->int32array_constructor);
+    intrinsics->bigint64array_class_id = find_constructed_class_id(
+            context, intrinsics->bigint64array_constructor);
+    intrinsics->float32array_class_id = find_constructed_class_id(
+            context, intrinsics->float32array_constructor);
+    intrinsics->float64array_class_id = find_constructed_class_id(
+            context, intrinsics->float64array_constructor);
+}
+
+static void free_js_values(JSContext *context, cvector_vector_type(JSValue)values) {
+    if (values == NULL) {
+        return;
+    }
+    size_t size = cvector_size(values);
+    for (uint32_t i = 0; i < size; i++) {
+        JS_FreeValue(context, values[i]);
+    }
+    cvector_free(values);
+}
+
+ContextData *context_data_init(JSContext *context, jobject realm_host) {
+    ContextData *data = malloc(sizeof(ContextData));
+    if (data == NULL) {
+        return NULL;
+    }
+    data->realm_host = realm_host;
+    data->map_typed_arrays = 0;
+    data->released = 0;
+    data->managed_js_values = NULL;
+    data->defined_js_objects = NULL;
+    data->binding_host_refs = NULL;
+    name_set_init(&data->module_names);
+    init_intrinsics(context, &data->intrinsics);
+    JS_SetContextOpaque(context, data);
+    return data;
+}
+
+void context_data_free(JNIEnv *env, JSContext *context) {
+    ContextData *data = context_data_get(context);
+    if (data == NULL) {
+        return;
+    }
+    JS_SetContextOpaque(context, NULL);
+    free_js_values(context, data->managed_js_values);
+    free_js_values(context, data->defined_js_objects);
+    cvector_vector_type(jobject)binding_host_refs = data->binding_host_refs;
+    if (binding_host_refs != NULL) {
+        size_t size = cvector_size(binding_host_refs);
+        for (uint32_t i = 0; i < size; i++) {
+            (*env)->DeleteGlobalRef(env, binding_host_refs[i]);
+        }
+        cvector_free(binding_host_refs);
+    }
+    name_set_free(&data->module_names);
+    JsIntrinsics *intrinsics = &data->intrinsics;
+    JS_FreeValue(context, intrinsics->promise_constructor);
+    JS_FreeValue(context, intrinsics->set_constructor);
+    JS_FreeValue(context, intrinsics->map_constructor);
+    JS_FreeValue(context, intrinsics->uint8array_constructor);
+    JS_FreeValue(context, intrinsics->int8array_constructor);
+    JS_FreeValue(context, intrinsics->int32array_constructor);
+    JS_FreeValue(context, intrinsics->bigint64array_constructor);
+    JS_FreeValue(context, intrinsics->float32array_constructor);
+    JS_FreeValue(context, intrinsics->float64array_constructor);
+    if (data->realm_host != NULL) {
+        (*env)->DeleteGlobalRef(env, data->realm_host);
+    }
+    free(data);
+}
+
+int context_has_module(JSContext *context, const char *name, size_t length, uint32_t hash) {
+    ContextData *data = context_data_get(context);
+    return data != NULL && name_set_contains(&data->module_names, name, length, hash);
+}
+
+void context_add_module(JSContext *context, const char *name, size_t length, uint32_t hash) {
+    ContextData *data = context_data_get(context);
+    if (data != NULL) {
+        name_set_add(&data->module_names, name, length, hash);
+    }
+}
+
+int js_is_intrinsic(JSContext *context, JSValue value, JSClassID class_id,
+                    JSValue constructor) {
+    if (class_id != 0) {
+        return JS_GetOpaque(value, class_id) != NULL;
+    }
+    if (JS_VALUE_GET_TAG(value) != JS_TAG_OBJECT || !JS_IsObject(constructor)) {
+        return 0;
+    }
+    return JS_IsInstanceOf(context, value, constructor) == 1;
+}
@@ -0,0 +1,147 @@
+#ifndef QJS_KT_CONTEXT_DATA_H
+#define QJS_KT_CONTEXT_DATA_H
+
+#include "jni.h"
+#include "quickjs.h"
+#include "cvector.h"
+#include "name_set.h"
+
+/**
+ * Built-in constructors and class ids of a context.
+ *
+ * Resolved once when the context is created, so type checks don't look up
+ * globalThis, and keep working when user code overwrites the globals.
+ */
+typedef struct {
+    /** Class ids of the built-in types, 0 if not found. */
+    JSClassID promise_class_id;
+    JSClassID set_class_id;
+    JSClassID map_class_id;
+    JSClassID uint8array_class_id;
+    JSClassID int8array_class_id;
+    JSClassID int32array_class_id;
+    JSClassID bigint64array_class_id;
+    JSClassID float32array_class_id;
+    JSClassID float64array_class_id;
+    JSValue promise_constructor;
+    JSValue set_constructor;
+    JSValue map_constructor;
+    JSValue uint8array_constructor;
+    JSValue int8array_constructor;
+    JSValue int32array_constructor;
+    JSValue bigint64array_constructor;
+    JSValue float32array_constructor;
+    JSValue float64array_constructor;
+} JsIntrinsics;
+
+/**
+ * Data of a context created by QuickJs, stored as the context opaque.
+ */
+typedef struct {
+    /**
+     * The QuickJs host global ref of a realm context, NULL for the main context
+     * of a runtime.
+     */
+    jobject realm_host;
+    /**
+     * Whether primitive java arrays are mapped to typed arrays, and typed arrays
+     * back to primitive arrays.
+     */
+    int map_typed_arrays;
+    /**
+     * Set when the context is replaced by a reset, bindings called by its
+     * leftover jobs fail without calling into Kotlin.
+     */
+    int released;
+    /**
+     * JS values used by the C functions of the bindings.
+     */
+    cvector_vector_type(JSValue)managed_js_values;
+    /**
+     * Defined JS objects, indexed by the object handles to support nested define.
+     */
+    cvector_vector_type(JSValue)defined_js_objects;
+    /**
+     * Global refs of the binding hosts, read by the bindings from their function data.
+     */
+    cvector_vector_type(jobject)binding_host_refs;
+    /**
+     * Names of the modules read by bundles and the module loader. QuickJS can't look up
+     * modules by name, bundles check these to not register a module twice.
+     */
+    NameSet module_names;
+    JsIntrinsics intrinsics;
+} ContextData;
+
+/**
+ * Create the data of a new context and set it as the context opaque.
+ *
+ * @param realm_host The realm host global ref, the data takes the ownership.
+ * @return NULL if out of memory.
+ */
+ContextData *context_data_init(JSContext *context, jobject realm_host);
+
+/**
+ * Get the data of a context, NULL if the context has no data.
+ */
+static inline ContextData *context_data_get(JSContext *context) {
+    return (ContextData *) JS_GetContextOpaque(context);
+}
+
+/**
+ * Get the built-in types of a context, NULL if the context has no data.
+ */
+static inline JsIntrinsics *js_intrinsics(JSContext *context) {
+    ContextData *data = context_data_get(context);
+    return data != NULL ? &data->intrinsics : NULL;
+}
+
+/**
+ * Check if the context maps primitive arrays to typed arrays.
+ */
+static inline int context_maps_typed_arrays(JSContext *context) {
+    ContextData *data = context_data_get(context);
+    return data != NULL && data->map_typed_arrays;
+}
+
+/**
+ * Check if the context was replaced by a reset or released, bindings and host
+ * callbacks must not be called for it.
+ */
+static inline int context_is_released(JSContext *context) {
+    ContextData *data = context_data_get(context);
+    return data == NULL || data->released;
+}
+
+/**
+ * Check if a module was registered in the context by a bundle or the module loader.
+ *
+ * @param name The module name, not null-terminated.
+ * @param hash The name_set_hash() of the name.
+ */
+int context_has_module(JSContext *context, const char *name, size_t length, uint32_t hash);
+
+/**
+ * Record a module registered in the context, does nothing if the context has no data.
+ *
+ * @param name The module name, not null-terminated.
+ * @param hash The name_set_hash() of the name.
+ */
+void context_add_module(JSContext *context, const char *name, size_t length, uint32_t hash);
+
+/**
+ * Free the data of a context with the values and host refs of its bindings, must be
+ * called before JS_FreeContext().
+ */
+void context_data_free(JNIEnv *env, JSContext *context);
+
+/**
+ * Check if the value is an instance of a built-in type.
+ *
+ * @param class_id The class id of the type, checked against the constructor if 0.
+ * @param constructor The constructor of the type.
+ */
+int js_is_intrinsic(JSContext *context, JSValue value, JSClassID class_id,
+                    JSValue constructor);
+
+#endif //QJS_KT_CONTEXT_DATA_H
@@ -0,0 +1,87 @@
+#include "handle_table.h"
+
+#define HANDLE_TABLE_NO_SLOT UINT32_MAX
+#define HANDLE_TABLE_IN_USE (UINT32_MAX - 1)
+#define HANDLE_TABLE_GENERATION_MASK 0x7FFFFFFF
+
+static inline int64_t pack_handle(uint32_t index, uint32_t generation) {
+    return (int64_t) (generation & HANDLE_TABLE_GENERATION_MASK) << 32 | index;
+}
+
+static void release_slot(JSContext *context, HandleTable *table, uint32_t index) {
+    HandleSlot *slot = &table->slots[index];
+    for (int i = 0; i < HANDLE_TABLE_SLOT_VALUES; i++) {
+        JS_FreeValue(context, slot->values[i]);
+        slot->values[i] = JS_UNDEFINED;
+    }
+    slot->generation++;
+    slot->next_free = table->free_head;
+    table->free_head = index;
+}
+
+void handle_table_init(HandleTable *table) {
+    table->slots = NULL;
+    table->free_head = HANDLE_TABLE_NO_SLOT;
+}
+
+int64_t handle_table_add(HandleTable *table, const JSValue *values, int count) {
+    uint32_t index;
+    if (table->free_head != HANDLE_TABLE_NO_SLOT) {
+        index = table->free_head;
+        table->free_head = table->slots[index].next_free;
+    } else {
+        size_t size = cvector_size(table->slots);
+        if (size >= HANDLE_TABLE_IN_USE) {
+            return -1;
+        }
+        HandleSlot slot = {.generation = 0};
+        cvector_push_back(table->slots, slot);
+        index = (uint32_t) size;
+    }
+    HandleSlot *slot = &table->slots[index];
+    for (int i = 0; i < HANDLE_TABLE_SLOT_VALUES; i++) {
+        slot->values[i] = i < count ? values[i] : JS_UNDEFINED;
+    }
+    slot->next_free = HANDLE_TABLE_IN_USE;
+    return pack_handle(index, slot->generation);
+}
+
+HandleSlot *handle_table_get(HandleTable *table, int64_t handle) {
+    if (handle < 0 || table->slots == NULL) {
+        return NULL;
+    }
+    uint64_t index = (uint64_t) handle & 0xFFFFFFFF;
+    if (index >= cvector_size(table->slots)) {
+        return NULL;
+    }
+    HandleSlot *slot = &table->slots[index];
+    if (slot->next_free != HANDLE_TABLE_IN_USE ||
+        pack_handle((uint32_t) index, slot->generation) != handle) {
+        return NULL;
+    }
+    return slot;
+}
+
+int handle_table_remove(JSContext *context, HandleTable *table, int64_t handle) {
+    if (handle_table_get(table, handle) == NULL) {
+        return 0;
+    }
+    release_slot(context, table, (uint32_t) (handle & 0xFFFFFFFF));
+    return 1;
+}
+
+void handle_table_clear(JSContext *context, HandleTable *table) {
+    size_t size = cvector_size(table->slots);
+    for (size_t i = 0; i < size; i++) {
+        if (table->slots[i].next_free == HANDLE_TABLE_IN_USE) {
+            release_slot(context, table, (uint32_t) i);
+        }
+    }
+}
+
+void handle_table_free(JSContext *context, HandleTable *table) {
+    handle_table_clear(context, table);
+    cvector_free(table->slots);
+    table->slots = NULL;
+    table->free_head = HANDLE_TABLE_NO_SLOT;
+}
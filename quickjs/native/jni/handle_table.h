@@ -0,0 +1,74 @@
+#ifndef QJS_KT_HANDLE_TABLE_H
+#define QJS_KT_HANDLE_TABLE_H
+
+#include <stdint.h>
+#include "cvector.h"
+#include "quickjs.h"
+
+#define HANDLE_TABLE_SLOT_VALUES 2
+
+/**
+ * A slot of JS values owned by a handle table.
+ */
+typedef struct {
+    JSValue values[HANDLE_TABLE_SLOT_VALUES];
+    /** Bumped every time the slot is released, so old handles become stale. */
+    uint32_t generation;
+    /** The next free slot when released, HANDLE_TABLE_IN_USE when allocated. */
+    uint32_t next_free;
+} HandleSlot;
+
+/**
+ * Generational handles of JS values with an embedded free list.
+ *
+ * A handle packs the slot index in the low 32 bits and the slot generation in
+ * the high 31 bits, so handles are always positive and a released handle is
+ * never accepted again, even after its slot has been reused.
+ */
+typedef struct {
+    cvector_vector_type(HandleSlot)slots;
+    /** The most recently released slot, HANDLE_TABLE_NO_SLOT if none. */
+    uint32_t free_head;
+} HandleTable;
+
+/**
+ * Init an empty table.
+ */
+void handle_table_init(HandleTable *table);
+
+/**
+ * Store values into a free slot, the table takes the ownership.
+ *
+ * @param values The values, unused values of the slot are set to undefined.
+ * @param count The number of values, up to HANDLE_TABLE_SLOT_VALUES.
+ * @return The handle, -1 if the table is full.
+ */
+int64_t handle_table_add(HandleTable *table, const JSValue *values, int count);
+
+/**
+ * Get the slot of a handle.
+ *
+ * The slot pointer is invalidated by the next handle_table_add() call.
+ *
+ * @return NULL if the handle is invalid or has been released.
+ */
+HandleSlot *handle_table_get(HandleTable *table, int64_t handle);
+
+/**
+ * Free the values of a handle and recycle its slot.
+ *
+ * @return 1 if released, 0 if the handle is invalid or has been released.
+ */
+int handle_table_remove(JSContext *context, HandleTable *table, int64_t handle);
+
+/**
+ * Release all handles, slots are kept for reuse.
+ */
+void handle_table_clear(JSContext *context, HandleTable *table);
+
+/**
+ * Release all handles and free the slots.
+ */
+void handle_table_free(JSContext *context, HandleTable *table);
+
+#endif //QJS_KT_HANDLE_TABLE_H
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "js_value_util.h"
+#include "context_data.h"
 #include "log_util.h"
 
 char *js_array_join(JSContext *context, JSValue array, const char *separator) {
@@ -197,43 +198,67 @@ JSValue new_js_error(JSContext *context,
     return error;
 }
 
-int js_is_instance_of(JSContext *context, JSValue global_this, JSValue value,
-                      const char *constructor_name) {
-    JSValue constructor = JS_GetPropertyStr(context, global_this, constructor_name);
-    if (JS_IsUndefined(constructor)) {
-        JS_FreeValue(context, constructor);
-        return 0;
-    }
-    int result = JS_IsInstanceOf(context, value, constructor);
-    JS_FreeValue(context, constructor);
-    return result;
+int js_is_promise(JSContext *context, JSValue value) {
+    JsIntrinsics *intrinsics = js_intrinsics(context);
+    return intrinsics != NULL &&
+           js_is_intrinsic(context, value, intrinsics->promise_class_id,
+                           intrinsics->promise_constructor);
 }
 
-int js_is_promise(JSContext *context, JSValue value) {
-    JSValue global_this = JS_GetGlobalObject(context);
-    int result = js_is_promise_2(context, global_this, value);
-    JS_FreeValue(context, global_this);
-    return result;
+int js_is_uint8array(JSContext *context, JSValue value) {
+    JsIntrinsics *intrinsics = js_intrinsics(context);
+    return intrinsics != NULL &&
+           js_is_intrinsic(context, value, intrinsics->uint8array_class_id,
+                           intrinsics->uint8array_constructor);
+}
+
+int js_is_int8array(JSContext *context, JSValue value) {
+    JsIntrinsics *intrinsics = js_intrinsics(context);
+    return intrinsics != NULL &&
+           js_is_intrinsic(context, value, intrinsics->int8array_class_id,
+                           intrinsics->int8array_constructor);
+}
+
+int js_is_int32array(JSContext *context, JSValue value) {
+    JsIntrinsics *intrinsics = js_intrinsics(context);
+    return intrinsics != NULL &&
+           js_is_intrinsic(context, value, intrinsics->int32array_class_id,
+                           intrinsics->int32array_constructor);
 }
 
-int js_is_promise_2(JSContext *context, JSValue global_this, JSValue value) {
-    return js_is_instance_of(context, global_this, value, "Promise");
+int js_is_bigint64array(JSContext *context, JSValue value) {
+    JsIntrinsics *intrinsics = js_intrinsics(context);
+    return intrinsics != NULL &&
+           js_is_intrinsic(context, value, intrinsics->bigint64array_class_id,
+                           intrinsics->bigint64array_constructor);
 }
 
-int js_is_uint8array(JSContext *context, JSValue global_this, JSValue value) {
-    return js_is_instance_of(context, global_this, value, "Uint8Array");
+int js_is_float32array(JSContext *context, JSValue value) {
+    JsIntrinsics *intrinsics = js_intrinsics(context);
+    return intrinsics != NULL &&
+           js_is_intrinsic(context, value, intrinsics->float32array_class_id,
+                           intrinsics->float32array_constructor);
 }
 
-int js_is_int8array(JSContext *context, JSValue global_this, JSValue value) {
-    return js_is_instance_of(context, global_this, value, "Int8Array");
+int js_is_float64array(JSContext *context, JSValue value) {
+    JsIntrinsics *intrinsics = js_intrinsics(context);
+    return intrinsics != NULL &&
+           js_is_intrinsic(context, value, intrinsics->float64array_class_id,
+                           intrinsics->float64array_constructor);
 }
 
-int js_is_set(JSContext *context, JSValue global_this, JSValue value) {
-    return js_is_instance_of(context, global_this, value, "Set");
+int js_is_set(JSContext *context, JSValue value) {
+    JsIntrinsics *intrinsics = js_intrinsics(context);
+    return intrinsics != NULL &&
+           js_is_intrinsic(context, value, intrinsics->set_class_id,
+                           intrinsics->set_constructor);
 }
 
-int js_is_map(JSContext *context, JSValue global_this, JSValue value) {
-    return js_is_instance_of(context, global_this, value, "Map");
+int js_is_map(JSContext *context, JSValue value) {
+    JsIntrinsics *intrinsics = js_intrinsics(context);
+    return intrinsics != NULL &&
+           js_is_intrinsic(context, value, intrinsics->map_class_id,
+                           intrinsics->map_constructor);
 }
 
 JSValue js_promise_get_fulfilled_value(JSContext *context, JSValue promise) {
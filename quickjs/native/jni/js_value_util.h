@@ -49,29 +49,44 @@ JSValue new_js_error(JSContext *context,
 int js_is_promise(JSContext *context, JSValue value);
 
 /**
- * Check if the js value is a Promise.
+ * Check if the js value is a Uint8Array.
  */
-int js_is_promise_2(JSContext *context, JSValue global_this, JSValue value);
+int js_is_uint8array(JSContext *context, JSValue value);
 
 /**
- * Check if the js value is a Uint8Array.
+ * Check if the js value is a Int8Array.
  */
-int js_is_uint8array(JSContext *context, JSValue global_this, JSValue value);
+int js_is_int8array(JSContext *context, JSValue value);
 
 /**
- * Check if the js value is a Int8Array.
+ * Check if the js value is a Int32Array.
+ */
+int js_is_int32array(JSContext *context, JSValue value);
+
+/**
+ * Check if the js value is a BigInt64Array.
+ */
+int js_is_bigint64array(JSContext *context, JSValue value);
+
+/**
+ * Check if the js value is a Float32Array.
+ */
+int js_is_float32array(JSContext *context, JSValue value);
+
+/**
+ * Check if the js value is a Float64Array.
  */
-int js_is_int8array(JSContext *context, JSValue global_this, JSValue value);
+int js_is_float64array(JSContext *context, JSValue value);
 
 /**
  * Check if the js value is a Set.
  */
-int js_is_set(JSContext *context, JSValue global_this, JSValue value);
+int js_is_set(JSContext *context, JSValue value);
 
 /**
  * Check if the js value is a Map.
  */
-int js_is_map(JSContext *context, JSValue global_this, JSValue value);
+int js_is_map(JSContext *context, JSValue value);
 
 /**
  * Get the value of a fulfilled promise.
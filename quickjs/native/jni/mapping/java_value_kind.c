@@ -0,0 +1,247 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include "java_value_kind.h"
+#include "jni_globals_generated.h"
+
+#define KIND_CACHE_CAPACITY 256
+#define KIND_CACHE_MAX_ENTRIES 192
+
+/** The class of a slot whose class was unloaded. Lookups probe past it, inserts reuse it. */
+#define RECLAIMED_CLASS ((jweak) (uintptr_t) 1)
+
+/**
+ * A cached class, empty if the class is NULL.
+ *
+ * Classes are weak global refs, so the cache never keeps class loaders alive.
+ * The class is stored last with a release store, so a reader that sees it also
+ * sees the hash and the kind.
+ */
+typedef struct {
+    _Atomic(jweak) cls;
+    atomic_int identity_hash;
+    atomic_int kind;
+} KindCacheSlot;
+
+/** Serializes inserts and reclaims, lookups don't lock. */
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static KindCacheSlot slots[KIND_CACHE_CAPACITY];
+/** Slots that are not empty, including reclaimed ones, cache_mutex must be locked. */
+static uint32_t used_slot_count = 0;
+/** Lookups in progress, reclaimed classes are only deleted when there are none. */
+static atomic_int active_readers = 0;
+/** Weak refs of reclaimed slots waiting to be deleted, cache_mutex must be locked. */
+static jweak retired_classes[KIND_CACHE_CAPACITY];
+static uint32_t retired_class_count = 0;
+
+static inline uint32_t slot_home(jint identity_hash) {
+    return ((uint32_t) identity_hash * 0x9E3779B1u) & (KIND_CACHE_CAPACITY - 1);
+}
+
+/**
+ * Find the slot of a class. Slots are never emptied again, so the probe always stops at an
+ * empty slot.
+ */
+static KindCacheSlot *find_slot(JNIEnv *env, jclass cls, jint identity_hash) {
+    uint32_t index = slot_home(identity_hash);
+    jweak slot_cls;
+    // Sequentially consistent with reclaim_slots(), which only deletes a weak ref when no
+    // lookup can still load it
+    while ((slot_cls = atomic_load(&slots[index].cls)) != NULL) {
+        KindCacheSlot *slot = &slots[index];
+        if (slot_cls != RECLAIMED_CLASS &&
+            atomic_load_explicit(&slot->identity_hash, memory_order_relaxed) == identity_hash &&
+            (*env)->IsSameObject(env, slot_cls, cls)) {
+            return slot;
+        }
+        index = (index + 1) & (KIND_CACHE_CAPACITY - 1);
+    }
+    return NULL;
+}
+
+/**
+ * Delete the retired weak refs if no lookup can still read them, cache_mutex must be locked.
+ */
+static void delete_retired_classes(JNIEnv *env) {
+    if (retired_class_count == 0 || atomic_load(&active_readers) != 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < retired_class_count; i++) {
+        (*env)->DeleteWeakGlobalRef(env, retired_classes[i]);
+    }
+    retired_class_count = 0;
+}
+
+/**
+ * Reclaim the slots of unloaded classes, cache_mutex must be locked.
+ */
+static void reclaim_slots(JNIEnv *env) {
+    for (uint32_t i = 0; i < KIND_CACHE_CAPACITY; i++) {
+        if (retired_class_count == KIND_CACHE_CAPACITY) {
+            break;
+        }
+        jweak slot_cls = atomic_load_explicit(&slots[i].cls, memory_order_relaxed);
+        if (slot_cls == NULL || slot_cls == RECLAIMED_CLASS ||
+            !(*env)->IsSameObject(env, slot_cls, NULL)) {
+            continue;
+        }
+        // Lookups started before this store may still read the weak ref
+        atomic_store(&slots[i].cls, RECLAIMED_CLASS);
+        retired_classes[retired_class_count++] = slot_cls;
+    }
+    delete_retired_classes(env);
+}
+
+/**
+ * Add the class to the cache, does nothing if the cache is full.
+ *
+ * A full cache first reclaims the slots of unloaded classes. The table has a bounded
+ * number of used slots, so lookups always stop at an empty slot.
+ */
+static void cache_kind(JNIEnv *env, jclass cls, jint identity_hash, JavaValueKind kind) {
+    pthread_mutex_lock(&cache_mutex);
+    if (used_slot_count >= KIND_CACHE_MAX_ENTRIES) {
+        reclaim_slots(env);
+    } else {
+        delete_retired_classes(env);
+    }
+    if (find_slot(env, cls, identity_hash) != NULL) {
+        pthread_mutex_unlock(&cache_mutex);
+        return;
+    }
+    // Reuse the first reclaimed slot of the probe, or take the empty slot ending it
+    uint32_t index = slot_home(identity_hash);
+    jweak slot_cls;
+    while ((slot_cls = atomic_load_explicit(&slots[index].cls, memory_order_relaxed)) != NULL &&
+           slot_cls != RECLAIMED_CLASS) {
+        index = (index + 1) & (KIND_CACHE_CAPACITY - 1);
+    }
+    if (slot_cls == NULL && used_slot_count >= KIND_CACHE_MAX_ENTRIES) {
+        pthread_mutex_unlock(&cache_mutex);
+        return;
+    }
+    jweak weak_cls = (*env)->NewWeakGlobalRef(env, cls);
+    if (weak_cls != NULL) {
+        KindCacheSlot *slot = &slots[index];
+        atomic_store_explicit(&slot->identity_hash, identity_hash, memory_order_relaxed);
+        atomic_store_explicit(&slot->kind, kind, memory_order_relaxed);
+        atomic_store_explicit(&slot->cls, weak_cls, memory_order_release);
+        if (slot_cls == NULL) {
+            used_slot_count++;
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+static JavaValueKind array_kind_of(JNIEnv *env, jclass cls) {
+    jstring j_cls_name = (jstring) (*env)->CallObjectMethod(env, cls, method_class_get_name(env));
+    const char *cls_name = (*env)->GetStringUTFChars(env, j_cls_name, NULL);
+
+    JavaValueKind kind;
+    if (strcmp("[B", cls_name) == 0) {
+        kind = JAVA_VALUE_KIND_BYTE_ARRAY;
+    } else if (strcmp("[Z", cls_name) == 0) {
+        kind = JAVA_VALUE_KIND_BOOLEAN_ARRAY;
+    } else if (strcmp("[I", cls_name) == 0) {
+        kind = JAVA_VALUE_KIND_INT_ARRAY;
+    } else if (strcmp("[J", cls_name) == 0) {
+        kind = JAVA_VALUE_KIND_LONG_ARRAY;
+    } else if (strcmp("[F", cls_name) == 0) {
+        kind = JAVA_VALUE_KIND_FLOAT_ARRAY;
+    } else if (strcmp("[D", cls_name) == 0) {
+        kind = JAVA_VALUE_KIND_DOUBLE_ARRAY;
+    } else if ('[' == cls_name[0]) {
+        kind = JAVA_VALUE_KIND_OBJECT_ARRAY;
+    } else {
+        kind = JAVA_VALUE_KIND_UNSUPPORTED;
+    }
+
+    (*env)->ReleaseStringUTFChars(env, j_cls_name, cls_name);
+    (*env)->DeleteLocalRef(env, j_cls_name);
+    return kind;
+}
+
+static JavaValueKind classify(JNIEnv *env, jclass cls) {
+    if ((*env)->IsAssignableFrom(env, cls, cls_boolean(env))) {
+        return JAVA_VALUE_KIND_BOOLEAN;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_byte(env))) {
+        return JAVA_VALUE_KIND_BYTE;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_short(env))) {
+        return JAVA_VALUE_KIND_SHORT;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_integer(env))) {
+        return JAVA_VALUE_KIND_INTEGER;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_long(env))) {
+        return JAVA_VALUE_KIND_LONG;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_float(env))) {
+        return JAVA_VALUE_KIND_FLOAT;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_double(env))) {
+        return JAVA_VALUE_KIND_DOUBLE;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_string(env))) {
+        return JAVA_VALUE_KIND_STRING;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_list(env))) {
+        return JAVA_VALUE_KIND_LIST;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_js_object(env))) {
+        // JsObject (A map delegate)
+        return JAVA_VALUE_KIND_JS_OBJECT;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_map(env))) {
+        return JAVA_VALUE_KIND_MAP;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_set(env))) {
+        return JAVA_VALUE_KIND_SET;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_throwable(env))) {
+        return JAVA_VALUE_KIND_THROWABLE;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_ubyte_array(env))) {
+        return JAVA_VALUE_KIND_UBYTE_ARRAY;
+    } else if ((*env)->IsAssignableFrom(env, cls, cls_unit(env))) {
+        return JAVA_VALUE_KIND_UNIT;
+    }
+    // Try by the class name
+    return array_kind_of(env, cls);
+}
+
+/**
+ * Get the kind of the most common final classes without hashing, returns
+ * JAVA_VALUE_KIND_UNSUPPORTED for other classes.
+ */
+static JavaValueKind common_kind_of(JNIEnv *env, jclass cls) {
+    if ((*env)->IsSameObject(env, cls, cls_string(env))) {
+        return JAVA_VALUE_KIND_STRING;
+    } else if ((*env)->IsSameObject(env, cls, cls_integer(env))) {
+        return JAVA_VALUE_KIND_INTEGER;
+    } else if ((*env)->IsSameObject(env, cls, cls_long(env))) {
+        return JAVA_VALUE_KIND_LONG;
+    } else if ((*env)->IsSameObject(env, cls, cls_double(env))) {
+        return JAVA_VALUE_KIND_DOUBLE;
+    } else if ((*env)->IsSameObject(env, cls, cls_boolean(env))) {
+        return JAVA_VALUE_KIND_BOOLEAN;
+    }
+    return JAVA_VALUE_KIND_UNSUPPORTED;
+}
+
+JavaValueKind java_value_kind_of(JNIEnv *env, jobject value) {
+    jclass cls = (*env)->GetObjectClass(env, value);
+    JavaValueKind kind = common_kind_of(env, cls);
+    if (kind != JAVA_VALUE_KIND_UNSUPPORTED) {
+        (*env)->DeleteLocalRef(env, cls);
+        return kind;
+    }
+
+    jint identity_hash = (*env)->CallStaticIntMethod(env, cls_system(env),
+                                                     method_system_identity_hash_code(env), cls);
+
+    atomic_fetch_add(&active_readers, 1);
+    KindCacheSlot *slot = find_slot(env, cls, identity_hash);
+    int found = slot != NULL;
+    if (found) {
+        kind = (JavaValueKind) atomic_load_explicit(&slot->kind, memory_order_relaxed);
+    }
+    atomic_fetch_sub(&active_readers, 1);
+
+    if (!found) {
+        kind = classify(env, cls);
+        cache_kind(env, cls, identity_hash, kind);
+    }
+
+    (*env)->DeleteLocalRef(env, cls);
+    return kind;
+}
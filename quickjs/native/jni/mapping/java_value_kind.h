@@ -0,0 +1,45 @@
+#ifndef QJS_KT_JAVA_VALUE_KIND_H
+#define QJS_KT_JAVA_VALUE_KIND_H
+
+#include "jni.h"
+
+/**
+ * How a java value is converted to a js value.
+ */
+typedef enum {
+    JAVA_VALUE_KIND_UNSUPPORTED = 0,
+    JAVA_VALUE_KIND_BOOLEAN,
+    JAVA_VALUE_KIND_BYTE,
+    JAVA_VALUE_KIND_SHORT,
+    JAVA_VALUE_KIND_INTEGER,
+    JAVA_VALUE_KIND_LONG,
+    JAVA_VALUE_KIND_FLOAT,
+    JAVA_VALUE_KIND_DOUBLE,
+    JAVA_VALUE_KIND_STRING,
+    JAVA_VALUE_KIND_LIST,
+    JAVA_VALUE_KIND_JS_OBJECT,
+    JAVA_VALUE_KIND_MAP,
+    JAVA_VALUE_KIND_SET,
+    JAVA_VALUE_KIND_THROWABLE,
+    JAVA_VALUE_KIND_UBYTE_ARRAY,
+    JAVA_VALUE_KIND_UNIT,
+    JAVA_VALUE_KIND_BYTE_ARRAY,
+    JAVA_VALUE_KIND_BOOLEAN_ARRAY,
+    JAVA_VALUE_KIND_INT_ARRAY,
+    JAVA_VALUE_KIND_LONG_ARRAY,
+    JAVA_VALUE_KIND_FLOAT_ARRAY,
+    JAVA_VALUE_KIND_DOUBLE_ARRAY,
+    JAVA_VALUE_KIND_OBJECT_ARRAY,
+} JavaValueKind;
+
+/**
+ * Get the conversion kind of a non-null java value.
+ *
+ * Strings, integers, longs, doubles and booleans are matched by their class
+ * refs. Other kinds are cached by class in a process-wide table that is read
+ * without locking, only the first value of a class is classified by
+ * IsAssignableFrom() checks and its class name.
+ */
+JavaValueKind java_value_kind_of(JNIEnv *env, jobject value);
+
+#endif //QJS_KT_JAVA_VALUE_KIND_H
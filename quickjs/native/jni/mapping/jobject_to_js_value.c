@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include "jobject_to_js_value.h"
 #include "js_value_util.h"
+#include "context_data.h"
+#include "java_value_kind.h"
 #include "exception_util.h"
 #include "log_util.h"
 #include "jni_globals.h"
@@ -13,70 +15,161 @@ void throw_circular_ref_error(JSContext *context) {
     JS_Throw(context, err);
 }
 
-void visit_first(JNIEnv *env, jobject visited_set, jobject current) {
-    if (current == NULL) {
-        return;
-    }
-    if (!(*env)->CallBooleanMethod(env, visited_set, method_set_is_empty(env))) {
-        return;
+#define CONVERSION_PATH_INLINE_CAPACITY 16
+
+/**
+ * A slot of the conversion path, empty if the object is NULL.
+ */
+typedef struct {
+    jobject object;
+    jint identity_hash;
+} PathSlot;
+
+/**
+ * The lists, sets, maps and arrays on the current conversion path, an open
+ * addressing table keyed by their identity hash codes.
+ *
+ * Only containers on the path are tracked, an object that is shared by siblings
+ * is converted every time it's found. Objects with the same hash code are told
+ * apart by IsSameObject(), so hash collisions are never taken as circular
+ * references.
+ */
+typedef struct {
+    PathSlot *slots;
+    uint32_t capacity;
+    uint32_t size;
+    PathSlot inline_slots[CONVERSION_PATH_INLINE_CAPACITY];
+} ConversionPath;
+
+static void path_init(ConversionPath *path) {
+    memset(path->inline_slots, 0, sizeof(path->inline_slots));
+    path->slots = path->inline_slots;
+    path->capacity = CONVERSION_PATH_INLINE_CAPACITY;
+    path->size = 0;
+}
+
+static void path_free(ConversionPath *path) {
+    if (path->slots != path->inline_slots) {
+        free(path->slots);
     }
-    jint hash = (*env)->CallStaticIntMethod(env, cls_system(env),
-                                            method_system_identity_hash_code(env), current);
-    jobject hash_boxed = (*env)->CallStaticObjectMethod(env, cls_integer(env),
-                                                        method_integer_value_of(env), hash);
-    (*env)->CallBooleanMethod(env, visited_set, method_set_add(env), hash_boxed);
+    path->slots = NULL;
+}
+
+static inline uint32_t path_home(jint identity_hash, uint32_t capacity) {
+    return ((uint32_t) identity_hash * 0x9E3779B1u) & (capacity - 1);
 }
 
-int visit_or_circular_ref_error(JNIEnv *env, JSContext *context,
-                                jobject visited_set, jobject current) {
-    if (current == NULL) {
+static int path_grow(ConversionPath *path) {
+    uint32_t capacity = path->capacity * 2;
+    PathSlot *slots = calloc(capacity, sizeof(PathSlot));
+    if (slots == NULL) {
         return 0;
     }
-    jclass cls = (*env)->GetObjectClass(env, current);
-    if (!(*env)->CallBooleanMethod(env, cls, method_class_is_array(env)) &&
-        !(*env)->IsInstanceOf(env, current, cls_list(env)) &&
-        !(*env)->IsInstanceOf(env, current, cls_set(env)) &&
-        !(*env)->IsInstanceOf(env, current, cls_map(env)) &&
-        !(*env)->IsInstanceOf(env, current, cls_js_object(env))) {
-        return 0;
+    for (uint32_t i = 0; i < path->capacity; i++) {
+        PathSlot slot = path->slots[i];
+        if (slot.object == NULL) {
+            continue;
+        }
+        uint32_t index = path_home(slot.identity_hash, capacity);
+        while (slots[index].object != NULL) {
+            index = (index + 1) & (capacity - 1);
+        }
+        slots[index] = slot;
     }
+    if (path->slots != path->inline_slots) {
+        free(path->slots);
+    }
+    path->slots = slots;
+    path->capacity = capacity;
+    return 1;
+}
+
+/**
+ * Push the container to the conversion path.
+ *
+ * @param identity_hash Destination of the identity hash code, required by
+ * path_leave().
+ * @return 1 if pushed, 0 if it's a circular reference or out of memory, the js
+ * exception is thrown.
+ */
+static int path_enter(JNIEnv *env, JSContext *context, ConversionPath *path,
+                      jobject object, jint *identity_hash) {
     jint hash = (*env)->CallStaticIntMethod(env, cls_system(env),
-                                            method_system_identity_hash_code(env), current);
-    jobject hash_boxed = (*env)->CallStaticObjectMethod(env, cls_integer(env),
-                                                        method_integer_value_of(env), hash);
-    if ((*env)->CallBooleanMethod(env, visited_set, method_set_contains(env), hash_boxed)) {
-        throw_circular_ref_error(context);
-        return 1;
-    } else {
-        (*env)->CallBooleanMethod(env, visited_set, method_set_add(env), hash_boxed);
+                                            method_system_identity_hash_code(env), object);
+    if ((path->size + 1) * 2 > path->capacity && !path_grow(path)) {
+        JS_ThrowOutOfMemory(context);
         return 0;
     }
+    uint32_t mask = path->capacity - 1;
+    uint32_t index = path_home(hash, path->capacity);
+    while (path->slots[index].object != NULL) {
+        PathSlot *slot = &path->slots[index];
+        if (slot->identity_hash == hash && (*env)->IsSameObject(env, slot->object, object)) {
+            throw_circular_ref_error(context);
+            return 0;
+        }
+        index = (index + 1) & mask;
+    }
+    path->slots[index].object = object;
+    path->slots[index].identity_hash = hash;
+    path->size++;
+    *identity_hash = hash;
+    return 1;
+}
+
+/**
+ * Pop the container from the conversion path.
+ */
+static void path_leave(ConversionPath *path, jobject object, jint identity_hash) {
+    uint32_t mask = path->capacity - 1;
+    uint32_t index = path_home(identity_hash, path->capacity);
+    while (path->slots[index].object != object) {
+        if (path->slots[index].object == NULL) {
+            return;
+        }
+        index = (index + 1) & mask;
+    }
+    path->slots[index].object = NULL;
+    path->size--;
+    // Shift the following slots back, so lookups never stop at the hole
+    uint32_t next = (index + 1) & mask;
+    while (path->slots[next].object != NULL) {
+        uint32_t home = path_home(path->slots[next].identity_hash, path->capacity);
+        if (((next - home) & mask) >= ((next - index) & mask)) {
+            path->slots[index] = path->slots[next];
+            path->slots[next].object = NULL;
+            index = next;
+        }
+        next = (next + 1) & mask;
+    }
 }
 
-JSValue java_list_to_js_array(JNIEnv *env, JSContext *context,
-                              jobject visited_set, jobject java_list) {
-    int delete_global_visited_ref = 0;
-    if (visited_set == NULL) {
-        jobject visited = (*env)->NewObject(env, cls_hash_set(env), method_hash_set_init(env));
-        visited_set = (*env)->NewGlobalRef(env, visited);
-        (*env)->DeleteLocalRef(env, visited);
-        delete_global_visited_ref = 1;
+static JSValue to_js_value(JNIEnv *env, JSContext *context, ConversionPath *path,
+                           jobject value);
+
+typedef JSValue (*ContainerConverter)(JNIEnv *env, JSContext *context,
+                                      ConversionPath *path, jobject container);
+
+static JSValue convert_container(JNIEnv *env, JSContext *context, ConversionPath *path,
+                                 jobject container, ContainerConverter converter) {
+    jint identity_hash;
+    if (!path_enter(env, context, path, container, &identity_hash)) {
+        return JS_EXCEPTION;
     }
-    visit_first(env, visited_set, java_list);
+    JSValue result = converter(env, context, path, container);
+    path_leave(path, container, identity_hash);
+    return result;
+}
 
+static JSValue java_list_to_js_array(JNIEnv *env, JSContext *context,
+                                     ConversionPath *path, jobject java_list) {
     JSValue js_array = JS_NewArray(context);
     jmethodID method_get = method_list_get(env);
     jint size = (*env)->CallIntMethod(env, java_list, method_list_size(env));
     int has_exception = 0;
     for (int i = 0; i < size && has_exception == 0; i++) {
         jobject element = (*env)->CallObjectMethod(env, java_list, method_get, i);
-        // Check circular refs
-        if (visit_or_circular_ref_error(env, context, visited_set, element)) {
-            (*env)->DeleteLocalRef(env, element);
-            has_exception = 1;
-            break;
-        }
-        JSValue js_element = jobject_to_js_value(env, context, visited_set, element);
+        JSValue js_element = to_js_value(env, context, path, element);
         if (!JS_IsException(js_element)) {
             JS_SetPropertyUint32(context, js_array, i, js_element);
         } else {
@@ -85,10 +178,6 @@ JSValue java_list_to_js_array(JNIEnv *env, JSContext *context,
         (*env)->DeleteLocalRef(env, element);
     }
 
-    if (delete_global_visited_ref) {
-        (*env)->DeleteGlobalRef(env, visited_set);
-    }
-
     if (has_exception) {
         JS_FreeValue(context, js_array);
         return JS_EXCEPTION;
@@ -97,38 +186,44 @@ JSValue java_list_to_js_array(JNIEnv *env, JSContext *context,
     }
 }
 
-JSValue new_js_object_from_constructor(JSContext *context, const char *constructor,
-                                       int argc, JSValue *argv) {
-    JSValue result;
-
-    JSValue global_this = JS_GetGlobalObject(context);
-    JSValue js_constructor = JS_GetPropertyStr(context, global_this, constructor);
-    if (JS_IsUndefined(js_constructor)) {
+/**
+ * Call a constructor of the context intrinsics.
+ *
+ * @param name The constructor name, used by the error message.
+ */
+static JSValue new_js_object_from_constructor(JSContext *context, JSValue constructor,
+                                              const char *name, int argc, JSValue *argv) {
+    if (!JS_IsObject(constructor)) {
         char message[100];
-        sprintf(message, "JS constructor '%s' not found.", constructor);
+        sprintf(message, "JS constructor '%s' not found.", name);
         JS_Throw(context, new_js_error(context, "TypeMappingError", message, 0, NULL));
-        result = JS_EXCEPTION;
-    } else {
-        result = JS_CallConstructor(context, js_constructor, argc, argv);
+        return JS_EXCEPTION;
     }
-
-    JS_FreeValue(context, js_constructor);
-    JS_FreeValue(context, global_this);
-
-    return result;
+    return JS_CallConstructor(context, constructor, argc, argv);
 }
 
-JSValue java_set_to_js_set(JNIEnv *env, JSContext *context,
-                           jobject visited_set, jobject java_set) {
-    int delete_global_visited_ref = 0;
-    if (visited_set == NULL) {
-        jobject visited = (*env)->NewObject(env, cls_hash_set(env), method_hash_set_init(env));
-        visited_set = (*env)->NewGlobalRef(env, visited);
-        (*env)->DeleteLocalRef(env, visited);
-        delete_global_visited_ref = 1;
+/**
+ * Get the built-in types of the context, throws a TypeMappingError if the context has no
+ * data, such as a context not created by QuickJs.
+ *
+ * @param name The type to create, used by the error message.
+ */
+static JsIntrinsics *require_intrinsics(JSContext *context, const char *name) {
+    JsIntrinsics *intrinsics = js_intrinsics(context);
+    if (intrinsics == NULL) {
+        char message[100];
+        snprintf(message, sizeof(message), "Cannot create a %s in a context without data.", name);
+        JS_Throw(context, new_js_error(context, "TypeMappingError", message, 0, NULL));
     }
-    visit_first(env, visited_set, java_set);
+    return intrinsics;
+}
 
+static JSValue java_set_to_js_set(JNIEnv *env, JSContext *context,
+                                  ConversionPath *path, jobject java_set) {
+    JsIntrinsics *intrinsics = require_intrinsics(context, "Set");
+    if (intrinsics == NULL) {
+        return JS_EXCEPTION;
+    }
     jobject iterator = (*env)->CallObjectMethod(env, java_set, method_set_iterator(env));
 
     jmethodID method_has_next = method_iterator_has_next(env);
@@ -139,49 +234,33 @@ JSValue java_set_to_js_set(JNIEnv *env, JSContext *context,
 
     while ((*env)->CallBooleanMethod(env, iterator, method_has_next)) {
         jobject key = (*env)->CallObjectMethod(env, iterator, method_next);
-        // Check circular refs
-        if (visit_or_circular_ref_error(env, context, visited_set, key)) {
+        JSValue item = to_js_value(env, context, path, key);
+        if (JS_IsException(item)) {
             JS_FreeValue(context, js_array);
             (*env)->DeleteLocalRef(env, key);
-            if (delete_global_visited_ref) {
-                (*env)->DeleteGlobalRef(env, visited_set);
-            }
             return JS_EXCEPTION;
         }
-        JSValue item = jobject_to_js_value(env, context, visited_set, key);
-        if (JS_IsException(item)) {
-            (*env)->DeleteLocalRef(env, key);
-            break;
-        }
         JS_SetPropertyUint32(context, js_array, index, item);
         (*env)->DeleteLocalRef(env, key);
         index++;
     }
 
-    if (delete_global_visited_ref) {
-        (*env)->DeleteGlobalRef(env, visited_set);
-    }
-
     int argc = 1;
     JSValue argv[] = {js_array};
-    JSValue result = new_js_object_from_constructor(context, "Set", argc, argv);
+    JSValue constructor = intrinsics->set_constructor;
+    JSValue result = new_js_object_from_constructor(context, constructor, "Set", argc, argv);
 
     JS_FreeValue(context, js_array);
 
     return result;
 }
 
-JSValue java_map_to_js_map(JNIEnv *env, JSContext *context,
-                           jobject visited_set, jobject java_map) {
-    int delete_global_visited_ref = 0;
-    if (visited_set == NULL) {
-        jobject visited = (*env)->NewObject(env, cls_hash_set(env), method_hash_set_init(env));
-        visited_set = (*env)->NewGlobalRef(env, visited);
-        (*env)->DeleteLocalRef(env, visited);
-        delete_global_visited_ref = 1;
+static JSValue java_map_to_js_map(JNIEnv *env, JSContext *context,
+                                  ConversionPath *path, jobject java_map) {
+    JsIntrinsics *intrinsics = require_intrinsics(context, "Map");
+    if (intrinsics == NULL) {
+        return JS_EXCEPTION;
     }
-    visit_first(env, visited_set, java_map);
-
     jobject entry_set = (*env)->CallObjectMethod(env, java_map, method_map_entry_set(env));
     jobject iterator = (*env)->CallObjectMethod(env, entry_set, method_set_iterator(env));
 
@@ -198,53 +277,23 @@ JSValue java_map_to_js_map(JNIEnv *env, JSContext *context,
         jobject entry = (*env)->CallObjectMethod(env, iterator, method_next);
         jobject key = (*env)->CallObjectMethod(env, entry, method_get_key);
 
-        // Check circular refs
-        if (visit_or_circular_ref_error(env, context, visited_set, key)) {
-            JS_FreeValue(context, js_array);
-            (*env)->DeleteLocalRef(env, entry);
-            (*env)->DeleteLocalRef(env, key);
-            if (delete_global_visited_ref) {
-                (*env)->DeleteGlobalRef(env, visited_set);
-            }
-            return JS_EXCEPTION;
-        }
-
-        JSValue js_key = jobject_to_js_value(env, context, visited_set, key);
+        JSValue js_key = to_js_value(env, context, path, key);
         if (JS_IsException(js_key)) {
             JS_FreeValue(context, js_array);
             (*env)->DeleteLocalRef(env, entry);
             (*env)->DeleteLocalRef(env, key);
-            if (delete_global_visited_ref) {
-                (*env)->DeleteGlobalRef(env, visited_set);
-            }
             return JS_EXCEPTION;
         }
 
         jobject value = (*env)->CallObjectMethod(env, entry, method_get_val);
 
-        // Check circular refs
-        if (visit_or_circular_ref_error(env, context, visited_set, value)) {
-            JS_FreeValue(context, js_key);
-            JS_FreeValue(context, js_array);
-            (*env)->DeleteLocalRef(env, entry);
-            (*env)->DeleteLocalRef(env, key);
-            (*env)->DeleteLocalRef(env, value);
-            if (delete_global_visited_ref) {
-                (*env)->DeleteGlobalRef(env, visited_set);
-            }
-            return JS_EXCEPTION;
-        }
-
-        JSValue js_value = jobject_to_js_value(env, context, visited_set, value);
+        JSValue js_value = to_js_value(env, context, path, value);
         if (JS_IsException(js_value)) {
             JS_FreeValue(context, js_key);
             JS_FreeValue(context, js_array);
             (*env)->DeleteLocalRef(env, entry);
             (*env)->DeleteLocalRef(env, key);
             (*env)->DeleteLocalRef(env, value);
-            if (delete_global_visited_ref) {
-                (*env)->DeleteGlobalRef(env, visited_set);
-            }
             return JS_EXCEPTION;
         }
 
@@ -261,13 +310,10 @@ JSValue java_map_to_js_map(JNIEnv *env, JSContext *context,
         index++;
     }
 
-    if (delete_global_visited_ref) {
-        (*env)->DeleteGlobalRef(env, visited_set);
-    }
-
     int argc = 1;
     JSValue argv[] = {js_array};
-    JSValue result = new_js_object_from_constructor(context, "Map", argc, argv);
+    JSValue constructor = intrinsics->map_constructor;
+    JSValue result = new_js_object_from_constructor(context, constructor, "Map", argc, argv);
 
     JS_FreeValue(context, js_array);
 
@@ -333,17 +379,8 @@ JSValue java_throwable_to_js_error(JNIEnv *env, JSContext *context, jthrowable t
     return error;
 }
 
-JSValue java_map_to_js_object(JNIEnv *env, JSContext *context,
-                              jobject visited_set, jobject java_map) {
-    int delete_global_visited_ref = 0;
-    if (visited_set == NULL) {
-        jobject visited = (*env)->NewObject(env, cls_hash_set(env), method_hash_set_init(env));
-        visited_set = (*env)->NewGlobalRef(env, visited);
-        (*env)->DeleteLocalRef(env, visited);
-        delete_global_visited_ref = 1;
-    }
-    visit_first(env, visited_set, java_map);
-
+static JSValue java_map_to_js_object(JNIEnv *env, JSContext *context,
+                                     ConversionPath *path, jobject java_map) {
     jobject entry_set = (*env)->CallObjectMethod(env, java_map, method_map_entry_set(env));
     jobject iterator = (*env)->CallObjectMethod(env, entry_set, method_set_iterator(env));
 
@@ -362,25 +399,11 @@ JSValue java_map_to_js_object(JNIEnv *env, JSContext *context,
 
         jobject key = (*env)->CallObjectMethod(env, entry, method_get_key);
 
-        // Check circular refs
-        if (visit_or_circular_ref_error(env, context, visited_set, key)) {
-            JS_FreeValue(context, js_object);
-            (*env)->DeleteLocalRef(env, entry);
-            (*env)->DeleteLocalRef(env, key);
-            if (delete_global_visited_ref) {
-                (*env)->DeleteGlobalRef(env, visited_set);
-            }
-            return JS_EXCEPTION;
-        }
-
         // Check key type
         if ((*env)->IsInstanceOf(env, key, cls_str) == JNI_FALSE) {
             JS_FreeValue(context, js_object);
             (*env)->DeleteLocalRef(env, entry);
             (*env)->DeleteLocalRef(env, key);
-            if (delete_global_visited_ref) {
-                (*env)->DeleteGlobalRef(env, visited_set);
-            }
             const char *message = "Cannot convert java map to js value: "
                                   "only string keys are supported.";
             JS_Throw(context, new_js_error(context, "TypeMappingError", message, 0, NULL));
@@ -390,30 +413,15 @@ JSValue java_map_to_js_object(JNIEnv *env, JSContext *context,
 
         jobject value = (*env)->CallObjectMethod(env, entry, method_get_val);
 
-        // Check circular refs
-        if (visit_or_circular_ref_error(env, context, visited_set, value)) {
-            JS_FreeValue(context, js_object);
-            (*env)->ReleaseStringUTFChars(env, key, str_key);
-            (*env)->DeleteLocalRef(env, entry);
-            (*env)->DeleteLocalRef(env, key);
-            (*env)->DeleteLocalRef(env, value);
-            if (delete_global_visited_ref) {
-                (*env)->DeleteGlobalRef(env, visited_set);
-            }
-            return JS_EXCEPTION;
-        }
-
         JSAtom js_key = JS_NewAtom(context, str_key);
-        JSValue js_value = jobject_to_js_value(env, context, visited_set, value);
+        JSValue js_value = to_js_value(env, context, path, value);
         if (JS_IsException(js_value)) {
+            JS_FreeAtom(context, js_key);
             JS_FreeValue(context, js_object);
             (*env)->ReleaseStringUTFChars(env, key, str_key);
             (*env)->DeleteLocalRef(env, entry);
             (*env)->DeleteLocalRef(env, key);
             (*env)->DeleteLocalRef(env, value);
-            if (delete_global_visited_ref) {
-                (*env)->DeleteGlobalRef(env, visited_set);
-            }
             return js_value;
         }
         JS_SetProperty(context, js_object, js_key, js_value);
@@ -425,10 +433,6 @@ JSValue java_map_to_js_object(JNIEnv *env, JSContext *context,
         (*env)->DeleteLocalRef(env, value);
     }
 
-    if (delete_global_visited_ref) {
-        (*env)->DeleteGlobalRef(env, visited_set);
-    }
-
     return js_object;
 }
 
@@ -436,203 +440,301 @@ void js_free_array_buffer(JSRuntime *runtime, void *opaque, void *ptr) {
     free(ptr);
 }
 
-JSValue byte_array_to_js_byte_array(JNIEnv *env, JSContext *context, jobject value,
-                                    const char *array_constructor_name) {
-    size_t size = (*env)->GetArrayLength(env, value);
-    jbyte *bytes = (*env)->GetByteArrayElements(env, value, NULL);
-    uint8_t *c_buffer = malloc(size);
-    memcpy(c_buffer, bytes, size);
+/**
+ * Copy a primitive array to a new typed array, with a single copy of the
+ * elements.
+ *
+ * @param kind The kind of the array, one of the byte, int, long, float and
+ * double arrays.
+ * @param name The constructor name, used by the error message.
+ */
+static JSValue primitive_array_to_js_typed_array(JNIEnv *env, JSContext *context, jarray value,
+                                                 JavaValueKind kind,
+                                                 JSValue array_constructor,
+                                                 const char *name) {
+    jsize length = (*env)->GetArrayLength(env, value);
+    size_t element_size;
+    switch (kind) {
+        case JAVA_VALUE_KIND_BYTE_ARRAY:
+            element_size = sizeof(jbyte);
+            break;
+        case JAVA_VALUE_KIND_INT_ARRAY:
+        case JAVA_VALUE_KIND_FLOAT_ARRAY:
+            element_size = sizeof(jint);
+            break;
+        case JAVA_VALUE_KIND_LONG_ARRAY:
+        case JAVA_VALUE_KIND_DOUBLE_ARRAY:
+            element_size = sizeof(jlong);
+            break;
+        default:
+            JS_ThrowTypeError(context, "Cannot map java array to a %s.", name);
+            return JS_EXCEPTION;
+    }
+
+    size_t size = (size_t) length * element_size;
+    // malloc(0) may return NULL
+    void *c_buffer = malloc(size > 0 ? size : 1);
+    if (c_buffer == NULL) {
+        JS_ThrowOutOfMemory(context);
+        return JS_EXCEPTION;
+    }
+    switch (kind) {
+        case JAVA_VALUE_KIND_BYTE_ARRAY:
+            (*env)->GetByteArrayRegion(env, value, 0, length, c_buffer);
+            break;
+        case JAVA_VALUE_KIND_INT_ARRAY:
+            (*env)->GetIntArrayRegion(env, value, 0, length, c_buffer);
+            break;
+        case JAVA_VALUE_KIND_FLOAT_ARRAY:
+            (*env)->GetFloatArrayRegion(env, value, 0, length, c_buffer);
+            break;
+        case JAVA_VALUE_KIND_LONG_ARRAY:
+            (*env)->GetLongArrayRegion(env, value, 0, length, c_buffer);
+            break;
+        default:
+            (*env)->GetDoubleArrayRegion(env, value, 0, length, c_buffer);
+            break;
+    }
+
     JSValue array_buffer = JS_NewArrayBuffer(context, c_buffer, size,
                                              js_free_array_buffer, NULL, 0);
+    if (JS_IsException(array_buffer)) {
+        free(c_buffer);
+        return JS_EXCEPTION;
+    }
     int argc = 1;
     JSValue argv[1] = {array_buffer};
-    JSValue result = new_js_object_from_constructor(context, array_constructor_name,
-                                                    argc, argv);
+    JSValue result = new_js_object_from_constructor(context, array_constructor,
+                                                    name, argc, argv);
     JS_FreeValue(context, array_buffer);
     return result;
 }
 
+JSValue byte_array_to_js_byte_array(JNIEnv *env, JSContext *context, jobject value,
+                                    JSValue array_constructor,
+                                    const char *array_constructor_name) {
+    return primitive_array_to_js_typed_array(env, context, value, JAVA_VALUE_KIND_BYTE_ARRAY,
+                                             array_constructor, array_constructor_name);
+}
+
 JSValue byte_array_to_js_int8array(JNIEnv *env, JSContext *context, jobject value) {
-    return byte_array_to_js_byte_array(env, context, value, "Int8Array");
+    JsIntrinsics *intrinsics = require_intrinsics(context, "Int8Array");
+    if (intrinsics == NULL) {
+        return JS_EXCEPTION;
+    }
+    return byte_array_to_js_byte_array(env, context, value,
+                                       intrinsics->int8array_constructor,
+                                       "Int8Array");
 }
 
 JSValue kt_ubyte_array_to_js_uint8array(JNIEnv *env, JSContext *context, jobject value) {
+    JsIntrinsics *intrinsics = require_intrinsics(context, "Uint8Array");
+    if (intrinsics == NULL) {
+        return JS_EXCEPTION;
+    }
     jobject storage = (*env)->GetObjectField(env, value, field_ubyte_array_storage(env));
-    return byte_array_to_js_byte_array(env, context, storage, "Uint8Array");
+    return byte_array_to_js_byte_array(env, context, storage,
+                                       intrinsics->uint8array_constructor,
+                                       "Uint8Array");
 }
 
-JSValue jobject_to_js_value(JNIEnv *env, JSContext *context, jobject visited_set, jobject value) {
-    if (value == NULL) {
-        return JS_NULL;
-    }
-
-    JSValue result = JS_UNDEFINED;
-
-    if ((*env)->IsInstanceOf(env, value, cls_boolean(env))) {
-        // Boolean
-        jmethodID method = method_boolean_boolean_value(env);
-        jboolean unboxed = (*env)->CallBooleanMethod(env, value, method);
-        if (unboxed == JNI_TRUE) {
-            result = JS_TRUE;
-        } else {
-            result = JS_FALSE;
+static JSValue java_object_array_to_js_array(JNIEnv *env, JSContext *context,
+                                             ConversionPath *path, jobject java_array) {
+    int size = (*env)->GetArrayLength(env, java_array);
+    JSValue js_array = JS_NewArray(context);
+    for (uint32_t i = 0; i < size; i++) {
+        jobject element = (*env)->GetObjectArrayElement(env, java_array, i);
+        JSValue js_element = to_js_value(env, context, path, element);
+        (*env)->DeleteLocalRef(env, element);
+        if (JS_IsException(js_element)) {
+            JS_FreeValue(context, js_array);
+            return JS_EXCEPTION;
         }
-    } else if ((*env)->IsInstanceOf(env, value, cls_byte(env))) {
-        // Byte
-        jmethodID method = method_byte_byte_value(env);
-        jbyte unboxed = (*env)->CallByteMethod(env, value, method);
-        result = JS_NewInt32(context, unboxed);
-    } else if ((*env)->IsInstanceOf(env, value, cls_short(env))) {
-        // Short
-        jmethodID method = method_short_short_value(env);
-        jshort unboxed = (*env)->CallShortMethod(env, value, method);
-        result = JS_NewInt32(context, unboxed);
-    }  else if ((*env)->IsInstanceOf(env, value, cls_integer(env))) {
-        // Integer
-        jmethodID method = method_integer_int_value(env);
-        jint unboxed = (*env)->CallIntMethod(env, value, method);
-        result = JS_NewInt32(context, unboxed);
-    } else if ((*env)->IsInstanceOf(env, value, cls_long(env))) {
-        // Long
-        jmethodID method = method_long_long_value(env);
-        jlong unboxed = (*env)->CallLongMethod(env, value, method);
-        result = JS_NewInt64(context, unboxed);
-    } else if ((*env)->IsInstanceOf(env, value, cls_float(env))) {
-        // Float
-        jmethodID method = method_float_float_value(env);
-        jfloat unboxed = (*env)->CallFloatMethod(env, value, method);
-        result = JS_NewFloat64(context, unboxed);
-    } else if ((*env)->IsInstanceOf(env, value, cls_double(env))) {
-        // Double
-        jmethodID method = method_double_double_value(env);
-        jdouble unboxed = (*env)->CallDoubleMethod(env, value, method);
-        result = JS_NewFloat64(context, unboxed);
-    } else if ((*env)->IsInstanceOf(env, value, cls_string(env))) {
-        // String
-        const char *c_str = (*env)->GetStringUTFChars(env, value, NULL);
-        JSValue js_value = JS_NewString(context, c_str);
-        (*env)->ReleaseStringUTFChars(env, value, c_str);
-        result = js_value;
-    } else if ((*env)->IsInstanceOf(env, value, cls_list(env))) {
-        // List
-        result = java_list_to_js_array(env, context, visited_set, value);
-    } else if ((*env)->IsInstanceOf(env, value, cls_js_object(env))) {
-        // JsObject (A map delegate)
-        result = java_map_to_js_object(env, context, visited_set, value);
-    } else if ((*env)->IsInstanceOf(env, value, cls_map(env))) {
-        // Map
-        result = java_map_to_js_map(env, context, visited_set, value);
-    } else if ((*env)->IsInstanceOf(env, value, cls_set(env))) {
-        // Set
-        result = java_set_to_js_set(env, context, visited_set, value);
-    } else if ((*env)->IsInstanceOf(env, value, cls_throwable(env))) {
-        // Throwable
-        result = java_throwable_to_js_error(env, context, (jthrowable) value);
-    } else if ((*env)->IsInstanceOf(env, value, cls_ubyte_array(env))) {
-        // UByteArray
-        result = kt_ubyte_array_to_js_uint8array(env, context, value);
-    }
-
-    if (!JS_IsUndefined(result)) {
-        return result;
+        JS_SetPropertyUint32(context, js_array, i, js_element);
     }
+    return js_array;
+}
 
+static JSValue unsupported_java_type_error(JNIEnv *env, JSContext *context, jobject value) {
     jclass cls = (*env)->GetObjectClass(env, value);
     jstring j_cls_name = (jstring) (*env)->CallObjectMethod(env, cls, method_class_get_name(env));
     const char *cls_name = (*env)->GetStringUTFChars(env, j_cls_name, NULL);
+    char message[100];
+    snprintf(message, sizeof(message), "Cannot convert java type '%s' to a js value.", cls_name);
+    JS_Throw(context, new_js_error(context, "TypeError", message, 0, NULL));
+    (*env)->ReleaseStringUTFChars(env, j_cls_name, cls_name);
+    (*env)->DeleteLocalRef(env, j_cls_name);
+    (*env)->DeleteLocalRef(env, cls);
+    return JS_EXCEPTION;
+}
 
-    // Try by the class name
-    if ((*env)->IsInstanceOf(env, value, cls_unit(env))) {
-        result = JS_UNDEFINED;
-    } else if (strcmp("[B", cls_name) == 0) {
-        result = byte_array_to_js_int8array(env, context, value);
-    } else if (strcmp("[Z", cls_name) == 0) {
-        // boolean array
-        int size = (*env)->GetArrayLength(env, value);
-        jboolean *arr = (*env)->GetBooleanArrayElements(env, value, NULL);
-        JSValue js_array = JS_NewArray(context);
-        for (uint32_t i = 0; i < size; i++) {
-            JSValue js_element = JS_NewBool(context, arr[i] == JNI_TRUE);
-            JS_SetPropertyUint32(context, js_array, i, js_element);
+static JSValue to_js_value(JNIEnv *env, JSContext *context, ConversionPath *path,
+                           jobject value) {
+    if (value == NULL) {
+        return JS_NULL;
+    }
+
+    switch (java_value_kind_of(env, value)) {
+        case JAVA_VALUE_KIND_BOOLEAN: {
+            jmethodID method = method_boolean_boolean_value(env);
+            jboolean unboxed = (*env)->CallBooleanMethod(env, value, method);
+            return unboxed == JNI_TRUE ? JS_TRUE : JS_FALSE;
         }
-        result = js_array;
-        (*env)->ReleaseBooleanArrayElements(env, value, arr, 0);
-    } else if (strcmp("[I", cls_name) == 0) {
-        // int array
-        int size = (*env)->GetArrayLength(env, value);
-        jint *arr = (*env)->GetIntArrayElements(env, value, NULL);
-        JSValue js_array = JS_NewArray(context);
-        for (uint32_t i = 0; i < size; i++) {
-            JSValue js_element = JS_NewInt32(context, arr[i]);
-            JS_SetPropertyUint32(context, js_array, i, js_element);
+        case JAVA_VALUE_KIND_BYTE: {
+            jmethodID method = method_byte_byte_value(env);
+            jbyte unboxed = (*env)->CallByteMethod(env, value, method);
+            return JS_NewInt32(context, unboxed);
         }
-        result = js_array;
-        (*env)->ReleaseIntArrayElements(env, value, arr, 0);
-    } else if (strcmp("[J", cls_name) == 0) {
-        // long array
-        int size = (*env)->GetArrayLength(env, value);
-        jlong *arr = (*env)->GetLongArrayElements(env, value, NULL);
-        JSValue js_array = JS_NewArray(context);
-        for (uint32_t i = 0; i < size; i++) {
-            JSValue js_element = JS_NewInt64(context, arr[i]);
-            JS_SetPropertyUint32(context, js_array, i, js_element);
+        case JAVA_VALUE_KIND_SHORT: {
+            jmethodID method = method_short_short_value(env);
+            jshort unboxed = (*env)->CallShortMethod(env, value, method);
+            return JS_NewInt32(context, unboxed);
         }
-        result = js_array;
-        (*env)->ReleaseLongArrayElements(env, value, arr, 0);
-    } else if (strcmp("[F", cls_name) == 0) {
-        // float array
-        int size = (*env)->GetArrayLength(env, value);
-        jfloat *arr = (*env)->GetFloatArrayElements(env, value, NULL);
-        JSValue js_array = JS_NewArray(context);
-        for (uint32_t i = 0; i < size; i++) {
-            JSValue js_element = JS_NewFloat64(context, arr[i]);
-            JS_SetPropertyUint32(context, js_array, i, js_element);
+        case JAVA_VALUE_KIND_INTEGER: {
+            jmethodID method = method_integer_int_value(env);
+            jint unboxed = (*env)->CallIntMethod(env, value, method);
+            return JS_NewInt32(context, unboxed);
         }
-        result = js_array;
-        (*env)->ReleaseFloatArrayElements(env, value, arr, 0);
-    } else if (strcmp("[D", cls_name) == 0) {
-        // double array
-        int size = (*env)->GetArrayLength(env, value);
-        jdouble *arr = (*env)->GetDoubleArrayElements(env, value, NULL);
-        JSValue js_array = JS_NewArray(context);
-        for (uint32_t i = 0; i < size; i++) {
-            JSValue js_element = JS_NewFloat64(context, arr[i]);
-            JS_SetPropertyUint32(context, js_array, i, js_element);
+        case JAVA_VALUE_KIND_LONG: {
+            jmethodID method = method_long_long_value(env);
+            jlong unboxed = (*env)->CallLongMethod(env, value, method);
+            return JS_NewInt64(context, unboxed);
+        }
+        case JAVA_VALUE_KIND_FLOAT: {
+            jmethodID method = method_float_float_value(env);
+            jfloat unboxed = (*env)->CallFloatMethod(env, value, method);
+            return JS_NewFloat64(context, unboxed);
+        }
+        case JAVA_VALUE_KIND_DOUBLE: {
+            jmethodID method = method_double_double_value(env);
+            jdouble unboxed = (*env)->CallDoubleMethod(env, value, method);
+            return JS_NewFloat64(context, unboxed);
         }
-        result = js_array;
-        (*env)->ReleaseDoubleArrayElements(env, value, arr, 0);
-    } else if ('[' == cls_name[0]) {
-        // Object array
-        int size = (*env)->GetArrayLength(env, value);
-        JSValue js_array = JS_NewArray(context);
-        int has_exception = 0;
-        for (uint32_t i = 0; i < size; i++) {
-            jobject element = (*env)->GetObjectArrayElement(env, value, i);
-            // Check circular refs
-            if ((*env)->IsSameObject(env, value, element)) {
-                JS_FreeValue(context, js_array);
-                (*env)->DeleteLocalRef(env, element);
-                throw_circular_ref_error(context);
-                has_exception = 1;
-                break;
+        case JAVA_VALUE_KIND_STRING: {
+            const char *c_str = (*env)->GetStringUTFChars(env, value, NULL);
+            JSValue js_value = JS_NewString(context, c_str);
+            (*env)->ReleaseStringUTFChars(env, value, c_str);
+            return js_value;
+        }
+        case JAVA_VALUE_KIND_LIST:
+            return convert_container(env, context, path, value, java_list_to_js_array);
+        case JAVA_VALUE_KIND_JS_OBJECT:
+            return convert_container(env, context, path, value, java_map_to_js_object);
+        case JAVA_VALUE_KIND_MAP:
+            return convert_container(env, context, path, value, java_map_to_js_map);
+        case JAVA_VALUE_KIND_SET:
+            return convert_container(env, context, path, value, java_set_to_js_set);
+        case JAVA_VALUE_KIND_THROWABLE:
+            return java_throwable_to_js_error(env, context, (jthrowable) value);
+        case JAVA_VALUE_KIND_UBYTE_ARRAY:
+            return kt_ubyte_array_to_js_uint8array(env, context, value);
+        case JAVA_VALUE_KIND_UNIT:
+            return JS_UNDEFINED;
+        case JAVA_VALUE_KIND_BYTE_ARRAY:
+            return byte_array_to_js_int8array(env, context, value);
+        case JAVA_VALUE_KIND_BOOLEAN_ARRAY: {
+            int size = (*env)->GetArrayLength(env, value);
+            jboolean *arr = (*env)->GetBooleanArrayElements(env, value, NULL);
+            JSValue js_array = JS_NewArray(context);
+            for (uint32_t i = 0; i < size; i++) {
+                JSValue js_element = JS_NewBool(context, arr[i] == JNI_TRUE);
+                JS_SetPropertyUint32(context, js_array, i, js_element);
             }
-            JSValue js_element = jobject_to_js_value(env, context, visited_set, element);
-            JS_SetPropertyUint32(context, js_array, i, js_element);
-            (*env)->DeleteLocalRef(env, element);
+            (*env)->ReleaseBooleanArrayElements(env, value, arr, 0);
+            return js_array;
         }
-        if (has_exception) {
-            result = JS_EXCEPTION;
-        } else {
-            result = js_array;
+        case JAVA_VALUE_KIND_INT_ARRAY: {
+            if (context_maps_typed_arrays(context)) {
+                JsIntrinsics *intrinsics = require_intrinsics(context, "Int32Array");
+                if (intrinsics == NULL) {
+                    return JS_EXCEPTION;
+                }
+                return primitive_array_to_js_typed_array(
+                        env, context, value, JAVA_VALUE_KIND_INT_ARRAY,
+                        intrinsics->int32array_constructor, "Int32Array");
+            }
+            int size = (*env)->GetArrayLength(env, value);
+            jint *arr = (*env)->GetIntArrayElements(env, value, NULL);
+            JSValue js_array = JS_NewArray(context);
+            for (uint32_t i = 0; i < size; i++) {
+                JSValue js_element = JS_NewInt32(context, arr[i]);
+                JS_SetPropertyUint32(context, js_array, i, js_element);
+            }
+            (*env)->ReleaseIntArrayElements(env, value, arr, 0);
+            return js_array;
         }
-    } else {
-        char message[100];
-        sprintf(message, "Cannot convert java type '%s' to a js value.", cls_name);
-        JS_Throw(context, new_js_error(context, "TypeError", message, 0, NULL));
-        result = JS_EXCEPTION;
+        case JAVA_VALUE_KIND_LONG_ARRAY: {
+            if (context_maps_typed_arrays(context)) {
+                JsIntrinsics *intrinsics = require_intrinsics(context, "BigInt64Array");
+                if (intrinsics == NULL) {
+                    return JS_EXCEPTION;
+                }
+                return primitive_array_to_js_typed_array(
+                        env, context, value, JAVA_VALUE_KIND_LONG_ARRAY,
+                        intrinsics->bigint64array_constructor, "BigInt64Array");
+            }
+            int size = (*env)->GetArrayLength(env, value);
+            jlong *arr = (*env)->GetLongArrayElements(env, value, NULL);
+            JSValue js_array = JS_NewArray(context);
+            for (uint32_t i = 0; i < size; i++) {
+                JSValue js_element = JS_NewInt64(context, arr[i]);
+                JS_SetPropertyUint32(context, js_array, i, js_element);
+            }
+            (*env)->ReleaseLongArrayElements(env, value, arr, 0);
+            return js_array;
+        }
+        case JAVA_VALUE_KIND_FLOAT_ARRAY: {
+            if (context_maps_typed_arrays(context)) {
+                JsIntrinsics *intrinsics = require_intrinsics(context, "Float32Array");
+                if (intrinsics == NULL) {
+                    return JS_EXCEPTION;
+                }
+                return primitive_array_to_js_typed_array(
+                        env, context, value, JAVA_VALUE_KIND_FLOAT_ARRAY,
+                        intrinsics->float32array_constructor, "Float32Array");
+            }
+            int size = (*env)->GetArrayLength(env, value);
+            jfloat *arr = (*env)->GetFloatArrayElements(env, value, NULL);
+            JSValue js_array = JS_NewArray(context);
+            for (uint32_t i = 0; i < size; i++) {
+                JSValue js_element = JS_NewFloat64(context, arr[i]);
+                JS_SetPropertyUint32(context, js_array, i, js_element);
+            }
+            (*env)->ReleaseFloatArrayElements(env, value, arr, 0);
+            return js_array;
+        }
+        case JAVA_VALUE_KIND_DOUBLE_ARRAY: {
+            if (context_maps_typed_arrays(context)) {
+                JsIntrinsics *intrinsics = require_intrinsics(context, "Float64Array");
+                if (intrinsics == NULL) {
+                    return JS_EXCEPTION;
+                }
+                return primitive_array_to_js_typed_array(
+                        env, context, value, JAVA_VALUE_KIND_DOUBLE_ARRAY,
+                        intrinsics->float64array_constructor, "Float64Array");
+            }
+            int size = (*env)->GetArrayLength(env, value);
+            jdouble *arr = (*env)->GetDoubleArrayElements(env, value, NULL);
+            JSValue js_array = JS_NewArray(context);
+            for (uint32_t i = 0; i < size; i++) {
+                JSValue js_element = JS_NewFloat64(context, arr[i]);
+                JS_SetPropertyUint32(context, js_array, i, js_element);
+            }
+            (*env)->ReleaseDoubleArrayElements(env, value, arr, 0);
+            return js_array;
+        }
+        case JAVA_VALUE_KIND_OBJECT_ARRAY:
+            return convert_container(env, context, path, value, java_object_array_to_js_array);
+        case JAVA_VALUE_KIND_UNSUPPORTED:
+        default:
+            return unsupported_java_type_error(env, context, value);
     }
+}
 
-    (*env)->ReleaseStringUTFChars(env, j_cls_name, cls_name);
-
+JSValue jobject_to_js_value(JNIEnv *env, JSContext *context, jobject value) {
+    ConversionPath path;
+    path_init(&path);
+    JSValue result = to_js_value(env, context, &path, value);
+    path_free(&path);
     return result;
 }
@@ -6,8 +6,11 @@
 
 /**
  * Convert java JsValue to QuickJS JsValue.
+ *
+ * @return JS_EXCEPTION if failed to convert, e.g. the value has circular
+ * references, the js exception is thrown.
  */
-JSValue jobject_to_js_value(JNIEnv *env, JSContext *context, jobject visited_set, jobject value);
+JSValue jobject_to_js_value(JNIEnv *env, JSContext *context, jobject value);
 
 
 #endif //QJS_KT_JOBJECT_TO_JS_VALUE_H
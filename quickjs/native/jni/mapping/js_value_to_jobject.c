@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include "js_value_to_jobject.h"
 #include "js_value_util.h"
+#include "context_data.h"
+#include "java_value_kind.h"
+#include "pointer_set.h"
 #include "jni_globals_generated.h"
 #include "exception_util.h"
 #include "log_util.h"
@@ -119,7 +122,47 @@ jthrowable js_error_to_java_error(JNIEnv *env, JSContext *context, JSValue error
     return java_error;
 }
 
-jobjectArray to_java_list(JNIEnv *env, JSContext *context, JSValue value) {
+/**
+ * The state of one conversion.
+ */
+typedef struct {
+    /** The arrays and objects on the current conversion path. */
+    PointerSet path;
+    /** Set when a circular reference is found, the exception is pending. */
+    int aborted;
+} ConversionState;
+
+static jobject to_java_object(JNIEnv *env, JSContext *context, JSValue value,
+                              ConversionState *state);
+
+/**
+ * Push the container to the conversion path.
+ *
+ * Only containers on the current path are tracked, an object that is shared
+ * by siblings is converted every time it's found.
+ *
+ * @return 1 if pushed, 0 if it's a circular reference, the exception is thrown.
+ */
+static int enter_container(JNIEnv *env, ConversionState *state, JSValue value) {
+    int added = pointer_set_add(&state->path, JS_VALUE_GET_PTR(value));
+    if (added == 1) {
+        return 1;
+    }
+    if (added == 0) {
+        jni_throw_qjs_exception(env, "Unable to map objects with circular reference.");
+    } else {
+        jni_throw_qjs_exception(env, "Out of memory.");
+    }
+    state->aborted = 1;
+    return 0;
+}
+
+static void leave_container(ConversionState *state, JSValue value) {
+    pointer_set_remove(&state->path, JS_VALUE_GET_PTR(value));
+}
+
+static jobject to_java_list(JNIEnv *env, JSContext *context, JSValue value,
+                            ConversionState *state) {
     uint32_t len, i;
     JSValue js_arr_len = JS_GetPropertyStr(context, value, "length");
     JS_ToUint32(context, &len, js_arr_len);
@@ -132,15 +175,20 @@ jobjectArray to_java_list(JNIEnv *env, JSContext *context, JSValue value) {
     // Convert items
     for (i = 0; i < len; i++) {
         JSValue val = JS_GetPropertyUint32(context, value, i);
-        jobject item = js_value_to_jobject(env, context, val);
+        jobject item = to_java_object(env, context, val, state);
         JS_FreeValue(context, val);
+        if (state->aborted) {
+            (*env)->DeleteLocalRef(env, list);
+            return NULL;
+        }
         (*env)->CallBooleanMethod(env, list, list_add_method, item);
         (*env)->DeleteLocalRef(env, item);
     }
     return list;
 }
 
-jobject to_java_set(JNIEnv *env, JSContext *context, JSValue set) {
+static jobject to_java_set(JNIEnv *env, JSContext *context, JSValue set,
+                           ConversionState *state) {
     // Create a java set
     jclass set_cls = cls_linked_hash_set(env);
     jmethodID constructor = method_linked_hash_set_init(env);
@@ -162,13 +210,21 @@ jobject to_java_set(JNIEnv *env, JSContext *context, JSValue set) {
 
         JSValue key = JS_GetPropertyStr(context, entry, "value");
 
-        jobject java_key = js_value_to_jobject(env, context, key);
-        // Set.add()
-        (*env)->CallBooleanMethod(env, java_set, add_method, java_key);
-        (*env)->DeleteLocalRef(env, java_key);
+        jobject java_key = to_java_object(env, context, key, state);
+        if (!state->aborted) {
+            // Set.add()
+            (*env)->CallBooleanMethod(env, java_set, add_method, java_key);
+            (*env)->DeleteLocalRef(env, java_key);
+        }
 
         JS_FreeValue(context, key);
         JS_FreeValue(context, entry);
+
+        if (state->aborted) {
+            (*env)->DeleteLocalRef(env, java_set);
+            java_set = NULL;
+            break;
+        }
     }
 
     JS_FreeValue(context, next_func);
@@ -178,7 +234,8 @@ jobject to_java_set(JNIEnv *env, JSContext *context, JSValue set) {
     return java_set;
 }
 
-jobject to_java_map(JNIEnv *env, JSContext *context, JSValue map) {
+static jobject to_java_map(JNIEnv *env, JSContext *context, JSValue map,
+                           ConversionState *state) {
     // Create a java map
     jclass map_cls = cls_linked_hash_map(env);
     jmethodID constructor = method_linked_hash_map_init(env);
@@ -202,10 +259,15 @@ jobject to_java_map(JNIEnv *env, JSContext *context, JSValue map) {
         JSValue key = JS_GetPropertyUint32(context, entry_value, 0);
         JSValue val = JS_GetPropertyUint32(context, entry_value, 1);
 
-        jobject java_key = js_value_to_jobject(env, context, key);
-        jobject java_val = js_value_to_jobject(env, context, val);
-        // Map.put(k, v)
-        (*env)->CallObjectMethod(env, java_map, put_method, java_key, java_val);
+        jobject java_key = to_java_object(env, context, key, state);
+        jobject java_val = NULL;
+        if (!state->aborted) {
+            java_val = to_java_object(env, context, val, state);
+        }
+        if (!state->aborted) {
+            // Map.put(k, v)
+            (*env)->CallObjectMethod(env, java_map, put_method, java_key, java_val);
+        }
         (*env)->DeleteLocalRef(env, java_key);
         (*env)->DeleteLocalRef(env, java_val);
 
@@ -213,6 +275,12 @@ jobject to_java_map(JNIEnv *env, JSContext *context, JSValue map) {
         JS_FreeValue(context, val);
         JS_FreeValue(context, entry_value);
         JS_FreeValue(context, entry);
+
+        if (state->aborted) {
+            (*env)->DeleteLocalRef(env, java_map);
+            java_map = NULL;
+            break;
+        }
     }
 
     JS_FreeValue(context, next_func);
@@ -222,20 +290,8 @@ jobject to_java_map(JNIEnv *env, JSContext *context, JSValue map) {
     return java_map;
 }
 
-jobject object_to_java_js_object(JNIEnv *env, JSContext *context, JSValue value) {
-    // This can check circular references for us
-    JSValue json = JS_JSONStringify(context, value, JS_UNDEFINED, JS_UNDEFINED);
-    if (JS_IsException(json)) {
-        JSValue js_err = JS_GetException(context);
-        if (!JS_IsNull(js_err)) {
-            (*env)->Throw(env, js_error_to_java_error(env, context, js_err));
-        }
-        JS_FreeValue(context, js_err);
-        JS_FreeValue(context, json);
-        return NULL;
-    }
-    JS_FreeValue(context, json);
-
+static jobject object_to_java_js_object(JNIEnv *env, JSContext *context, JSValue value,
+                                        ConversionState *state) {
     JSPropertyEnum *props;
     uint32_t prop_len;
     JS_GetOwnPropertyNames(context, &props, &prop_len, value,
@@ -264,23 +320,29 @@ jobject object_to_java_js_object(JNIEnv *env, JSContext *context, JSValue value)
             goto free_values;
         }
 
-        jobject java_key = js_value_to_jobject(env, context, key);
+        jobject java_key = to_java_object(env, context, key, state);
         if (try_catch_java_exceptions(env) != NULL) {
             goto free_values;
         }
 
         jobject java_val;
-        if (JS_VALUE_GET_TAG(val) == value_tag &&
-            JS_VALUE_GET_PTR(val) == value_ptr) {
-            // Avoid infinite recursion
+        if (JS_IsFunction(context, val)) {
+            java_val = to_java_string(env, "[Function]");
+        } else if (!props[i].is_enumerable && JS_VALUE_GET_TAG(val) == JS_TAG_OBJECT &&
+                   pointer_set_contains(&state->path, JS_VALUE_GET_PTR(val))) {
+            // Like JSON.stringify(), non-enumerable properties are not checked, avoid
+            // infinite recursion, e.g. globalThis.globalThis
             const char *val_str = JS_ToCString(context, val);
             java_val = to_java_string(env, val_str);
             JS_FreeCString(context, val_str);
-        } else if (JS_IsFunction(context, val)) {
-            java_val = to_java_string(env, "[Function]");
         } else {
-            java_val = js_value_to_jobject(env, context, val);
+            java_val = to_java_object(env, context, val, state);
+            if (state->aborted) {
+                (*env)->DeleteLocalRef(env, java_key);
+                goto free_values;
+            }
             if (try_catch_java_exceptions(env) != NULL) {
+                (*env)->DeleteLocalRef(env, java_key);
                 goto free_values;
             }
         }
@@ -294,11 +356,23 @@ jobject object_to_java_js_object(JNIEnv *env, JSContext *context, JSValue value)
         free_values:
         JS_FreeValue(context, key);
         JS_FreeValue(context, val);
+        if (state->aborted) {
+            // Free the remaining atoms
+            for (uint32_t j = i; j < prop_len; j++) {
+                JS_FreeAtom(context, props[j].atom);
+            }
+            break;
+        }
         JS_FreeAtom(context, prop_atom);
     }
 
     js_free(context, props);
 
+    if (state->aborted) {
+        (*env)->DeleteLocalRef(env, java_map);
+        return NULL;
+    }
+
     // Wrap java_map as JsObject
     jclass js_object_cls = cls_js_object(env);
     jmethodID js_object_constructor = method_js_object_init(env);
@@ -330,6 +404,100 @@ jobject js_int8array_to_kt_ubyte_array(JNIEnv *env, JSContext *context, JSValue
     return (*env)->NewObject(env, cls_ubyte_array(env), method_ubyte_array_init(env), bytes);
 }
 
+/**
+ * Copy the elements of a typed array to a new primitive array, with a single
+ * copy of the elements.
+ *
+ * @param kind The kind of the primitive array, one of the int, long, float and
+ * double arrays.
+ */
+static jobject js_typed_array_to_java_array(JNIEnv *env, JSContext *context, JSValue value,
+                                            JavaValueKind kind) {
+    size_t byte_offset;
+    size_t byte_length;
+    size_t bytes_per_element;
+    JSValue buffer = JS_GetTypedArrayBuffer(context, value, &byte_offset, &byte_length,
+                                            &bytes_per_element);
+    if (JS_IsException(buffer)) {
+        JS_FreeValue(context, JS_GetException(context));
+        jni_throw_qjs_exception(env, "Cannot read typed array.");
+        return NULL;
+    }
+    size_t size;
+    uint8_t *c_buffer = JS_GetArrayBuffer(context, &size, buffer);
+    if (c_buffer == NULL) {
+        // Detached
+        JS_FreeValue(context, JS_GetException(context));
+        JS_FreeValue(context, buffer);
+        jni_throw_qjs_exception(env, "Cannot read array buffer.");
+        return NULL;
+    }
+
+    jsize length = (jsize) (byte_length / bytes_per_element);
+    const void *elements = c_buffer + byte_offset;
+    jarray array = NULL;
+    switch (kind) {
+        case JAVA_VALUE_KIND_INT_ARRAY:
+            array = (*env)->NewIntArray(env, length);
+            if (array != NULL) {
+                (*env)->SetIntArrayRegion(env, array, 0, length, elements);
+            }
+            break;
+        case JAVA_VALUE_KIND_LONG_ARRAY:
+            array = (*env)->NewLongArray(env, length);
+            if (array != NULL) {
+                (*env)->SetLongArrayRegion(env, array, 0, length, elements);
+            }
+            break;
+        case JAVA_VALUE_KIND_FLOAT_ARRAY:
+            array = (*env)->NewFloatArray(env, length);
+            if (array != NULL) {
+                (*env)->SetFloatArrayRegion(env, array, 0, length, elements);
+            }
+            break;
+        case JAVA_VALUE_KIND_DOUBLE_ARRAY:
+            array = (*env)->NewDoubleArray(env, length);
+            if (array != NULL) {
+                (*env)->SetDoubleArrayRegion(env, array, 0, length, elements);
+            }
+            break;
+        default:
+            jni_throw_qjs_exception(env, "Unsupported typed array.");
+            break;
+    }
+
+    JS_FreeValue(context, buffer);
+    return array;
+}
+
+/**
+ * Map Int32Array, BigInt64Array, Float32Array and Float64Array to primitive
+ * arrays, if enabled for the context.
+ *
+ * @param result Destination of the primitive array.
+ * @return 1 if the value is one of the typed arrays, 0 otherwise.
+ */
+static int try_map_typed_array(JNIEnv *env, JSContext *context, JSValue value,
+                               jobject *result) {
+    if (!context_maps_typed_arrays(context)) {
+        return 0;
+    }
+    JavaValueKind kind;
+    if (js_is_int32array(context, value)) {
+        kind = JAVA_VALUE_KIND_INT_ARRAY;
+    } else if (js_is_bigint64array(context, value)) {
+        kind = JAVA_VALUE_KIND_LONG_ARRAY;
+    } else if (js_is_float32array(context, value)) {
+        kind = JAVA_VALUE_KIND_FLOAT_ARRAY;
+    } else if (js_is_float64array(context, value)) {
+        kind = JAVA_VALUE_KIND_DOUBLE_ARRAY;
+    } else {
+        return 0;
+    }
+    *result = js_typed_array_to_java_array(env, context, value, kind);
+    return 1;
+}
+
 jobject try_handle_promise_result(JNIEnv *env, JSContext *context, JSValue promise) {
     JSPromiseStateEnum state = JS_PromiseState(context, promise);
     if (state == JS_PROMISE_FULFILLED) {
@@ -341,7 +509,8 @@ jobject try_handle_promise_result(JNIEnv *env, JSContext *context, JSValue promi
     }
 }
 
-jobject js_value_to_jobject(JNIEnv *env, JSContext *context, JSValue value) {
+static jobject to_java_object(JNIEnv *env, JSContext *context, JSValue value,
+                              ConversionState *state) {
     int tag = JS_VALUE_GET_NORM_TAG(value);
 
     if (tag == JS_TAG_NULL || tag == JS_TAG_UNDEFINED || tag == JS_TAG_UNINITIALIZED) {
@@ -402,7 +571,12 @@ jobject js_value_to_jobject(JNIEnv *env, JSContext *context, JSValue value) {
     }
 
     if (JS_IsArray(context, value)) {
-        return to_java_list(env, context, value);
+        if (!enter_container(env, state, value)) {
+            return NULL;
+        }
+        jobject result = to_java_list(env, context, value, state);
+        leave_container(state, value);
+        return result;
     }
 
     if (JS_IsError(context, value)) {
@@ -410,25 +584,35 @@ jobject js_value_to_jobject(JNIEnv *env, JSContext *context, JSValue value) {
     }
 
     if (tag == JS_TAG_OBJECT) {
-        JSValue global_this = JS_GetGlobalObject(context);
         jobject result;
 
-        if (js_is_promise_2(context, global_this, value)) {
+        if (js_is_promise(context, value)) {
             result = try_handle_promise_result(env, context, value);
-        } else if (js_is_set(context, global_this, value)) {
-            result = to_java_set(env, context, value);
-        } else if (js_is_map(context, global_this, value)) {
-            result = to_java_map(env, context, value);
-        } else if (js_is_uint8array(context, global_this, value)) {
+        } else if (js_is_set(context, value)) {
+            result = NULL;
+            if (enter_container(env, state, value)) {
+                result = to_java_set(env, context, value, state);
+                leave_container(state, value);
+            }
+        } else if (js_is_map(context, value)) {
+            result = NULL;
+            if (enter_container(env, state, value)) {
+                result = to_java_map(env, context, value, state);
+                leave_container(state, value);
+            }
+        } else if (js_is_uint8array(context, value)) {
             result = js_int8array_to_kt_ubyte_array(env, context, value);
-        } else if (js_is_int8array(context, global_this, value)) {
+        } else if (js_is_int8array(context, value)) {
             result = js_int8array_to_java_byte_array(env, context, value);
+        } else if (try_map_typed_array(env, context, value, &result)) {
+            // Mapped to a primitive array
+        } else if (enter_container(env, state, value)) {
+            result = object_to_java_js_object(env, context, value, state);
+            leave_container(state, value);
         } else {
-            result = object_to_java_js_object(env, context, value);
+            result = NULL;
         }
 
-        JS_FreeValue(context, global_this);
-
         return result;
     }
 
@@ -437,3 +621,12 @@ jobject js_value_to_jobject(JNIEnv *env, JSContext *context, JSValue value) {
     JS_FreeCString(context, string);
     return NULL;
 }
+
+jobject js_value_to_jobject(JNIEnv *env, JSContext *context, JSValue value) {
+    ConversionState state;
+    pointer_set_init(&state.path);
+    state.aborted = 0;
+    jobject result = to_java_object(env, context, value, &state);
+    pointer_set_free(&state.path);
+    return result;
+}
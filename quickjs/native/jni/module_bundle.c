@@ -0,0 +1,103 @@
+#include <string.h>
+#include "module_bundle.h"
+#include "quickjs_version.h"
+#include "context_data.h"
+
+#define BUNDLE_MAGIC 0x42534a51 // "QJSB"
+#define BUNDLE_FORMAT_VERSION 2
+#define BUNDLE_HEADER_SIZE 24
+#define BUNDLE_TABLE_ENTRY_SIZE 20
+
+static uint32_t read_u32(const uint8_t *p) {
+    return (uint32_t) p[0] |
+           ((uint32_t) p[1] << 8) |
+           ((uint32_t) p[2] << 16) |
+           ((uint32_t) p[3] << 24);
+}
+
+static int has_range(size_t length, uint32_t offset, uint32_t size) {
+    return (uint64_t) offset + size <= length;
+}
+
+int read_module_bundle(JSContext *context,
+                       const uint8_t *bundle,
+                       size_t length,
+                       const uint8_t **entry,
+                       size_t *entry_length) {
+    if (length < BUNDLE_HEADER_SIZE ||
+        read_u32(bundle) != BUNDLE_MAGIC ||
+        read_u32(bundle + 4) != BUNDLE_FORMAT_VERSION) {
+        JS_ThrowTypeError(context, "Not a module bundle.");
+        return 0;
+    }
+    uint32_t count = read_u32(bundle + 8);
+    uint32_t entry_index = read_u32(bundle + 12);
+    if (count == 0 || entry_index >= count ||
+        BUNDLE_HEADER_SIZE + (uint64_t) BUNDLE_TABLE_ENTRY_SIZE * count > length) {
+        JS_ThrowTypeError(context, "Corrupted module bundle table.");
+        return 0;
+    }
+    uint32_t version_offset = read_u32(bundle + 16);
+    uint32_t version_length = read_u32(bundle + 20);
+    if (!has_range(length, version_offset, version_length)) {
+        JS_ThrowTypeError(context, "Corrupted module bundle table.");
+        return 0;
+    }
+    // Bytecode is not compatible across QuickJS versions
+    const char *version = quickjs_version();
+    if (version_length != strlen(version) ||
+        memcmp(bundle + version_offset, version, version_length) != 0) {
+        JS_ThrowTypeError(context, "Module bundle was compiled by QuickJS %.*s, but the runtime is %s.",
+                          (int) version_length, (const char *) bundle + version_offset, version);
+        return 0;
+    }
+
+    // Validate the whole table before reading any module
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *table_entry = bundle + BUNDLE_HEADER_SIZE + BUNDLE_TABLE_ENTRY_SIZE * i;
+        uint32_t name_offset = read_u32(table_entry + 4);
+        uint32_t name_length = read_u32(table_entry + 8);
+        uint32_t bytecode_length = read_u32(table_entry + 16);
+        if (!has_range(length, name_offset, name_length) ||
+            bytecode_length == 0 ||
+            !has_range(length, read_u32(table_entry + 12), bytecode_length) ||
+            name_set_hash((const char *) bundle + name_offset, name_length) !=
+            read_u32(table_entry)) {
+            JS_ThrowTypeError(context, "Corrupted module bundle entry: %u", i);
+            return 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *table_entry = bundle + BUNDLE_HEADER_SIZE + BUNDLE_TABLE_ENTRY_SIZE * i;
+        const uint8_t *bytecode = bundle + read_u32(table_entry + 12);
+        size_t bytecode_length = read_u32(table_entry + 16);
+        if (i == entry_index) {
+            *entry = bytecode;
+            *entry_length = bytecode_length;
+            continue;
+        }
+        const char *name = (const char *) bundle + read_u32(table_entry + 4);
+        uint32_t name_length = read_u32(table_entry + 8);
+        // Validated against the name above
+        uint32_t hash = read_u32(table_entry);
+        if (context_has_module(context, name, name_length, hash)) {
+            // Read by an earlier bundle or the module loader
+            continue;
+        }
+        JSValue module = JS_ReadObject(context, bytecode, bytecode_length,
+                                       JS_READ_OBJ_BYTECODE | JS_READ_OBJ_REFERENCE);
+        if (JS_IsException(module)) {
+            return 0;
+        }
+        int is_module = JS_VALUE_GET_TAG(module) == JS_TAG_MODULE;
+        // The module stays registered in the context
+        JS_FreeValue(context, module);
+        if (!is_module) {
+            JS_ThrowTypeError(context, "Module bundle entry %u is not an ES module.", i);
+            return 0;
+        }
+        context_add_module(context, name, name_length, hash);
+    }
+    return 1;
+}
@@ -0,0 +1,25 @@
+#ifndef QJS_KT_MODULE_BUNDLE_H
+#define QJS_KT_MODULE_BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "quickjs.h"
+
+/**
+ * Reads every module of a bundle into the context except the entry, which is returned as
+ * a bytecode range for the caller to evaluate. js_mutex must be locked.
+ *
+ * Bundled modules are registered in the context, so resolving the entry finds them
+ * without calling the host module loader. Modules the context already read from a
+ * bundle or the module loader are skipped. The layout is described in ModuleBundle.kt.
+ * Bundles written by another QuickJS version, or with empty modules, are rejected.
+ *
+ * Returns 1 on success, 0 with a pending JavaScript exception on failure.
+ */
+int read_module_bundle(JSContext *context,
+                       const uint8_t *bundle,
+                       size_t length,
+                       const uint8_t **entry,
+                       size_t *entry_length);
+
+#endif //QJS_KT_MODULE_BUNDLE_H
@@ -0,0 +1,249 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "module_cache.h"
+
+#define MODULE_CACHE_BUCKETS 256
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ModuleCacheEntry *buckets[MODULE_CACHE_BUCKETS];
+// The most and the least recently used entries
+static ModuleCacheEntry *lru_head = NULL;
+static ModuleCacheEntry *lru_tail = NULL;
+static size_t entry_count = 0;
+static size_t total_bytes = 0;
+static size_t max_bytes = 64 * 1024 * 1024;
+
+/** 64-bit FNV-1a hash. */
+static uint64_t fnv1a(const uint8_t *data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static ModuleCacheEntry **bucket_of(const char *namespace, int strip_flags, const char *name) {
+    uint64_t hash = fnv1a((const uint8_t *) namespace, strlen(namespace));
+    hash = (hash ^ (uint64_t) strip_flags) * 0x100000001b3ULL;
+    hash ^= fnv1a((const uint8_t *) name, strlen(name));
+    return &buckets[hash % MODULE_CACHE_BUCKETS];
+}
+
+static int entry_matches(const ModuleCacheEntry *entry,
+                         const char *namespace,
+                         int strip_flags,
+                         const char *name) {
+    return entry->strip_flags == strip_flags &&
+           strcmp(entry->name, name) == 0 &&
+           strcmp(entry->namespace, namespace) == 0;
+}
+
+/** cache_mutex must be locked. */
+static void unref_entry(ModuleCacheEntry *entry) {
+    if (--entry->ref_count > 0) {
+        return;
+    }
+    free(entry->namespace);
+    free(entry->name);
+    free(entry->bytecode);
+    free(entry);
+}
+
+/** cache_mutex must be locked. */
+static void lru_remove(ModuleCacheEntry *entry) {
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+/** cache_mutex must be locked. */
+static void lru_push_front(ModuleCacheEntry *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = lru_head;
+    if (lru_head != NULL) {
+        lru_head->lru_prev = entry;
+    } else {
+        lru_tail = entry;
+    }
+    lru_head = entry;
+}
+
+/** Unlinks the entry at *link and drops the table reference, cache_mutex must be locked. */
+static void unlink_entry(ModuleCacheEntry **link) {
+    ModuleCacheEntry *entry = *link;
+    *link = entry->next;
+    entry->next = NULL;
+    lru_remove(entry);
+    entry_count--;
+    total_bytes -= entry->length;
+    unref_entry(entry);
+}
+
+static ModuleCacheEntry **find_link(const char *namespace, int strip_flags, const char *name) {
+    ModuleCacheEntry **link = bucket_of(namespace, strip_flags, name);
+    while (*link != NULL && !entry_matches(*link, namespace, strip_flags, name)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/** Evicts the least recently used entries until the cache fits, cache_mutex must be locked. */
+static void evict_until(size_t bytes) {
+    while (total_bytes > bytes) {
+        ModuleCacheEntry *lru = lru_tail;
+        unlink_entry(find_link(lru->namespace, lru->strip_flags, lru->name));
+    }
+}
+
+ModuleCacheEntry *module_cache_acquire(const char *namespace, int strip_flags, const char *name) {
+    pthread_mutex_lock(&cache_mutex);
+    ModuleCacheEntry *entry = *find_link(namespace, strip_flags, name);
+    if (entry != NULL) {
+        entry->ref_count++;
+        lru_remove(entry);
+        lru_push_front(entry);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return entry;
+}
+
+void module_cache_release(ModuleCacheEntry *entry) {
+    pthread_mutex_lock(&cache_mutex);
+    unref_entry(entry);
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void module_cache_put(const char *namespace,
+                      int strip_flags,
+                      const char *name,
+                      const uint8_t *bytecode,
+                      size_t length) {
+    uint64_t hash = fnv1a(bytecode, length);
+
+    // Copy outside of the lock
+    size_t namespace_size = strlen(namespace) + 1;
+    size_t name_size = strlen(name) + 1;
+    ModuleCacheEntry *entry = malloc(sizeof(ModuleCacheEntry));
+    char *namespace_copy = malloc(namespace_size);
+    char *name_copy = malloc(name_size);
+    uint8_t *bytecode_copy = malloc(length);
+    if (entry == NULL || namespace_copy == NULL || name_copy == NULL || bytecode_copy == NULL) {
+        free(entry);
+        free(namespace_copy);
+        free(name_copy);
+        free(bytecode_copy);
+        return;
+    }
+    memcpy(namespace_copy, namespace, namespace_size);
+    memcpy(name_copy, name, name_size);
+    memcpy(bytecode_copy, bytecode, length);
+    entry->namespace = namespace_copy;
+    entry->strip_flags = strip_flags;
+    entry->name = name_copy;
+    entry->hash = hash;
+    entry->bytecode = bytecode_copy;
+    entry->length = length;
+    entry->ref_count = 1;
+    entry->next = NULL;
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+
+    pthread_mutex_lock(&cache_mutex);
+    ModuleCacheEntry **link = find_link(namespace, strip_flags, name);
+    ModuleCacheEntry *existing = *link;
+    if (existing != NULL && existing->hash == hash && existing->length == length) {
+        // Cached by another runtime
+        pthread_mutex_unlock(&cache_mutex);
+        unref_entry(entry);
+        return;
+    }
+    if (length > max_bytes) {
+        pthread_mutex_unlock(&cache_mutex);
+        unref_entry(entry);
+        return;
+    }
+    if (existing != NULL) {
+        unlink_entry(link);
+    }
+    evict_until(max_bytes - length);
+    ModuleCacheEntry **bucket = bucket_of(namespace, strip_flags, name);
+    entry->next = *bucket;
+    *bucket = entry;
+    lru_push_front(entry);
+    entry_count++;
+    total_bytes += length;
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void module_cache_remove_entry(ModuleCacheEntry *entry) {
+    pthread_mutex_lock(&cache_mutex);
+    ModuleCacheEntry **link = find_link(entry->namespace, entry->strip_flags, entry->name);
+    if (*link == entry) {
+        unlink_entry(link);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void module_cache_remove(const char *name) {
+    pthread_mutex_lock(&cache_mutex);
+    // Entries of the name are spread over the buckets of their namespaces
+    for (int i = 0; i < MODULE_CACHE_BUCKETS; i++) {
+        ModuleCacheEntry **link = &buckets[i];
+        while (*link != NULL) {
+            if (strcmp((*link)->name, name) == 0) {
+                unlink_entry(link);
+            } else {
+                link = &(*link)->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void module_cache_clear(void) {
+    pthread_mutex_lock(&cache_mutex);
+    for (int i = 0; i < MODULE_CACHE_BUCKETS; i++) {
+        while (buckets[i] != NULL) {
+            unlink_entry(&buckets[i]);
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void module_cache_set_max_bytes(size_t bytes) {
+    pthread_mutex_lock(&cache_mutex);
+    max_bytes = bytes;
+    evict_until(max_bytes);
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+size_t module_cache_max_bytes(void) {
+    pthread_mutex_lock(&cache_mutex);
+    size_t bytes = max_bytes;
+    pthread_mutex_unlock(&cache_mutex);
+    return bytes;
+}
+
+size_t module_cache_count(void) {
+    pthread_mutex_lock(&cache_mutex);
+    size_t count = entry_count;
+    pthread_mutex_unlock(&cache_mutex);
+    return count;
+}
+
+size_t module_cache_bytes(void) {
+    pthread_mutex_lock(&cache_mutex);
+    size_t bytes = total_bytes;
+    pthread_mutex_unlock(&cache_mutex);
+    return bytes;
+}
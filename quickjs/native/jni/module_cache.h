@@ -0,0 +1,74 @@
+#ifndef QJS_KT_MODULE_CACHE_H
+#define QJS_KT_MODULE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A process-wide cache of module bytecode in native memory, shared by every runtime that
+ * enables it. Entries are keyed by a namespace, the strip flags of the compiling runtime and
+ * the normalized module name. The namespace identifies the modules of a loader, so runtimes
+ * with different loaders never read each other's modules. Entries hold the hash of their
+ * bytecode, so a changed module replaces the old entry instead of adding another one.
+ *
+ * The cache evicts the least recently acquired entries when a new entry would grow it over
+ * its max size. Entries are reference counted, an entry acquired by a runtime stays valid
+ * after it's replaced, evicted or removed until the runtime releases it. All functions are
+ * thread-safe.
+ */
+typedef struct ModuleCacheEntry {
+    char *namespace;
+    int strip_flags;
+    char *name;
+    uint64_t hash;
+    uint8_t *bytecode;
+    size_t length;
+    /** One reference for the table while the entry is cached, one for each reader. */
+    int ref_count;
+    /** The next entry of the bucket. */
+    struct ModuleCacheEntry *next;
+    /** Neighbors in the LRU list, from the most to the least recently used entry. */
+    struct ModuleCacheEntry *lru_prev;
+    struct ModuleCacheEntry *lru_next;
+} ModuleCacheEntry;
+
+/**
+ * Find the bytecode of a module, returns NULL if not cached. Release it with
+ * module_cache_release().
+ */
+ModuleCacheEntry *module_cache_acquire(const char *namespace, int strip_flags, const char *name);
+
+void module_cache_release(ModuleCacheEntry *entry);
+
+/**
+ * Cache a copy of the bytecode, replacing the entry of the same key if its bytecode is
+ * different. Least recently used entries are evicted to keep the cache under its max size,
+ * bytecode larger than the max size is not cached.
+ */
+void module_cache_put(const char *namespace,
+                      int strip_flags,
+                      const char *name,
+                      const uint8_t *bytecode,
+                      size_t length);
+
+/**
+ * Remove an acquired entry if it's still cached, a newer replacement is kept.
+ */
+void module_cache_remove_entry(ModuleCacheEntry *entry);
+
+/**
+ * Remove the entries of a name in all namespaces.
+ */
+void module_cache_remove(const char *name);
+
+void module_cache_clear(void);
+
+void module_cache_set_max_bytes(size_t max_bytes);
+
+size_t module_cache_max_bytes(void);
+
+size_t module_cache_count(void);
+
+size_t module_cache_bytes(void);
+
+#endif //QJS_KT_MODULE_CACHE_H
@@ -1,6 +1,8 @@
 #include <limits.h>
 #include <string.h>
 #include "module_loader.h"
+#include "context_data.h"
+#include "module_cache.h"
 #include "mapping/jobject_to_js_value.h"
 #include "exception_util.h"
 #include "jni_globals.h"
@@ -18,7 +20,7 @@ static int forward_java_exception(JNIEnv *env,
         return 0;
     }
 
-    JSValue js_error = jobject_to_js_value(env, context, NULL, exception);
+    JSValue js_error = jobject_to_js_value(env, context, exception);
     (*env)->DeleteLocalRef(env, exception);
     if (JS_IsException(js_error)) {
         return 1;
@@ -89,10 +91,10 @@ static int notify_module_compiled(JNIEnv *env,
             0,
             (jsize) bytecode_length,
             (jbyte *) bytecode);
-    js_free(context, bytecode);
     if (forward_java_exception(
             env, context,
             "Cannot copy bytecode for module '%s'.", module_name)) {
+        js_free(context, bytecode);
         (*env)->DeleteLocalRef(env, java_bytecode);
         return 0;
     }
@@ -107,12 +109,38 @@ static int notify_module_compiled(JNIEnv *env,
     if (forward_java_exception(
             env, context,
             "Module compilation callback failed for '%s'.", module_name)) {
+        js_free(context, bytecode);
         return 0;
     }
+    if (globals->use_shared_module_cache) {
+        module_cache_put(globals->shared_module_cache_namespace, globals->strip_flags,
+                         module_name, bytecode, bytecode_length);
+    }
+    js_free(context, bytecode);
     return 1;
 }
 
-/** Reads module bytecode supplied by the host loader. */
+/** Adds the bytecode of a module to the shared cache, failures are ignored. */
+static void add_shared_module(JSContext *context,
+                              Globals *globals,
+                              const char *module_name,
+                              JSValue module) {
+    size_t bytecode_length;
+    uint8_t *bytecode = JS_WriteObject(
+            context,
+            &bytecode_length,
+            module,
+            JS_WRITE_OBJ_BYTECODE | JS_WRITE_OBJ_REFERENCE);
+    if (bytecode == NULL) {
+        JS_FreeValue(context, JS_GetException(context));
+        return;
+    }
+    module_cache_put(globals->shared_module_cache_namespace, globals->strip_flags,
+                     module_name, bytecode, bytecode_length);
+    js_free(context, bytecode);
+}
+
+/** Reads module bytecode supplied by the host loader as a byte array. */
 static JSValue read_module_bytecode(JNIEnv *env,
                                     JSContext *context,
                                     jbyteArray java_bytecode,
@@ -142,6 +170,24 @@ static JSValue read_module_bytecode(JNIEnv *env,
     return module;
 }
 
+/** Reads module bytecode supplied by the host loader in place from a direct buffer. */
+static JSValue read_module_bytecode_buffer(JNIEnv *env,
+                                           JSContext *context,
+                                           jobject java_buffer,
+                                           const char *module_name) {
+    const uint8_t *bytecode = (*env)->GetDirectBufferAddress(env, java_buffer);
+    jlong bytecode_length = (*env)->GetDirectBufferCapacity(env, java_buffer);
+    if (bytecode == NULL || bytecode_length < 0) {
+        JS_ThrowTypeError(context, "Bytecode of module '%s' is not a direct buffer.", module_name);
+        return JS_EXCEPTION;
+    }
+    return JS_ReadObject(
+            context,
+            bytecode,
+            (size_t) bytecode_length,
+            JS_READ_OBJ_BYTECODE | JS_READ_OBJ_REFERENCE);
+}
+
 /** Verifies that cached bytecode belongs to the normalized requested name. */
 static int validate_module_name(JSContext *context,
                                 JSValue module,
@@ -166,12 +212,61 @@ static int validate_module_name(JSContext *context,
     return matches;
 }
 
+/** Records a module registered in the context, so bundles don't register it again. */
+static void record_module(JSContext *context, const char *module_name) {
+    size_t length = strlen(module_name);
+    context_add_module(context, module_name, length, name_set_hash(module_name, length));
+}
+
+/**
+ * Reads a module from the shared cache without calling into Java.
+ *
+ * Only entries added in the namespace of the runtime and with its strip flags are read.
+ * Returns NULL without a pending exception on a miss. A cached entry that cannot be read is
+ * removed, so the module is loaded from the host loader instead.
+ */
+static JSModuleDef *load_shared_module(JSContext *context,
+                                       Globals *globals,
+                                       const char *module_name) {
+    ModuleCacheEntry *entry = module_cache_acquire(globals->shared_module_cache_namespace,
+                                                   globals->strip_flags,
+                                                   module_name);
+    if (entry == NULL) {
+        return NULL;
+    }
+    JSValue module = JS_ReadObject(
+            context,
+            entry->bytecode,
+            entry->length,
+            JS_READ_OBJ_BYTECODE | JS_READ_OBJ_REFERENCE);
+    JSModuleDef *definition = NULL;
+    if (!JS_IsException(module) &&
+        JS_VALUE_GET_TAG(module) == JS_TAG_MODULE &&
+        validate_module_name(context, module, module_name)) {
+        definition = JS_VALUE_GET_PTR(module);
+        record_module(context, module_name);
+    } else {
+        module_cache_remove_entry(entry);
+        JS_FreeValue(context, JS_GetException(context));
+    }
+    JS_FreeValue(context, module);
+    module_cache_release(entry);
+    return definition;
+}
+
 /**
  * Loads source or bytecode from the runtime-scoped Kotlin ModuleLoader.
 
  */
 static JSModuleDef *load_module(JSContext *context, const char *module_name, void *opaque) {
     Globals *globals = (Globals *) opaque;
+    if (globals->use_shared_module_cache && !globals->resolving_module_graph) {
+        JSModuleDef *shared = load_shared_module(context, globals, module_name);
+        if (shared != NULL) {
+            return shared;
+        }
+    }
+
     JNIEnv *env = get_jni_env();
     if (env == NULL) {
         JS_ThrowInternalError(context, "Cannot access JNI while loading module '%s'.", module_name);
@@ -243,26 +338,46 @@ static JSModuleDef *load_module(JSContext *context, const char *module_name, voi
             module = JS_EXCEPTION;
         }
     } else {
-        jbyteArray java_bytecode = (jbyteArray) (*env)->CallObjectMethod(
+        // Checked first, the heap bytecode of a buffer would be a copy
+        jobject java_buffer = (*env)->CallObjectMethod(
                 env,
                 globals->module_loader_host,
-                globals->get_module_bytecode_method,
+                globals->get_module_bytecode_buffer_method,
                 content);
         if (forward_java_exception(
                 env, context,
                 "Cannot inspect module bytecode for '%s'.", module_name)) {
             goto notify_failure;
         }
-        if (java_bytecode == NULL) {
-            JS_ThrowTypeError(context, "Unsupported module content for '%s'.", module_name);
-            goto notify_failure;
+        if (java_buffer != NULL) {
+            module = read_module_bytecode_buffer(env, context, java_buffer, module_name);
+            (*env)->DeleteLocalRef(env, java_buffer);
+        } else {
+            jbyteArray java_bytecode = (jbyteArray) (*env)->CallObjectMethod(
+                    env,
+                    globals->module_loader_host,
+                    globals->get_module_bytecode_method,
+                    content);
+            if (forward_java_exception(
+                    env, context,
+                    "Cannot inspect module bytecode for '%s'.", module_name)) {
+                goto notify_failure;
+            }
+            if (java_bytecode == NULL) {
+                JS_ThrowTypeError(context, "Unsupported module content for '%s'.", module_name);
+                goto notify_failure;
+            }
+            module = read_module_bytecode(env, context, java_bytecode, module_name);
+            (*env)->DeleteLocalRef(env, java_bytecode);
         }
-        module = read_module_bytecode(env, context, java_bytecode, module_name);
-        (*env)->DeleteLocalRef(env, java_bytecode);
-        if (!JS_IsException(module) && JS_VALUE_GET_TAG(module) == JS_TAG_MODULE &&
-            !validate_module_name(context, module, module_name)) {
-            JS_FreeValue(context, module);
-            module = JS_EXCEPTION;
+        if (!JS_IsException(module) && JS_VALUE_GET_TAG(module) == JS_TAG_MODULE) {
+            if (!validate_module_name(context, module, module_name)) {
+                JS_FreeValue(context, module);
+                module = JS_EXCEPTION;
+            } else if (java_buffer == NULL && globals->use_shared_module_cache) {
+                // Mapped buffers are already shared, only heap bytecode is copied
+                add_shared_module(context, globals, module_name, module);
+            }
         }
     }
 
@@ -277,6 +392,7 @@ static JSModuleDef *load_module(JSContext *context, const char *module_name, voi
 
     definition = JS_VALUE_GET_PTR(module);
     JS_FreeValue(context, module);
+    record_module(context, module_name);
     goto cleanup_refs;
 
 notify_failure:
@@ -312,6 +428,11 @@ int install_module_loader(JNIEnv *env, JSRuntime *runtime, Globals *globals, job
             host_class,
             "getModuleBytecode",
             "(Ljava/lang/Object;)[B");
+    jmethodID get_module_bytecode_buffer_method = (*env)->GetMethodID(
+            env,
+            host_class,
+            "getModuleBytecodeBuffer",
+            "(Ljava/lang/Object;)Ljava/nio/ByteBuffer;");
     jmethodID on_module_compiled_method = (*env)->GetMethodID(
             env,
             host_class,
@@ -327,6 +448,7 @@ int install_module_loader(JNIEnv *env, JSRuntime *runtime, Globals *globals, job
     if (load_module_method == NULL ||
         get_module_source_method == NULL ||
         get_module_bytecode_method == NULL ||
+        get_module_bytecode_buffer_method == NULL ||
         on_module_compiled_method == NULL ||
         on_module_load_failed_method == NULL) {
         return 0;
@@ -336,6 +458,7 @@ int install_module_loader(JNIEnv *env, JSRuntime *runtime, Globals *globals, job
     globals->load_module_method = load_module_method;
     globals->get_module_source_method = get_module_source_method;
     globals->get_module_bytecode_method = get_module_bytecode_method;
+    globals->get_module_bytecode_buffer_method = get_module_bytecode_buffer_method;
     globals->on_module_compiled_method = on_module_compiled_method;
     globals->on_module_load_failed_method = on_module_load_failed_method;
     JS_SetModuleLoaderFunc(runtime, NULL, load_module, globals);
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+#include "name_set.h"
+
+#define NAME_SET_INITIAL_CAPACITY 16
+
+static uint32_t find_slot(const NameSetSlot *slots, uint32_t capacity,
+                          const char *name, size_t length, uint32_t hash) {
+    uint32_t mask = capacity - 1;
+    uint32_t index = hash & mask;
+    while (slots[index].name != NULL) {
+        const NameSetSlot *slot = &slots[index];
+        if (slot->hash == hash && slot->length == length &&
+            memcmp(slot->name, name, length) == 0) {
+            break;
+        }
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+static int grow(NameSet *set) {
+    uint32_t capacity = set->capacity == 0 ? NAME_SET_INITIAL_CAPACITY : set->capacity * 2;
+    NameSetSlot *slots = calloc(capacity, sizeof(NameSetSlot));
+    if (slots == NULL) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < set->capacity; i++) {
+        NameSetSlot *slot = &set->slots[i];
+        if (slot->name != NULL) {
+            slots[find_slot(slots, capacity, slot->name, slot->length, slot->hash)] = *slot;
+        }
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = capacity;
+    return 1;
+}
+
+void name_set_init(NameSet *set) {
+    set->slots = NULL;
+    set->capacity = 0;
+    set->size = 0;
+}
+
+int name_set_add(NameSet *set, const char *name, size_t length, uint32_t hash) {
+    if (name_set_contains(set, name, length, hash)) {
+        return 0;
+    }
+    // Keep the load factor under 1/2 so probe sequences stay short
+    if ((set->size + 1) * 2 > set->capacity && !grow(set)) {
+        return -1;
+    }
+    char *name_copy = malloc(length + 1);
+    if (name_copy == NULL) {
+        return -1;
+    }
+    memcpy(name_copy, name, length);
+    name_copy[length] = '\0';
+    NameSetSlot *slot = &set->slots[find_slot(set->slots, set->capacity, name, length, hash)];
+    slot->name = name_copy;
+    slot->length = (uint32_t) length;
+    slot->hash = hash;
+    set->size++;
+    return 1;
+}
+
+int name_set_contains(const NameSet *set, const char *name, size_t length, uint32_t hash) {
+    if (set->capacity == 0) {
+        return 0;
+    }
+    return set->slots[find_slot(set->slots, set->capacity, name, length, hash)].name != NULL;
+}
+
+void name_set_free(NameSet *set) {
+    for (uint32_t i = 0; i < set->capacity; i++) {
+        free(set->slots[i].name);
+    }
+    free(set->slots);
+    name_set_init(set);
+}
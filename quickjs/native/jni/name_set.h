@@ -0,0 +1,63 @@
+#ifndef QJS_KT_NAME_SET_H
+#define QJS_KT_NAME_SET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A name and its hash, the name is owned by the set.
+ */
+typedef struct {
+    char *name;
+    uint32_t length;
+    uint32_t hash;
+} NameSetSlot;
+
+/**
+ * An open addressing hash set of UTF-8 names, hashed by name_set_hash().
+ */
+typedef struct {
+    NameSetSlot *slots;
+    uint32_t capacity;
+    uint32_t size;
+} NameSet;
+
+/**
+ * 32-bit FNV-1a hash of a name, also stored in the module bundle table.
+ */
+static inline uint32_t name_set_hash(const char *name, size_t length) {
+    uint32_t hash = 0x811c9dc5;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t) name[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+/**
+ * Init an empty set, slots are allocated by the first add.
+ */
+void name_set_init(NameSet *set);
+
+/**
+ * Add a copy of the name to the set.
+ *
+ * @param name The name, not null-terminated.
+ * @param hash The name_set_hash() of the name.
+ * @return 1 if added, 0 if the name is already in the set, -1 if out of memory.
+ */
+int name_set_add(NameSet *set, const char *name, size_t length, uint32_t hash);
+
+/**
+ * Check if the name is in the set.
+ *
+ * @param name The name, not null-terminated.
+ * @param hash The name_set_hash() of the name.
+ */
+int name_set_contains(const NameSet *set, const char *name, size_t length, uint32_t hash);
+
+/**
+ * Free the names and the slots of the set.
+ */
+void name_set_free(NameSet *set);
+
+#endif //QJS_KT_NAME_SET_H
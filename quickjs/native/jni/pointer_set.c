@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pointer_set.h"
+
+static inline uint32_t hash_pointer(void *ptr) {
+    uint64_t h = (uint64_t) (uintptr_t) ptr;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return (uint32_t) h;
+}
+
+static uint32_t find_slot(void **slots, uint32_t capacity, void *ptr) {
+    uint32_t mask = capacity - 1;
+    uint32_t index = hash_pointer(ptr) & mask;
+    while (slots[index] != NULL && slots[index] != ptr) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+static int grow(PointerSet *set) {
+    uint32_t capacity = set->capacity * 2;
+    void **slots = calloc(capacity, sizeof(void *));
+    if (slots == NULL) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < set->capacity; i++) {
+        void *ptr = set->slots[i];
+        if (ptr != NULL) {
+            slots[find_slot(slots, capacity, ptr)] = ptr;
+        }
+    }
+    if (set->slots != set->inline_slots) {
+        free(set->slots);
+    }
+    set->slots = slots;
+    set->capacity = capacity;
+    return 1;
+}
+
+void pointer_set_init(PointerSet *set) {
+    memset(set->inline_slots, 0, sizeof(set->inline_slots));
+    set->slots = set->inline_slots;
+    set->capacity = POINTER_SET_INLINE_CAPACITY;
+    set->size = 0;
+}
+
+int pointer_set_add(PointerSet *set, void *ptr) {
+    uint32_t index = find_slot(set->slots, set->capacity, ptr);
+    if (set->slots[index] != NULL) {
+        return 0;
+    }
+    // Keep the load factor under 1/2 so probe sequences stay short
+    if ((set->size + 1) * 2 > set->capacity) {
+        if (!grow(set)) {
+            return -1;
+        }
+        index = find_slot(set->slots, set->capacity, ptr);
+    }
+    set->slots[index] = ptr;
+    set->size++;
+    return 1;
+}
+
+int pointer_set_contains(PointerSet *set, void *ptr) {
+    return set->slots[find_slot(set->slots, set->capacity, ptr)] != NULL;
+}
+
+void pointer_set_remove(PointerSet *set, void *ptr) {
+    uint32_t mask = set->capacity - 1;
+    uint32_t index = find_slot(set->slots, set->capacity, ptr);
+    if (set->slots[index] == NULL) {
+        return;
+    }
+    set->slots[index] = NULL;
+    set->size--;
+    // Shift the following entries back, so lookups never stop at the hole
+    uint32_t next = (index + 1) & mask;
+    while (set->slots[next] != NULL) {
+        uint32_t home = hash_pointer(set->slots[next]) & mask;
+        // Move the entry if the hole is between its home slot and its slot
+        if (((next - home) & mask) >= ((next - index) & mask)) {
+            set->slots[index] = set->slots[next];
+            set->slots[next] = NULL;
+            index = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+void pointer_set_free(PointerSet *set) {
+    if (set->slots != set->inline_slots) {
+        free(set->slots);
+    }
+    set->slots = set->inline_slots;
+    set->capacity = POINTER_SET_INLINE_CAPACITY;
+    set->size = 0;
+    memset(set->inline_slots, 0, sizeof(set->inline_slots));
+}
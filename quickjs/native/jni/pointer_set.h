@@ -0,0 +1,49 @@
+#ifndef QJS_KT_POINTER_SET_H
+#define QJS_KT_POINTER_SET_H
+
+#include <stdint.h>
+
+#define POINTER_SET_INLINE_CAPACITY 16
+
+/**
+ * An open addressing hash set of non-NULL pointers.
+ *
+ * Small sets live in the inline slots, so the set must not be copied once it
+ * has been initialized.
+ */
+typedef struct {
+    void **slots;
+    uint32_t capacity;
+    uint32_t size;
+    void *inline_slots[POINTER_SET_INLINE_CAPACITY];
+} PointerSet;
+
+/**
+ * Init an empty set.
+ */
+void pointer_set_init(PointerSet *set);
+
+/**
+ * Add a pointer to the set.
+ *
+ * @return 1 if added, 0 if the pointer is already in the set, -1 if out of
+ * memory.
+ */
+int pointer_set_add(PointerSet *set, void *ptr);
+
+/**
+ * Check if the pointer is in the set.
+ */
+int pointer_set_contains(PointerSet *set, void *ptr);
+
+/**
+ * Remove a pointer from the set, does nothing if it's not in the set.
+ */
+void pointer_set_remove(PointerSet *set, void *ptr);
+
+/**
+ * Free the slots of the set.
+ */
+void pointer_set_free(PointerSet *set);
+
+#endif //QJS_KT_POINTER_SET_H
@@ -3,6 +3,7 @@
 #include "jni_globals.h"
 #include "jni_globals_generated.h"
 #include "js_value_to_jobject.h"
+#include "context_data.h"
 
 void promise_rejection_handler(JSContext *ctx, JSValue promise,
                                JSValue reason,
@@ -11,7 +12,16 @@ void promise_rejection_handler(JSContext *ctx, JSValue promise,
     if (env == NULL) {
         return;
     }
-    jobject host = (jobject) opaque;
+    if (context_is_released(ctx)) {
+        // Jobs left by a replaced or closed context
+        return;
+    }
+    // Realm contexts carry their own host, others report to the runtime owner
+    ContextData *data = context_data_get(ctx);
+    jobject host = data->realm_host;
+    if (host == NULL) {
+        host = (jobject) opaque;
+    }
     jlong promise_id = (jlong) (uintptr_t) JS_VALUE_GET_PTR(promise);
     if (!is_handled) {
         (*env)->CallVoidMethod(env, host,
@@ -1,4 +1,6 @@
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
 #include "jni.h"
 #include "quickjs.h"
 #include "quickjs_jni.h"
@@ -10,10 +12,14 @@
 #include "js_value_to_jobject.h"
 #include "jobject_to_js_value.h"
 #include "js_value_util.h"
+#include "context_data.h"
 #include "quickjs_version.h"
 #include "quickjs_interrupt.h"
+#include "quickjs_slab_allocator.h"
+#include "module_cache.h"
 #include "promise_rejection_handler.h"
 #include "module_loader.h"
+#include "module_bundle.h"
 
 JSRuntime *runtime_from_ptr(JNIEnv *env, jlong ptr) {
     if (ptr == 0) {
@@ -63,6 +69,7 @@ static void release_failed_globals_init(JNIEnv *env,
         cvector_free(global_object_refs);
     }
 
+    free(globals->shared_module_cache_namespace);
     pthread_mutex_destroy(&globals->js_mutex);
     clear_java_vm_cache();
     if (get_qjs_instance_count() <= 0) {
@@ -89,19 +96,22 @@ JNIEXPORT jlong JNICALL Java_com_dokar_quickjs_QuickJs_initGlobals(JNIEnv *env,
         return 0;
     }
 
-    globals->managed_js_values = NULL;
-    globals->defined_js_objects = NULL;
     globals->global_object_refs = NULL;
-    globals->created_js_functions = NULL;
-    globals->evaluate_result_promises = NULL;
-    globals->evaluate_result_active = NULL;
+    handle_table_init(&globals->promise_capabilities);
+    handle_table_init(&globals->evaluate_results);
+    handle_table_init(&globals->function_refs);
     globals->module_loader_host = NULL;
     globals->load_module_method = NULL;
     globals->get_module_source_method = NULL;
     globals->get_module_bytecode_method = NULL;
+    globals->get_module_bytecode_buffer_method = NULL;
     globals->on_module_compiled_method = NULL;
     globals->on_module_load_failed_method = NULL;
     globals->module_load_failure_version = 0;
+    globals->use_shared_module_cache = 0;
+    globals->shared_module_cache_namespace = NULL;
+    globals->strip_flags = 0;
+    globals->resolving_module_graph = 0;
 
     pthread_mutexattr_t mutex_attributes;
     pthread_mutexattr_init(&mutex_attributes);
@@ -178,13 +188,51 @@ JNIEXPORT jlong JNICALL Java_com_dokar_quickjs_QuickJs_initGlobals(JNIEnv *env,
 /**
  * Create a new QuickJS JavaScript runtime.
  *
+ * @param allocator_ptr The slab allocator pointer, or 0 to use the system allocator.
  * @return Runtime pointer.
  */
-JNIEXPORT jlong JNICALL Java_com_dokar_quickjs_QuickJs_newRuntime(JNIEnv *env, jobject this) {
-    JSRuntime *runtime = JS_NewRuntime();
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_QuickJs_newRuntime(JNIEnv *env, jobject this, jlong allocator_ptr) {
+    JSRuntime *runtime;
+    if (allocator_ptr != 0) {
+        runtime = qjs_slab_new_runtime((void *) allocator_ptr);
+    } else {
+        runtime = JS_NewRuntime();
+    }
     return (jlong) runtime;
 }
 
+/**
+ * Create a slab allocator for a new runtime.
+ *
+ * @return Allocator pointer.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_QuickJs_newSlabAllocator(JNIEnv *env, jobject this) {
+    void *allocator = qjs_slab_new();
+    if (allocator == NULL) {
+        jni_throw_qjs_exception(env, "Failed to create the slab allocator.");
+        return 0;
+    }
+    return (jlong) allocator;
+}
+
+/**
+ * Release the free chunks of a slab allocator.
+ */
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_QuickJs_trimSlabAllocator(JNIEnv *env, jobject this, jlong allocator_ptr) {
+    qjs_slab_trim((void *) allocator_ptr);
+}
+
+/**
+ * Free a slab allocator, the runtime using it must be released first.
+ */
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_QuickJs_freeSlabAllocator(JNIEnv *env, jobject this, jlong allocator_ptr) {
+    qjs_slab_free((void *) allocator_ptr);
+}
+
 /**
  * Create a new QuickJS JavaScript Context from the given runtime pointer.
  *
@@ -197,10 +245,85 @@ Java_com_dokar_quickjs_QuickJs_newContext(JNIEnv *env, jobject this, jlong runti
     if (runtime == NULL) {
         return 0;
     }
+    // The context data calls into JS
+    JS_UpdateStackTop(runtime);
+    JSContext *context = JS_NewContext(runtime);
+    if (context == NULL) {
+        jni_throw_qjs_exception(env, "Failed to create js context.");
+        return 0;
+    }
+    if (context_data_init(context, NULL) == NULL) {
+        JS_FreeContext(context);
+        jni_throw_qjs_exception(env, "Failed to create js context.");
+        return 0;
+    }
+    return (jlong) context;
+}
+
+/**
+ * Create a realm context on a runtime owned by another QuickJs instance.
+ *
+ * The realm host is stored in the context data, so runtime-wide callbacks like the
+ * promise rejection tracker can reach the realm instead of the runtime owner.
+ *
+ * @return Context pointer, or 0 with an exception thrown.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_QuickJs_newRealmContext(JNIEnv *env, jobject this, jlong runtime_ptr,
+                                               jlong globals_ptr) {
+    JSRuntime *runtime = runtime_from_ptr(env, runtime_ptr);
+    if (runtime == NULL) {
+        return 0;
+    }
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (globals == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&globals->js_mutex);
+    JS_UpdateStackTop(runtime);
     JSContext *context = JS_NewContext(runtime);
+    if (context == NULL) {
+        pthread_mutex_unlock(&globals->js_mutex);
+        jni_throw_qjs_exception(env, "Failed to create js context.");
+        return 0;
+    }
+    jobject realm_host_ref = (*env)->NewGlobalRef(env, this);
+    if (realm_host_ref == NULL) {
+        JS_FreeContext(context);
+        pthread_mutex_unlock(&globals->js_mutex);
+        jni_throw_qjs_exception(env, "Cannot allocate realm host reference.");
+        return 0;
+    }
+    if (context_data_init(context, realm_host_ref) == NULL) {
+        (*env)->DeleteGlobalRef(env, realm_host_ref);
+        JS_FreeContext(context);
+        pthread_mutex_unlock(&globals->js_mutex);
+        jni_throw_qjs_exception(env, "Failed to create js context.");
+        return 0;
+    }
+    pthread_mutex_unlock(&globals->js_mutex);
+
     return (jlong) context;
 }
 
+/**
+ * Release a realm context created by newRealmContext.
+ *
+ * The values and host refs of the realm bindings live in the context data, so they
+ * are released with the realm instead of the runtime owner.
+ */
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_QuickJs_releaseRealmContext(JNIEnv *env, jobject this,
+                                                   jlong context_ptr) {
+    if (context_ptr == 0) {
+        return;
+    }
+    JSContext *context = (JSContext *) context_ptr;
+    context_data_free(env, context);
+    JS_FreeContext(context);
+}
+
 /**
  * Release globals.
  */
@@ -218,35 +341,7 @@ Java_com_dokar_quickjs_QuickJs_releaseGlobals(JNIEnv *env, jobject this, jlong c
 
     Globals *globals = globals_from_ptr(env, globals_ptr);
 
-    cvector_vector_type(JSValue)created_js_functions = globals->created_js_functions;
-    if (created_js_functions != NULL) {
-        size_t size = cvector_size(created_js_functions);
-        for (uint32_t i = 0; i < size; i++) {
-            JSValue item = created_js_functions[i];
-            JS_FreeValue(context, item);
-        }
-        cvector_free(created_js_functions);
-    }
-
-    // Check and free js values that are used by bindings
-    cvector_vector_type(JSValue)managed_js_values = globals->managed_js_values;
-    if (managed_js_values != NULL) {
-        size_t size = cvector_size(managed_js_values);
-        for (uint32_t i = 0; i < size; i++) {
-            JSValue value = managed_js_values[i];
-            JS_FreeValue(context, value);
-        }
-        cvector_free(managed_js_values);
-    }
-
-    cvector_vector_type(JSValue)defined_js_objects = globals->defined_js_objects;
-    if (defined_js_objects != NULL) {
-        size_t size = cvector_size(defined_js_objects);
-        for (uint32_t i = 0; i < size; i++) {
-            JS_FreeValue(context, defined_js_objects[i]);
-        }
-        cvector_free(defined_js_objects);
-    }
+    handle_table_free(context, &globals->promise_capabilities);
 
     // Check and free global jni object refs
     cvector_vector_type(jobject)global_object_refs = globals->global_object_refs;
@@ -259,15 +354,10 @@ Java_com_dokar_quickjs_QuickJs_releaseGlobals(JNIEnv *env, jobject this, jlong c
     }
 
     // Free result promises even if their evaluations were cancelled.
-    cvector_vector_type(JSValue)evaluate_result_promises = globals->evaluate_result_promises;
-    if (evaluate_result_promises != NULL) {
-        size_t size = cvector_size(evaluate_result_promises);
-        for (uint32_t i = 0; i < size; i++) {
-            JS_FreeValue(context, evaluate_result_promises[i]);
-        }
-        cvector_free(evaluate_result_promises);
-    }
-    cvector_free(globals->evaluate_result_active);
+    handle_table_free(context, &globals->evaluate_results);
+    handle_table_free(context, &globals->function_refs);
+
+    free(globals->shared_module_cache_namespace);
 
     // Destroy js mutex
     pthread_mutex_destroy(&globals->js_mutex);
@@ -291,7 +381,86 @@ Java_com_dokar_quickjs_QuickJs_releaseContext(JNIEnv *env, jobject this, jlong c
         return;
     }
     JSContext *context = context_from_ptr(env, context_ptr);
+    context_data_free(env, context);
+    JS_FreeContext(context);
+}
+
+#define RESET_MAX_DRAINED_JOBS 100000
+
+/**
+ * Replace the context with a fresh one on the same runtime.
+ *
+ * The old context is marked as released first, so its bindings throw instead of
+ * calling into Kotlin, then at most RESET_MAX_DRAINED_JOBS pending jobs are
+ * executed to let them settle. The caller should request an interrupt, so job
+ * loops that never end are aborted. Jobs left after the budget keep the old
+ * context alive until they run, they can no longer reach the bindings. The
+ * bindings are released with the old context data, the globals struct is reused.
+ *
+ * @return The new context pointer, or 0 with an exception thrown.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_QuickJs_resetContext(JNIEnv *env, jobject this, jlong runtime_ptr,
+                                            jlong context_ptr, jlong globals_ptr) {
+    JSRuntime *runtime = runtime_from_ptr(env, runtime_ptr);
+    if (runtime == NULL) {
+        return 0;
+    }
+    JSContext *context = context_from_ptr(env, context_ptr);
+    if (context == NULL) {
+        return 0;
+    }
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (globals == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&globals->js_mutex);
+    JS_UpdateStackTop(runtime);
+
+    JSContext *new_context = JS_NewContext(runtime);
+    if (new_context == NULL) {
+        pthread_mutex_unlock(&globals->js_mutex);
+        jni_throw_qjs_exception(env, "Failed to create js context.");
+        return 0;
+    }
+    ContextData *new_context_data = context_data_init(new_context, NULL);
+    if (new_context_data == NULL) {
+        JS_FreeContext(new_context);
+        pthread_mutex_unlock(&globals->js_mutex);
+        jni_throw_qjs_exception(env, "Failed to create js context.");
+        return 0;
+    }
+    new_context_data->map_typed_arrays = context_maps_typed_arrays(context);
+
+    // Jobs still queued for the old context must not call into bindings
+    ContextData *context_data = context_data_get(context);
+    if (context_data != NULL) {
+        context_data->released = 1;
+    }
+    JSContext *job_context;
+    for (int i = 0; i < RESET_MAX_DRAINED_JOBS; i++) {
+        int job_ret = JS_ExecutePendingJob(runtime, &job_context);
+        if (job_ret == 0) {
+            break;
+        }
+        if (job_ret < 0 && job_context != NULL) {
+            // Errors of discarded jobs are dropped together with their context
+            JS_FreeValue(job_context, JS_GetException(job_context));
+        }
+    }
+
+    handle_table_clear(context, &globals->promise_capabilities);
+    handle_table_clear(context, &globals->evaluate_results);
+    handle_table_clear(context, &globals->function_refs);
+
+    // Frees the values and host refs of the bindings
+    context_data_free(env, context);
     JS_FreeContext(context);
+
+    pthread_mutex_unlock(&globals->js_mutex);
+
+    return (jlong) new_context;
 }
 
 /**
@@ -325,13 +494,19 @@ Java_com_dokar_quickjs_QuickJs_defineObject(JNIEnv *env, jobject this,
     if (context == NULL) {
         return -1;
     }
+    ContextData *context_data = context_data_get(context);
+    if (context_data == NULL) {
+        jni_throw_qjs_exception(env, "Cannot define bindings in this context.");
+        return -1;
+    }
     int64_t parent_index = parent;
-    uint32_t defined_size = cvector_size(globals->defined_js_objects);
+    uint32_t defined_size = cvector_size(context_data->defined_js_objects);
     if (parent_index >= defined_size) {
         jni_throw_qjs_exception(env, "Parent handle out of the bounds.");
         return -1;
     }
-    JSValue *parent_val = parent_index < 0 ? NULL : &globals->defined_js_objects[parent_index];
+    JSValue *parent_val = parent_index < 0 ? NULL
+                                           : &context_data->defined_js_objects[parent_index];
     // The global js value index
     int64_t handle = defined_size;
     JSValue result = define_js_object(env,
@@ -348,7 +523,7 @@ Java_com_dokar_quickjs_QuickJs_defineObject(JNIEnv *env, jobject this,
         return -1;
     }
     // Insert at the target index
-    cvector_push_back(globals->defined_js_objects, result);
+    cvector_push_back(context_data->defined_js_objects, result);
     // Return the handle
     return handle;
 }
@@ -370,6 +545,10 @@ Java_com_dokar_quickjs_QuickJs_defineFunction(JNIEnv *env, jobject this,
     if (context == NULL) {
         return;
     }
+    if (context_data_get(context) == NULL) {
+        jni_throw_qjs_exception(env, "Cannot define bindings in this context.");
+        return;
+    }
     define_js_function(env, context, globals, this, name, is_async);
 }
 
@@ -390,7 +569,7 @@ Java_com_dokar_quickjs_QuickJs_gc(JNIEnv *env, jobject this, jlong runtime_ptr,
  * Get QuickJS version.
  */
 JNIEXPORT jstring JNICALL
-Java_com_dokar_quickjs_QuickJs_nativeGetVersion(JNIEnv *env, jobject this) {
+Java_com_dokar_quickjs_QuickJs_nativeGetVersion(JNIEnv *env, jclass clazz) {
     return (*env)->NewStringUTF(env, quickjs_version());
 }
 
@@ -430,6 +609,112 @@ Java_com_dokar_quickjs_QuickJs_setMaxStackSize(JNIEnv *env, jobject this, jlong
     pthread_mutex_unlock(&globals->js_mutex);
 }
 
+/**
+ * Set the debug info to strip from functions compiled afterward.
+ */
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_QuickJs_setStripInfo(JNIEnv *env, jobject this, jlong runtime_ptr,
+                                            jlong globals_ptr,
+                                            jint flags) {
+    JSRuntime *runtime = runtime_from_ptr(env, runtime_ptr);
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+
+    pthread_mutex_lock(&globals->js_mutex);
+
+    JS_SetStripInfo(runtime, flags);
+    globals->strip_flags = flags;
+
+    pthread_mutex_unlock(&globals->js_mutex);
+}
+
+/**
+ * Set the namespace the runtime reads modules from and adds modules to in the shared module
+ * cache, a null namespace disables the cache.
+ */
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_QuickJs_setSharedModuleCache(JNIEnv *env, jobject this,
+                                                    jlong globals_ptr,
+                                                    jstring namespace) {
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+
+    char *namespace_copy = NULL;
+    if (namespace != NULL) {
+        const char *chars = (*env)->GetStringUTFChars(env, namespace, NULL);
+        if (chars == NULL) {
+            return;
+        }
+        namespace_copy = strdup(chars);
+        (*env)->ReleaseStringUTFChars(env, namespace, chars);
+        if (namespace_copy == NULL) {
+            jni_throw_qjs_exception(env, "Cannot allocate the module cache namespace.");
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&globals->js_mutex);
+    free(globals->shared_module_cache_namespace);
+    globals->shared_module_cache_namespace = namespace_copy;
+    globals->use_shared_module_cache = namespace_copy != NULL;
+    pthread_mutex_unlock(&globals->js_mutex);
+}
+
+/**
+ * Set whether the context maps primitive arrays to typed arrays.
+ */
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_QuickJs_setTypedArrayMapping(JNIEnv *env, jobject this, jlong context_ptr,
+                                                    jlong globals_ptr,
+                                                    jboolean enabled) {
+    JSContext *context = context_from_ptr(env, context_ptr);
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (context == NULL || globals == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&globals->js_mutex);
+    ContextData *data = context_data_get(context);
+    if (data != NULL) {
+        data->map_typed_arrays = enabled == JNI_TRUE;
+    }
+    pthread_mutex_unlock(&globals->js_mutex);
+}
+
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_SharedModuleCache_nativeRemove(JNIEnv *env, jclass clazz, jstring name) {
+    const char *module_name = (*env)->GetStringUTFChars(env, name, NULL);
+    if (module_name == NULL) {
+        return;
+    }
+    module_cache_remove(module_name);
+    (*env)->ReleaseStringUTFChars(env, name, module_name);
+}
+
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_SharedModuleCache_nativeClear(JNIEnv *env, jclass clazz) {
+    module_cache_clear();
+}
+
+JNIEXPORT jint JNICALL
+Java_com_dokar_quickjs_SharedModuleCache_nativeCount(JNIEnv *env, jclass clazz) {
+    return (jint) module_cache_count();
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_SharedModuleCache_nativeBytes(JNIEnv *env, jclass clazz) {
+    return (jlong) module_cache_bytes();
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_SharedModuleCache_nativeGetMaxBytes(JNIEnv *env, jclass clazz) {
+    return (jlong) module_cache_max_bytes();
+}
+
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_SharedModuleCache_nativeSetMaxBytes(JNIEnv *env, jclass clazz,
+                                                         jlong max_bytes) {
+    module_cache_set_max_bytes((size_t) max_bytes);
+}
+
 /**
  * Register the interrupt handler, returns the state handle.
  */
@@ -559,7 +844,7 @@ jobject handle_eval_result(JNIEnv *env,
 }
 
 /**
- * Validate and store an evaluation result promise, returning its stable index.
+ * Validate and store an evaluation result promise, returning its handle.
  */
 jlong store_evaluate_result(JNIEnv *env,
                             JSContext *context,
@@ -580,25 +865,28 @@ jlong store_evaluate_result(JNIEnv *env,
     }
 
     pthread_mutex_lock(&globals->js_mutex);
-    size_t size = cvector_size(globals->evaluate_result_promises);
-    jlong handle = -1;
-    for (uint32_t i = 0; i < size; i++) {
-        if (!globals->evaluate_result_active[i]) {
-            handle = (jlong) i;
-            globals->evaluate_result_promises[i] = value;
-            globals->evaluate_result_active[i] = 1;
-            break;
-        }
-    }
+    jlong handle = handle_table_add(&globals->evaluate_results, &value, 1);
     if (handle < 0) {
-        handle = (jlong) size;
-        cvector_push_back(globals->evaluate_result_promises, value);
-        cvector_push_back(globals->evaluate_result_active, 1);
+        JS_FreeValue(context, value);
+        jni_throw_qjs_exception(env, "Too many pending evaluations.");
     }
     pthread_mutex_unlock(&globals->js_mutex);
     return handle;
 }
 
+/**
+ * Get the slot of an evaluation handle, js_mutex must be locked.
+ *
+ * @return NULL and throw if the handle is invalid or has been released.
+ */
+static HandleSlot *evaluate_result_slot(JNIEnv *env, Globals *globals, jlong handle) {
+    HandleSlot *slot = handle_table_get(&globals->evaluate_results, handle);
+    if (slot == NULL) {
+        jni_throw_qjs_exception(env, "Invalid evaluation handle: %ld", handle);
+    }
+    return slot;
+}
+
 jobject eval(JNIEnv *env, jlong context_ptr,
              jlong globals_ptr,
              jstring jfilename,
@@ -647,6 +935,104 @@ jobject eval(JNIEnv *env, jlong context_ptr,
     return handle_eval_result(env, context, globals, value, async);
 }
 
+/**
+ * Get UTF-8 source bytes from a byte array or a direct buffer as a zero-terminated string,
+ * which JS_Eval() requires.
+ *
+ * The memory of a direct buffer is used in place when the byte after the source is already
+ * zero. Otherwise, the bytes are copied once into a new allocation, a byte array can't stay
+ * pinned while the code calls back into the JVM.
+ *
+ * @param owned Set to the copy that must be freed, NULL if the source is used in place.
+ * @return NULL and throw if the source can't be read.
+ */
+static const char *read_utf8_source(JNIEnv *env,
+                                    jbyteArray jarray,
+                                    jobject jbuffer,
+                                    jint offset,
+                                    jint length,
+                                    char **owned) {
+    *owned = NULL;
+
+    const char *address = NULL;
+    jlong capacity;
+    if (jbuffer != NULL) {
+        address = (*env)->GetDirectBufferAddress(env, jbuffer);
+        capacity = (*env)->GetDirectBufferCapacity(env, jbuffer);
+        if (address == NULL || capacity < 0) {
+            jni_throw_qjs_exception(env, "Source buffer is not a direct buffer.");
+            return NULL;
+        }
+    } else {
+        capacity = (*env)->GetArrayLength(env, jarray);
+    }
+
+    if (offset < 0 || length < 0 || (jlong) offset + length > capacity) {
+        jni_throw_qjs_exception(env, "Invalid source range: offset %d, length %d.",
+                                offset, length);
+        return NULL;
+    }
+
+    if (address != NULL && (jlong) offset + length < capacity
+        && address[offset + length] == '\0') {
+        return address + offset;
+    }
+
+    char *copy = malloc((size_t) length + 1);
+    if (copy == NULL) {
+        jni_throw_qjs_exception(env, "Cannot allocate source buffer.");
+        return NULL;
+    }
+    if (address != NULL) {
+        memcpy(copy, address + offset, length);
+    } else {
+        (*env)->GetByteArrayRegion(env, jarray, offset, length, (jbyte *) copy);
+        if ((*env)->ExceptionCheck(env)) {
+            free(copy);
+            return NULL;
+        }
+    }
+    copy[length] = '\0';
+    *owned = copy;
+    return copy;
+}
+
+/**
+ * Run JS_Eval() on UTF-8 source bytes.
+ *
+ * @return JS_EXCEPTION with a pending Java exception if the source or filename can't be read.
+ */
+static JSValue eval_utf8_source(JNIEnv *env,
+                                JSContext *context,
+                                Globals *globals,
+                                jstring jfilename,
+                                jbyteArray jarray,
+                                jobject jbuffer,
+                                jint offset,
+                                jint length,
+                                int eval_flags) {
+    const char *filename = (*env)->GetStringUTFChars(env, jfilename, NULL);
+    if (filename == NULL) {
+        jni_throw_qjs_exception(env, "Cannot read filename.");
+        return JS_EXCEPTION;
+    }
+    char *owned;
+    const char *code = read_utf8_source(env, jarray, jbuffer, offset, length, &owned);
+    if (code == NULL) {
+        (*env)->ReleaseStringUTFChars(env, jfilename, filename);
+        return JS_EXCEPTION;
+    }
+
+    pthread_mutex_lock(&globals->js_mutex);
+    JS_UpdateStackTop(JS_GetRuntime(context));
+    JSValue value = JS_Eval(context, code, (size_t) length, filename, eval_flags);
+    pthread_mutex_unlock(&globals->js_mutex);
+
+    free(owned);
+    (*env)->ReleaseStringUTFChars(env, jfilename, filename);
+    return value;
+}
+
 /**
  * Compile JavaScript code to bytecode.
  */
@@ -668,17 +1054,49 @@ Java_com_dokar_quickjs_QuickJs_compile(JNIEnv *env, jobject this, jlong context_
 }
 
 /**
- * Resolves an ES module graph in a temporary context without evaluating it.
- *
- * A fresh context ensures every static dependency reaches the runtime loader,
- * even when the main context already contains modules with the same names.
+ * Compile UTF-8 encoded JavaScript code from a byte array or a direct buffer to bytecode.
  */
-JNIEXPORT jstring JNICALL
-Java_com_dokar_quickjs_QuickJs_resolveModuleGraphBytecode(JNIEnv *env,
-                                                         jobject this,
-                                                         jlong runtime_ptr,
-                                                         jlong globals_ptr,
-                                                         jbyteArray jbuffer) {
+JNIEXPORT jbyteArray JNICALL
+Java_com_dokar_quickjs_QuickJs_compileUtf8(JNIEnv *env,
+                                           jobject this,
+                                           jlong context_ptr,
+                                           jlong globals_ptr,
+                                           jstring jfilename,
+                                           jbyteArray jarray,
+                                           jobject jbuffer,
+                                           jint offset,
+                                           jint length,
+                                           jboolean as_module) {
+    int eval_flags = JS_EVAL_FLAG_COMPILE_ONLY | JS_EVAL_FLAG_ASYNC;
+    if (as_module) {
+        eval_flags |= JS_EVAL_TYPE_MODULE;
+    }
+    JSContext *context = context_from_ptr(env, context_ptr);
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (context == NULL || globals == NULL) {
+        return NULL;
+    }
+    JSValue value = eval_utf8_source(env, context, globals, jfilename, jarray, jbuffer,
+                                     offset, length, eval_flags);
+    if ((*env)->ExceptionCheck(env)) {
+        JS_FreeValue(context, value);
+        return NULL;
+    }
+    return handle_eval_result(env, context, globals, value, 1);
+}
+
+/**
+ * Resolves an ES module graph in a temporary context without evaluating it.
+ *
+ * A fresh context ensures every static dependency reaches the runtime loader,
+ * even when the main context already contains modules with the same names.
+ */
+JNIEXPORT jstring JNICALL
+Java_com_dokar_quickjs_QuickJs_resolveModuleGraphBytecode(JNIEnv *env,
+                                                         jobject this,
+                                                         jlong runtime_ptr,
+                                                         jlong globals_ptr,
+                                                         jbyteArray jbuffer) {
     JSRuntime *runtime = runtime_from_ptr(env, runtime_ptr);
     Globals *globals = globals_from_ptr(env, globals_ptr);
     if (runtime == NULL || globals == NULL) {
@@ -696,6 +1114,8 @@ Java_com_dokar_quickjs_QuickJs_resolveModuleGraphBytecode(JNIEnv *env,
     }
 
     pthread_mutex_lock(&globals->js_mutex);
+    // The context data calls into JS
+    JS_UpdateStackTop(runtime);
     JSContext *context = JS_NewContext(runtime);
     if (context == NULL) {
         (*env)->ReleaseByteArrayElements(env, jbuffer, buffer, JNI_ABORT);
@@ -703,7 +1123,14 @@ Java_com_dokar_quickjs_QuickJs_resolveModuleGraphBytecode(JNIEnv *env,
         jni_throw_qjs_exception(env, "Cannot create module graph context.");
         return NULL;
     }
-    JS_UpdateStackTop(runtime);
+    // Module loading and value mapping read the context data like in other contexts
+    if (context_data_init(context, NULL) == NULL) {
+        JS_FreeContext(context);
+        (*env)->ReleaseByteArrayElements(env, jbuffer, buffer, JNI_ABORT);
+        pthread_mutex_unlock(&globals->js_mutex);
+        jni_throw_qjs_exception(env, "Cannot create module graph context.");
+        return NULL;
+    }
     JSValue entry = JS_ReadObject(
             context,
             (uint8_t *) buffer,
@@ -715,12 +1142,14 @@ Java_com_dokar_quickjs_QuickJs_resolveModuleGraphBytecode(JNIEnv *env,
         if (!check_js_context_exception(env, context)) {
             jni_throw_qjs_exception(env, "Cannot read ES module entry bytecode.");
         }
+        context_data_free(env, context);
         JS_FreeContext(context);
         pthread_mutex_unlock(&globals->js_mutex);
         return NULL;
     }
     if (JS_VALUE_GET_TAG(entry) != JS_TAG_MODULE) {
         JS_FreeValue(context, entry);
+        context_data_free(env, context);
         JS_FreeContext(context);
         pthread_mutex_unlock(&globals->js_mutex);
         jni_throw_qjs_exception(env, "Bytecode is not an ES module.");
@@ -735,6 +1164,7 @@ Java_com_dokar_quickjs_QuickJs_resolveModuleGraphBytecode(JNIEnv *env,
         if (!check_js_context_exception(env, context)) {
             jni_throw_qjs_exception(env, "Cannot read the ES module entry name.");
         }
+        context_data_free(env, context);
         JS_FreeContext(context);
         pthread_mutex_unlock(&globals->js_mutex);
         return NULL;
@@ -744,23 +1174,30 @@ Java_com_dokar_quickjs_QuickJs_resolveModuleGraphBytecode(JNIEnv *env,
     JS_FreeCString(context, module_name);
     if (result == NULL) {
         JS_FreeValue(context, entry);
+        context_data_free(env, context);
         JS_FreeContext(context);
         pthread_mutex_unlock(&globals->js_mutex);
         return NULL;
     }
 
-    if (JS_ResolveModule(context, entry) < 0) {
+    // Cache hits don't reach the Kotlin loader, which collects the modules of the graph
+    globals->resolving_module_graph = 1;
+    int resolve_result = JS_ResolveModule(context, entry);
+    globals->resolving_module_graph = 0;
+    if (resolve_result < 0) {
         JS_FreeValue(context, entry);
         (*env)->DeleteLocalRef(env, result);
         if (!check_js_context_exception(env, context)) {
             jni_throw_qjs_exception(env, "Cannot resolve ES module entry bytecode.");
         }
+        context_data_free(env, context);
         JS_FreeContext(context);
         pthread_mutex_unlock(&globals->js_mutex);
         return NULL;
     }
 
     JS_FreeValue(context, entry);
+    context_data_free(env, context);
     JS_FreeContext(context);
     pthread_mutex_unlock(&globals->js_mutex);
     return result;
@@ -809,33 +1246,52 @@ Java_com_dokar_quickjs_QuickJs_evaluate(JNIEnv *env,
 }
 
 /**
- * Evaluate compiled bytecode.
+ * Evaluate UTF-8 encoded JavaScript code from a byte array or a direct buffer.
  */
 JNIEXPORT jlong JNICALL
-Java_com_dokar_quickjs_QuickJs_evaluateBytecode(JNIEnv *env, jobject this, jlong context_ptr,
-                                                jlong globals_ptr,
-                                                jbyteArray jbuffer) {
+Java_com_dokar_quickjs_QuickJs_evaluateUtf8(JNIEnv *env,
+                                            jobject this,
+                                            jlong context_ptr,
+                                            jlong globals_ptr,
+                                            jstring jfilename,
+                                            jbyteArray jarray,
+                                            jobject jbuffer,
+                                            jint offset,
+                                            jint length,
+                                            jboolean as_module) {
+    int eval_flags = JS_EVAL_FLAG_ASYNC;
+    eval_flags |= as_module ? JS_EVAL_TYPE_MODULE : JS_EVAL_TYPE_GLOBAL;
     JSContext *context = context_from_ptr(env, context_ptr);
-    if (context == NULL) {
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (context == NULL || globals == NULL) {
         return -1;
     }
-
-    Globals *globals = globals_from_ptr(env, globals_ptr);
-    if (globals == NULL) {
+    JSValue value = eval_utf8_source(env, context, globals, jfilename, jarray, jbuffer,
+                                     offset, length, eval_flags);
+    if ((*env)->ExceptionCheck(env)) {
+        JS_FreeValue(context, value);
         return -1;
     }
+    return store_evaluate_result(env, context, globals, value);
+}
 
-    jlong buf_len = (*env)->GetArrayLength(env, jbuffer);
-    jbyte *buffer = (*env)->GetByteArrayElements(env, jbuffer, NULL);
-
+/**
+ * Read bytecode, resolve its module graph if it's a module, and evaluate it.
+ *
+ * JS_ReadObject() copies what it needs, the buffer can be released once this returns.
+ */
+static jlong eval_bytecode(JNIEnv *env,
+                           JSContext *context,
+                           Globals *globals,
+                           const uint8_t *buffer,
+                           size_t buf_len) {
     pthread_mutex_lock(&globals->js_mutex);
 
     JS_UpdateStackTop(JS_GetRuntime(context));
 
     // Read buffer
-    JSValue bytecode = JS_ReadObject(context, (uint8_t *) buffer, buf_len, JS_READ_OBJ_BYTECODE | JS_READ_OBJ_REFERENCE);
+    JSValue bytecode = JS_ReadObject(context, buffer, buf_len, JS_READ_OBJ_BYTECODE | JS_READ_OBJ_REFERENCE);
     if (JS_IsException(bytecode)) {
-        (*env)->ReleaseByteArrayElements(env, jbuffer, buffer, JNI_ABORT);
         if (!check_js_context_exception(env, context)) {
             jni_throw_qjs_exception(env, "Cannot read buffer as bytecode.");
         }
@@ -847,7 +1303,6 @@ Java_com_dokar_quickjs_QuickJs_evaluateBytecode(JNIEnv *env, jobject this, jlong
     // before evaluation so QuickJS never observes null dependency pointers.
     if (JS_VALUE_GET_TAG(bytecode) == JS_TAG_MODULE &&
         JS_ResolveModule(context, bytecode) < 0) {
-        (*env)->ReleaseByteArrayElements(env, jbuffer, buffer, JNI_ABORT);
         JS_FreeValue(context, bytecode);
         if (!check_js_context_exception(env, context)) {
             jni_throw_qjs_exception(env, "Cannot resolve module bytecode.");
@@ -859,176 +1314,713 @@ Java_com_dokar_quickjs_QuickJs_evaluateBytecode(JNIEnv *env, jobject this, jlong
     // Eval
     JSValue value = JS_EvalFunction(context, bytecode);
 
-    (*env)->ReleaseByteArrayElements(env, jbuffer, buffer, JNI_ABORT);
-
     pthread_mutex_unlock(&globals->js_mutex);
 
     return store_evaluate_result(env, context, globals, value);
 }
 
 /**
- * Call a JavaScript function.
- *
- * Promise resolve() and reject() handles are passed as the first two parameters to onCallFunction.
- * Other functions not currently supported.
+ * Evaluate compiled bytecode.
  */
-JNIEXPORT void JNICALL
-Java_com_dokar_quickjs_QuickJs_invokeJsFunction(JNIEnv *env,
-                                                jobject this,
-                                                jlong context_ptr,
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_QuickJs_evaluateBytecode(JNIEnv *env, jobject this, jlong context_ptr,
                                                 jlong globals_ptr,
-                                                jlong handle,
-                                                jobjectArray args) {
+                                                jbyteArray jbuffer) {
     JSContext *context = context_from_ptr(env, context_ptr);
     if (context == NULL) {
-        return;
+        return -1;
     }
 
-    if (handle < 0) {
-        jni_throw_qjs_exception(env, "Invalid handle: %ld", handle);
-        return;
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (globals == NULL) {
+        return -1;
+    }
+
+    jlong buf_len = (*env)->GetArrayLength(env, jbuffer);
+    jbyte *buffer = (*env)->GetByteArrayElements(env, jbuffer, NULL);
+    if (buffer == NULL) {
+        if (!(*env)->ExceptionCheck(env)) {
+            jni_throw_qjs_exception(env, "Cannot read bytecode.");
+        }
+        return -1;
     }
 
+    jlong handle = eval_bytecode(env, context, globals, (uint8_t *) buffer, buf_len);
+
+    (*env)->ReleaseByteArrayElements(env, jbuffer, buffer, JNI_ABORT);
+
+    return handle;
+}
+
+/**
+ * Evaluate compiled bytecode in place from a direct buffer, such as a memory-mapped file.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_QuickJs_evaluateBytecodeBuffer(JNIEnv *env,
+                                                      jobject this,
+                                                      jlong context_ptr,
+                                                      jlong globals_ptr,
+                                                      jobject jbuffer,
+                                                      jint offset,
+                                                      jint length) {
+    JSContext *context = context_from_ptr(env, context_ptr);
     Globals *globals = globals_from_ptr(env, globals_ptr);
-    if (globals == NULL) {
-        return;
+    if (context == NULL || globals == NULL) {
+        return -1;
     }
 
-    if (globals->created_js_functions == NULL) {
-        jni_throw_qjs_exception(env, "Function not found.");
-        return;
+    const uint8_t *address = (*env)->GetDirectBufferAddress(env, jbuffer);
+    jlong capacity = (*env)->GetDirectBufferCapacity(env, jbuffer);
+    if (address == NULL || capacity < 0) {
+        jni_throw_qjs_exception(env, "Bytecode buffer is not a direct buffer.");
+        return -1;
+    }
+    if (offset < 0 || length < 0 || (jlong) offset + length > capacity) {
+        jni_throw_qjs_exception(env, "Invalid bytecode range: offset %d, length %d.",
+                                offset, length);
+        return -1;
     }
 
-    size_t size = cvector_size(globals->created_js_functions);
-    uint64_t index = (uint64_t) handle;
-    if (index >= size) {
-        jni_throw_qjs_exception(env, "Invalid handle: %ld", handle);
-        return;
+    return eval_bytecode(env, context, globals, address + offset, (size_t) length);
+}
+
+/**
+ * Evaluate the entry of a module bundle, after reading every other bundled module into the
+ * context in the same call.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_QuickJs_evaluateBundle(JNIEnv *env,
+                                              jobject this,
+                                              jlong context_ptr,
+                                              jlong globals_ptr,
+                                              jbyteArray jbundle) {
+    JSContext *context = context_from_ptr(env, context_ptr);
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (context == NULL || globals == NULL) {
+        return -1;
     }
 
-    JSValue func = globals->created_js_functions[index];
-    if (!JS_IsFunction(context, func)) {
-        jni_throw_qjs_exception(env, "Can't get a valid function.");
-        return;
+    jsize bundle_length = (*env)->GetArrayLength(env, jbundle);
+    jbyte *bundle = (*env)->GetByteArrayElements(env, jbundle, NULL);
+    if (bundle == NULL) {
+        if (!(*env)->ExceptionCheck(env)) {
+            jni_throw_qjs_exception(env, "Cannot read module bundle.");
+        }
+        return -1;
     }
 
     pthread_mutex_lock(&globals->js_mutex);
-
     JS_UpdateStackTop(JS_GetRuntime(context));
+    const uint8_t *entry = NULL;
+    size_t entry_length = 0;
+    jlong handle = -1;
+    if (read_module_bundle(context, (uint8_t *) bundle, bundle_length, &entry, &entry_length)) {
+        handle = eval_bytecode(env, context, globals, entry, entry_length);
+    } else if (!check_js_context_exception(env, context)) {
+        jni_throw_qjs_exception(env, "Cannot read module bundle.");
+    }
+    pthread_mutex_unlock(&globals->js_mutex);
 
-    // Map args
-    int argc = args != NULL ? (*env)->GetArrayLength(env, args) : 0;
-    JSValue argv[argc];
-    for (int i = 0; i < argc; ++i) {
-        jobject element = (*env)->GetObjectArrayElement(env, args, i);
-        JSValue item = jobject_to_js_value(env, context, NULL, element);
-        if (JS_IsException(item)) {
-            // Mapping has failed, cleanup and return
-            for (int j = 0; j < i; ++j) {
-                JS_FreeValue(context, argv[j]);
+    (*env)->ReleaseByteArrayElements(env, jbundle, bundle, JNI_ABORT);
+    return handle;
+}
+
+/**
+ * Drain pending jobs and settle the result of a synchronous evaluation, js_mutex must be
+ * locked. A promise result is unwrapped once the jobs are drained.
+ *
+ * @param async_completion Whether the value is the completion promise of code compiled with
+ * the async eval flag.
+ * @return The settled value, or JS_EXCEPTION with an exception thrown.
+ */
+static JSValue settle_sync_result(JNIEnv *env,
+                                  JSContext *context,
+                                  JSValue value,
+                                  int async_completion) {
+    if (JS_IsException(value)) {
+        if (!check_js_context_exception(env, context)) {
+            jni_throw_qjs_exception(env, "Failed to evaluate.");
+        }
+        return JS_EXCEPTION;
+    }
+
+    JSRuntime *runtime = JS_GetRuntime(context);
+    JSContext *job_context;
+    int ret;
+    while ((ret = JS_ExecutePendingJob(runtime, &job_context)) != 0) {
+        if (ret < 0) {
+            JS_FreeValue(context, value);
+            if (!check_js_context_exception(env, job_context)) {
+                jni_throw_qjs_exception(env, "Failed to execute pending jobs.");
             }
-            (*env)->DeleteLocalRef(env, element);
+            return JS_EXCEPTION;
+        }
+    }
 
-            pthread_mutex_unlock(&globals->js_mutex);
+    if (!js_is_promise(context, value)) {
+        return value;
+    }
+    JSPromiseStateEnum state = JS_PromiseState(context, value);
+    if (state == JS_PROMISE_PENDING) {
+        JS_FreeValue(context, value);
+        jni_throw_qjs_exception(env, "The result promise is still pending, "
+                                     "use evaluate() to await async functions.");
+        return JS_EXCEPTION;
+    }
+    JSValue promise_result = state == JS_PROMISE_FULFILLED && async_completion
+                             ? js_promise_get_fulfilled_value(context, value)
+                             : JS_PromiseResult(context, value);
+    JS_FreeValue(context, value);
+    if (JS_IsException(promise_result)) {
+        if (!check_js_context_exception(env, context)) {
+            jni_throw_qjs_exception(env, "Failed to read the result promise.");
+        }
+        return JS_EXCEPTION;
+    }
+    if (state == JS_PROMISE_REJECTED) {
+        JS_Throw(context, promise_result);
+        check_js_context_exception(env, context);
+        return JS_EXCEPTION;
+    }
+    return promise_result;
+}
 
-            return;
+/**
+ * Settle and convert the result of a synchronous evaluation, js_mutex must be locked.
+ *
+ * @see settle_sync_result
+ */
+static jobject finish_sync_evaluation(JNIEnv *env,
+                                      JSContext *context,
+                                      JSValue value,
+                                      int async_completion) {
+    value = settle_sync_result(env, context, value, async_completion);
+    if (JS_IsException(value)) {
+        return NULL;
+    }
+    jobject result = js_value_to_jobject(env, context, value);
+    JS_FreeValue(context, value);
+    return result;
+}
+
+/**
+ * Evaluate JavaScript code, drain pending jobs and return the converted result.
+ */
+JNIEXPORT jobject JNICALL
+Java_com_dokar_quickjs_QuickJs_evaluateSync(JNIEnv *env,
+                                            jobject this,
+                                            jlong context_ptr,
+                                            jlong globals_ptr,
+                                            jstring jfilename,
+                                            jstring jcode,
+                                            jboolean as_module) {
+    int eval_flags = as_module ? JS_EVAL_TYPE_MODULE : JS_EVAL_TYPE_GLOBAL;
+    JSContext *context = context_from_ptr(env, context_ptr);
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (context == NULL || globals == NULL) {
+        return NULL;
+    }
+    const char *filename = (*env)->GetStringUTFChars(env, jfilename, NULL);
+    if (filename == NULL) {
+        jni_throw_qjs_exception(env, "Cannot read filename.");
+        return NULL;
+    }
+    const char *code = (*env)->GetStringUTFChars(env, jcode, NULL);
+    if (code == NULL) {
+        (*env)->ReleaseStringUTFChars(env, jfilename, filename);
+        jni_throw_qjs_exception(env, "Cannot read code.");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&globals->js_mutex);
+    JS_UpdateStackTop(JS_GetRuntime(context));
+    JSValue value = JS_Eval(context, code, strlen(code), filename, eval_flags);
+    (*env)->ReleaseStringUTFChars(env, jfilename, filename);
+    (*env)->ReleaseStringUTFChars(env, jcode, code);
+    jobject result = finish_sync_evaluation(env, context, value, 0);
+    pthread_mutex_unlock(&globals->js_mutex);
+
+    return result;
+}
+
+/**
+ * Evaluate compiled bytecode, drain pending jobs and return the converted result.
+ */
+JNIEXPORT jobject JNICALL
+Java_com_dokar_quickjs_QuickJs_evaluateBytecodeSync(JNIEnv *env,
+                                                    jobject this,
+                                                    jlong context_ptr,
+                                                    jlong globals_ptr,
+                                                    jbyteArray jbuffer) {
+    JSContext *context = context_from_ptr(env, context_ptr);
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (context == NULL || globals == NULL) {
+        return NULL;
+    }
+
+    jsize buf_len = (*env)->GetArrayLength(env, jbuffer);
+    jbyte *buffer = (*env)->GetByteArrayElements(env, jbuffer, NULL);
+    if (buffer == NULL) {
+        if (!(*env)->ExceptionCheck(env)) {
+            jni_throw_qjs_exception(env, "Cannot read bytecode.");
         }
-        argv[i] = item;
-        (*env)->DeleteLocalRef(env, element);
+        return NULL;
     }
 
-    JSValue result = JS_Call(context, func, JS_NULL, argc, argv);
+    pthread_mutex_lock(&globals->js_mutex);
+    JS_UpdateStackTop(JS_GetRuntime(context));
+    JSValue bytecode = JS_ReadObject(context, (uint8_t *) buffer, buf_len,
+                                     JS_READ_OBJ_BYTECODE | JS_READ_OBJ_REFERENCE);
+    (*env)->ReleaseByteArrayElements(env, jbuffer, buffer, JNI_ABORT);
+    if (!JS_IsException(bytecode) && JS_VALUE_GET_TAG(bytecode) == JS_TAG_MODULE &&
+        JS_ResolveModule(context, bytecode) < 0) {
+        JS_FreeValue(context, bytecode);
+        bytecode = JS_EXCEPTION;
+    }
+    JSValue value = JS_IsException(bytecode) ? bytecode : JS_EvalFunction(context, bytecode);
+    jobject result = finish_sync_evaluation(env, context, value, 1);
+    pthread_mutex_unlock(&globals->js_mutex);
 
-    // Free arguments
-    for (int i = 0; i < argc; ++i) {
-        JS_FreeValue(context, argv[i]);
+    return result;
+}
+
+/**
+ * Reference a function of the global object.
+ *
+ * @return The function handle, or -1 with an exception thrown.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_QuickJs_getFunction(JNIEnv *env,
+                                           jobject this,
+                                           jlong context_ptr,
+                                           jlong globals_ptr,
+                                           jstring jname) {
+    JSContext *context = context_from_ptr(env, context_ptr);
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (context == NULL || globals == NULL) {
+        return -1;
+    }
+    const char *name = (*env)->GetStringUTFChars(env, jname, NULL);
+    if (name == NULL) {
+        jni_throw_qjs_exception(env, "Cannot read function name.");
+        return -1;
     }
 
-    // Do nothing with the result
-    JS_FreeValue(context, result);
+    pthread_mutex_lock(&globals->js_mutex);
+    JS_UpdateStackTop(JS_GetRuntime(context));
+
+    JSValue global_this = JS_GetGlobalObject(context);
+    JSValue func = JS_GetPropertyStr(context, global_this, name);
+    JS_FreeValue(context, global_this);
 
+    jlong handle = -1;
+    if (JS_IsException(func)) {
+        check_js_context_exception(env, context);
+    } else if (!JS_IsFunction(context, func)) {
+        JS_FreeValue(context, func);
+        jni_throw_qjs_exception(env, "'%s' is not a function.", name);
+    } else {
+        handle = handle_table_add(&globals->function_refs, &func, 1);
+        if (handle < 0) {
+            JS_FreeValue(context, func);
+            jni_throw_qjs_exception(env, "Too many function references.");
+        }
+    }
     pthread_mutex_unlock(&globals->js_mutex);
+
+    (*env)->ReleaseStringUTFChars(env, jname, name);
+    return handle;
+}
+
+/** Arguments of function calls up to this count are kept on the stack. */
+#define FUNCTION_STACK_ARGS 8
+
+static JSValue *alloc_function_args(JNIEnv *env, jsize argc, JSValue *stack_argv) {
+    if (argc <= FUNCTION_STACK_ARGS) {
+        return stack_argv;
+    }
+    JSValue *argv = malloc(sizeof(JSValue) * argc);
+    if (argv == NULL) {
+        jni_throw_qjs_exception(env, "Cannot allocate function arguments.");
+    }
+    return argv;
+}
+
+static void free_function_args(JSValue *argv, JSValue *stack_argv) {
+    if (argv != stack_argv) {
+        free(argv);
+    }
 }
 
 /**
- * Try to execute a pending JS job.
+ * Call a referenced function and settle its result like evaluateSync, js_mutex must be
+ * locked. The arguments are freed.
  *
- * @return true if executed, false if no job, or failed to execute.
+ * @return The settled result, or JS_EXCEPTION with an exception thrown.
  */
-JNIEXPORT jboolean JNICALL
-Java_com_dokar_quickjs_QuickJs_executePendingJob(JNIEnv *env,
-                                                 jobject this,
-                                                 jlong context_ptr,
-                                                 jlong globals_ptr) {
+static JSValue call_function_ref(JNIEnv *env,
+                                 JSContext *context,
+                                 Globals *globals,
+                                 jlong handle,
+                                 int argc,
+                                 JSValue *argv) {
+    HandleSlot *slot = handle_table_get(&globals->function_refs, handle);
+    if (slot == NULL) {
+        for (int i = 0; i < argc; i++) {
+            JS_FreeValue(context, argv[i]);
+        }
+        jni_throw_qjs_exception(env, "Invalid or released function handle: %ld", handle);
+        return JS_EXCEPTION;
+    }
+    // The function can be released while it is running
+    JSValue func = JS_DupValue(context, slot->values[0]);
+    JSValue value = JS_Call(context, func, JS_UNDEFINED, argc, argv);
+    for (int i = 0; i < argc; i++) {
+        JS_FreeValue(context, argv[i]);
+    }
+    JS_FreeValue(context, func);
+    return settle_sync_result(env, context, value, 0);
+}
+
+/**
+ * Call a referenced function, drain pending jobs and return the converted result.
+ *
+ * A promise result is unwrapped once the jobs are drained, like evaluateSync.
+ */
+JNIEXPORT jobject JNICALL
+Java_com_dokar_quickjs_QuickJs_callFunction(JNIEnv *env,
+                                            jobject this,
+                                            jlong context_ptr,
+                                            jlong globals_ptr,
+                                            jlong handle,
+                                            jobjectArray jargs) {
     JSContext *context = context_from_ptr(env, context_ptr);
-    if (context == NULL) {
-        return JNI_FALSE;
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (context == NULL || globals == NULL) {
+        return NULL;
     }
-    JSRuntime *runtime = JS_GetRuntime(context);
+
+    jsize argc = (*env)->GetArrayLength(env, jargs);
+    JSValue stack_argv[FUNCTION_STACK_ARGS];
+    JSValue *argv = alloc_function_args(env, argc, stack_argv);
+    if (argv == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&globals->js_mutex);
+    JS_UpdateStackTop(JS_GetRuntime(context));
+
+    jobject result = NULL;
+    for (jsize i = 0; i < argc; i++) {
+        jobject jarg = (*env)->GetObjectArrayElement(env, jargs, i);
+        argv[i] = jobject_to_js_value(env, context, jarg);
+        (*env)->DeleteLocalRef(env, jarg);
+        if (JS_IsException(argv[i])) {
+            for (jsize j = 0; j < i; j++) {
+                JS_FreeValue(context, argv[j]);
+            }
+            goto unlock;
+        }
+    }
+
+    JSValue value = call_function_ref(env, context, globals, handle, argc, argv);
+    if (!JS_IsException(value)) {
+        result = js_value_to_jobject(env, context, value);
+        JS_FreeValue(context, value);
+    }
+
+unlock:
+    pthread_mutex_unlock(&globals->js_mutex);
+    free_function_args(argv, stack_argv);
+    return result;
+}
+
+/**
+ * Call a referenced function with number arguments, returning a number without boxing.
+ *
+ * @param jargs A jdoubleArray when as_double, a jlongArray otherwise.
+ * @param out The result number.
+ * @return 1 on success, 0 with an exception thrown.
+ */
+static int call_function_ref_number(JNIEnv *env,
+                                    jlong context_ptr,
+                                    jlong globals_ptr,
+                                    jlong handle,
+                                    jarray jargs,
+                                    int as_double,
+                                    void *out) {
+    JSContext *context = context_from_ptr(env, context_ptr);
     Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (context == NULL || globals == NULL) {
+        return 0;
+    }
+
+    jsize argc = (*env)->GetArrayLength(env, jargs);
+    JSValue stack_argv[FUNCTION_STACK_ARGS];
+    JSValue *argv = alloc_function_args(env, argc, stack_argv);
+    if (argv == NULL) {
+        return 0;
+    }
 
     pthread_mutex_lock(&globals->js_mutex);
+    JS_UpdateStackTop(JS_GetRuntime(context));
 
-    JS_UpdateStackTop(runtime);
-    if (check_js_context_exception(env, context)) {
+    // Numbers are created without allocating, so nothing runs inside the critical section
+    void *elements = (*env)->GetPrimitiveArrayCritical(env, jargs, NULL);
+    if (elements == NULL) {
         pthread_mutex_unlock(&globals->js_mutex);
+        free_function_args(argv, stack_argv);
+        if (!(*env)->ExceptionCheck(env)) {
+            jni_throw_qjs_exception(env, "Cannot read function arguments.");
+        }
+        return 0;
+    }
+    for (jsize i = 0; i < argc; i++) {
+        argv[i] = as_double
+                  ? JS_NewFloat64(context, ((jdouble *) elements)[i])
+                  : JS_NewInt64(context, ((jlong *) elements)[i]);
+    }
+    (*env)->ReleasePrimitiveArrayCritical(env, jargs, elements, JNI_ABORT);
 
-        return JNI_FALSE;
+    int ok = 0;
+    JSValue value = call_function_ref(env, context, globals, handle, argc, argv);
+    if (!JS_IsException(value)) {
+        if (!JS_IsNumber(value)) {
+            jni_throw_qjs_exception(env, "The function result is not a number.");
+        } else if (as_double) {
+            ok = JS_ToFloat64(context, (double *) out, value) == 0;
+        } else {
+            ok = JS_ToInt64(context, (int64_t *) out, value) == 0;
+        }
+        JS_FreeValue(context, value);
+    }
+
+    pthread_mutex_unlock(&globals->js_mutex);
+    free_function_args(argv, stack_argv);
+    return ok;
+}
+
+/**
+ * Call a referenced function with double arguments and return its number result.
+ */
+JNIEXPORT jdouble JNICALL
+Java_com_dokar_quickjs_QuickJs_callFunctionDouble(JNIEnv *env,
+                                                  jobject this,
+                                                  jlong context_ptr,
+                                                  jlong globals_ptr,
+                                                  jlong handle,
+                                                  jdoubleArray jargs) {
+    double result = 0;
+    call_function_ref_number(env, context_ptr, globals_ptr, handle, jargs, 1, &result);
+    return result;
+}
+
+/**
+ * Call a referenced function with long arguments and return its number result, which is
+ * truncated to an integer.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_QuickJs_callFunctionLong(JNIEnv *env,
+                                                jobject this,
+                                                jlong context_ptr,
+                                                jlong globals_ptr,
+                                                jlong handle,
+                                                jlongArray jargs) {
+    int64_t result = 0;
+    call_function_ref_number(env, context_ptr, globals_ptr, handle, jargs, 0, &result);
+    return result;
+}
+
+/**
+ * Release a function handle, releasing a released handle does nothing.
+ */
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_QuickJs_releaseFunction(JNIEnv *env,
+                                               jobject this,
+                                               jlong context_ptr,
+                                               jlong globals_ptr,
+                                               jlong handle) {
+    JSContext *context = context_from_ptr(env, context_ptr);
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (context == NULL || globals == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&globals->js_mutex);
+    handle_table_remove(context, &globals->function_refs, handle);
+    pthread_mutex_unlock(&globals->js_mutex);
+}
+
+/**
+ * Settle the promise of an async function call and release its handle.
+ *
+ * The promise handle is passed as the first parameter to onCallFunction.
+ */
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_QuickJs_settlePromise(JNIEnv *env,
+                                             jobject this,
+                                             jlong context_ptr,
+                                             jlong globals_ptr,
+                                             jlong handle,
+                                             jboolean reject,
+                                             jobject value) {
+    JSContext *context = context_from_ptr(env, context_ptr);
+    if (context == NULL) {
+        return;
+    }
+
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (globals == NULL) {
+        return;
     }
-    JSContext *ctx;
-    int ret = JS_ExecutePendingJob(runtime, &ctx);
-    if (ret == 0) {
-        pthread_mutex_unlock(&globals->js_mutex);
 
-        // No jobs
-        return JNI_FALSE;
+    pthread_mutex_lock(&globals->js_mutex);
+
+    JS_UpdateStackTop(JS_GetRuntime(context));
+
+    HandleSlot *slot = handle_table_get(&globals->promise_capabilities, handle);
+    if (slot == NULL) {
+        pthread_mutex_unlock(&globals->js_mutex);
+        jni_throw_qjs_exception(env, "Invalid or settled promise handle: %ld", handle);
+        return;
     }
-    if (ret < 0) {
-        jni_throw_qjs_exception(env, "Failed to execute pending jobs.");
 
+    JSValue arg = jobject_to_js_value(env, context, value);
+    if (JS_IsException(arg)) {
+        // Mapping has failed, keep the handle so the promise can still be rejected
         pthread_mutex_unlock(&globals->js_mutex);
+        return;
+    }
+
+    // Release the handle before calling, the call may reuse the slot
+    JSValue func = JS_DupValue(context, slot->values[reject ? 1 : 0]);
+    handle_table_remove(context, &globals->promise_capabilities, handle);
+
+    JSValue result = JS_Call(context, func, JS_NULL, 1, &arg);
+
+    // Do nothing with the result
+    JS_FreeValue(context, result);
+    JS_FreeValue(context, arg);
+    JS_FreeValue(context, func);
+
+    pthread_mutex_unlock(&globals->js_mutex);
+}
+
+/**
+ * Release the handle of an async function call without settling its promise.
+ */
+JNIEXPORT void JNICALL
+Java_com_dokar_quickjs_QuickJs_releasePromise(JNIEnv *env,
+                                              jobject this,
+                                              jlong context_ptr,
+                                              jlong globals_ptr,
+                                              jlong handle) {
+    JSContext *context = context_from_ptr(env, context_ptr);
+    if (context == NULL) {
+        return;
+    }
 
-        return JNI_FALSE;
+    Globals *globals = globals_from_ptr(env, globals_ptr);
+    if (globals == NULL) {
+        return;
     }
 
+    pthread_mutex_lock(&globals->js_mutex);
+    handle_table_remove(context, &globals->promise_capabilities, handle);
     pthread_mutex_unlock(&globals->js_mutex);
+}
 
-    return JNI_TRUE;
+/** drainPendingJobs() state bits, the executed job count is stored above them. */
+#define DRAIN_RESULT_PENDING 1
+#define DRAIN_HAS_MORE_JOBS 2
+#define DRAIN_COUNT_SHIFT 2
+
+static int64_t monotonic_nanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
 /**
- * Check whether an evaluation result promise is still pending without consuming it.
+ * Execute pending JS jobs until none is left or a budget is used up, then check the
+ * evaluation result, all under one lock.
+ *
+ * @param max_jobs The max number of jobs to execute, no limit if not positive.
+ * @param max_nanos The time budget, no limit if not positive. At least one job is executed.
+ * @return The executed job count shifted by DRAIN_COUNT_SHIFT, with DRAIN_RESULT_PENDING
+ * and DRAIN_HAS_MORE_JOBS set when they apply. 0 with an exception thrown if a job failed.
  */
-JNIEXPORT jboolean JNICALL
-Java_com_dokar_quickjs_QuickJs_isEvaluateResultPending(JNIEnv *env,
-                                                       jobject this,
-                                                       jlong context_ptr,
-                                                       jlong globals_ptr,
-                                                       jlong handle) {
+JNIEXPORT jlong JNICALL
+Java_com_dokar_quickjs_QuickJs_drainPendingJobs(JNIEnv *env,
+                                                jobject this,
+                                                jlong context_ptr,
+                                                jlong globals_ptr,
+                                                jlong result_handle,
+                                                jint max_jobs,
+                                                jlong max_nanos) {
     JSContext *context = context_from_ptr(env, context_ptr);
     Globals *globals = globals_from_ptr(env, globals_ptr);
     if (context == NULL || globals == NULL) {
-        return JNI_FALSE;
+        return 0;
     }
+    JSRuntime *runtime = JS_GetRuntime(context);
 
     pthread_mutex_lock(&globals->js_mutex);
-    if (handle < 0 || (uint64_t) handle >= cvector_size(globals->evaluate_result_promises) ||
-        !globals->evaluate_result_active[handle]) {
-        jni_throw_qjs_exception(env, "Invalid evaluation handle: %ld", handle);
+
+    JS_UpdateStackTop(runtime);
+    if (check_js_context_exception(env, context)) {
         pthread_mutex_unlock(&globals->js_mutex);
-        return JNI_FALSE;
+        return 0;
+    }
+
+    int64_t deadline = max_nanos > 0 ? monotonic_nanos() + max_nanos : 0;
+    jlong executed = 0;
+    while (max_jobs <= 0 || executed < max_jobs) {
+        JSContext *job_context;
+        int ret = JS_ExecutePendingJob(runtime, &job_context);
+        if (ret == 0) {
+            break;
+        }
+        if (ret < 0) {
+            if (!check_js_context_exception(env, job_context)) {
+                jni_throw_qjs_exception(env, "Failed to execute pending jobs.");
+            }
+            pthread_mutex_unlock(&globals->js_mutex);
+            return 0;
+        }
+        executed++;
+        if ((*env)->ExceptionCheck(env)) {
+            // Thrown by a binding, report it before running more JS
+            pthread_mutex_unlock(&globals->js_mutex);
+            return 0;
+        }
+        if (deadline != 0 && monotonic_nanos() >= deadline) {
+            break;
+        }
+    }
+
+    jlong state = executed << DRAIN_COUNT_SHIFT;
+    if (JS_IsJobPending(runtime)) {
+        state |= DRAIN_HAS_MORE_JOBS;
     }
 
-    JSValue result_promise = globals->evaluate_result_promises[handle];
+    HandleSlot *slot = evaluate_result_slot(env, globals, result_handle);
+    if (slot == NULL) {
+        pthread_mutex_unlock(&globals->js_mutex);
+        return 0;
+    }
+    JSValue result_promise = slot->values[0];
     if (!js_is_promise(context, result_promise)) {
         jni_throw_qjs_exception(env, "Invalid result promise object.");
         pthread_mutex_unlock(&globals->js_mutex);
-        return JNI_FALSE;
+        return 0;
+    }
+    if (JS_PromiseState(context, result_promise) == JS_PROMISE_PENDING) {
+        state |= DRAIN_RESULT_PENDING;
     }
 
-    jboolean pending = JS_PromiseState(context, result_promise) == JS_PROMISE_PENDING;
     pthread_mutex_unlock(&globals->js_mutex);
-    return pending;
+    return state;
 }
 
 /**
@@ -1047,14 +2039,13 @@ Java_com_dokar_quickjs_QuickJs_getEvaluateResultPromiseId(JNIEnv *env,
     }
 
     pthread_mutex_lock(&globals->js_mutex);
-    if (handle < 0 || (uint64_t) handle >= cvector_size(globals->evaluate_result_promises) ||
-        !globals->evaluate_result_active[handle]) {
-        jni_throw_qjs_exception(env, "Invalid evaluation handle: %ld", handle);
+    HandleSlot *slot = evaluate_result_slot(env, globals, handle);
+    if (slot == NULL) {
         pthread_mutex_unlock(&globals->js_mutex);
         return 0;
     }
 
-    JSValue result_promise = globals->evaluate_result_promises[handle];
+    JSValue result_promise = slot->values[0];
     jlong promise_id = (jlong) (uintptr_t) JS_VALUE_GET_PTR(result_promise);
     pthread_mutex_unlock(&globals->js_mutex);
     return promise_id;
@@ -1077,11 +2068,6 @@ Java_com_dokar_quickjs_QuickJs_getEvaluateResult(JNIEnv *env,
     if (globals == NULL) {
         return NULL;
     }
-    if (handle < 0 || (uint64_t) handle >= cvector_size(globals->evaluate_result_promises) ||
-        !globals->evaluate_result_active[handle]) {
-        jni_throw_qjs_exception(env, "Invalid evaluation handle: %ld", handle);
-        return NULL;
-    }
 
     JSRuntime *runtime = JS_GetRuntime(context);
 
@@ -1089,7 +2075,12 @@ Java_com_dokar_quickjs_QuickJs_getEvaluateResult(JNIEnv *env,
 
     JS_UpdateStackTop(runtime);
 
-    JSValue result_promise = globals->evaluate_result_promises[handle];
+    HandleSlot *slot = evaluate_result_slot(env, globals, handle);
+    if (slot == NULL) {
+        pthread_mutex_unlock(&globals->js_mutex);
+        return NULL;
+    }
+    JSValue result_promise = slot->values[0];
     if (JS_IsUndefined(result_promise)) {
         jni_throw_qjs_exception(env, "Evaluation result has already been released.");
         pthread_mutex_unlock(&globals->js_mutex);
@@ -1097,7 +2088,7 @@ Java_com_dokar_quickjs_QuickJs_getEvaluateResult(JNIEnv *env,
     }
     if (!js_is_promise(context, result_promise)) {
         JS_FreeValue(context, result_promise);
-        globals->evaluate_result_promises[handle] = JS_UNDEFINED;
+        slot->values[0] = JS_UNDEFINED;
         jni_throw_qjs_exception(env, "Invalid result promise object.");
 
         pthread_mutex_unlock(&globals->js_mutex);
@@ -1143,9 +2134,12 @@ Java_com_dokar_quickjs_QuickJs_getEvaluateResult(JNIEnv *env,
         log("The result promise is still pending, it may be a bug in the bridge library.");
         result = (*env)->NewStringUTF(env, "Promise { <state>: \"pending\" }");
     }
-    // Clear the promise
+    // Clear the promise, the handle stays reserved until releaseEvaluateResult()
     JS_FreeValue(context, result_promise);
-    globals->evaluate_result_promises[handle] = JS_UNDEFINED;
+    slot = handle_table_get(&globals->evaluate_results, handle);
+    if (slot != NULL) {
+        slot->values[0] = JS_UNDEFINED;
+    }
 
     pthread_mutex_unlock(&globals->js_mutex);
 
@@ -1168,13 +2162,6 @@ Java_com_dokar_quickjs_QuickJs_releaseEvaluateResult(JNIEnv *env,
     }
 
     pthread_mutex_lock(&globals->js_mutex);
-    if (handle >= 0 && (uint64_t) handle < cvector_size(globals->evaluate_result_promises)) {
-        JSValue value = globals->evaluate_result_promises[handle];
-        if (!JS_IsUndefined(value)) {
-            JS_FreeValue(context, value);
-            globals->evaluate_result_promises[handle] = JS_UNDEFINED;
-        }
-        globals->evaluate_result_active[handle] = 0;
-    }
+    handle_table_remove(context, &globals->evaluate_results, handle);
     pthread_mutex_unlock(&globals->js_mutex);
 }
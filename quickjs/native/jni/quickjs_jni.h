@@ -5,6 +5,7 @@
 #include "cvector.h"
 #include "quickjs.h"
 #include "jni.h"
+#include "handle_table.h"
 
 /**
  * Global objects for the wrapped runtime.
@@ -20,36 +21,42 @@ typedef struct {
     jmethodID get_module_source_method;
     /** QuickJs.getModuleBytecode(Object) content accessor. */
     jmethodID get_module_bytecode_method;
+    /** QuickJs.getModuleBytecodeBuffer(Object) content accessor. */
+    jmethodID get_module_bytecode_buffer_method;
     /** QuickJs.onModuleCompiled(String, ByteArray) notification callback. */
     jmethodID on_module_compiled_method;
     /** QuickJs.onModuleLoadFailed(String) failure callback. */
     jmethodID on_module_load_failed_method;
     /** Monotonic counter used to suppress parent notifications after a nested failure. */
     uint64_t module_load_failure_version;
+    /** Whether modules are read from and added to the process-wide module_cache.h. */
+    int use_shared_module_cache;
+    /** Namespace of the modules in the shared module cache, NULL if not used. */
+    char *shared_module_cache_namespace;
+    /** Debug info stripped by the runtime, part of the shared module cache key. */
+    int strip_flags;
     /**
-     * Some JS values, used by C functions.
+     * Set while a module graph is resolved for Kotlin, which records the names and the
+     * bytecode of the loaded modules, so the shared module cache is not read.
      */
-    cvector_vector_type(JSValue)managed_js_values;
+    int resolving_module_graph;
     /**
-     * Defined JS objects, keep them to support nested define.
+     * Resolve/reject functions of pending async function calls, released once settled.
      */
-    cvector_vector_type(JSValue)defined_js_objects;
+    HandleTable promise_capabilities;
     /**
-     * Promise resolve/reject functions.
-     */
-    cvector_vector_type(JSValue)created_js_functions;
-    /**
-     * Global JNI refs.
+     * Global JNI refs, the host of the runtime owner is at index 0. Bindings keep
+     * their host refs in the context data.
      */
     cvector_vector_type(jobject)global_object_refs;
     /**
-     * Result promises of eval calls. The index is exposed to Kotlin as an evaluation handle.
+     * Result promises of eval calls, reserved by Kotlin until released.
      */
-    cvector_vector_type(JSValue)evaluate_result_promises;
+    HandleTable evaluate_results;
     /**
-     * Whether the corresponding evaluation result slot is reserved by Kotlin.
+     * JS functions referenced by Kotlin function handles, reserved until released.
      */
-    cvector_vector_type(uint8_t)evaluate_result_active;
+    HandleTable function_refs;
     /**
      * The mutex which is used to protect the JS stack in a multi-threaded environment.
      * Scopes with a JS_UpdateStackTop() call are required to be locked.
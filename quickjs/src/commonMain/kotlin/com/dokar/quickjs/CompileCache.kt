@@ -0,0 +1,149 @@
+package com.dokar.quickjs
+
+import com.dokar.quickjs.util.withLockSync
+import kotlinx.coroutines.sync.Mutex
+
+/**
+ * A bounded LRU cache of compiled bytecode, keyed by the content of the source code, the
+ * filename, the module flag and the stripped debug info.
+ *
+ * Set it to [QuickJs.compileCache] to make [QuickJs.evaluate] compile the code once and
+ * evaluate the cached bytecode afterward. A cache can be shared by multiple instances,
+ * including the instances of a [QuickJsPool].
+ *
+ * @param maxEntries The max number of cached scripts.
+ * @param maxBytes The max total size of cached bytecode.
+ */
+class CompileCache(
+    private val maxEntries: Int = 256,
+    private val maxBytes: Long = 32L * 1024 * 1024,
+) {
+    private val mutex = Mutex()
+
+    // Insertion order is kept, so re-inserting on every hit makes the first entry
+    // the least recently used one.
+    private val entries = LinkedHashMap<Long, Entry>()
+
+    private var totalBytes = 0L
+
+    init {
+        require(maxEntries > 0) { "maxEntries must be positive." }
+        require(maxBytes > 0) { "maxBytes must be positive." }
+    }
+
+    /**
+     * The number of cached scripts.
+     */
+    val size: Int get() = mutex.withLockSync { entries.size }
+
+    /**
+     * The total size of cached bytecode.
+     */
+    val sizeInBytes: Long get() = mutex.withLockSync { totalBytes }
+
+    /**
+     * Remove all cached bytecode.
+     */
+    fun clear() {
+        mutex.withLockSync {
+            entries.clear()
+            totalBytes = 0L
+        }
+    }
+
+    /**
+     * Get the cached bytecode of [code], or compile it with [compile] and cache the result.
+     *
+     * The cache is not locked while compiling, instances compiling the same code at the same
+     * time may both do the work.
+     */
+    internal fun getOrCompile(
+        code: String,
+        filename: String,
+        asModule: Boolean,
+        stripDebugInfo: StripDebugInfo,
+        compile: () -> ByteArray,
+    ): ByteArray {
+        val key = sourceHash(code, filename, asModule, stripDebugInfo)
+        get(key, code, filename, asModule, stripDebugInfo)?.let { return it }
+        val bytecode = compile()
+        put(key, Entry(code, filename, asModule, stripDebugInfo, bytecode))
+        return bytecode
+    }
+
+    private fun get(
+        key: Long,
+        code: String,
+        filename: String,
+        asModule: Boolean,
+        stripDebugInfo: StripDebugInfo,
+    ): ByteArray? {
+        return mutex.withLockSync {
+            val entry = entries.remove(key) ?: return@withLockSync null
+            entries[key] = entry
+            // The hash only narrows it down, a colliding source is a miss
+            if (entry.matches(code, filename, asModule, stripDebugInfo)) entry.bytecode else null
+        }
+    }
+
+    private fun put(key: Long, entry: Entry) {
+        if (entry.bytecode.size > maxBytes) {
+            return
+        }
+        mutex.withLockSync {
+            entries.remove(key)?.let { totalBytes -= it.bytecode.size }
+            entries[key] = entry
+            totalBytes += entry.bytecode.size
+            val iterator = entries.values.iterator()
+            while (entries.size > maxEntries || totalBytes > maxBytes) {
+                totalBytes -= iterator.next().bytecode.size
+                iterator.remove()
+            }
+        }
+    }
+
+    private class Entry(
+        private val code: String,
+        private val filename: String,
+        private val asModule: Boolean,
+        private val stripDebugInfo: StripDebugInfo,
+        val bytecode: ByteArray,
+    ) {
+        fun matches(
+            code: String,
+            filename: String,
+            asModule: Boolean,
+            stripDebugInfo: StripDebugInfo,
+        ): Boolean {
+            return this.asModule == asModule &&
+                    this.stripDebugInfo == stripDebugInfo &&
+                    this.filename == filename &&
+                    this.code == code
+        }
+    }
+}
+
+/**
+ * 64-bit FNV-1a hash of the source code, the filename, the module flag and the strip flags.
+ */
+private fun sourceHash(
+    code: String,
+    filename: String,
+    asModule: Boolean,
+    stripDebugInfo: StripDebugInfo,
+): Long {
+    var hash = FNV_OFFSET_BASIS
+    for (char in code) {
+        hash = (hash xor char.code.toLong()) * FNV_PRIME
+    }
+    // Separate the code from the filename
+    hash *= FNV_PRIME
+    for (char in filename) {
+        hash = (hash xor char.code.toLong()) * FNV_PRIME
+    }
+    hash = (hash xor if (asModule) 1L else 0L) * FNV_PRIME
+    return (hash xor stripDebugInfo.flags.toLong()) * FNV_PRIME
+}
+
+private const val FNV_OFFSET_BASIS = -0x340d631b7bdddcdbL
+private const val FNV_PRIME = 0x100000001b3L
@@ -0,0 +1,77 @@
+package com.dokar.quickjs
+
+import com.dokar.quickjs.converter.castValueOr
+import com.dokar.quickjs.converter.typeOfInstance
+import kotlin.concurrent.atomics.AtomicBoolean
+import kotlin.concurrent.atomics.ExperimentalAtomicApi
+import kotlin.reflect.typeOf
+
+/**
+ * A reference to a JavaScript function, returned by [QuickJs.getFunction].
+ *
+ * The function is kept alive until the reference is closed, calling it does not parse or
+ * evaluate any code. References are released when their [QuickJs] is closed or reset, and
+ * can no longer be called afterwards.
+ */
+@OptIn(ExperimentalAtomicApi::class)
+class JsFunctionRef internal constructor(
+    @PublishedApi
+    internal val quickJs: QuickJs,
+    @PublishedApi
+    internal val handle: Long,
+) : AutoCloseable {
+    private val closed = AtomicBoolean(false)
+
+    /**
+     * Call the function synchronously on the calling thread, with `undefined` as `this`.
+     *
+     * Works like [QuickJs.evaluateSync]: pending jobs are executed before returning, and a
+     * promise result is unwrapped once settled.
+     *
+     * @param T The result type.
+     * @param args The arguments, mapped like the results of function bindings.
+     * @throws QuickJsException If the function throws, the reference or its [QuickJs] is
+     * closed, or the result promise is still pending.
+     */
+    @Throws(QuickJsException::class)
+    inline fun <reified T> call(vararg args: Any?): T {
+        return castValueOr(quickJs.callFunctionInternal(handle, args), typeOf<T>()) {
+            quickJs.typeConverters.convert(
+                source = it,
+                sourceType = typeOfInstance(quickJs.typeConverters, it),
+                targetType = typeOf<T>()
+            )
+        }
+    }
+
+    /**
+     * Call the function with number arguments and return its number result, without
+     * boxing the numbers or mapping them by type. Meant for hot loops like scoring
+     * functions.
+     *
+     * @throws QuickJsException If the function throws or returns something other than a
+     * number, or if the reference or its [QuickJs] is closed.
+     * @see call
+     */
+    @Throws(QuickJsException::class)
+    fun callDouble(vararg args: Double): Double = quickJs.callFunctionDouble(handle, args)
+
+    /**
+     * Call the function with integer arguments and return its number result, truncated to
+     * a [Long]. Arguments out of the safe integer range of JavaScript lose precision.
+     *
+     * @throws QuickJsException If the function throws or returns something other than a
+     * number, or if the reference or its [QuickJs] is closed.
+     * @see callDouble
+     */
+    @Throws(QuickJsException::class)
+    fun callLong(vararg args: Long): Long = quickJs.callFunctionLong(handle, args)
+
+    /**
+     * Release the function. Does nothing if already closed.
+     */
+    override fun close() {
+        if (!closed.compareAndSet(expectedValue = false, newValue = true)) return
+        quickJs.releaseFunction(handle)
+    }
+}
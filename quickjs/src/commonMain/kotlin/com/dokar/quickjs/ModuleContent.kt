@@ -22,4 +22,20 @@ sealed interface ModuleContent {
      * @param bytes The compiled ES module bytecode.
      */
     class Bytecode(val bytes: ByteArray) : ModuleContent
+
+    /**
+     * QuickJS module bytecode read in place from memory outside the heap, such as
+     * `MappedBytecode` on JVM and Android.
+     *
+     * The same requirements as [Bytecode] apply.
+     *
+     * Adding this subtype is source-incompatible: exhaustive `when` expressions over
+     * [ModuleContent] need a branch for it, which can fall back to [toByteArray].
+     */
+    abstract class BytecodeBuffer internal constructor() : ModuleContent {
+        /**
+         * Copy the bytecode to a new array, for loaders that can't read it in place.
+         */
+        abstract fun toByteArray(): ByteArray
+    }
 }
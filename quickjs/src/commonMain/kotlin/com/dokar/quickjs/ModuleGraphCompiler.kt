@@ -0,0 +1,144 @@
+package com.dokar.quickjs
+
+import com.dokar.quickjs.util.availableProcessors
+import com.dokar.quickjs.util.withLockSync
+import kotlinx.coroutines.CoroutineDispatcher
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.channels.Channel
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.sync.Mutex
+import kotlin.coroutines.cancellation.CancellationException
+
+/**
+ * Compile the module graphs of [entries] concurrently on a pool of scratch runtimes.
+ *
+ * Modules are loaded from [moduleLoader], every module loaded as source is compiled on
+ * one of the scratch runtimes and reported to [ModuleLoader.onCompiled] as usual, so a
+ * caching loader returns bytecode when the graph is resolved or evaluated later. The static
+ * imports of a module are queued as soon as it's compiled, so independent modules are
+ * compiled at the same time. Dynamic imports are not followed.
+ *
+ * Unlike a [QuickJs] instance, this calls [moduleLoader] from multiple threads at the same
+ * time, it must be thread-safe.
+ *
+ * @param entries The normalized names of the entry modules.
+ * @param moduleLoader The loader of the modules.
+ * @param parallelism The number of scratch runtimes. Defaults to the number of available
+ * processors.
+ * @param stripDebugInfo The debug info to drop from the compiled modules.
+ * @param dispatcher The dispatcher to compile on.
+ * @return The bytecode of every module in the graphs, including the entries and modules
+ * loaded as bytecode.
+ * @throws QuickJsException If a module cannot be loaded or compiled. [ModuleLoader.onLoadFailed]
+ * is called for the module.
+ */
+@Throws(QuickJsException::class, CancellationException::class)
+suspend fun compileModuleGraph(
+    entries: Collection<String>,
+    moduleLoader: ModuleLoader,
+    parallelism: Int = availableProcessors(),
+    stripDebugInfo: StripDebugInfo = StripDebugInfo.None,
+    dispatcher: CoroutineDispatcher = Dispatchers.Default,
+): Map<String, ByteArray> {
+    require(parallelism > 0) { "parallelism must be positive." }
+    if (entries.isEmpty()) {
+        return emptyMap()
+    }
+
+    val mutex = Mutex()
+    val queue = Channel<String>(Channel.UNLIMITED)
+    val queuedNames = mutableSetOf<String>()
+    val results = mutableMapOf<String, ByteArray>()
+    var pendingCount = 0
+
+    fun enqueue(names: Collection<String>) {
+        for (name in names) {
+            if (queuedNames.add(name)) {
+                pendingCount++
+                queue.trySend(name)
+            }
+        }
+    }
+
+    mutex.withLockSync { enqueue(entries) }
+
+    coroutineScope {
+        repeat(parallelism) {
+            launch(dispatcher) {
+                ScratchCompiler(dispatcher, stripDebugInfo).use { compiler ->
+                    for (name in queue) {
+                        val (bytecode, imports) = compiler.load(name, moduleLoader)
+                        mutex.withLockSync {
+                            results[name] = bytecode
+                            enqueue(imports)
+                            if (--pendingCount == 0) {
+                                queue.close()
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return results
+}
+
+/**
+ * A scratch runtime, its module loader only records the imports of the compiled module.
+ * Not thread-safe.
+ */
+internal class ScratchCompiler(
+    dispatcher: CoroutineDispatcher,
+    stripDebugInfo: StripDebugInfo = StripDebugInfo.None,
+) : AutoCloseable {
+    private val imports = linkedSetOf<String>()
+
+    private val quickJs = QuickJs.create(
+        jobDispatcher = dispatcher,
+        moduleLoader = moduleLoader { load(::recordImport) },
+    ).also { it.stripDebugInfo = stripDebugInfo }
+
+    private fun recordImport(name: String): ModuleContent {
+        imports += name
+        // Imports are only resolved, never linked, an empty module is enough
+        return ModuleContent.Source("")
+    }
+
+    /**
+     * Load a module from [loader] and [compile] it, the compiled source is reported to
+     * [ModuleLoader.onCompiled].
+     */
+    fun load(name: String, loader: ModuleLoader): Pair<ByteArray, Set<String>> {
+        try {
+            val content = loader.load(name) ?: qjsError("Cannot load module '$name'.")
+            val (bytecode, imports) = compile(name, content)
+            if (content is ModuleContent.Source) {
+                loader.onCompiled(name, bytecode)
+            }
+            return bytecode to imports
+        } catch (e: Throwable) {
+            loader.onLoadFailed(name)
+            throw e
+        }
+    }
+
+    /**
+     * Compile the module [content] if it's source, and find its static imports.
+     */
+    @Throws(QuickJsException::class)
+    fun compile(name: String, content: ModuleContent): Pair<ByteArray, Set<String>> {
+        val bytecode = when (content) {
+            is ModuleContent.Source -> quickJs.compile(content.code, filename = name, asModule = true)
+            is ModuleContent.Bytecode -> content.bytes
+            is ModuleContent.BytecodeBuffer -> content.toByteArray()
+        }
+        imports.clear()
+        quickJs.resolveModuleGraph(bytecode)
+        return bytecode to imports.toSet()
+    }
+
+    override fun close() {
+        quickJs.close()
+    }
+}
@@ -112,6 +112,12 @@ expect class QuickJs {
      */
     var maxStackSize: Long
 
+    /**
+     * The debug info to drop from code compiled afterward, including [evaluate] and modules
+     * loaded from source. Defaults to [StripDebugInfo.None].
+     */
+    var stripDebugInfo: StripDebugInfo
+
     /**
      * The memory usage of the js runtime.
      */
@@ -127,6 +133,15 @@ expect class QuickJs {
      */
     var evaluationTimeoutMillis: Long
 
+    /**
+     * The bytecode cache of [evaluate] with source code, disabled when null (the default).
+     *
+     * When set, code is compiled on the first evaluation and the cached bytecode is
+     * evaluated afterward, skipping the parser. The cache can be shared with other
+     * instances.
+     */
+    var compileCache: CompileCache?
+
     /**
      * Interrupt the running evaluation, failing it with a
      * [QuickJsInterruptedException]. Works even on busy JavaScript like an
@@ -158,6 +173,22 @@ expect class QuickJs {
     @ExperimentalQuickJsApi
     fun onNativeClose(cleanup: (QuickJsNativeContext) -> Unit)
 
+    /**
+     * Open a new realm, an isolated context on this instance's runtime.
+     *
+     * The realm has its own globals, bindings and type converters, while the atom table,
+     * shapes, memory limits, interrupts and the [ModuleLoader] are shared with this
+     * instance. Evaluations on the same runtime run one at a time.
+     *
+     * Realms are closed when the instance that opened them is closed. Opening a realm
+     * from a realm opens it on the same runtime.
+     *
+     * @throws QuickJsException If the runtime is closed or the context cannot be created.
+     */
+    @ExperimentalQuickJsApi
+    @Throws(QuickJsException::class)
+    fun openRealm(): QuickJs
+
     /**
      * Add type converters to extend the type mapping on function parameters,
      * function returns, and [evaluate] results.
@@ -235,10 +266,37 @@ expect class QuickJs {
      * @param code The code to compile.
      * @param filename The script filename.
      * @param asModule Whether compile the code as a module.
+     * @param stripDebugInfo The debug info to drop from the bytecode, null to use
+     * [QuickJs.stripDebugInfo].
+     * @throws QuickJsException If an error occurred when evaluating code or mapping values.
+     */
+    @Throws(QuickJsException::class)
+    fun compile(
+        code: String,
+        filename: String = "main.js",
+        asModule: Boolean = false,
+        stripDebugInfo: StripDebugInfo? = null,
+    ): ByteArray
+
+    /**
+     * Compile UTF-8 encoded javascript code to QuickJS bytecode.
+     *
+     * The bytes are passed to QuickJS as they are, which saves the string transcoding of
+     * [compile] for large scripts that are already loaded as UTF-8.
+     *
+     * @param code The UTF-8 encoded code to compile.
+     * @param length The number of bytes to compile, starting from the first byte of [code].
+     * @param filename The script filename.
+     * @param asModule Whether compile the code as a module.
      * @throws QuickJsException If an error occurred when evaluating code or mapping values.
      */
     @Throws(QuickJsException::class)
-    fun compile(code: String, filename: String = "main.js", asModule: Boolean = false): ByteArray
+    fun compileUtf8(
+        code: ByteArray,
+        length: Int = code.size,
+        filename: String = "main.js",
+        asModule: Boolean = false,
+    ): ByteArray
 
     /**
      * Resolves the statically reachable ES module graph without evaluating it.
@@ -257,6 +315,27 @@ expect class QuickJs {
     @Throws(QuickJsException::class)
     fun resolveModuleGraph(entryBytecode: ByteArray): Set<String>
 
+    /**
+     * Compile an ES module and its static imports into a single bundle for [evaluateBundle].
+     *
+     * Imports are supplied by the runtime's [ModuleLoader], from source or bytecode. Dynamic
+     * imports are not bundled and are loaded during evaluation as usual. When [asModule] is
+     * false, the code is compiled as a script and the bundle only contains the script.
+     *
+     * The bundle is stamped with the QuickJS [version], other versions reject it.
+     *
+     * @param code The code of the entry module.
+     * @param filename The name of the entry module.
+     * @param asModule Compile the code as an ES module.
+     * @throws QuickJsException If failed to compile the code or to load an import.
+     */
+    @Throws(QuickJsException::class)
+    fun compileBundle(
+        code: String,
+        filename: String = "main.js",
+        asModule: Boolean = true,
+    ): ByteArray
+
     /**
      * Evaluate QuickJS-compiled bytecode.
      *
@@ -267,6 +346,21 @@ expect class QuickJs {
     @Throws(QuickJsException::class, CancellationException::class)
     suspend inline fun <reified T> evaluate(bytecode: ByteArray): T
 
+    /**
+     * Evaluate the entry of a bundle created by [compileBundle].
+     *
+     * All bundled modules are read at once, the [ModuleLoader] is only called for modules
+     * that are not in the bundle. Modules already read by an earlier bundle or the loader
+     * are not read again, the entry is evaluated on every call.
+     *
+     * @param T The result type.
+     * @param bundle The bundle buffer.
+     * @throws QuickJsException If the bundle is invalid or compiled by another QuickJS version,
+     * or an error occurred when evaluating code or mapping values.
+     */
+    @Throws(QuickJsException::class, CancellationException::class)
+    suspend inline fun <reified T> evaluateBundle(bundle: ByteArray): T
+
     /**
      * Evaluate javascript code.
      *
@@ -285,11 +379,106 @@ expect class QuickJs {
         asModule: Boolean = false,
     ): T
 
+    /**
+     * Evaluate UTF-8 encoded javascript code.
+     *
+     * The bytes are passed to QuickJS as they are, which saves the string transcoding of
+     * [evaluate] for large scripts that are already loaded as UTF-8.
+     *
+     * @param T The result type.
+     * @param code The UTF-8 encoded code to evaluate.
+     * @param length The number of bytes to evaluate, starting from the first byte of [code].
+     * @param filename The script filename.
+     * @param asModule Whether evaluate the code as a module or evaluate it globally.
+     * @throws QuickJsException If an error occurred when evaluating code or mapping values.
+     */
+    @Throws(QuickJsException::class, CancellationException::class)
+    suspend inline fun <reified T> evaluateUtf8(
+        code: ByteArray,
+        length: Int = code.size,
+        filename: String = "main.js",
+        asModule: Boolean = false,
+    ): T
+
+    /**
+     * Evaluate javascript code synchronously on the calling thread.
+     *
+     * Pending jobs are executed before returning, and a promise result is unwrapped once
+     * settled. Async function bindings can't be awaited this way and fail when called, use
+     * [evaluate] for code that calls them. Blocks while another evaluation is running, so it
+     * must not be called from async function bindings of the same runtime.
+     *
+     * This skips the coroutine machinery of [evaluate], which makes it considerably faster
+     * for short scripts.
+     *
+     * @param T The result type.
+     * @param code The code to evaluate.
+     * @param filename The script filename.
+     * @param asModule Whether evaluate the code as a module or evaluate it globally.
+     * @throws QuickJsException If an error occurred when evaluating code or mapping values,
+     * or if the result promise is still pending.
+     */
+    @Throws(QuickJsException::class)
+    inline fun <reified T> evaluateSync(
+        code: String,
+        filename: String = "main.js",
+        asModule: Boolean = false,
+    ): T
+
+    /**
+     * Evaluate QuickJS-compiled bytecode synchronously on the calling thread.
+     *
+     * @param T The result type.
+     * @param bytecode The bytecode buffer.
+     * @throws QuickJsException If an error occurred when evaluating code or mapping values,
+     * or if the result promise is still pending.
+     * @see evaluateSync
+     */
+    @Throws(QuickJsException::class)
+    inline fun <reified T> evaluateSync(bytecode: ByteArray): T
+
+    /**
+     * Reference a function of the global object, so it can be called many times without
+     * evaluating code. Close the returned reference to release the function.
+     *
+     * @param name The name of the global function.
+     * @throws QuickJsException If the global value is not a function, or if closed.
+     */
+    @Throws(QuickJsException::class)
+    fun getFunction(name: String): JsFunctionRef
+
+    @PublishedApi
+    internal fun callFunctionInternal(handle: Long, args: Array<out Any?>): Any?
+
+    internal fun callFunctionDouble(handle: Long, args: DoubleArray): Double
+
+    internal fun callFunctionLong(handle: Long, args: LongArray): Long
+
+    internal fun releaseFunction(handle: Long)
+
     /**
      * Run GC.
      */
     fun gc()
 
+    /**
+     * Discard all JavaScript state and continue with a fresh context on the same runtime.
+     *
+     * Bindings defined by [defineBinding] and modules added by [addModule] are applied
+     * again, type converters and runtime settings are kept. Cleanup callbacks registered
+     * by [onNativeClose] run and are removed, since their context is gone.
+     *
+     * Object handles returned by [defineBinding] before the reset must not be used
+     * afterwards.
+     *
+     * Realms can't be reset, and an instance can't be reset while it has open realms.
+     *
+     * @throws QuickJsException If called while evaluating, from a binding callback, or
+     * after [close].
+     */
+    @Throws(QuickJsException::class)
+    fun reset()
+
     /**
      * Free the JavaScript runtime and context.
      */
@@ -325,5 +514,20 @@ expect class QuickJs {
             jobDispatcher: CoroutineDispatcher,
             moduleLoader: ModuleLoader,
         ): QuickJs
+
+        /**
+         * Creates a QuickJS runtime using [allocator] for its memory.
+         *
+         * @param jobDispatcher The dispatcher for executing async jobs.
+         * @param moduleLoader The runtime-scoped ES module loader, or null for none.
+         * @param allocator The memory allocator of the runtime.
+         * @throws QuickJsException If runtime creation fails.
+         */
+        @Throws(QuickJsException::class)
+        fun create(
+            jobDispatcher: CoroutineDispatcher,
+            moduleLoader: ModuleLoader?,
+            allocator: QuickJsAllocator,
+        ): QuickJs
     }
 }
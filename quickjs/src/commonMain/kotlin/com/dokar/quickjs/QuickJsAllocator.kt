@@ -0,0 +1,20 @@
+package com.dokar.quickjs
+
+/**
+ * The memory allocator used by a QuickJS runtime.
+ */
+enum class QuickJsAllocator {
+    /**
+     * Allocate everything with the system malloc.
+     */
+    System,
+
+    /**
+     * Allocate small blocks from size-class slabs owned by the runtime.
+     *
+     * Freed blocks are recycled without going back to the system allocator, which
+     * avoids allocator lock contention when many instances run on different threads.
+     * Slabs without live blocks are released on [QuickJs.gc] and [QuickJs.reset].
+     */
+    Slab,
+}
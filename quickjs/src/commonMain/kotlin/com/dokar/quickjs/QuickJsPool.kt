@@ -0,0 +1,228 @@
+package com.dokar.quickjs
+
+import com.dokar.quickjs.util.availableProcessors
+import com.dokar.quickjs.util.withLockSync
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.CompletableDeferred
+import kotlinx.coroutines.CoroutineDispatcher
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.SupervisorJob
+import kotlinx.coroutines.cancel
+import kotlinx.coroutines.channels.Channel
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.job
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.sync.Mutex
+import kotlin.concurrent.atomics.AtomicBoolean
+import kotlin.concurrent.atomics.AtomicInt
+import kotlin.concurrent.atomics.ExperimentalAtomicApi
+import kotlin.concurrent.atomics.fetchAndIncrement
+
+/**
+ * A pool of pre-warmed [QuickJs] instances.
+ *
+ * Instances are created and set up once when the pool is created, so bindings and modules
+ * are ready before the first task runs. Every instance is owned by a worker with its own
+ * task queue, tasks are distributed to the queues in turn, and idle workers steal queued
+ * tasks from busy ones.
+ *
+ * Instances are reused between tasks, globals set by one task are visible to later tasks
+ * running on the same instance.
+ */
+@OptIn(ExperimentalAtomicApi::class)
+class QuickJsPool private constructor(
+    private val instances: List<QuickJs>,
+    jobDispatcher: CoroutineDispatcher,
+) {
+    private val scope = CoroutineScope(SupervisorJob() + jobDispatcher)
+
+    private val queues = List(instances.size) { TaskQueue() }
+
+    // One signal per submitted task, so a worker receiving a signal always finds a task
+    // in its own queue or in another worker's queue.
+    private val signals = Channel<Unit>(Channel.UNLIMITED)
+
+    private val nextQueue = AtomicInt(0)
+
+    private val closed = AtomicBoolean(false)
+
+    /**
+     * Whether the pool has closed.
+     */
+    val isClosed: Boolean
+        get() = closed.load()
+
+    /**
+     * The number of instances in this pool.
+     */
+    val size: Int get() = instances.size
+
+    init {
+        scope.coroutineContext.job.invokeOnCompletion {
+            instances.forEach { it.close() }
+        }
+        for (index in instances.indices) {
+            scope.launch { runWorker(index) }
+        }
+    }
+
+    /**
+     * Run [block] on the first available instance.
+     *
+     * Cancelling the caller cancels the task, whether it is queued or running.
+     *
+     * @throws IllegalStateException If the pool is closed.
+     */
+    suspend fun <T> use(block: suspend QuickJs.() -> T): T {
+        check(!isClosed) { "QuickJsPool is closed." }
+        val task = Task(block)
+        val index = (nextQueue.fetchAndIncrement() and Int.MAX_VALUE) % queues.size
+        queues[index].push(task)
+        if (signals.trySend(Unit).isFailure) {
+            task.result.completeExceptionally(closedError())
+        }
+        try {
+            @Suppress("UNCHECKED_CAST")
+            return task.result.await() as T
+        } catch (e: CancellationException) {
+            task.result.cancel(e)
+            throw e
+        }
+    }
+
+    /**
+     * Evaluate javascript code on the first available instance.
+     *
+     * @see QuickJs.evaluate
+     */
+    @Throws(QuickJsException::class, CancellationException::class)
+    suspend inline fun <reified T> evaluate(
+        code: String,
+        filename: String = "main.js",
+        asModule: Boolean = false,
+    ): T = use { evaluate<T>(code = code, filename = filename, asModule = asModule) }
+
+    /**
+     * Evaluate QuickJS-compiled bytecode on the first available instance.
+     *
+     * @see QuickJs.evaluate
+     */
+    @Throws(QuickJsException::class, CancellationException::class)
+    suspend inline fun <reified T> evaluate(bytecode: ByteArray): T {
+        return use { evaluate<T>(bytecode) }
+    }
+
+    /**
+     * Cancel queued and running tasks, then close all instances once their workers
+     * have stopped.
+     */
+    fun close() {
+        if (!closed.compareAndSet(expectedValue = false, newValue = true)) {
+            return
+        }
+        signals.close()
+        scope.cancel()
+        for (queue in queues) {
+            queue.drain().forEach { it.result.completeExceptionally(closedError()) }
+        }
+    }
+
+    private suspend fun runWorker(index: Int) {
+        val quickJs = instances[index]
+        while (signals.receiveCatching().isSuccess) {
+            val task = takeTask(index) ?: continue
+            if (task.result.isCompleted) {
+                // Cancelled while queued
+                continue
+            }
+            runTask(quickJs, task)
+        }
+    }
+
+    private fun takeTask(index: Int): Task? {
+        queues[index].pop()?.let { return it }
+        for (offset in 1 until queues.size) {
+            val victim = queues[(index + offset) % queues.size]
+            victim.steal()?.let { return it }
+        }
+        return null
+    }
+
+    private suspend fun runTask(quickJs: QuickJs, task: Task) = coroutineScope {
+        val job = launch {
+            try {
+                task.result.complete(task.block(quickJs))
+            } catch (e: Throwable) {
+                val error = if (e is CancellationException && isClosed) closedError() else e
+                task.result.completeExceptionally(error)
+            }
+        }
+        val handle = task.result.invokeOnCompletion { job.cancel() }
+        job.join()
+        handle.dispose()
+    }
+
+    private fun closedError() = IllegalStateException("QuickJsPool is closed.")
+
+    private class Task(val block: suspend QuickJs.() -> Any?) {
+        val result = CompletableDeferred<Any?>()
+    }
+
+    private class TaskQueue {
+        private val mutex = Mutex()
+        private val tasks = ArrayDeque<Task>()
+
+        fun push(task: Task) = mutex.withLockSync { tasks.addLast(task) }
+
+        fun pop(): Task? = mutex.withLockSync { tasks.removeFirstOrNull() }
+
+        /**
+         * Take the most recently queued task, which is the last one the owner would reach.
+         */
+        fun steal(): Task? = mutex.withLockSync { tasks.removeLastOrNull() }
+
+        fun drain(): List<Task> = mutex.withLockSync {
+            tasks.toList().also { tasks.clear() }
+        }
+    }
+
+    companion object {
+        /**
+         * Create a pool of pre-warmed QuickJS instances.
+         *
+         * @param jobDispatcher The dispatcher for running tasks and executing async jobs.
+         * @param moduleLoader The ES module loader used by every instance.
+         * @param instancesPerCore The number of instances created for each worker core.
+         * @param parallelism The number of cores to create instances for. Defaults to the
+         * number of available processors.
+         * @param allocator The memory allocator of every instance's runtime.
+         * @param setup Runs once on every instance after creation, to define bindings, add
+         * type converters, etc.
+         * @throws QuickJsException If failed to create a runtime.
+         */
+        @Throws(QuickJsException::class)
+        fun create(
+            jobDispatcher: CoroutineDispatcher,
+            moduleLoader: ModuleLoader? = null,
+            instancesPerCore: Int = 1,
+            parallelism: Int = availableProcessors(),
+            allocator: QuickJsAllocator = QuickJsAllocator.System,
+            setup: QuickJs.() -> Unit = {},
+        ): QuickJsPool {
+            require(instancesPerCore > 0) { "instancesPerCore must be positive." }
+            require(parallelism > 0) { "parallelism must be positive." }
+            val instances = ArrayList<QuickJs>(instancesPerCore * parallelism)
+            try {
+                repeat(instancesPerCore * parallelism) {
+                    val quickJs = QuickJs.create(jobDispatcher, moduleLoader, allocator)
+                    instances.add(quickJs)
+                    quickJs.setup()
+                }
+            } catch (e: Throwable) {
+                instances.forEach { it.close() }
+                throw e
+            }
+            return QuickJsPool(instances, jobDispatcher)
+        }
+    }
+}
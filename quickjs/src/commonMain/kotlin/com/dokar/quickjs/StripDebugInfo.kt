@@ -0,0 +1,29 @@
+package com.dokar.quickjs
+
+/**
+ * What debug info to drop from compiled functions.
+ *
+ * Stripped functions are smaller in memory and in bytecode, see
+ * [MemoryUsage.jsFuncPc2lineSize], and load faster.
+ */
+enum class StripDebugInfo(internal val flags: Int) {
+    /**
+     * Keep all debug info.
+     */
+    None(0),
+
+    /**
+     * Drop the source code, `Function.prototype.toString()` no longer returns it.
+     */
+    Source(JS_STRIP_SOURCE),
+
+    /**
+     * Drop the source code, the filenames and the line number tables. Error stack traces
+     * no longer have locations.
+     */
+    All(JS_STRIP_SOURCE or JS_STRIP_DEBUG),
+}
+
+// Same as the flags of JS_SetStripInfo() in quickjs.h
+private const val JS_STRIP_SOURCE = 1 shl 0
+private const val JS_STRIP_DEBUG = 1 shl 1
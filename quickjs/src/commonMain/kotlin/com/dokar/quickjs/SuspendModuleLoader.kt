@@ -0,0 +1,208 @@
+package com.dokar.quickjs
+
+import com.dokar.quickjs.util.withLockSync
+import kotlinx.coroutines.CompletableDeferred
+import kotlinx.coroutines.CoroutineDispatcher
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.currentCoroutineContext
+import kotlinx.coroutines.ensureActive
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
+import kotlin.coroutines.cancellation.CancellationException
+
+/**
+ * Supplies ES modules from a suspending source, such as disk or network storage.
+ *
+ * QuickJS resolves modules synchronously, so this loader is used through a
+ * [PrefetchingModuleLoader], which loads whole module graphs ahead of evaluation.
+ */
+interface SuspendModuleLoader {
+    /**
+     * Loads a normalized module name, like [ModuleLoader.load]. Calls may run concurrently.
+     *
+     * @param name The normalized module name.
+     * @return The module content, or null when it cannot be loaded.
+     */
+    suspend fun load(name: String): ModuleContent?
+
+    /**
+     * Reports bytecode of a source module, like [ModuleLoader.onCompiled].
+     */
+    fun onCompiled(name: String, bytecode: ByteArray) = Unit
+
+    /**
+     * Reports that a module could not be loaded, like [ModuleLoader.onLoadFailed].
+     */
+    fun onLoadFailed(name: String) = Unit
+}
+
+/**
+ * A [ModuleLoader] serving modules prefetched from a [SuspendModuleLoader].
+ *
+ * [prefetch] loads the entry modules and their static imports concurrently, compiles the
+ * sources, and keeps the bytecode in memory. Module resolution of the [QuickJs] instances
+ * using this loader then never waits for [loader]. Modules that are not prefetched, such as
+ * dynamic imports that were not passed to [prefetch], are unavailable.
+ *
+ * A loader can be shared by multiple instances, the prefetched modules are kept until
+ * [clear] is called.
+ *
+ * @param loader The suspending source of modules.
+ */
+class PrefetchingModuleLoader(
+    private val loader: SuspendModuleLoader,
+) : ModuleLoader {
+    private val mutex = Mutex()
+
+    private val modules = mutableMapOf<String, ModuleContent>()
+
+    // Loads of prefetched or being prefetched names, completed with the static imports
+    private val loads = mutableMapOf<String, CompletableDeferred<Collection<String>>>()
+
+    /**
+     * Load [entries] and their static imports that are not prefetched yet.
+     *
+     * Modules are loaded concurrently on [dispatcher], a module's imports are loaded as soon
+     * as the module itself is. Sources are compiled on a scratch runtime and reported to
+     * [SuspendModuleLoader.onCompiled]. Sources failing to compile are kept as is, the error
+     * is reported when QuickJS resolves the module.
+     *
+     * Modules being loaded by a concurrent call are awaited instead of loaded again, so the
+     * graph is available when any of the calls returns.
+     *
+     * @param entries The normalized names of the entry modules.
+     * @param dispatcher The dispatcher to load modules on, usually `Dispatchers.IO`.
+     * @throws QuickJsException If failed to create the scratch runtime. Exceptions thrown by
+     * [SuspendModuleLoader.load] are rethrown.
+     */
+    @Throws(QuickJsException::class, CancellationException::class)
+    suspend fun prefetch(entries: Collection<String>, dispatcher: CoroutineDispatcher) {
+        val compilerMutex = Mutex()
+        // Names visited by this call, guarded by mutex
+        val visited = mutableSetOf<String>()
+        ScratchCompiler(dispatcher).use { compiler ->
+            coroutineScope {
+                // Returns the static imports, or null if the module is not found
+                suspend fun fetch(name: String): Collection<String>? {
+                    val content = try {
+                        loader.load(name)
+                    } catch (e: Throwable) {
+                        if (e !is CancellationException) {
+                            loader.onLoadFailed(name)
+                        }
+                        throw e
+                    }
+                    if (content == null) {
+                        // Reported when QuickJS resolves the module
+                        return null
+                    }
+                    val (bytecode, imports) = try {
+                        compilerMutex.withLock { compiler.compile(name, content) }
+                    } catch (e: QuickJsException) {
+                        mutex.withLockSync { modules[name] = content }
+                        return emptyList()
+                    }
+                    if (content is ModuleContent.Source) {
+                        loader.onCompiled(name, bytecode)
+                    }
+                    mutex.withLockSync { modules[name] = ModuleContent.Bytecode(bytecode) }
+                    return imports
+                }
+
+                suspend fun awaitLoad(name: String): Collection<String> {
+                    while (true) {
+                        val (load, owned) = claim(name)
+                        if (owned) {
+                            try {
+                                val imports = fetch(name)
+                                if (imports == null) {
+                                    // Retried on the next prefetch
+                                    unclaim(name, load)
+                                }
+                                load.complete(imports.orEmpty())
+                                return imports.orEmpty()
+                            } catch (e: Throwable) {
+                                unclaim(name, load)
+                                load.completeExceptionally(e)
+                                throw e
+                            }
+                        }
+                        try {
+                            return load.await()
+                        } catch (e: CancellationException) {
+                            // The call loading it was cancelled, load it here instead
+                            currentCoroutineContext().ensureActive()
+                        }
+                    }
+                }
+
+                fun visit(name: String) {
+                    if (!mutex.withLockSync { visited.add(name) }) {
+                        return
+                    }
+                    launch(dispatcher) {
+                        for (import in awaitLoad(name)) {
+                            visit(import)
+                        }
+                    }
+                }
+
+                for (name in entries) {
+                    visit(name)
+                }
+            }
+        }
+    }
+
+    /**
+     * Drop all prefetched modules.
+     */
+    fun clear() {
+        mutex.withLockSync {
+            modules.clear()
+            loads.clear()
+        }
+    }
+
+    override fun load(name: String): ModuleContent? {
+        return mutex.withLockSync { modules[name] }
+    }
+
+    override fun onCompiled(name: String, bytecode: ByteArray) {
+        // Sources kept after failing to compile on the scratch runtime
+        mutex.withLockSync { modules[name] = ModuleContent.Bytecode(bytecode) }
+        loader.onCompiled(name, bytecode)
+    }
+
+    override fun onLoadFailed(name: String) {
+        mutex.withLockSync {
+            modules.remove(name)
+            loads.remove(name)
+        }
+        loader.onLoadFailed(name)
+    }
+
+    /**
+     * Returns the load of [name], and whether it was created by this call and should be
+     * done by the caller.
+     */
+    private fun claim(name: String): Pair<CompletableDeferred<Collection<String>>, Boolean> {
+        return mutex.withLockSync {
+            val load = loads[name]
+            if (load != null) {
+                load to false
+            } else {
+                CompletableDeferred<Collection<String>>().also { loads[name] = it } to true
+            }
+        }
+    }
+
+    private fun unclaim(name: String, load: CompletableDeferred<Collection<String>>) {
+        mutex.withLockSync {
+            if (loads[name] === load) {
+                loads.remove(name)
+            }
+        }
+    }
+}
@@ -0,0 +1,153 @@
+package com.dokar.quickjs.internal
+
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.qjsError
+
+/**
+ * The binary layout of a module bundle, all integers are little-endian u32:
+ *
+ * ```
+ * Header: magic "QJSB", format version, module count, entry index, version offset, version length
+ * Table:  module count * (name hash, name offset, name length, bytecode offset, bytecode length)
+ * Data:   UTF-8 QuickJS version, names and module bytecode
+ * ```
+ *
+ * The table is sorted by the FNV-1a hash of the names, the entry index points into the
+ * table. Offsets are relative to the start of the bundle. QuickJS bytecode is not compatible
+ * across versions, so a bundle is only read by the QuickJS version that wrote it. Empty
+ * module bytecode is rejected. native/jni/module_bundle.c reads the same layout.
+ */
+internal object ModuleBundle {
+    private const val MAGIC = 0x42534a51 // "QJSB"
+    private const val FORMAT_VERSION = 2
+    private const val HEADER_SIZE = 24
+    private const val TABLE_ENTRY_SIZE = 20
+
+    class Module(
+        val name: String,
+        val bytecodeOffset: Int,
+        val bytecodeLength: Int,
+    )
+
+    class Index(
+        val modules: List<Module>,
+        val entry: Module,
+    )
+
+    fun write(entryName: String, modules: Map<String, ByteArray>, version: String): ByteArray {
+        val names = modules.keys.sortedBy { nameHash(it.encodeToByteArray()).toUInt() }
+        val entryIndex = names.indexOf(entryName)
+        require(entryIndex >= 0) { "Missing entry module '$entryName'." }
+        val encodedNames = names.map { it.encodeToByteArray() }
+        val encodedVersion = version.encodeToByteArray()
+        val dataSize = encodedVersion.size + encodedNames.sumOf { it.size.toLong() } +
+                names.sumOf { modules.getValue(it).size.toLong() }
+        val totalSize = HEADER_SIZE + TABLE_ENTRY_SIZE.toLong() * names.size + dataSize
+        if (totalSize > Int.MAX_VALUE) {
+            qjsError("Module bundle is too large: $totalSize bytes.")
+        }
+
+        val bundle = ByteArray(totalSize.toInt())
+        bundle.putInt(0, MAGIC)
+        bundle.putInt(4, FORMAT_VERSION)
+        bundle.putInt(8, names.size)
+        bundle.putInt(12, entryIndex)
+        var dataOffset = HEADER_SIZE + TABLE_ENTRY_SIZE * names.size
+        bundle.putInt(16, dataOffset)
+        bundle.putInt(20, encodedVersion.size)
+        encodedVersion.copyInto(bundle, dataOffset)
+        dataOffset += encodedVersion.size
+        for ((i, name) in names.withIndex()) {
+            val encodedName = encodedNames[i]
+            val bytecode = modules.getValue(name)
+            val tableOffset = HEADER_SIZE + TABLE_ENTRY_SIZE * i
+            bundle.putInt(tableOffset, nameHash(encodedName))
+            bundle.putInt(tableOffset + 4, dataOffset)
+            bundle.putInt(tableOffset + 8, encodedName.size)
+            encodedName.copyInto(bundle, dataOffset)
+            dataOffset += encodedName.size
+            bundle.putInt(tableOffset + 12, dataOffset)
+            bundle.putInt(tableOffset + 16, bytecode.size)
+            bytecode.copyInto(bundle, dataOffset)
+            dataOffset += bytecode.size
+        }
+        return bundle
+    }
+
+    @Throws(QuickJsException::class)
+    fun read(bundle: ByteArray, version: String): Index {
+        if (bundle.size < HEADER_SIZE ||
+            bundle.getInt(0) != MAGIC ||
+            bundle.getInt(4) != FORMAT_VERSION
+        ) {
+            qjsError("Not a module bundle.")
+        }
+        val count = bundle.getInt(8)
+        val entryIndex = bundle.getInt(12)
+        if (count <= 0 || entryIndex !in 0..<count ||
+            HEADER_SIZE + TABLE_ENTRY_SIZE.toLong() * count > bundle.size
+        ) {
+            qjsError("Corrupted module bundle table.")
+        }
+        val versionOffset = bundle.getInt(16)
+        val versionLength = bundle.getInt(20)
+        if (!bundle.hasRange(versionOffset, versionLength)) {
+            qjsError("Corrupted module bundle table.")
+        }
+        val bundleVersion = bundle.decodeToString(versionOffset, versionOffset + versionLength)
+        if (bundleVersion != version) {
+            qjsError(
+                "Module bundle was compiled by QuickJS $bundleVersion, " +
+                        "but the runtime is $version."
+            )
+        }
+        val modules = List(count) { i ->
+            val tableOffset = HEADER_SIZE + TABLE_ENTRY_SIZE * i
+            val nameOffset = bundle.getInt(tableOffset + 4)
+            val nameLength = bundle.getInt(tableOffset + 8)
+            val bytecodeOffset = bundle.getInt(tableOffset + 12)
+            val bytecodeLength = bundle.getInt(tableOffset + 16)
+            if (!bundle.hasRange(nameOffset, nameLength) ||
+                bytecodeLength == 0 ||
+                !bundle.hasRange(bytecodeOffset, bytecodeLength)
+            ) {
+                qjsError("Corrupted module bundle entry: $i")
+            }
+            val encodedName = bundle.copyOfRange(nameOffset, nameOffset + nameLength)
+            if (nameHash(encodedName) != bundle.getInt(tableOffset)) {
+                qjsError("Corrupted module bundle entry: $i")
+            }
+            Module(encodedName.decodeToString(), bytecodeOffset, bytecodeLength)
+        }
+        return Index(modules, modules[entryIndex])
+    }
+
+    /**
+     * 32-bit FNV-1a hash of a UTF-8 module name.
+     */
+    private fun nameHash(name: ByteArray): Int {
+        var hash = 0x811c9dc5.toInt()
+        for (byte in name) {
+            hash = (hash xor (byte.toInt() and 0xff)) * 0x01000193
+        }
+        return hash
+    }
+
+    private fun ByteArray.hasRange(offset: Int, length: Int): Boolean {
+        return offset >= 0 && length >= 0 && offset.toLong() + length <= size
+    }
+
+    private fun ByteArray.putInt(offset: Int, value: Int) {
+        this[offset] = value.toByte()
+        this[offset + 1] = (value ushr 8).toByte()
+        this[offset + 2] = (value ushr 16).toByte()
+        this[offset + 3] = (value ushr 24).toByte()
+    }
+
+    private fun ByteArray.getInt(offset: Int): Int {
+        return (this[offset].toInt() and 0xff) or
+                ((this[offset + 1].toInt() and 0xff) shl 8) or
+                ((this[offset + 2].toInt() and 0xff) shl 16) or
+                ((this[offset + 3].toInt() and 0xff) shl 24)
+    }
+}
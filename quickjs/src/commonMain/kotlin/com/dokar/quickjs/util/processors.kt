@@ -0,0 +1,6 @@
+package com.dokar.quickjs.util
+
+/**
+ * The number of processors available to the current process, at least 1.
+ */
+internal expect fun availableProcessors(): Int
@@ -37,6 +37,26 @@ class AsyncFunctionsTest {
         }
     }
 
+    @Test
+    fun settledAsyncCallsAreReleased() = runTest {
+        quickJs {
+            asyncFunction("echo") { it.first() }
+            val code = """
+                let sum = 0;
+                for (let i = 0; i < 5000; i++) sum += await echo(1);
+                sum
+            """.trimIndent()
+
+            assertEquals(5000, evaluate<Int>(code))
+            gc()
+            val baseline = memoryUsage.mallocSize
+            repeat(4) { assertEquals(5000, evaluate<Int>(code)) }
+            gc()
+            // Leaked resolve/reject functions would add several MB
+            assertTrue(memoryUsage.mallocSize - baseline < 512 * 1024)
+        }
+    }
+
     @Test
     fun evaluateInsideAsyncFunction() = runTest {
         quickJs {
@@ -0,0 +1,108 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.CompileCache
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.StripDebugInfo
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+import kotlin.test.assertFalse
+import kotlin.test.assertTrue
+
+class CompileCacheTest {
+    @Test
+    fun repeatedEvaluationsHitTheCache() = runTest {
+        val cache = CompileCache()
+        quickJs {
+            compileCache = cache
+            evaluate<Any?>("globalThis.count = 0")
+            repeat(3) {
+                assertEquals(it + 1, evaluate<Int>("++count"))
+            }
+            assertEquals(2, cache.size)
+        }
+    }
+
+    @Test
+    fun filenameAndModuleFlagArePartOfTheKey() = runTest {
+        val cache = CompileCache()
+        quickJs {
+            compileCache = cache
+            evaluate<Any?>("1", filename = "a.js")
+            evaluate<Any?>("1", filename = "b.js")
+            evaluate<Any?>("1", filename = "a.js", asModule = true)
+            assertEquals(3, cache.size)
+        }
+    }
+
+    @Test
+    fun stripDebugInfoIsPartOfTheKey() = runTest {
+        val cache = CompileCache()
+        val code = "(function add(a, b) { return a + b; }).toString()"
+        quickJs {
+            compileCache = cache
+            assertTrue(evaluate<String>(code).contains("return a + b"))
+        }
+        quickJs {
+            compileCache = cache
+            stripDebugInfo = StripDebugInfo.Source
+            assertFalse(evaluate<String>(code).contains("return a + b"))
+        }
+        assertEquals(2, cache.size)
+    }
+
+    @Test
+    fun sharedAcrossInstances() = runTest {
+        val cache = CompileCache()
+        quickJs {
+            compileCache = cache
+            assertEquals("Hi", evaluate<String>("'H' + 'i'"))
+        }
+        quickJs {
+            compileCache = cache
+            assertEquals("Hi", evaluate<String>("'H' + 'i'"))
+        }
+        assertEquals(1, cache.size)
+    }
+
+    @Test
+    fun evictsLeastRecentlyUsed() = runTest {
+        val cache = CompileCache(maxEntries = 2)
+        quickJs {
+            compileCache = cache
+            evaluate<Any?>("1")
+            evaluate<Any?>("2")
+            evaluate<Any?>("1")
+            evaluate<Any?>("3")
+            assertEquals(2, cache.size)
+        }
+        cache.clear()
+        assertEquals(0, cache.size)
+        assertEquals(0L, cache.sizeInBytes)
+    }
+
+    @Test
+    fun syntaxErrorsAreNotCached() = runTest {
+        val cache = CompileCache()
+        quickJs {
+            compileCache = cache
+            assertFailsWith<QuickJsException> { evaluate<Any?>("let = ;") }
+            assertEquals(0, cache.size)
+        }
+    }
+
+    @Test
+    fun cachedModuleEvaluation() = runTest {
+        val cache = CompileCache()
+        quickJs {
+            compileCache = cache
+            val code = "globalThis.result = await Promise.resolve('module');"
+            repeat(2) {
+                evaluate<Any?>(code, asModule = true)
+                assertEquals("module", evaluate<String>("result"))
+            }
+        }
+    }
+}
@@ -1,10 +1,13 @@
 package com.dokar.quickjs.test
 
+import com.dokar.quickjs.StripDebugInfo
 import com.dokar.quickjs.quickJs
 import kotlinx.coroutines.test.runTest
 import kotlin.test.Test
 import kotlin.test.assertEquals
 import kotlin.test.assertFails
+import kotlin.test.assertFalse
+import kotlin.test.assertTrue
 
 class CompileTest {
     @Test
@@ -15,6 +18,37 @@ class CompileTest {
         }
     }
 
+    @Test
+    fun compileWithStrippedDebugInfo() = runTest {
+        val code = """
+            function add(a, b) {
+                return a + b;
+            }
+            add(1, 2);
+        """.trimIndent()
+        quickJs {
+            val full = compile(code)
+            val noSource = compile(code, stripDebugInfo = StripDebugInfo.Source)
+            val stripped = compile(code, stripDebugInfo = StripDebugInfo.All)
+            assertTrue(noSource.size < full.size)
+            assertTrue(stripped.size < noSource.size)
+            assertEquals(3, evaluate(stripped))
+            // The runtime setting is not changed
+            assertEquals(StripDebugInfo.None, stripDebugInfo)
+            assertEquals(full.size, compile(code).size)
+        }
+    }
+
+    @Test
+    fun stripSourceOfRuntime() = runTest {
+        quickJs {
+            val code = "(function add(a, b) { return a + b; }).toString()"
+            assertTrue(evaluate<String>(code).contains("return a + b"))
+            stripDebugInfo = StripDebugInfo.Source
+            assertFalse(evaluate<String>(code).contains("return a + b"))
+        }
+    }
+
     @Test
     fun evaluateMalformedBytecode() = runTest {
         quickJs {
@@ -0,0 +1,91 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.binding.asyncFunction
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertContains
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+
+class EvaluateSyncTest {
+    @Test
+    fun evaluateSyncReturnsResult() = runTest {
+        quickJs {
+            assertEquals(42, evaluateSync<Int>("40 + 2"))
+            assertEquals("Hi", evaluateSync<String>("['H', 'i'].join('')"))
+        }
+    }
+
+    @Test
+    fun evaluateSyncUnwrapsSettledPromises() = runTest {
+        quickJs {
+            assertEquals(3, evaluateSync<Int>("Promise.resolve(1).then((it) => it + 2)"))
+            val error = assertFailsWith<QuickJsException> {
+                evaluateSync<Any?>("Promise.reject(new Error('Boom'))")
+            }
+            assertContains(error.message!!, "Boom")
+        }
+    }
+
+    @Test
+    fun evaluateSyncRunsPendingJobs() = runTest {
+        quickJs {
+            evaluateSync<Any?>("globalThis.done = false; Promise.resolve().then(() => done = true)")
+            assertEquals(true, evaluateSync<Boolean>("done"))
+        }
+    }
+
+    @Test
+    fun evaluateSyncModule() = runTest {
+        quickJs {
+            var result: Any? = null
+            function("returns") { result = it.first() }
+            evaluateSync<Any?>(
+                code = "const value = await Promise.resolve(5); returns(value);",
+                asModule = true,
+            )
+            assertEquals(5L, result)
+        }
+    }
+
+    @Test
+    fun evaluateSyncBytecode() = runTest {
+        quickJs {
+            val bytecode = compile("21 * 2")
+            assertEquals(42, evaluateSync<Int>(bytecode))
+        }
+    }
+
+    @Test
+    fun evaluateSyncWithSyncBindings() = runTest {
+        quickJs {
+            function("add") { (it[0] as Long) + (it[1] as Long) }
+            assertEquals(3L, evaluateSync<Long>("add(1, 2)"))
+        }
+    }
+
+    @Test
+    fun evaluateSyncFailsOnAsyncBindings() = runTest {
+        quickJs {
+            asyncFunction("fetch") { "Hello" }
+            assertFailsWith<QuickJsException> {
+                evaluateSync<String>("fetch()")
+            }
+            // The instance is still usable
+            assertEquals("Hello", evaluate<String>("await fetch()"))
+        }
+    }
+
+    @Test
+    fun evaluateSyncThrowsErrors() = runTest {
+        quickJs {
+            val error = assertFailsWith<QuickJsException> {
+                evaluateSync<Any?>("throw new TypeError('Bad')")
+            }
+            assertContains(error.message!!, "Bad")
+        }
+    }
+}
@@ -0,0 +1,150 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertContains
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+
+class JsFunctionRefTest {
+    @Test
+    fun callFunctionRef() = runTest {
+        quickJs {
+            evaluate<Any?>("function add(a, b) { return a + b; }")
+            getFunction("add").use { add ->
+                assertEquals(3, add.call<Int>(1, 2))
+                assertEquals("ab", add.call<String>("a", "b"))
+                for (i in 0..<1000) {
+                    assertEquals(i + 1L, add.call<Long>(i, 1))
+                }
+            }
+        }
+    }
+
+    @Test
+    fun callKeepsFunctionState() = runTest {
+        quickJs {
+            evaluate<Any?>(
+                """
+                    let count = 0;
+                    globalThis.next = () => ++count;
+                """.trimIndent()
+            )
+            val next = getFunction("next")
+            next.call<Any?>()
+            next.call<Any?>()
+            assertEquals(3, next.call<Int>())
+            assertEquals(3, evaluate<Int>("count"))
+            next.close()
+        }
+    }
+
+    @Test
+    fun callUnwrapsSettledPromises() = runTest {
+        quickJs {
+            evaluate<Any?>("async function double(value) { return value * 2; }")
+            getFunction("double").use { assertEquals(42, it.call<Int>(21)) }
+        }
+    }
+
+    @Test
+    fun callRethrowsErrors() = runTest {
+        quickJs {
+            evaluate<Any?>("function fail(message) { throw new Error(message); }")
+            getFunction("fail").use { fail ->
+                val error = assertFailsWith<QuickJsException> { fail.call<Any?>("Boom") }
+                assertContains(error.message!!, "Boom")
+            }
+        }
+    }
+
+    @Test
+    fun functionIsKeptWhenGlobalChanges() = runTest {
+        quickJs {
+            evaluate<Any?>("function answer() { return 42; }")
+            getFunction("answer").use { answer ->
+                evaluate<Any?>("answer = undefined")
+                assertEquals(42, answer.call<Int>())
+            }
+        }
+    }
+
+    @Test
+    fun callWithNumbers() = runTest {
+        quickJs {
+            evaluate<Any?>("function score(a, b, c) { return a * b + c; }")
+            getFunction("score").use { score ->
+                assertEquals(7.5, score.callDouble(2.0, 3.0, 1.5))
+                assertEquals(7L, score.callLong(2, 3, 1))
+                assertEquals(Double.NaN, score.callDouble())
+                var sum = 0.0
+                for (i in 0..<1000) {
+                    sum += score.callDouble(i.toDouble(), 0.5, 0.0)
+                }
+                assertEquals(249750.0, sum)
+            }
+        }
+    }
+
+    @Test
+    fun callWithNumbersTruncatesLongResults() = runTest {
+        quickJs {
+            evaluate<Any?>("function half(value) { return value / 2; }")
+            getFunction("half").use { assertEquals(2L, it.callLong(5)) }
+        }
+    }
+
+    @Test
+    fun callWithNumbersRequiresNumberResults() = runTest {
+        quickJs {
+            evaluate<Any?>("function text() { return 'text'; }")
+            getFunction("text").use { text ->
+                assertFailsWith<QuickJsException> { text.callDouble() }
+                assertFailsWith<QuickJsException> { text.callLong() }
+            }
+        }
+    }
+
+    @Test
+    fun getNonFunction() = runTest {
+        quickJs {
+            evaluate<Any?>("globalThis.value = 1")
+            assertFailsWith<QuickJsException> { getFunction("value") }
+            assertFailsWith<QuickJsException> { getFunction("missing") }
+        }
+    }
+
+    @Test
+    fun callClosedRef() = runTest {
+        quickJs {
+            evaluate<Any?>("function answer() { return 42; }")
+            val answer = getFunction("answer")
+            answer.close()
+            answer.close()
+            assertFailsWith<QuickJsException> { answer.call<Int>() }
+        }
+    }
+
+    @Test
+    fun refsAreReleasedOnReset() = runTest {
+        quickJs {
+            evaluate<Any?>("function answer() { return 42; }")
+            val answer = getFunction("answer")
+            reset()
+            assertFailsWith<QuickJsException> { answer.call<Int>() }
+            answer.close()
+        }
+    }
+
+    @Test
+    fun closeRefAfterQuickJs() = runTest {
+        val answer = quickJs {
+            evaluate<Any?>("function answer() { return 42; }")
+            getFunction("answer")
+        }
+        assertFailsWith<QuickJsException> { answer.call<Int>() }
+        answer.close()
+    }
+}
@@ -50,6 +50,22 @@ class JsPromiseTest {
         }
     }
 
+    @Test
+    fun longPromiseChain() = runTest {
+        quickJs {
+            val result = evaluate<Int>(
+                """
+                let promise = Promise.resolve(0);
+                for (let i = 0; i < 10000; i++) {
+                    promise = promise.then((value) => value + 1);
+                }
+                await promise
+                """.trimIndent()
+            )
+            assertEquals(10000, result)
+        }
+    }
+
     @Test
     fun promiseWithoutAwait() = runTest {
         quickJs {
@@ -0,0 +1,156 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.ModuleContent
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.moduleLoader
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+import kotlin.test.assertTrue
+
+class ModuleBundleTest {
+    private val sources = mapOf(
+        "middle" to """
+            import { value } from "leaf";
+            export const result = value * 2;
+        """.trimIndent(),
+        "leaf" to "export const value = 21;",
+    )
+
+    private val entry = """
+        import { result } from "middle";
+        returns(result);
+    """.trimIndent()
+
+    @Test
+    fun evaluateBundleWithoutLoadingModules() = runTest {
+        val loader = moduleLoader {
+            load { name -> sources[name]?.let(ModuleContent::Source) }
+        }
+        val bundle = quickJs(moduleLoader = loader) {
+            compileBundle(entry, filename = "entry")
+        }
+
+        val loaded = mutableListOf<String>()
+        val emptyLoader = moduleLoader {
+            load { name ->
+                loaded += name
+                null
+            }
+        }
+        quickJs(moduleLoader = emptyLoader) {
+            var result: Any? = null
+            function("returns") { result = it.first() }
+            evaluateBundle<Any?>(bundle)
+            assertEquals(42L, result)
+        }
+        assertTrue(loaded.isEmpty())
+    }
+
+    @Test
+    fun bundleModulesLoadedAsBytecode() = runTest {
+        val bytecode = quickJs {
+            sources.mapValues { (name, code) -> compile(code, name, asModule = true) }
+        }
+        val loader = moduleLoader {
+            load { name -> bytecode[name]?.let(ModuleContent::Bytecode) }
+        }
+        quickJs(moduleLoader = loader) {
+            val bundle = compileBundle(entry, filename = "entry")
+            var result: Any? = null
+            function("returns") { result = it.first() }
+            evaluateBundle<Any?>(bundle)
+            assertEquals(42L, result)
+        }
+    }
+
+    @Test
+    fun evaluateInvalidBundle() = runTest {
+        quickJs {
+            assertFailsWith<QuickJsException> {
+                evaluateBundle<Any?>(byteArrayOf(1, 2, 3))
+            }
+            val bundle = compileBundle("export const a = 1;")
+            // Point the entry name to another offset
+            bundle[28] = (bundle[28] + 1).toByte()
+            assertFailsWith<QuickJsException> {
+                evaluateBundle<Any?>(bundle)
+            }
+        }
+    }
+
+    @Test
+    fun evaluateBundleTwice() = runTest {
+        val largeSources = sources + ("leaf" to
+                "export const value = 21; export const data = [${(0..<5000).joinToString()}];")
+        val loader = moduleLoader {
+            load { name -> largeSources[name]?.let(ModuleContent::Source) }
+        }
+        quickJs(moduleLoader = loader) {
+            val leafSize = compile(largeSources.getValue("leaf"), "leaf", asModule = true).size
+            val bundle = compileBundle(entry, filename = "entry")
+            var result: Any? = null
+            function("returns") { result = it.first() }
+
+            evaluateBundle<Any?>(bundle)
+            gc()
+            val usedSize = memoryUsage.memoryUsedSize
+            result = null
+            evaluateBundle<Any?>(bundle)
+            gc()
+
+            assertEquals(42L, result)
+            // The bundled modules are not read again
+            assertTrue(memoryUsage.memoryUsedSize - usedSize < leafSize / 2)
+        }
+    }
+
+    @Test
+    fun rejectEmptyBundleModule() = runTest {
+        val loader = moduleLoader {
+            load { name -> sources[name]?.let(ModuleContent::Source) }
+        }
+        val bundle = quickJs(moduleLoader = loader) {
+            compileBundle(entry, filename = "entry")
+        }
+        val entryIndex = bundle[12].toInt()
+        val emptyIndex = if (entryIndex == 0) 1 else 0
+        // Clear the bytecode length of a module that is not the entry
+        for (i in 0..<4) {
+            bundle[24 + 20 * emptyIndex + 16 + i] = 0
+        }
+        quickJs {
+            function("returns") {}
+            assertFailsWith<QuickJsException> {
+                evaluateBundle<Any?>(bundle)
+            }
+        }
+    }
+
+    @Test
+    fun evaluateScriptBundle() = runTest {
+        val bundle = quickJs {
+            compileBundle("1 + 2", filename = "script.js", asModule = false)
+        }
+        quickJs {
+            assertEquals(3L, evaluateBundle<Long>(bundle))
+        }
+    }
+
+    @Test
+    fun rejectBundleOfAnotherVersion() = runTest {
+        quickJs {
+            val bundle = compileBundle("export const a = 1;")
+            // Change the first char of the stamped QuickJS version
+            val versionOffset = bundle[16].toInt() and 0xff
+            bundle[versionOffset] = (bundle[versionOffset] + 1).toByte()
+            val error = assertFailsWith<QuickJsException> {
+                evaluateBundle<Any?>(bundle)
+            }
+            assertTrue(error.message!!.contains(version))
+        }
+    }
+}
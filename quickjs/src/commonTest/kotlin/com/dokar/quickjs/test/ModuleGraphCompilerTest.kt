@@ -0,0 +1,77 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.ModuleContent
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.compileModuleGraph
+import com.dokar.quickjs.moduleLoader
+import com.dokar.quickjs.quickJs
+import com.dokar.quickjs.util.withLockSync
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+
+class ModuleGraphCompilerTest {
+    private val sources = mapOf(
+        "entry" to """
+            import { a } from "a";
+            import { b } from "b";
+            returns(a + b);
+        """.trimIndent(),
+        "a" to """
+            import { value } from "shared";
+            export const a = value;
+        """.trimIndent(),
+        "b" to """
+            import { value } from "shared";
+            export const b = value * 2;
+        """.trimIndent(),
+        "shared" to "export const value = 14;",
+        "unused" to "export const value = 0;",
+    )
+
+    @Test
+    fun compileGraphConcurrently() = runTest {
+        val mutex = Mutex()
+        val loaded = mutableListOf<String>()
+        val compiled = mutableMapOf<String, ByteArray>()
+        val loader = moduleLoader {
+            load { name ->
+                mutex.withLockSync { loaded += name }
+                sources[name]?.let(ModuleContent::Source)
+            }
+            onCompiled { name, bytecode -> mutex.withLockSync { compiled[name] = bytecode } }
+        }
+
+        val modules = compileModuleGraph(listOf("entry"), loader, parallelism = 3)
+        assertEquals(setOf("entry", "a", "b", "shared"), modules.keys)
+        assertEquals(modules.keys, compiled.keys)
+        // Every module is loaded once
+        assertEquals(modules.keys.sorted(), loaded.sorted())
+
+        val bytecodeLoader = moduleLoader {
+            load { name -> modules[name]?.let(ModuleContent::Bytecode) }
+        }
+        quickJs(moduleLoader = bytecodeLoader) {
+            var result: Any? = null
+            function("returns") { result = it.first() }
+            evaluate<Any?>(modules.getValue("entry"))
+            assertEquals(42L, result)
+        }
+    }
+
+    @Test
+    fun compileGraphWithMissingModule() = runTest {
+        val failed = mutableListOf<String>()
+        val loader = moduleLoader {
+            load { name -> if (name == "shared") null else sources[name]?.let(ModuleContent::Source) }
+            onLoadFailed { name -> failed += name }
+        }
+        assertFailsWith<QuickJsException> {
+            compileModuleGraph(listOf("entry"), loader, parallelism = 1)
+        }
+        assertEquals(listOf("shared"), failed)
+    }
+}
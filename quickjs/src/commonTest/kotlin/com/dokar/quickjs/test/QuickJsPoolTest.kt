@@ -0,0 +1,41 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.QuickJsPool
+import com.dokar.quickjs.binding.function
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+
+class QuickJsPoolTest {
+    @Test
+    fun evaluateOnPreparedInstances() = runTest {
+        val pool = QuickJsPool.create(
+            jobDispatcher = Dispatchers.Default,
+            parallelism = 2,
+        ) {
+            function("double") { (it.first() as Long) * 2 }
+        }
+        try {
+            assertEquals(2, pool.size)
+            val results = List(100) { index ->
+                async { pool.evaluate<Long>("double($index)") }
+            }.awaitAll()
+            assertEquals(List(100) { it * 2L }, results)
+        } finally {
+            pool.close()
+        }
+    }
+
+    @Test
+    fun useClosedPool() = runTest {
+        val pool = QuickJsPool.create(jobDispatcher = Dispatchers.Default, parallelism = 1)
+        pool.close()
+        assertFailsWith<IllegalStateException> {
+            pool.evaluate<Int>("1 + 1")
+        }
+    }
+}
@@ -0,0 +1,97 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.ExperimentalQuickJsApi
+import com.dokar.quickjs.ModuleContent
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.StripDebugInfo
+import com.dokar.quickjs.binding.define
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.moduleLoader
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+import kotlin.test.assertTrue
+
+@OptIn(ExperimentalQuickJsApi::class)
+class RealmTest {
+    @Test
+    fun realmsHaveSeparateGlobals() = runTest {
+        quickJs {
+            function("name") { "main" }
+            evaluate<Any?>("globalThis.shared = 1")
+
+            val realm = openRealm()
+            realm.function("name") { "realm" }
+
+            assertEquals("undefined", realm.evaluate<String>("typeof shared"))
+            assertEquals("realm", realm.evaluate<String>("name()"))
+            assertEquals("main", evaluate<String>("name()"))
+
+            realm.close()
+            assertEquals(1, evaluate<Int>("shared"))
+        }
+    }
+
+    @Test
+    fun realmsShareModuleLoader() = runTest {
+        val loader = moduleLoader {
+            load { name ->
+                if (name == "answer") ModuleContent.Source("export default 42;") else null
+            }
+        }
+        quickJs(moduleLoader = loader) {
+            val realm = openRealm()
+            var result: Any? = null
+            realm.function("returns") { result = it.first() }
+            realm.evaluate<Any?>(
+                "import answer from 'answer'; returns(answer);",
+                asModule = true,
+            )
+            assertEquals(42L, result)
+        }
+    }
+
+    @Test
+    fun realmsShareStripDebugInfo() = runTest {
+        quickJs {
+            val realm = openRealm()
+            realm.stripDebugInfo = StripDebugInfo.Source
+            assertEquals(StripDebugInfo.Source, stripDebugInfo)
+
+            stripDebugInfo = StripDebugInfo.None
+            assertEquals(StripDebugInfo.None, realm.stripDebugInfo)
+            val code = "(function add(a, b) { return a + b; }).toString()"
+            assertTrue(realm.evaluate<String>(code).contains("return a + b"))
+        }
+    }
+
+    @Test
+    fun realmBindingsAreReleasedWithRealm() = runTest {
+        quickJs {
+            gc()
+            val objectCount = memoryUsage.objCount
+            repeat(3) {
+                val realm = openRealm()
+                realm.function("name") { "realm" }
+                realm.define("app") {
+                    property("version") {
+                        getter { 1 }
+                    }
+                }
+                assertEquals("realm", realm.evaluate<String>("name()"))
+                realm.close()
+            }
+            gc()
+            assertEquals(objectCount, memoryUsage.objCount)
+        }
+    }
+
+    @Test
+    fun realmsAreClosedWithOwner() = runTest {
+        val realm = quickJs { openRealm() }
+        assertTrue(realm.isClosed)
+        assertFailsWith<QuickJsException> { realm.evaluate<Int>("1") }
+    }
+}
@@ -0,0 +1,90 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.binding.asyncFunction
+import com.dokar.quickjs.binding.define
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+
+class ResetTest {
+    @Test
+    fun resetDiscardsGlobalsAndKeepsBindings() = runTest {
+        quickJs {
+            define("app") {
+                property("name") {
+                    getter { "QuickJs" }
+                }
+                define("nested") {
+                    function("answer") { 42 }
+                }
+            }
+            function("double") { (it.first() as Long) * 2 }
+            asyncFunction("delayed") { it.first() }
+
+            evaluate<Any?>("globalThis.leftover = 1")
+            assertEquals("number", evaluate<String>("typeof leftover"))
+
+            reset()
+
+            assertEquals("undefined", evaluate<String>("typeof leftover"))
+            assertEquals("QuickJs", evaluate<String>("app.name"))
+            assertEquals(42, evaluate<Int>("app.nested.answer()"))
+            assertEquals(4L, evaluate<Long>("double(2)"))
+            assertEquals("async", evaluate<String>("await delayed('async')"))
+        }
+    }
+
+    @Test
+    fun resetReappliesAddedModules() = runTest {
+        quickJs {
+            @Suppress("DEPRECATION")
+            addModule(name = "hello", code = "export const greeting = 'Hi';")
+            var result: Any? = null
+            function("returns") { result = it.first() }
+
+            reset()
+
+            evaluate<Any?>(
+                "import { greeting } from 'hello'; returns(greeting);",
+                asModule = true,
+            )
+            assertEquals("Hi", result)
+        }
+    }
+
+    @Test
+    fun resetWithNeverEndingMicrotasks() = runTest {
+        quickJs {
+            var ticks = 0
+            function("tick") { ticks++ }
+            // The failed evaluation leaves the loops queued
+            assertFailsWith<QuickJsException> {
+                evaluate<Any?>(
+                    """
+                        (async () => { for (;;) await 0; })();
+                        (async () => { for (;;) { tick(); await 0; } })();
+                        throw new Error("Stop");
+                    """.trimIndent()
+                )
+            }
+            val queuedTicks = ticks
+
+            reset()
+
+            assertEquals(queuedTicks, ticks)
+            assertEquals(2, evaluate<Int>("1 + 1"))
+            evaluate<Any?>("tick()")
+            assertEquals(queuedTicks + 1, ticks)
+        }
+    }
+
+    @Test
+    fun resetClosedInstance() = runTest {
+        val instance = quickJs { this }
+        assertFailsWith<QuickJsException> { instance.reset() }
+    }
+}
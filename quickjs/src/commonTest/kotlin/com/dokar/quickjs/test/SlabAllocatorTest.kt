@@ -0,0 +1,64 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.QuickJs
+import com.dokar.quickjs.QuickJsAllocator
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.binding.function
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+import kotlin.test.assertTrue
+
+class SlabAllocatorTest {
+    @Test
+    fun evaluateWithSlabAllocator() = runTest {
+        val quickJs = QuickJs.create(Dispatchers.Default, null, QuickJsAllocator.Slab)
+        try {
+            quickJs.function("join") { it.joinToString(",") }
+            val code = """
+                const items = [];
+                for (let i = 0; i < 10000; i++) {
+                    items.push({ index: i, name: 'item' + i, tags: [i, i * 2] });
+                }
+                const big = 'x'.repeat(100000);
+                join(items.length, items[9999].name, big.length)
+            """.trimIndent()
+            assertEquals("10000,item9999,100000", quickJs.evaluate<String>(code))
+            quickJs.gc()
+            assertTrue(quickJs.memoryUsage.mallocCount > 0)
+        } finally {
+            quickJs.close()
+        }
+    }
+
+    @Test
+    fun resetReleasesFreeSlabs() = runTest {
+        val quickJs = QuickJs.create(Dispatchers.Default, null, QuickJsAllocator.Slab)
+        try {
+            quickJs.evaluate<Any?>("globalThis.data = Array.from({ length: 50000 }, (_, i) => ({ i }))")
+            val before = quickJs.memoryUsage.mallocSize
+            quickJs.reset()
+            assertTrue(quickJs.memoryUsage.mallocSize < before)
+            assertEquals(3, quickJs.evaluate<Int>("1 + 2"))
+        } finally {
+            quickJs.close()
+        }
+    }
+
+    @Test
+    fun memoryLimitWithSlabAllocator() = runTest {
+        val quickJs = QuickJs.create(Dispatchers.Default, null, QuickJsAllocator.Slab)
+        try {
+            quickJs.memoryLimit = 2 * 1024 * 1024L
+            assertFailsWith<QuickJsException> {
+                quickJs.evaluate<Any?>("const a = []; while (true) a.push({})")
+            }
+            // Block headers count against the limit too
+            assertTrue(quickJs.memoryUsage.mallocSize <= quickJs.memoryLimit)
+        } finally {
+            quickJs.close()
+        }
+    }
+}
@@ -0,0 +1,104 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.ModuleContent
+import com.dokar.quickjs.PrefetchingModuleLoader
+import com.dokar.quickjs.SuspendModuleLoader
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.test.StandardTestDispatcher
+import kotlinx.coroutines.test.advanceTimeBy
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertNotNull
+import kotlin.test.assertNull
+
+class SuspendModuleLoaderTest {
+    private val sources = mapOf(
+        "entry" to """
+            import { a } from "a";
+            import { b } from "b";
+            export const result = a + b;
+        """.trimIndent(),
+        "a" to "export const a = 20;",
+        "b" to "export const b = 22;",
+    )
+
+    private class DelayedLoader(private val sources: Map<String, String>) : SuspendModuleLoader {
+        val loaded = mutableListOf<String>()
+        val compiled = mutableListOf<String>()
+        var loading = 0
+        var maxLoading = 0
+
+        override suspend fun load(name: String): ModuleContent? {
+            loaded += name
+            loading++
+            maxLoading = maxOf(maxLoading, loading)
+            delay(100)
+            loading--
+            return sources[name]?.let(ModuleContent::Source)
+        }
+
+        override fun onCompiled(name: String, bytecode: ByteArray) {
+            compiled += name
+        }
+    }
+
+    @Test
+    fun prefetchGraphConcurrently() = runTest {
+        val source = DelayedLoader(sources)
+        val loader = PrefetchingModuleLoader(source)
+        loader.prefetch(listOf("entry"), StandardTestDispatcher(testScheduler))
+        assertEquals(setOf("entry", "a", "b"), source.loaded.toSet())
+        assertEquals(setOf("entry", "a", "b"), source.compiled.toSet())
+        // Imports of the entry are loaded at the same time
+        assertEquals(2, source.maxLoading)
+
+        quickJs(moduleLoader = loader) {
+            var result: Any? = null
+            function("returns") { result = it.first() }
+            evaluate<Any?>(
+                """
+                    import { result } from "entry";
+                    returns(result);
+                """.trimIndent(),
+                asModule = true,
+            )
+            assertEquals(42L, result)
+        }
+        // Resolved from the prefetched bytecode
+        assertEquals(3, source.loaded.size)
+        assertEquals(3, source.compiled.size)
+    }
+
+    @Test
+    fun missingModulesAreNotPrefetched() = runTest {
+        val source = DelayedLoader(sources)
+        val loader = PrefetchingModuleLoader(source)
+        loader.prefetch(listOf("missing"), StandardTestDispatcher(testScheduler))
+        assertNull(loader.load("missing"))
+        // Retried on the next prefetch
+        loader.prefetch(listOf("missing"), StandardTestDispatcher(testScheduler))
+        assertEquals(listOf("missing", "missing"), source.loaded)
+    }
+
+    @Test
+    fun concurrentPrefetchesAwaitInFlightModules() = runTest {
+        val source = DelayedLoader(sources)
+        val loader = PrefetchingModuleLoader(source)
+        val dispatcher = StandardTestDispatcher(testScheduler)
+        val first = launch { loader.prefetch(listOf("entry"), dispatcher) }
+        advanceTimeBy(50)
+        assertEquals(listOf("entry"), source.loaded)
+        // Starts while the entry is being loaded by the first call
+        loader.prefetch(listOf("entry"), dispatcher)
+        // The whole graph is loaded when the second call returns
+        assertNotNull(loader.load("a"))
+        assertNotNull(loader.load("b"))
+        first.join()
+        // Each module is loaded once
+        assertEquals(3, source.loaded.size)
+    }
+}
@@ -92,6 +92,35 @@ class TypeMappingTest {
         }
     }
 
+    @Test
+    fun ktReturnsRepeatedTypes() = runTest {
+        quickJs {
+            function("mixedValues") {
+                listOf(
+                    1, "a", listOf(1), mutableListOf(2), emptyList<Int>(), setOf(3), 0.5, true,
+                    byteArrayOf(5), arrayOf("b"), mapOf("c" to 6), mapOf("d" to 7).toJsObject(),
+                    Unit, null,
+                )
+            }
+            function("unsupported") { Any() }
+
+            val expected = "1|a|[1]|[2]|[]|Set|0.5|true|Int8Array|[\"b\"]|Map|{\"d\":7}|" +
+                "undefined|null"
+            val code = """
+                mixedValues().map((value) => {
+                    if (value instanceof Set || value instanceof Map || value instanceof Int8Array) {
+                        return value.constructor.name;
+                    }
+                    return typeof value === "object" ? JSON.stringify(value) : String(value);
+                }).join("|");
+            """.trimIndent()
+            repeat(3) {
+                assertEquals(expected, evaluate<String>(code))
+                assertFails { evaluate("unsupported()") }
+            }
+        }
+    }
+
     @Test
     fun jsPassesNumbers() = runTest {
         quickJs {
@@ -280,6 +309,45 @@ class TypeMappingTest {
         }
     }
 
+    @Test
+    fun jsDeepLevelCircularRefs() = runTest {
+        quickJs {
+            assertFails {
+                evaluate<Any?>(
+                    """
+                        const root = { children: [] };
+                        root.children.push(new Map([["parent", { nodes: [root] }]]));
+                        root;
+                    """.trimIndent()
+                )
+            }.also {
+                assertContains(it.message!!, "circular reference")
+            }
+
+            assertFails {
+                evaluate<Any?>("const set = new Set(); set.add([set]); set;")
+            }.also {
+                assertContains(it.message!!, "circular reference")
+            }
+        }
+    }
+
+    @Test
+    fun jsSharedRefObjects() = runTest {
+        quickJs {
+            val result = evaluate<List<Map<String, Any?>>>(
+                """
+                    const shared = { value: 1 };
+                    [{ a: shared, b: shared }, { c: [shared, shared] }];
+                """.trimIndent()
+            )
+            val shared = mapOf("value" to 1L).toJsObject()
+            assertEquals(shared, result[0]["a"])
+            assertEquals(shared, result[0]["b"])
+            assertEquals(listOf(shared, shared), result[1]["c"])
+        }
+    }
+
     @Test
     fun ktCircularRefObjects() = runTest {
         quickJs {
@@ -356,6 +424,34 @@ class TypeMappingTest {
         }
     }
 
+    @Test
+    fun ktSharedRefObjects() = runTest {
+        quickJs {
+            val shared = listOf(1, 2)
+            function("sharedRefs") {
+                mapOf(
+                    "lists" to listOf(shared, shared),
+                    "arrays" to arrayOf(shared, arrayOf(shared)),
+                    "objects" to mapOf("a" to shared, "b" to shared).toJsObject(),
+                )
+            }
+
+            assertEquals(
+                "[[1,2],[1,2]]|[[1,2],[[1,2]]]|{\"a\":[1,2],\"b\":[1,2]}",
+                evaluate(
+                    """
+                        const refs = sharedRefs();
+                        [
+                            JSON.stringify(refs.get("lists")),
+                            JSON.stringify(refs.get("arrays")),
+                            JSON.stringify(refs.get("objects")),
+                        ].join("|");
+                    """.trimIndent()
+                )
+            )
+        }
+    }
+
     @Test
     fun typedParameters() = runTest {
         quickJs {
@@ -0,0 +1,54 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+
+class Utf8SourceTest {
+    @Test
+    fun evaluateUtf8Bytes() = runTest {
+        quickJs {
+            assertEquals("你好, 42", evaluateUtf8<String>("'你好, ' + (40 + 2)".encodeToByteArray()))
+        }
+    }
+
+    @Test
+    fun evaluateUtf8WithLength() = runTest {
+        quickJs {
+            // Trailing bytes are ignored, with or without a terminator after the length
+            val code = "1 + 2;garbage".encodeToByteArray()
+            assertEquals(3, evaluateUtf8<Int>(code, length = 5))
+            val terminated = "1 + 2\u0000".encodeToByteArray()
+            assertEquals(3, evaluateUtf8<Int>(terminated, length = terminated.size - 1))
+        }
+    }
+
+    @Test
+    fun evaluateUtf8Module() = runTest {
+        quickJs {
+            val code = "await Promise.resolve(); globalThis.result = 'done';".encodeToByteArray()
+            evaluateUtf8<Any?>(code, asModule = true)
+            assertEquals("done", evaluate<String>("result"))
+        }
+    }
+
+    @Test
+    fun evaluateUtf8InvalidLength() = runTest {
+        quickJs {
+            val code = "1".encodeToByteArray()
+            assertFailsWith<QuickJsException> { evaluateUtf8<Any?>(code, length = 2) }
+            assertFailsWith<QuickJsException> { evaluateUtf8<Any?>(code, length = -1) }
+        }
+    }
+
+    @Test
+    fun compileUtf8Bytes() = runTest {
+        quickJs {
+            val bytecode = compileUtf8("'Hello, ' + 'UTF-8'".encodeToByteArray())
+            assertEquals("Hello, UTF-8", evaluate<String>(bytecode))
+        }
+    }
+}
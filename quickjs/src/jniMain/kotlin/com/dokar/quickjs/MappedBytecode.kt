@@ -0,0 +1,25 @@
+package com.dokar.quickjs
+
+import java.nio.ByteBuffer
+
+/**
+ * ES module bytecode that QuickJS reads in place from a direct [ByteBuffer], such as a
+ * [java.nio.MappedByteBuffer] of a bytecode file, without copying it to the heap.
+ *
+ * The bytes between the position and the limit of the buffer are used. A mapped buffer can
+ * be shared by all instances in the process.
+ *
+ * @param buffer The direct buffer of compiled ES module bytecode.
+ */
+class MappedBytecode(buffer: ByteBuffer) : ModuleContent.BytecodeBuffer() {
+    init {
+        require(buffer.isDirect) { "MappedBytecode requires a direct buffer." }
+    }
+
+    // QuickJS reads the whole capacity of the slice
+    internal val buffer: ByteBuffer = buffer.slice()
+
+    override fun toByteArray(): ByteArray {
+        return ByteArray(buffer.remaining()).also { buffer.duplicate().get(it) }
+    }
+}
@@ -0,0 +1,202 @@
+package com.dokar.quickjs
+
+import java.io.File
+import java.io.IOException
+import java.io.RandomAccessFile
+import java.nio.ByteBuffer
+import java.nio.channels.FileChannel
+import java.security.MessageDigest
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.Executor
+
+/**
+ * A [ModuleLoader] that keeps compiled modules in a directory on disk.
+ *
+ * Module source from [sourceLoader] is compiled once, the bytecode is stored in a file named
+ * by the hash of the module name, its source and the [QuickJs.stripDebugInfo] of the loading
+ * instance, and later loads memory-map that file and hand it to QuickJS as [MappedBytecode].
+ * Changing the source of a module changes its file, so stale bytecode is never loaded.
+ *
+ * Every file starts with a header of the QuickJS version, files written by a different
+ * version are ignored and replaced. Files are written to a temporary file first and then
+ * renamed, so other processes sharing the directory never see a partial file. When the files
+ * grow over [maxBytes], the least recently used ones are deleted.
+ *
+ * The cache can be shared by multiple instances. I/O errors never fail a module load, the
+ * module is compiled from source instead.
+ *
+ * @param directory The cache directory, created if it doesn't exist.
+ * @param maxBytes The max total size of cached files.
+ * @param writeExecutor Runs file writes and evictions, defaults to the compiling thread.
+ * @param sourceLoader Returns the source of a normalized module name, or null when the module
+ * is unavailable.
+ */
+class PersistentModuleCache(
+    private val directory: File,
+    private val maxBytes: Long = 64L * 1024 * 1024,
+    private val writeExecutor: Executor = Executor { it.run() },
+    private val sourceLoader: (name: String) -> String?,
+) : StripAwareModuleLoader {
+    private val header: ByteArray = buildHeader(QuickJs.nativeVersion)
+
+    // Cache keys of modules being compiled from source, or loaded from a cached file
+    private val pendingKeys = ConcurrentHashMap<String, String>()
+    private val loadedKeys = ConcurrentHashMap<String, String>()
+
+    init {
+        require(maxBytes > 0) { "maxBytes must be positive." }
+    }
+
+    override fun load(name: String): ModuleContent? = load(name, StripDebugInfo.None)
+
+    override fun load(name: String, stripDebugInfo: StripDebugInfo): ModuleContent? {
+        val source = sourceLoader(name) ?: return null
+        val key = cacheKey(name, source, stripDebugInfo)
+        val buffer = readCached(key)
+        if (buffer != null) {
+            loadedKeys[name] = key
+            return MappedBytecode(buffer)
+        }
+        pendingKeys[pendingKey(name, stripDebugInfo)] = key
+        return ModuleContent.Source(source)
+    }
+
+    override fun onCompiled(name: String, bytecode: ByteArray) {
+        onCompiled(name, bytecode, StripDebugInfo.None)
+    }
+
+    override fun onCompiled(name: String, bytecode: ByteArray, stripDebugInfo: StripDebugInfo) {
+        val key = pendingKeys.remove(pendingKey(name, stripDebugInfo)) ?: return
+        writeExecutor.execute {
+            try {
+                writeCached(key, bytecode)
+                evict()
+            } catch (e: IOException) {
+                // Compiled again on the next load
+            }
+        }
+    }
+
+    override fun onLoadFailed(name: String) {
+        for (stripDebugInfo in StripDebugInfo.entries) {
+            pendingKeys.remove(pendingKey(name, stripDebugInfo))
+        }
+        // The cached file may be corrupted, drop it so the next load compiles the source
+        val key = loadedKeys.remove(name) ?: return
+        fileOf(key).delete()
+    }
+
+    /**
+     * Delete all cached files.
+     */
+    fun clear() {
+        cacheFiles().forEach { it.delete() }
+    }
+
+    private fun readCached(key: String): ByteBuffer? {
+        val file = fileOf(key)
+        if (!file.isFile) {
+            return null
+        }
+        val buffer = try {
+            RandomAccessFile(file, "r").use {
+                it.channel.map(FileChannel.MapMode.READ_ONLY, 0, it.length())
+            }
+        } catch (e: IOException) {
+            return null
+        }
+        if (buffer.remaining() <= header.size) {
+            return null
+        }
+        for (i in header.indices) {
+            if (buffer.get(i) != header[i]) {
+                // Written by another QuickJS version
+                return null
+            }
+        }
+        // Keep the recently used files on eviction
+        file.setLastModified(System.currentTimeMillis())
+        buffer.position(header.size)
+        return buffer
+    }
+
+    private fun writeCached(key: String, bytecode: ByteArray) {
+        if (!directory.isDirectory && !directory.mkdirs() && !directory.isDirectory) {
+            throw IOException("Cannot create cache directory: $directory")
+        }
+        val temp = File.createTempFile(key, TEMP_SUFFIX, directory)
+        try {
+            temp.outputStream().use {
+                it.write(header)
+                it.write(bytecode)
+            }
+            if (!temp.renameTo(fileOf(key))) {
+                throw IOException("Cannot move cache file: $temp")
+            }
+        } finally {
+            temp.delete()
+        }
+    }
+
+    private fun evict() {
+        val files = cacheFiles().sortedBy { it.lastModified() }
+        var totalBytes = files.sumOf { it.length() }
+        for (file in files) {
+            if (totalBytes <= maxBytes) {
+                break
+            }
+            val length = file.length()
+            if (file.delete()) {
+                totalBytes -= length
+            }
+        }
+    }
+
+    private fun cacheFiles(): List<File> {
+        return directory.listFiles { file -> file.name.endsWith(FILE_SUFFIX) }?.toList()
+            ?: emptyList()
+    }
+
+    private fun fileOf(key: String): File = File(directory, key + FILE_SUFFIX)
+
+    private companion object {
+        const val FILE_SUFFIX = ".qjsc"
+        const val TEMP_SUFFIX = ".tmp"
+
+        // Bump when the file layout changes
+        const val FORMAT_VERSION = 1
+
+        val MAGIC = "QJSC".encodeToByteArray()
+
+        /**
+         * Magic, format version, and the length-prefixed QuickJS version.
+         */
+        fun buildHeader(quickJsVersion: String): ByteArray {
+            val version = quickJsVersion.encodeToByteArray()
+            return ByteBuffer.allocate(MAGIC.size + 1 + 4 + version.size)
+                .put(MAGIC)
+                .put(FORMAT_VERSION.toByte())
+                .putInt(version.size)
+                .put(version)
+                .array()
+        }
+
+        /**
+         * SHA-256 of the module name, its source and the strip flags.
+         */
+        fun cacheKey(name: String, source: String, stripDebugInfo: StripDebugInfo): String {
+            val digest = MessageDigest.getInstance("SHA-256")
+            digest.update(name.encodeToByteArray())
+            digest.update(0)
+            digest.update(source.encodeToByteArray())
+            digest.update(0)
+            digest.update(stripDebugInfo.flags.toByte())
+            return digest.digest().joinToString("") { "%02x".format(it) }
+        }
+
+        // Instances with different strip levels may compile the same module at once
+        fun pendingKey(name: String, stripDebugInfo: StripDebugInfo): String {
+            return "${stripDebugInfo.flags}:$name"
+        }
+    }
+}
@@ -12,6 +12,7 @@ import com.dokar.quickjs.converter.TypeConverters
 import com.dokar.quickjs.converter.castValueOr
 import com.dokar.quickjs.converter.typeOfClass
 import com.dokar.quickjs.converter.typeOfInstance
+import com.dokar.quickjs.internal.ModuleBundle
 import com.dokar.quickjs.internal.isInBindingCallback
 import com.dokar.quickjs.internal.withBindingCallback
 import com.dokar.quickjs.util.withLockSync
@@ -31,7 +32,9 @@ import kotlinx.coroutines.launch
 import kotlinx.coroutines.sync.Mutex
 import kotlinx.coroutines.sync.withLock
 import kotlinx.coroutines.withContext
+import kotlinx.coroutines.yield
 import java.io.Closeable
+import java.nio.ByteBuffer
 import kotlin.concurrent.atomics.AtomicBoolean
 import kotlin.concurrent.atomics.ExperimentalAtomicApi
 import kotlin.coroutines.AbstractCoroutineContextElement
@@ -146,24 +149,40 @@ suspend fun <T> QuickJs.evaluate(
 actual class QuickJs private constructor(
     private val jobDispatcher: CoroutineDispatcher,
     private val moduleLoader: ModuleLoader?,
+    /**
+     * The instance owning the runtime, null if this instance is not a realm.
+     */
+    private val owner: QuickJs? = null,
+    private val allocatorType: QuickJsAllocator = QuickJsAllocator.System,
 ) : Closeable {
     // Native pointers
     private var globals: Long = 0
     private var runtime: Long = 0
+    private var allocator: Long = 0
     private var context: Long = 0
     private var interruptState: Long = 0
 
     private val objectBindings = mutableMapOf<Long, ObjectBinding>()
     private val globalFunctions = mutableMapOf<String, Binding>()
+    private val bindingDefinitions = mutableListOf<BindingDefinition>()
     private val nativeCloseHandlers = mutableListOf<(QuickJsNativeContext) -> Unit>()
+    private val realms = mutableListOf<QuickJs>()
 
     private val modules = mutableListOf<ByteArray>()
+    private val addedModules = mutableListOf<ByteArray>()
     private var resolvingModuleNames: LinkedHashSet<String>? = null
+    // Collects the bytecode of loaded modules while compiling a bundle
+    private var bundledModules: MutableMap<String, ByteArray>? = null
 
     private var evalException: Throwable? = null
     private var currentEvaluationSession: EvaluationSession? = null
     private var currentEvaluation: EvaluationState? = null
 
+    /**
+     * Bumped by [reset], promise handles from older contexts must not be settled.
+     */
+    private var contextGeneration = 0L
+
     // Coroutines and async jobs related
     private val exceptionHandler = CoroutineExceptionHandler { _, throwable ->
         if (evalException == null) {
@@ -173,17 +192,24 @@ actual class QuickJs private constructor(
     private val coroutineScope = CoroutineScope(jobDispatcher + exceptionHandler)
 
     /**
-     * Avoid concurrent executions.
+     * Avoid concurrent executions. Shared by all realms of a runtime.
      */
-    private val jsMutex = Mutex()
-    private val interruptMutex = Mutex()
-    private val rootEvaluationMutex = Mutex()
+    private val jsMutex: Mutex = owner?.jsMutex ?: Mutex()
+    private val interruptMutex: Mutex = owner?.interruptMutex ?: Mutex()
+    private val rootEvaluationMutex: Mutex = owner?.rootEvaluationMutex ?: Mutex()
+    // Read by close() without the eval locks
+    private val isRootEvaluating = AtomicBoolean(false)
     private val runtimeProgress = MutableStateFlow(0L)
 
     private val jobsMutex = Mutex()
     private val asyncJobs = mutableListOf<AsyncJob>()
     private val activeEvaluateResults = mutableSetOf<Long>()
 
+    /**
+     * Handles of the functions referenced by [getFunction], released with the context.
+     */
+    private val functionRefs = mutableSetOf<Long>()
+
     @PublishedApi
     internal actual val typeConverters = TypeConverters()
 
@@ -193,7 +219,7 @@ actual class QuickJs private constructor(
         get() = closed.load()
         private set(value) = closed.store(value)
 
-    actual val version: String get() = nativeGetVersion()
+    actual val version: String get() = nativeVersion
 
     actual var memoryLimit: Long = -1L
         set(value) {
@@ -213,6 +239,88 @@ actual class QuickJs private constructor(
             }
         }
 
+    // The strip level is a runtime setting, realms read and write the one of the owner
+    private var runtimeStripDebugInfo: StripDebugInfo = StripDebugInfo.None
+
+    actual var stripDebugInfo: StripDebugInfo
+        get() = (owner ?: this).runtimeStripDebugInfo
+        set(value) {
+            withJsLockSync {
+                ensureNotClosed()
+                (owner ?: this).runtimeStripDebugInfo = value
+                setStripInfo(runtime, globals, value.flags)
+            }
+        }
+
+    // Modules of a realm are loaded by the runtime owner, so the shared cache settings are
+    // stored on the owner
+    private var runtimeUseSharedModuleCache = false
+    private var runtimeSharedModuleCacheNamespace: String? = null
+
+    /**
+     * Whether modules are read from and added to the process-wide [SharedModuleCache].
+     * Only used when the instance has a [ModuleLoader]. Defaults to false.
+     *
+     * Cached modules are scoped by [sharedModuleCacheNamespace] and [stripDebugInfo].
+     * [resolveModuleGraph] and [compileBundle] don't read the cache, so they see every
+     * module of the graph.
+     */
+    var useSharedModuleCache: Boolean
+        get() = (owner ?: this).runtimeUseSharedModuleCache
+        set(value) {
+            withJsLockSync {
+                ensureNotClosed()
+                (owner ?: this).runtimeUseSharedModuleCache = value
+                updateSharedModuleCache()
+            }
+        }
+
+    /**
+     * The namespace of the modules this instance reads from and adds to the
+     * [SharedModuleCache], only instances using the same namespace share modules.
+     *
+     * When null, modules are only shared by instances using the same [ModuleLoader] object.
+     * Set a key of the modules the loader supplies, such as a tenant and a version, to share
+     * them across loaders. Defaults to null.
+     */
+    var sharedModuleCacheNamespace: String?
+        get() = (owner ?: this).runtimeSharedModuleCacheNamespace
+        set(value) {
+            withJsLockSync {
+                ensureNotClosed()
+                (owner ?: this).runtimeSharedModuleCacheNamespace = value
+                updateSharedModuleCache()
+            }
+        }
+
+    private fun updateSharedModuleCache() {
+        val root = owner ?: this
+        val loader = root.moduleLoader
+        val namespace = when {
+            !root.runtimeUseSharedModuleCache || loader == null -> null
+            else -> SharedModuleCache.namespaceOf(loader, root.runtimeSharedModuleCacheNamespace)
+        }
+        setSharedModuleCache(root.globals, namespace)
+    }
+
+    /**
+     * Whether primitive arrays are mapped to typed arrays. Defaults to false.
+     *
+     * When enabled, [IntArray], [LongArray], [FloatArray] and [DoubleArray] are mapped to
+     * `Int32Array`, `BigInt64Array`, `Float32Array` and `Float64Array`, and these typed
+     * arrays are mapped back to the primitive arrays, copying the elements in bulk. When
+     * disabled, primitive arrays are mapped to plain arrays, and these typed arrays to
+     * objects.
+     */
+    var mapTypedArrays: Boolean = false
+        set(value) {
+            withJsLockSync {
+                ensureNotClosed()
+                field = value
+                setTypedArrayMapping(context, globals, value)
+            }
+        }
+
     actual val memoryUsage: MemoryUsage
         get() = withJsLockSync {
             ensureNotClosed()
@@ -221,6 +329,8 @@ actual class QuickJs private constructor(
 
     actual var evaluationTimeoutMillis: Long = -1L
 
+    actual var compileCache: CompileCache? = null
+
     actual fun interruptEvaluation() {
         interruptMutex.withLockSync {
             ensureNotClosed()
@@ -245,9 +355,37 @@ actual class QuickJs private constructor(
         }
     }
 
+    @ExperimentalQuickJsApi
+    @Throws(QuickJsException::class)
+    actual fun openRealm(): QuickJs {
+        val root = owner ?: this
+        return withJsLockSync {
+            root.ensureNotClosed()
+            QuickJs(
+                jobDispatcher = jobDispatcher,
+                moduleLoader = root.moduleLoader,
+                owner = root,
+            ).also { root.realms += it }
+        }
+    }
+
     init {
+        if (owner != null) {
+            runtime = owner.runtime
+            globals = owner.globals
+            interruptState = owner.interruptState
+            context = newRealmContext(runtime, globals)
+        } else {
+            initRuntime()
+        }
+    }
+
+    private fun initRuntime() {
         try {
-            runtime = newRuntime()
+            if (allocatorType == QuickJsAllocator.Slab) {
+                allocator = newSlabAllocator()
+            }
+            runtime = newRuntime(allocator)
             interruptState = installInterrupt(runtime)
             context = newContext(runtime)
         } catch (error: QuickJsException) {
@@ -291,6 +429,7 @@ actual class QuickJs private constructor(
                 throw QuickJsException("Failed to define object '$name'.")
             }
             objectBindings[nativeHandle] = binding
+            bindingDefinitions += BindingDefinition.Object(name, binding, parent.nativeHandle)
             JsObjectHandle(nativeHandle)
         }
     }
@@ -305,6 +444,7 @@ actual class QuickJs private constructor(
                 isAsync = false,
             )
             globalFunctions[name] = binding
+            bindingDefinitions += BindingDefinition.Function(name, isAsync = false)
         }
     }
 
@@ -318,6 +458,7 @@ actual class QuickJs private constructor(
                 isAsync = true,
             )
             globalFunctions[name] = binding
+            bindingDefinitions += BindingDefinition.Function(name, isAsync = true)
         }
     }
 
@@ -325,7 +466,9 @@ actual class QuickJs private constructor(
     actual fun addModule(name: String, code: String) {
         withJsLockSync {
             ensureNotClosed()
-            modules.add(compile(context, globals, name, code, true))
+            val bytecode = compile(context, globals, name, code, true)
+            modules.add(bytecode)
+            addedModules.add(bytecode)
         }
     }
 
@@ -333,31 +476,129 @@ actual class QuickJs private constructor(
         withJsLockSync {
             ensureNotClosed()
             modules.add(bytecode)
+            addedModules.add(bytecode)
         }
     }
 
     @Throws(QuickJsException::class)
-    actual fun compile(code: String, filename: String, asModule: Boolean): ByteArray {
+    actual fun compile(
+        code: String,
+        filename: String,
+        asModule: Boolean,
+        stripDebugInfo: StripDebugInfo?,
+    ): ByteArray {
         return withJsLockSync {
             ensureNotClosed()
-            return compile(context, globals, filename, code, asModule)
+            val runtimeStripInfo = this.stripDebugInfo
+            if (stripDebugInfo == null || stripDebugInfo == runtimeStripInfo) {
+                return compile(context, globals, filename, code, asModule)
+            }
+            setStripInfo(runtime, globals, stripDebugInfo.flags)
+            try {
+                compile(context, globals, filename, code, asModule)
+            } finally {
+                setStripInfo(runtime, globals, runtimeStripInfo.flags)
+            }
         }
     }
 
     @Throws(QuickJsException::class)
-    actual fun resolveModuleGraph(entryBytecode: ByteArray): Set<String> = withJsLockSync {
-        ensureNotClosed()
-        val names = linkedSetOf<String>()
-        resolvingModuleNames = names
-        try {
-            names += resolveModuleGraphBytecode(
-                runtime = runtime,
-                globals = globals,
-                bytecode = entryBytecode,
+    actual fun compileUtf8(
+        code: ByteArray,
+        length: Int,
+        filename: String,
+        asModule: Boolean,
+    ): ByteArray {
+        return withJsLockSync {
+            ensureNotClosed()
+            return compileUtf8(context, globals, filename, code, null, 0, length, asModule)
+        }
+    }
+
+    /**
+     * Compile UTF-8 encoded javascript code between the position and the limit of [code]
+     * to QuickJS bytecode. The position of [code] is not changed.
+     *
+     * A direct buffer is read in place, and isn't copied at all if the byte after its
+     * limit is 0.
+     *
+     * @see compileUtf8
+     */
+    @Throws(QuickJsException::class)
+    fun compileUtf8(
+        code: ByteBuffer,
+        filename: String = "main.js",
+        asModule: Boolean = false,
+    ): ByteArray {
+        return withJsLockSync {
+            ensureNotClosed()
+            withUtf8Source(code) { array, buffer, offset, length ->
+                compileUtf8(context, globals, filename, array, buffer, offset, length, asModule)
+            }
+        }
+    }
+
+    @Throws(QuickJsException::class)
+    actual fun resolveModuleGraph(entryBytecode: ByteArray): Set<String> {
+        if (owner != null) {
+            // Module loading calls back to the runtime owner
+            ensureNotClosed()
+            return owner.resolveModuleGraph(entryBytecode)
+        }
+        return withJsLockSync {
+            ensureNotClosed()
+            val names = linkedSetOf<String>()
+            resolvingModuleNames = names
+            try {
+                names += resolveModuleGraphBytecode(
+                    runtime = runtime,
+                    globals = globals,
+                    bytecode = entryBytecode,
+                )
+                names
+            } finally {
+                resolvingModuleNames = null
+            }
+        }
+    }
+
+    @Throws(QuickJsException::class)
+    actual fun compileBundle(code: String, filename: String, asModule: Boolean): ByteArray {
+        if (owner != null) {
+            // Module loading calls back to the runtime owner
+            ensureNotClosed()
+            return owner.compileBundle(code, filename, asModule)
+        }
+        return withJsLockSync {
+            ensureNotClosed()
+            if (!asModule) {
+                val script = compile(context, globals, filename, code, false)
+                return@withJsLockSync ModuleBundle.write(filename, mapOf(filename to script), version)
+            }
+            val entry = compile(context, globals, filename, code, true)
+            val modules = linkedMapOf(filename to entry)
+            bundledModules = modules
+            try {
+                resolveModuleGraphBytecode(
+                    runtime = runtime,
+                    globals = globals,
+                    bytecode = entry,
+                )
+            } finally {
+                bundledModules = null
+            }
+            ModuleBundle.write(filename, modules, version)
+        }
+    }
+
+    @Throws(QuickJsException::class, CancellationException::class)
+    actual suspend inline fun <reified T> evaluateBundle(bundle: ByteArray): T {
+        return castValueOr(evaluateBundleInternal(bundle), typeOf<T>()) {
+            typeConverters.convert(
+                source = it,
+                sourceType = typeOfInstance(typeConverters, it),
+                targetType = typeOf<T>()
             )
-            names
-        } finally {
-            resolvingModuleNames = null
         }
     }
 
@@ -372,6 +613,26 @@ actual class QuickJs private constructor(
         }
     }
 
+    /**
+     * Evaluate QuickJS-compiled bytecode between the position and the limit of [bytecode].
+     * The position of [bytecode] is not changed.
+     *
+     * A direct buffer, such as a [java.nio.MappedByteBuffer] of a bytecode file, is read in
+     * place without being copied to the heap.
+     *
+     * @see evaluate
+     */
+    @Throws(QuickJsException::class, CancellationException::class)
+    suspend inline fun <reified T> evaluate(bytecode: ByteBuffer): T {
+        return castValueOr(evaluateInternal(bytecode), typeOf<T>()) {
+            typeConverters.convert(
+                source = it,
+                sourceType = typeOfInstance(typeConverters, it),
+                targetType = typeOf<T>()
+            )
+        }
+    }
+
     @Throws(QuickJsException::class, CancellationException::class)
     actual suspend inline fun <reified T> evaluate(
         code: String,
@@ -387,18 +648,195 @@ actual class QuickJs private constructor(
         }
     }
 
+    @Throws(QuickJsException::class, CancellationException::class)
+    actual suspend inline fun <reified T> evaluateUtf8(
+        code: ByteArray,
+        length: Int,
+        filename: String,
+        asModule: Boolean,
+    ): T {
+        return castValueOr(evaluateUtf8Internal(code, length, filename, asModule), typeOf<T>()) {
+            typeConverters.convert(
+                source = it,
+                sourceType = typeOfInstance(typeConverters, it),
+                targetType = typeOf<T>()
+            )
+        }
+    }
+
+    /**
+     * Evaluate UTF-8 encoded javascript code between the position and the limit of [code].
+     * The position of [code] is not changed.
+     *
+     * A direct buffer is read in place, and isn't copied at all if the byte after its
+     * limit is 0.
+     *
+     * @see evaluateUtf8
+     */
+    @Throws(QuickJsException::class, CancellationException::class)
+    suspend inline fun <reified T> evaluateUtf8(
+        code: ByteBuffer,
+        filename: String = "main.js",
+        asModule: Boolean = false,
+    ): T {
+        return castValueOr(evaluateUtf8Internal(code, filename, asModule), typeOf<T>()) {
+            typeConverters.convert(
+                source = it,
+                sourceType = typeOfInstance(typeConverters, it),
+                targetType = typeOf<T>()
+            )
+        }
+    }
+
+    @Throws(QuickJsException::class)
+    actual inline fun <reified T> evaluateSync(
+        code: String,
+        filename: String,
+        asModule: Boolean,
+    ): T {
+        return castValueOr(evaluateSyncInternal(code, filename, asModule), typeOf<T>()) {
+            typeConverters.convert(
+                source = it,
+                sourceType = typeOfInstance(typeConverters, it),
+                targetType = typeOf<T>()
+            )
+        }
+    }
+
+    @Throws(QuickJsException::class)
+    actual inline fun <reified T> evaluateSync(bytecode: ByteArray): T {
+        return castValueOr(evaluateSyncInternal(bytecode), typeOf<T>()) {
+            typeConverters.convert(
+                source = it,
+                sourceType = typeOfInstance(typeConverters, it),
+                targetType = typeOf<T>()
+            )
+        }
+    }
+
+    @Throws(QuickJsException::class)
+    actual fun getFunction(name: String): JsFunctionRef = withJsLockSync {
+        ensureNotClosed()
+        val handle = getFunction(context, globals, name)
+        functionRefs += handle
+        JsFunctionRef(this, handle)
+    }
+
+    @PublishedApi
+    internal actual fun callFunctionInternal(handle: Long, args: Array<out Any?>): Any? =
+        evalSync { callFunction(context, globals, handle, args) }
+
+    internal actual fun callFunctionDouble(handle: Long, args: DoubleArray): Double =
+        evalSync { callFunctionDouble(context, globals, handle, args) }
+
+    internal actual fun callFunctionLong(handle: Long, args: LongArray): Long =
+        evalSync { callFunctionLong(context, globals, handle, args) }
+
+    internal actual fun releaseFunction(handle: Long) {
+        withJsLockSync {
+            if (isClosed || !functionRefs.remove(handle)) return@withJsLockSync
+            releaseFunction(context, globals, handle)
+        }
+    }
+
+    @PublishedApi
+    internal fun evaluateSyncInternal(bytecode: ByteArray): Any? = evalSync {
+        evaluateBytecodeSync(context = context, globals = globals, buffer = bytecode)
+    }
+
+    @PublishedApi
+    internal fun evaluateSyncInternal(
+        code: String,
+        filename: String,
+        asModule: Boolean,
+    ): Any? = evalSync {
+        evaluateSync(context, globals, filename, code, asModule)
+    }
+
     @PublishedApi
     internal suspend fun evaluateInternal(bytecode: ByteArray): Any? = evalAndAwait {
         evaluateBytecode(context = context, globals = globals, buffer = bytecode)
     }
 
+    @PublishedApi
+    internal suspend fun evaluateBundleInternal(bundle: ByteArray): Any? = evalAndAwait {
+        evaluateBundle(context = context, globals = globals, bundle = bundle)
+    }
+
+    @PublishedApi
+    internal suspend fun evaluateInternal(bytecode: ByteBuffer): Any? {
+        if (!bytecode.isDirect) {
+            val bytes = ByteArray(bytecode.remaining())
+            bytecode.duplicate().get(bytes)
+            return evaluateInternal(bytes)
+        }
+        return evalAndAwait {
+            evaluateBytecodeBuffer(
+                context = context,
+                globals = globals,
+                buffer = bytecode,
+                offset = bytecode.position(),
+                length = bytecode.remaining(),
+            )
+        }
+    }
+
     @PublishedApi
     internal suspend fun evaluateInternal(
         code: String,
         filename: String,
         asModule: Boolean,
+    ): Any? {
+        val cache = compileCache
+        if (cache != null) {
+            val strip = stripDebugInfo
+            val bytecode = cache.getOrCompile(code, filename, asModule, strip) {
+                compile(code, filename, asModule, strip)
+            }
+            return evaluateInternal(bytecode)
+        }
+        return evalAndAwait { evaluate(context, globals, filename, code, asModule) }
+    }
+
+    @PublishedApi
+    internal suspend fun evaluateUtf8Internal(
+        code: ByteArray,
+        length: Int,
+        filename: String,
+        asModule: Boolean,
+    ): Any? = evalAndAwait {
+        evaluateUtf8(context, globals, filename, code, null, 0, length, asModule)
+    }
+
+    @PublishedApi
+    internal suspend fun evaluateUtf8Internal(
+        code: ByteBuffer,
+        filename: String,
+        asModule: Boolean,
     ): Any? = evalAndAwait {
-        evaluate(context, globals, filename, code, asModule)
+        withUtf8Source(code) { array, buffer, offset, length ->
+            evaluateUtf8(context, globals, filename, array, buffer, offset, length, asModule)
+        }
+    }
+
+    /**
+     * Pass the remaining bytes of [code] to [block], either as a direct buffer or as an array.
+     */
+    private inline fun <R> withUtf8Source(
+        code: ByteBuffer,
+        block: (array: ByteArray?, buffer: ByteBuffer?, offset: Int, length: Int) -> R,
+    ): R = when {
+        code.isDirect -> block(null, code, code.position(), code.remaining())
+        code.hasArray() -> {
+            block(code.array(), null, code.arrayOffset() + code.position(), code.remaining())
+        }
+
+        else -> {
+            // Read-only heap buffer
+            val bytes = ByteArray(code.remaining())
+            code.duplicate().get(bytes)
+            block(bytes, null, 0, bytes.size)
+        }
     }
 
     private suspend fun evalAndAwait(evalBlock: suspend () -> Long): Any? {
@@ -408,6 +846,7 @@ actual class QuickJs private constructor(
             return evalInSession(inheritedSession, isRoot = false, evalBlock)
         }
         return rootEvaluationMutex.withLock {
+            isRootEvaluating.store(true)
             evalException = null
             resetInterruptState(evaluationTimeoutMillis)
             // Cancellation alone can't stop busy JavaScript, so hook it up
@@ -430,7 +869,58 @@ actual class QuickJs private constructor(
             } finally {
                 interruptOnCancel.complete()
                 resetInterruptState(0L)
+                isRootEvaluating.store(false)
+            }
+        }
+    }
+
+    private inline fun <T> evalSync(evalBlock: () -> T): T {
+        ensureNotClosed()
+        if (isInBindingCallback(this)) {
+            // The calling evaluation holds the locks
+            return runSyncEvaluation(evalBlock)
+        }
+        return rootEvaluationMutex.withLockSync {
+            isRootEvaluating.store(true)
+            resetInterruptState(evaluationTimeoutMillis)
+            try {
+                jsMutex.withLockSync { runSyncEvaluation(evalBlock) }
+            } catch (e: QuickJsException) {
+                if (isClosed) qjsError("Already closed.")
+                if (wasInterrupted()) throw QuickJsInterruptedException(e.message)
+                throw e
+            } finally {
+                resetInterruptState(0L)
+                isRootEvaluating.store(false)
+            }
+        }
+    }
+
+    private inline fun <T> runSyncEvaluation(evalBlock: () -> T): T {
+        ensureNotClosed()
+        val previousSession = currentEvaluationSession
+        val previousEvaluation = currentEvaluation
+        val previousException = evalException
+        // Without a session, errors of bindings and rejections are reported to evalException
+        currentEvaluationSession = null
+        currentEvaluation = null
+        evalException = null
+        try {
+            for (module in modules) {
+                val handle = evaluateBytecode(context = context, globals = globals, buffer = module)
+                releaseEvaluateResult(context, globals, handle)
             }
+            modules.clear()
+            val result = evalBlock()
+            evalException?.let { throw it }
+            return result
+        } catch (e: QuickJsException) {
+            // The Java exception of a failed binding call is more useful than its JS error
+            throw evalException ?: e
+        } finally {
+            evalException = previousException
+            currentEvaluationSession = previousSession
+            currentEvaluation = previousEvaluation
         }
     }
 
@@ -491,6 +981,97 @@ actual class QuickJs private constructor(
         withJsLockSync {
             ensureNotClosed()
             gc(runtime, globals)
+            if (allocator != 0L) {
+                trimSlabAllocator(allocator)
+            }
+        }
+    }
+
+    @Throws(QuickJsException::class)
+    actual fun reset() {
+        if (isInBindingCallback(this)) {
+            qjsError("Cannot reset QuickJs from within a binding callback.")
+        }
+        if (owner != null) {
+            qjsError("Cannot reset a realm, close it and open a new one instead.")
+        }
+        if (!rootEvaluationMutex.tryLock()) {
+            qjsError("Cannot reset QuickJs while evaluating.")
+        }
+        try {
+            ensureNotClosed()
+            if (jsMutex.withLockSync { realms.isNotEmpty() }) {
+                qjsError("Cannot reset QuickJs with open realms.")
+            }
+            jobsMutex.withLockSync {
+                asyncJobs.forEach { it.job.cancel() }
+                asyncJobs.clear()
+            }
+            var nativeCleanupError: Throwable? = null
+            jsMutex.withLockSync {
+                ensureNotClosed()
+                updateStackTop(runtime)
+                nativeCloseHandlers.asReversed().forEach { cleanup ->
+                    try {
+                        cleanup(
+                            QuickJsNativeContext(
+                                contextAddress = context,
+                                runtimeAddress = runtime,
+                            )
+                        )
+                    } catch (error: Throwable) {
+                        if (nativeCleanupError == null) nativeCleanupError = error
+                    }
+                }
+                nativeCloseHandlers.clear()
+                contextGeneration++
+                evalException = null
+                functionRefs.clear()
+                // Abort job loops of the old context, its bindings are blocked while draining
+                requestInterruptIfOpen()
+                try {
+                    context = resetContext(runtime, context, globals)
+                } finally {
+                    resetInterruptState(0L)
+                }
+                if (allocator != 0L) {
+                    trimSlabAllocator(allocator)
+                }
+                // Handles are indices of the defined objects, defining them again in the
+                // same order gives the same handles.
+                for (definition in bindingDefinitions) {
+                    when (definition) {
+                        is BindingDefinition.Object -> {
+                            val nativeHandle = defineObject(
+                                globals = globals,
+                                context = context,
+                                parent = definition.parent,
+                                name = definition.name,
+                                properties = definition.binding.properties.toTypedArray(),
+                                functions = definition.binding.functions.toTypedArray(),
+                            )
+                            if (nativeHandle < 0L) {
+                                throw QuickJsException(
+                                    "Failed to define object '${definition.name}'."
+                                )
+                            }
+                        }
+
+                        is BindingDefinition.Function -> defineFunction(
+                            globals = globals,
+                            context = context,
+                            name = definition.name,
+                            isAsync = definition.isAsync,
+                        )
+                    }
+                }
+                modules.clear()
+                modules.addAll(addedModules)
+            }
+            signalRuntimeProgress()
+            nativeCleanupError?.let { throw it }
+        } finally {
+            rootEvaluationMutex.unlock()
         }
     }
 
@@ -501,8 +1082,11 @@ actual class QuickJs private constructor(
         if (!closed.compareAndSet(expectedValue = false, newValue = true)) return
         // A busy evaluation holds the JS lock until it returns, so interrupt it
         // first. Without this, closing while something like 'while(true){}' is
-        // running would wait forever.
-        requestInterruptIfOpen()
+        // running would wait forever. Realms share the interrupt, so they only
+        // interrupt their own evaluation.
+        if (owner == null || isRootEvaluating.load()) {
+            requestInterruptIfOpen()
+        }
         signalRuntimeProgress()
         jobsMutex.withLockSync {
             asyncJobs.forEach { it.job.cancel() }
@@ -510,6 +1094,14 @@ actual class QuickJs private constructor(
             activeEvaluateResults.clear()
         }
         var nativeCleanupError: Throwable? = null
+        val openRealms = jsMutex.withLockSync { realms.toList() }
+        for (realm in openRealms) {
+            try {
+                realm.close()
+            } catch (error: Throwable) {
+                if (nativeCleanupError == null) nativeCleanupError = error
+            }
+        }
         jsMutex.withLockSync {
             if (context != 0L && runtime != 0L) {
                 updateStackTop(runtime)
@@ -529,7 +1121,25 @@ actual class QuickJs private constructor(
             }
             objectBindings.clear()
             globalFunctions.clear()
+            bindingDefinitions.clear()
             modules.clear()
+            addedModules.clear()
+            if (context != 0L && globals != 0L) {
+                functionRefs.forEach { releaseFunction(context, globals, it) }
+            }
+            functionRefs.clear()
+            if (owner != null) {
+                // The runtime and globals belong to the owner
+                owner.realms.remove(this)
+                if (context != 0L) {
+                    releaseRealmContext(context)
+                    context = 0
+                }
+                globals = 0
+                interruptState = 0
+                runtime = 0
+                return@withLockSync
+            }
             if (globals != 0L) {
                 releaseGlobals(context, globals)
                 globals = 0
@@ -548,6 +1158,10 @@ actual class QuickJs private constructor(
                 releaseRuntime(runtime)
                 runtime = 0
             }
+            if (allocator != 0L) {
+                freeSlabAllocator(allocator)
+                allocator = 0
+            }
         }
         nativeCleanupError?.let { throw it }
     }
@@ -580,17 +1194,21 @@ actual class QuickJs private constructor(
     ) {
         while (true) {
             val observedProgress = runtimeProgress.value
-            val (resultPending, executedJobs) = jsMutex.withLock {
+            val drainState = jsMutex.withLock {
                 if (isClosed) throw CancellationException("Already closed.")
                 withEvaluationSession(session) {
-                    var executedAny = false
-                    do {
-                        val executed = executePendingJob(context, globals)
-                        executedAny = executedAny || executed
-                    } while (executed)
-                    isEvaluateResultPending(context, globals, evaluation.handle) to executedAny
+                    drainPendingJobs(
+                        context = context,
+                        globals = globals,
+                        resultHandle = evaluation.handle,
+                        maxJobs = DRAIN_MAX_JOBS,
+                        maxNanos = DRAIN_MAX_NANOS,
+                    )
                 }
             }
+            val resultPending = drainState and DRAIN_RESULT_PENDING != 0L
+            val hasMoreJobs = drainState and DRAIN_HAS_MORE_JOBS != 0L
+            val executedJobs = drainState ushr DRAIN_COUNT_SHIFT != 0L
 
             var hasUnhandledException = false
             val activeJobs = if (isRoot) {
@@ -612,6 +1230,12 @@ actual class QuickJs private constructor(
 
             if (executedJobs) signalRuntimeProgress()
 
+            if (hasMoreJobs) {
+                // Out of budget, let others take the lock before draining the rest
+                yield()
+                continue
+            }
+
             if (!resultPending && !hasActiveJobs && progressUnchanged) {
                 return
             }
@@ -646,7 +1270,18 @@ actual class QuickJs private constructor(
     @Suppress("unused")
     private fun loadModule(name: String): Any? {
         resolvingModuleNames?.add(name)
-        return moduleLoader?.load(name)
+        val loader = moduleLoader
+        val content = if (loader is StripAwareModuleLoader) {
+            loader.load(name, stripDebugInfo)
+        } else {
+            loader?.load(name)
+        }
+        when (content) {
+            is ModuleContent.Bytecode -> bundledModules?.put(name, content.bytes)
+            is ModuleContent.BytecodeBuffer -> bundledModules?.put(name, content.toByteArray())
+            else -> {}
+        }
+        return content
     }
 
     /** Returns source when [content] represents a source module. */
@@ -659,10 +1294,21 @@ actual class QuickJs private constructor(
     private fun getModuleBytecode(content: Any): ByteArray? =
         (content as? ModuleContent.Bytecode)?.bytes
 
+    /** Returns the direct buffer when [content] is read in place. */
+    @Suppress("unused")
+    private fun getModuleBytecodeBuffer(content: Any): ByteBuffer? =
+        (content as? MappedBytecode)?.buffer
+
     /** Delivers source-compiled bytecode to the runtime's loader. */
     @Suppress("unused")
     private fun onModuleCompiled(name: String, bytecode: ByteArray) {
-        moduleLoader?.onCompiled(name, bytecode)
+        bundledModules?.put(name, bytecode)
+        val loader = moduleLoader
+        if (loader is StripAwareModuleLoader) {
+            loader.onCompiled(name, bytecode, stripDebugInfo)
+        } else {
+            loader?.onCompiled(name, bytecode)
+        }
     }
 
     /** Reports a failed module loading attempt to the runtime's loader. */
@@ -689,38 +1335,55 @@ actual class QuickJs private constructor(
     ) {
         if (isClosed) return
         val session = currentEvaluationSession
-            ?: qjsError("Async function was invoked outside an evaluation.")
-        val (resolveHandle, rejectHandle) = promiseHandlesFromArgs(args)
+            ?: qjsError("Async functions can only be called from evaluate().")
+        val promiseHandle = promiseHandleFromArgs(args)
+        val generation = contextGeneration
         val job = coroutineScope.launch(context = session, start = CoroutineStart.LAZY) {
+            var settled = false
             try {
-                val result = block(args.sliceArray(2..<args.size))
+                val result = block(args.sliceArray(1..<args.size))
                 jsMutex.withLock {
-                    if (isClosed) return@withLock
+                    if (isClosed || generation != contextGeneration) return@withLock
                     withEvaluationSession(session) {
                         // Call resolve() on JNI side
-                        invokeJsFunction(
+                        settlePromise(
                             context = context,
                             globals = globals,
-                            handle = resolveHandle,
-                            args = arrayOf(result)
+                            handle = promiseHandle,
+                            reject = false,
+                            value = result,
                         )
+                        settled = true
                     }
                 }
                 signalRuntimeProgress()
             } catch (e: Throwable) {
+                if (settled) throw e
                 jsMutex.withLock {
-                    if (isClosed) return@withLock
+                    if (isClosed || generation != contextGeneration) return@withLock
                     withEvaluationSession(session) {
                         // Call reject() on JNI side
-                        invokeJsFunction(
+                        settlePromise(
                             context = context,
                             globals = globals,
-                            handle = rejectHandle,
-                            args = arrayOf(e)
+                            handle = promiseHandle,
+                            reject = true,
+                            value = e,
                         )
+                        settled = true
                     }
                 }
                 signalRuntimeProgress()
+            } finally {
+                if (!settled) {
+                    // Cancelled, the promise won't be settled but its handle must be released
+                    withContext(NonCancellable) {
+                        jsMutex.withLock {
+                            if (isClosed || generation != contextGeneration) return@withLock
+                            releasePromise(context, globals, promiseHandle)
+                        }
+                    }
+                }
             }
         }
         jobsMutex.withLockSync { asyncJobs += AsyncJob(job, session) }
@@ -731,21 +1394,16 @@ actual class QuickJs private constructor(
         job.start()
     }
 
-    private fun promiseHandlesFromArgs(args: Array<Any?>): Pair<Long, Long> {
-        require(args.size >= 2) {
-            "Invoking async functions requires resolve and reject handles."
-        }
-        val resolveFunctionHandle = args[0]
-        require(resolveFunctionHandle is Long) {
-            val type = resolveFunctionHandle?.let { it::class.qualifiedName }
-            "Unexpected resolve handle type $type, expected: Long"
+    private fun promiseHandleFromArgs(args: Array<Any?>): Long {
+        require(args.isNotEmpty()) {
+            "Invoking async functions requires a promise handle."
         }
-        val rejectFunctionHandle = args[1]
-        require(rejectFunctionHandle is Long) {
-            val type = rejectFunctionHandle?.let { it::class.qualifiedName }
-            "Unexpected reject handle type $type, expected: Long"
+        val promiseHandle = args[0]
+        require(promiseHandle is Long) {
+            val type = promiseHandle?.let { it::class.qualifiedName }
+            "Unexpected promise handle type $type, expected: Long"
         }
-        return resolveFunctionHandle to rejectFunctionHandle
+        return promiseHandle
     }
 
     /**
@@ -892,7 +1550,14 @@ actual class QuickJs private constructor(
         }
     }
 
-    private external fun newRuntime(): Long
+    private external fun newRuntime(allocator: Long): Long
+
+    @Throws(QuickJsException::class)
+    private external fun newSlabAllocator(): Long
+
+    private external fun trimSlabAllocator(allocator: Long)
+
+    private external fun freeSlabAllocator(allocator: Long)
 
     @Throws(QuickJsException::class)
     private external fun newContext(runtime: Long): Long
@@ -912,6 +1577,14 @@ actual class QuickJs private constructor(
     @Throws(QuickJsException::class)
     private external fun releaseContext(context: Long)
 
+    @Throws(QuickJsException::class)
+    private external fun newRealmContext(runtime: Long, globals: Long): Long
+
+    private external fun releaseRealmContext(context: Long)
+
+    @Throws(QuickJsException::class)
+    private external fun resetContext(runtime: Long, context: Long, globals: Long): Long
+
     @Throws(QuickJsException::class)
     private external fun defineObject(
         globals: Long,
@@ -933,15 +1606,18 @@ actual class QuickJs private constructor(
     @Throws(QuickJsException::class)
     private external fun gc(runtime: Long, globals: Long)
 
-    @Throws(QuickJsException::class)
-    private external fun nativeGetVersion(): String
-
     @Throws(QuickJsException::class)
     private external fun setMemoryLimit(runtime: Long, globals: Long, byteCount: Long)
 
     @Throws(QuickJsException::class)
     private external fun setMaxStackSize(runtime: Long, globals: Long, byteCount: Long)
 
+    private external fun setStripInfo(runtime: Long, globals: Long, flags: Int)
+
+    private external fun setSharedModuleCache(globals: Long, namespace: String?)
+
+    private external fun setTypedArrayMapping(context: Long, globals: Long, enabled: Boolean)
+
     private external fun installInterrupt(runtime: Long): Long
 
     private external fun freeInterrupt(runtime: Long, state: Long)
@@ -966,6 +1642,18 @@ actual class QuickJs private constructor(
         asModule: Boolean
     ): ByteArray
 
+    @Throws(QuickJsException::class)
+    private external fun compileUtf8(
+        context: Long,
+        globals: Long,
+        filename: String,
+        array: ByteArray?,
+        buffer: ByteBuffer?,
+        offset: Int,
+        length: Int,
+        asModule: Boolean,
+    ): ByteArray
+
     @Throws(QuickJsException::class)
     private external fun resolveModuleGraphBytecode(
         runtime: Long,
@@ -982,6 +1670,18 @@ actual class QuickJs private constructor(
         asModule: Boolean
     ): Long
 
+    @Throws(QuickJsException::class)
+    private external fun evaluateUtf8(
+        context: Long,
+        globals: Long,
+        filename: String,
+        array: ByteArray?,
+        buffer: ByteBuffer?,
+        offset: Int,
+        length: Int,
+        asModule: Boolean,
+    ): Long
+
     @Throws(QuickJsException::class)
     private external fun evaluateBytecode(
         context: Long,
@@ -990,25 +1690,87 @@ actual class QuickJs private constructor(
     ): Long
 
     @Throws(QuickJsException::class)
-    private external fun invokeJsFunction(
+    private external fun evaluateBundle(context: Long, globals: Long, bundle: ByteArray): Long
+
+    @Throws(QuickJsException::class)
+    private external fun evaluateBytecodeBuffer(
+        context: Long,
+        globals: Long,
+        buffer: ByteBuffer,
+        offset: Int,
+        length: Int,
+    ): Long
+
+    @Throws(QuickJsException::class)
+    private external fun evaluateSync(
+        context: Long,
+        globals: Long,
+        filename: String,
+        code: String,
+        asModule: Boolean,
+    ): Any?
+
+    @Throws(QuickJsException::class)
+    private external fun evaluateBytecodeSync(context: Long, globals: Long, buffer: ByteArray): Any?
+
+    @Throws(QuickJsException::class)
+    private external fun settlePromise(
         context: Long,
         globals: Long,
         handle: Long,
-        args: Array<Any?>?,
+        reject: Boolean,
+        value: Any?,
     )
 
+    private external fun releasePromise(context: Long, globals: Long, handle: Long)
+
     @Throws(QuickJsException::class)
-    private external fun executePendingJob(context: Long, globals: Long): Boolean
+    private external fun getFunction(context: Long, globals: Long, name: String): Long
 
     @Throws(QuickJsException::class)
-    private external fun getEvaluateResult(context: Long, globals: Long, handle: Long): Any?
+    private external fun callFunction(
+        context: Long,
+        globals: Long,
+        handle: Long,
+        args: Array<out Any?>,
+    ): Any?
 
     @Throws(QuickJsException::class)
-    private external fun isEvaluateResultPending(
+    private external fun callFunctionDouble(
         context: Long,
         globals: Long,
         handle: Long,
-    ): Boolean
+        args: DoubleArray,
+    ): Double
+
+    @Throws(QuickJsException::class)
+    private external fun callFunctionLong(
+        context: Long,
+        globals: Long,
+        handle: Long,
+        args: LongArray,
+    ): Long
+
+    private external fun releaseFunction(context: Long, globals: Long, handle: Long)
+
+    /**
+     * Execute pending jobs until none is left or the budget is used up, and check whether
+     * the result of [resultHandle] is still pending.
+     *
+     * @return The executed job count shifted by [DRAIN_COUNT_SHIFT], with the
+     * [DRAIN_RESULT_PENDING] and [DRAIN_HAS_MORE_JOBS] bits.
+     */
+    @Throws(QuickJsException::class)
+    private external fun drainPendingJobs(
+        context: Long,
+        globals: Long,
+        resultHandle: Long,
+        maxJobs: Int,
+        maxNanos: Long,
+    ): Long
+
+    @Throws(QuickJsException::class)
+    private external fun getEvaluateResult(context: Long, globals: Long, handle: Long): Any?
 
     @Throws(QuickJsException::class)
     private external fun getEvaluateResultPromiseId(
@@ -1019,6 +1781,19 @@ actual class QuickJs private constructor(
 
     private external fun releaseEvaluateResult(context: Long, globals: Long, handle: Long)
 
+    private sealed interface BindingDefinition {
+        class Object(
+            val name: String,
+            val binding: ObjectBinding,
+            val parent: Long,
+        ) : BindingDefinition
+
+        class Function(
+            val name: String,
+            val isAsync: Boolean,
+        ) : BindingDefinition
+    }
+
     private data class AsyncJob(
         val job: Job,
         val session: EvaluationSession,
@@ -1042,6 +1817,11 @@ actual class QuickJs private constructor(
             NativeLibraryLoader.loadLibrary("quickjs")
         }
 
+        /**
+         * The version of the loaded QuickJS library.
+         */
+        internal val nativeVersion: String get() = nativeGetVersion()
+
         @Throws(QuickJsException::class)
         actual fun create(
             jobDispatcher: CoroutineDispatcher,
@@ -1058,5 +1838,28 @@ actual class QuickJs private constructor(
             jobDispatcher = jobDispatcher,
             moduleLoader = moduleLoader,
         )
+
+        @Throws(QuickJsException::class)
+        actual fun create(
+            jobDispatcher: CoroutineDispatcher,
+            moduleLoader: ModuleLoader?,
+            allocator: QuickJsAllocator,
+        ): QuickJs = QuickJs(
+            jobDispatcher = jobDispatcher,
+            moduleLoader = moduleLoader,
+            allocatorType = allocator,
+        )
+
+        @JvmStatic
+        private external fun nativeGetVersion(): String
     }
 }
+
+// Job budget of a drainPendingJobs() call, the lock is released between the calls
+private const val DRAIN_MAX_JOBS = 4096
+private const val DRAIN_MAX_NANOS = 10_000_000L
+
+// Same as the state bits in quickjs_jni.c
+private const val DRAIN_RESULT_PENDING = 1L
+private const val DRAIN_HAS_MORE_JOBS = 2L
+private const val DRAIN_COUNT_SHIFT = 2
@@ -0,0 +1,96 @@
+package com.dokar.quickjs
+
+import java.util.WeakHashMap
+
+/**
+ * A process-wide cache of ES module bytecode kept in native memory.
+ *
+ * Instances with [QuickJs.useSharedModuleCache] enabled look up modules here before calling
+ * their [ModuleLoader], a cached module is read without crossing JNI and without copying
+ * its bytecode to the Java heap. Modules loaded as source or as a [ByteArray] are added
+ * after they are loaded, [MappedBytecode] is already shared and is not copied.
+ *
+ * Entries are keyed by the [QuickJs.sharedModuleCacheNamespace], the
+ * [QuickJs.stripDebugInfo] and the normalized module name. Without a namespace, modules are
+ * only shared by instances using the same [ModuleLoader] object. Instances using the same
+ * namespace must load the same module for the same name. The loader of these instances is
+ * not called for cached modules, [remove] or [clear] the cache when modules change.
+ */
+object SharedModuleCache {
+    init {
+        NativeLibraryLoader.loadLibrary("quickjs")
+    }
+
+    // Namespaces of loaders, ids are never reused so a new loader never reads the modules
+    // of a collected one
+    private val loaderNamespaces = WeakHashMap<ModuleLoader, String>()
+    private var nextLoaderId = 0L
+
+    /**
+     * The max total size of cached bytecode. The least recently used modules are evicted
+     * to make room for new ones, a module larger than the max size is not cached. Defaults
+     * to 64 MiB.
+     */
+    var maxBytes: Long
+        get() = nativeGetMaxBytes()
+        set(value) {
+            require(value >= 0) { "maxBytes must not be negative." }
+            nativeSetMaxBytes(value)
+        }
+
+    /**
+     * The number of cached modules.
+     */
+    val size: Int get() = nativeCount()
+
+    /**
+     * The total size of cached bytecode.
+     */
+    val sizeInBytes: Long get() = nativeBytes()
+
+    /**
+     * Remove the module of a normalized name in all namespaces. Instances reading it at the
+     * same time are not affected.
+     */
+    fun remove(name: String) {
+        nativeRemove(name)
+    }
+
+    /**
+     * Remove all modules.
+     */
+    fun clear() {
+        nativeClear()
+    }
+
+    /**
+     * Returns the native namespace of an instance, user namespaces and loader namespaces
+     * are prefixed differently so they never collide.
+     */
+    internal fun namespaceOf(loader: ModuleLoader, namespace: String?): String {
+        if (namespace != null) {
+            return "user:$namespace"
+        }
+        return synchronized(loaderNamespaces) {
+            loaderNamespaces.getOrPut(loader) { "loader:${nextLoaderId++}" }
+        }
+    }
+
+    @JvmStatic
+    private external fun nativeRemove(name: String)
+
+    @JvmStatic
+    private external fun nativeClear()
+
+    @JvmStatic
+    private external fun nativeCount(): Int
+
+    @JvmStatic
+    private external fun nativeBytes(): Long
+
+    @JvmStatic
+    private external fun nativeGetMaxBytes(): Long
+
+    @JvmStatic
+    private external fun nativeSetMaxBytes(maxBytes: Long)
+}
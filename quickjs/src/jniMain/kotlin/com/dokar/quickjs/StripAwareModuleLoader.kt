@@ -0,0 +1,17 @@
+package com.dokar.quickjs
+
+/**
+ * A [ModuleLoader] caching compiled bytecode, which depends on the [QuickJs.stripDebugInfo]
+ * of the loading instance. [QuickJs] calls these overloads instead of the plain ones.
+ */
+internal interface StripAwareModuleLoader : ModuleLoader {
+    /**
+     * Like [load], for an instance compiling with [stripDebugInfo].
+     */
+    fun load(name: String, stripDebugInfo: StripDebugInfo): ModuleContent?
+
+    /**
+     * Like [onCompiled], for bytecode compiled with [stripDebugInfo].
+     */
+    fun onCompiled(name: String, bytecode: ByteArray, stripDebugInfo: StripDebugInfo)
+}
@@ -0,0 +1,5 @@
+package com.dokar.quickjs.util
+
+internal actual fun availableProcessors(): Int {
+    return Runtime.getRuntime().availableProcessors().coerceAtLeast(1)
+}
@@ -0,0 +1,90 @@
+package com.dokar.quickjs
+
+import kotlinx.coroutines.ExperimentalCoroutinesApi
+import kotlinx.coroutines.test.StandardTestDispatcher
+import kotlinx.coroutines.test.runTest
+import java.lang.reflect.InvocationTargetException
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFailsWith
+import kotlin.test.assertIs
+import kotlin.test.assertNotEquals
+import kotlin.test.assertTrue
+
+@OptIn(ExperimentalCoroutinesApi::class)
+class EvaluateResultHandleJvmTest {
+    @Test
+    fun releasedHandleIsRejectedAfterSlotRecycling() = runTest {
+        val quickJs = QuickJs.create(StandardTestDispatcher(testScheduler))
+        try {
+            val released = quickJs.evaluateHandle("1 + 2")
+            quickJs.callNative("releaseEvaluateResult", released)
+
+            val recycled = quickJs.evaluateHandle("3 + 4")
+            // Same slot, new generation
+            assertEquals(released and 0xFFFFFFFFL, recycled and 0xFFFFFFFFL)
+            assertNotEquals(released, recycled)
+
+            assertRejected { quickJs.callNative("getEvaluateResultPromiseId", released) }
+            assertRejected { quickJs.callNative("getEvaluateResult", released) }
+            assertRejected {
+                quickJs.javaClass.getDeclaredMethod(
+                    "drainPendingJobs",
+                    Long::class.java,
+                    Long::class.java,
+                    Long::class.java,
+                    Int::class.java,
+                    Long::class.java,
+                ).let { method ->
+                    method.isAccessible = true
+                    method.invoke(quickJs, quickJs.pointer("context"), quickJs.pointer("globals"), released, 1, 0L)
+                }
+            }
+
+            // The live handle is still usable
+            assertTrue(quickJs.callNative("getEvaluateResultPromiseId", recycled) as Long != 0L)
+            quickJs.callNative("releaseEvaluateResult", recycled)
+        } finally {
+            quickJs.close()
+        }
+    }
+
+    private fun assertRejected(block: () -> Unit) {
+        val error = assertFailsWith<InvocationTargetException> { block() }
+        val cause = assertIs<QuickJsException>(error.cause)
+        assertTrue(cause.message!!.contains("Invalid evaluation handle"))
+    }
+
+    private fun QuickJs.evaluateHandle(code: String): Long {
+        return javaClass.getDeclaredMethod(
+            "evaluate",
+            Long::class.java,
+            Long::class.java,
+            String::class.java,
+            String::class.java,
+            Boolean::class.java,
+        ).let { method ->
+            method.isAccessible = true
+            method.invoke(this, pointer("context"), pointer("globals"), "main.js", code, false) as Long
+        }
+    }
+
+    private fun QuickJs.callNative(name: String, handle: Long): Any? {
+        return javaClass.getDeclaredMethod(
+            name,
+            Long::class.java,
+            Long::class.java,
+            Long::class.java,
+        ).let { method ->
+            method.isAccessible = true
+            method.invoke(this, pointer("context"), pointer("globals"), handle)
+        }
+    }
+
+    private fun QuickJs.pointer(name: String): Long {
+        return javaClass.getDeclaredField(name).let { field ->
+            field.isAccessible = true
+            field.getLong(this)
+        }
+    }
+}
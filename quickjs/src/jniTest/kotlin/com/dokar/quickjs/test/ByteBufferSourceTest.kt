@@ -0,0 +1,50 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import java.nio.ByteBuffer
+import kotlin.test.Test
+import kotlin.test.assertEquals
+
+class ByteBufferSourceTest {
+    @Test
+    fun evaluateDirectBuffer() = runTest {
+        quickJs {
+            val bytes = "'direct ' + (1 + 1)".encodeToByteArray()
+            val buffer = ByteBuffer.allocateDirect(bytes.size).put(bytes)
+            buffer.flip()
+            assertEquals("direct 2", evaluateUtf8<String>(buffer))
+            assertEquals(0, buffer.position())
+        }
+    }
+
+    @Test
+    fun evaluateTerminatedDirectBufferRange() = runTest {
+        quickJs {
+            val bytes = "xx6 * 7\u0000".encodeToByteArray()
+            val buffer = ByteBuffer.allocateDirect(bytes.size).put(bytes)
+            buffer.position(2).limit(bytes.size - 1)
+            assertEquals(42, evaluateUtf8<Int>(buffer))
+        }
+    }
+
+    @Test
+    fun evaluateHeapBuffers() = runTest {
+        quickJs {
+            val buffer = ByteBuffer.wrap("--'heap'".encodeToByteArray())
+            buffer.position(2)
+            assertEquals("heap", evaluateUtf8<String>(buffer.slice()))
+            assertEquals("heap", evaluateUtf8<String>(buffer.asReadOnlyBuffer()))
+        }
+    }
+
+    @Test
+    fun compileDirectBuffer() = runTest {
+        quickJs {
+            val bytes = "'compiled'".encodeToByteArray()
+            val buffer = ByteBuffer.allocateDirect(bytes.size).put(bytes)
+            buffer.flip()
+            assertEquals("compiled", evaluate<String>(compileUtf8(buffer)))
+        }
+    }
+}
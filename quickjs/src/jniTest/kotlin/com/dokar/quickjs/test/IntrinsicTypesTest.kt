@@ -0,0 +1,69 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertContentEquals
+import kotlin.test.assertEquals
+
+class IntrinsicTypesTest {
+    @Test
+    fun mapJsValuesWithOverwrittenGlobals() = runTest {
+        quickJs {
+            val result = evaluate<List<Any?>>(
+                """
+                    const RealMap = Map;
+                    const RealSet = Set;
+                    const RealInt8Array = Int8Array;
+                    globalThis.Map = undefined;
+                    globalThis.Set = undefined;
+                    globalThis.Int8Array = undefined;
+                    [new RealMap([["a", 1]]), new RealSet([1]), new RealInt8Array([1, 2])];
+                """.trimIndent()
+            )
+            assertEquals(mapOf("a" to 1L), result[0])
+            assertEquals(setOf(1L), result[1])
+            assertContentEquals(byteArrayOf(1, 2), result[2] as ByteArray)
+        }
+    }
+
+    @Test
+    fun mapKotlinValuesWithOverwrittenGlobals() = runTest {
+        quickJs {
+            function("values") { listOf(mapOf("a" to 1), setOf(1), byteArrayOf(1, 2)) }
+            val result = evaluate<String>(
+                """
+                    const types = [Map, Set, Int8Array];
+                    globalThis.Map = globalThis.Set = globalThis.Int8Array = function () {
+                        throw new Error("Overwritten");
+                    };
+                    values().map((value, i) => value instanceof types[i]).join();
+                """.trimIndent()
+            )
+            assertEquals("true,true,true", result)
+        }
+    }
+
+    @OptIn(ExperimentalUnsignedTypes::class)
+    @Test
+    fun classifyPromisesAndTypedArrays() = runTest {
+        quickJs {
+            assertEquals(
+                listOf("Promise { <state>: \"fulfilled\" }"),
+                evaluate<List<Any?>>("[Promise.resolve(1)]")
+            )
+            assertContentEquals(
+                ubyteArrayOf(1u, 255u).asByteArray(),
+                evaluate<UByteArray>("new Uint8Array([1, 255])").asByteArray()
+            )
+            // Lookalikes are plain objects
+            assertEquals(
+                mapOf("size" to 0L),
+                evaluate<Map<String, Any?>>(
+                    "Object.create(Map.prototype, { size: { value: 0, enumerable: true } })"
+                )
+            )
+        }
+    }
+}
@@ -0,0 +1,76 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.MappedBytecode
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.moduleLoader
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import java.io.File
+import java.nio.ByteBuffer
+import java.nio.MappedByteBuffer
+import java.nio.channels.FileChannel
+import kotlin.test.Test
+import kotlin.test.assertContentEquals
+import kotlin.test.assertEquals
+
+class MappedBytecodeTest {
+    @Test
+    fun evaluateMappedBytecode() = runTest {
+        val file = File.createTempFile("quickjs", ".bin")
+        try {
+            quickJs {
+                file.writeBytes(compile("'mapped ' + (20 + 22)"))
+                val buffer = map(file)
+                assertEquals("mapped 42", evaluate<String>(buffer))
+                assertEquals(0, buffer.position())
+            }
+        } finally {
+            file.delete()
+        }
+    }
+
+    @Test
+    fun evaluateBufferRange() = runTest {
+        quickJs {
+            val bytecode = compile("1 + 2")
+            val buffer = ByteBuffer.allocateDirect(bytecode.size + 4)
+            buffer.position(2)
+            buffer.put(bytecode)
+            buffer.position(2).limit(2 + bytecode.size)
+            assertEquals(3, evaluate<Int>(buffer))
+            assertEquals(3, evaluate<Int>(ByteBuffer.wrap(bytecode)))
+        }
+    }
+
+    @Test
+    fun loadModuleFromMappedBytecode() = runTest {
+        val file = File.createTempFile("quickjs", ".bin")
+        try {
+            quickJs {
+                file.writeBytes(compile("export const value = 21;", "leaf", asModule = true))
+            }
+            val bytecode = MappedBytecode(map(file))
+            assertContentEquals(file.readBytes(), bytecode.toByteArray())
+            val loader = moduleLoader {
+                load { name -> if (name == "leaf") bytecode else null }
+            }
+            quickJs(moduleLoader = loader) {
+                var result: Any? = null
+                function("returns") { result = it.first() }
+                evaluate<Any?>(
+                    code = "import { value } from 'leaf'; returns(value * 2);",
+                    asModule = true,
+                )
+                assertEquals(42L, result)
+            }
+        } finally {
+            file.delete()
+        }
+    }
+
+    private fun map(file: File): MappedByteBuffer {
+        return FileChannel.open(file.toPath()).use {
+            it.map(FileChannel.MapMode.READ_ONLY, 0, it.size())
+        }
+    }
+}
@@ -0,0 +1,99 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.PersistentModuleCache
+import com.dokar.quickjs.StripDebugInfo
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import java.io.File
+import java.nio.file.Files
+import kotlin.test.AfterTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertFalse
+import kotlin.test.assertTrue
+
+class PersistentModuleCacheTest {
+    private val directory: File = Files.createTempDirectory("quickjs-cache").toFile()
+
+    @AfterTest
+    fun cleanup() {
+        directory.deleteRecursively()
+    }
+
+    @Test
+    fun cachedBytecodeIsReusedAcrossInstances() = runTest {
+        val sources = mutableMapOf(
+            "leaf" to "export const value = 21;",
+        )
+        val cache = PersistentModuleCache(directory) { sources[it] }
+
+        repeat(2) {
+            assertEquals(42L, evaluateEntry(cache))
+        }
+        val files = directory.listFiles()!!.filter { it.name.endsWith(".qjsc") }
+        assertEquals(1, files.size)
+
+        // Changed source gets a new file
+        sources["leaf"] = "export const value = 50;"
+        assertEquals(100L, evaluateEntry(cache))
+        assertEquals(2, directory.listFiles()!!.count { it.name.endsWith(".qjsc") })
+    }
+
+    @Test
+    fun corruptedFilesAreRecompiled() = runTest {
+        val cache = PersistentModuleCache(directory) { "export const value = 21;" }
+        assertEquals(42L, evaluateEntry(cache))
+
+        val file = directory.listFiles()!!.single { it.name.endsWith(".qjsc") }
+        file.writeBytes(ByteArray(4))
+        assertEquals(42L, evaluateEntry(cache))
+    }
+
+    @Test
+    fun evictsOverMaxBytes() = runTest {
+        val cache = PersistentModuleCache(directory, maxBytes = 1) {
+            "export const value = 21;"
+        }
+        assertEquals(42L, evaluateEntry(cache))
+        assertEquals(0, directory.listFiles()!!.count { it.name.endsWith(".qjsc") })
+    }
+
+    @Test
+    fun stripLevelsHaveSeparateFiles() = runTest {
+        val cache = PersistentModuleCache(directory) {
+            "export function add(a, b) { return a + b; }"
+        }
+        suspend fun addSource(stripDebugInfo: StripDebugInfo): String {
+            return quickJs(moduleLoader = cache) {
+                this.stripDebugInfo = stripDebugInfo
+                var result: Any? = null
+                function("returns") { result = it.first() }
+                evaluate<Any?>(
+                    code = "import { add } from 'leaf'; returns(add.toString());",
+                    asModule = true,
+                )
+                result as String
+            }
+        }
+
+        assertTrue(addSource(StripDebugInfo.None).contains("return a + b"))
+        assertFalse(addSource(StripDebugInfo.Source).contains("return a + b"))
+        // Loaded from the files
+        assertTrue(addSource(StripDebugInfo.None).contains("return a + b"))
+        assertFalse(addSource(StripDebugInfo.Source).contains("return a + b"))
+        assertEquals(2, directory.listFiles()!!.count { it.name.endsWith(".qjsc") })
+    }
+
+    private suspend fun evaluateEntry(cache: PersistentModuleCache): Any? {
+        return quickJs(moduleLoader = cache) {
+            var result: Any? = null
+            function("returns") { result = it.first() }
+            evaluate<Any?>(
+                code = "import { value } from 'leaf'; returns(value * 2);",
+                asModule = true,
+            )
+            result
+        }
+    }
+}
@@ -0,0 +1,189 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.ModuleContent
+import com.dokar.quickjs.SharedModuleCache
+import com.dokar.quickjs.StripDebugInfo
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.moduleLoader
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.AfterTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+import kotlin.test.assertTrue
+
+class SharedModuleCacheTest {
+    private val entry = """
+        import { value } from "shared-cache-leaf";
+        returns(value);
+    """.trimIndent()
+
+    @AfterTest
+    fun clearCache() {
+        SharedModuleCache.maxBytes = 64L * 1024 * 1024
+        SharedModuleCache.clear()
+    }
+
+    @Test
+    fun cachedModulesSkipTheLoader() = runTest {
+        val loaded = mutableListOf<String>()
+        val loader = moduleLoader {
+            load { name ->
+                loaded += name
+                if (name == "shared-cache-leaf") ModuleContent.Source("export const value = 42;") else null
+            }
+        }
+        repeat(3) {
+            quickJs(moduleLoader = loader) {
+                useSharedModuleCache = true
+                var result: Any? = null
+                function("returns") { result = it.first() }
+                evaluate<Any?>(entry, asModule = true)
+                assertEquals(42L, result)
+            }
+        }
+        assertEquals(listOf("shared-cache-leaf"), loaded)
+        assertTrue(SharedModuleCache.size >= 1)
+        assertTrue(SharedModuleCache.sizeInBytes > 0)
+
+        SharedModuleCache.remove("shared-cache-leaf")
+        quickJs(moduleLoader = loader) {
+            useSharedModuleCache = true
+            function("returns") {}
+            evaluate<Any?>(entry, asModule = true)
+        }
+        assertEquals(2, loaded.size)
+    }
+
+    @Test
+    fun disabledInstancesCallTheLoader() = runTest {
+        var loadCount = 0
+        val loader = moduleLoader {
+            load {
+                loadCount++
+                ModuleContent.Source("export const value = 1;")
+            }
+        }
+        repeat(2) {
+            quickJs(moduleLoader = loader) {
+                function("returns") {}
+                evaluate<Any?>(entry, asModule = true)
+            }
+        }
+        assertEquals(2, loadCount)
+    }
+
+    @Test
+    fun loadersDoNotShareModulesByDefault() = runTest {
+        val results = mutableListOf<Any?>()
+        for (value in listOf(1, 2)) {
+            val loader = moduleLoader {
+                load { ModuleContent.Source("export const value = $value;") }
+            }
+            quickJs(moduleLoader = loader) {
+                useSharedModuleCache = true
+                function("returns") { results += it.first() }
+                evaluate<Any?>(entry, asModule = true)
+            }
+        }
+        assertEquals(listOf<Any?>(1L, 2L), results)
+    }
+
+    @Test
+    fun loadersShareModulesInTheSameNamespace() = runTest {
+        var loadCount = 0
+        repeat(2) {
+            val loader = moduleLoader {
+                load {
+                    loadCount++
+                    ModuleContent.Source("export const value = 1;")
+                }
+            }
+            quickJs(moduleLoader = loader) {
+                useSharedModuleCache = true
+                sharedModuleCacheNamespace = "tenant-a:v1"
+                function("returns") {}
+                evaluate<Any?>(entry, asModule = true)
+            }
+        }
+        assertEquals(1, loadCount)
+    }
+
+    @Test
+    fun stripDebugInfoIsPartOfTheKey() = runTest {
+        var loadCount = 0
+        val loader = moduleLoader {
+            load {
+                loadCount++
+                ModuleContent.Source("export const value = 1;")
+            }
+        }
+        for (strip in listOf(StripDebugInfo.None, StripDebugInfo.All)) {
+            quickJs(moduleLoader = loader) {
+                useSharedModuleCache = true
+                stripDebugInfo = strip
+                function("returns") {}
+                evaluate<Any?>(entry, asModule = true)
+            }
+        }
+        assertEquals(2, loadCount)
+    }
+
+    @Test
+    fun compileBundleWithWarmCache() = runTest {
+        val loader = moduleLoader {
+            load { name ->
+                if (name == "shared-cache-leaf") ModuleContent.Source("export const value = 42;") else null
+            }
+        }
+        val bundle = quickJs(moduleLoader = loader) {
+            useSharedModuleCache = true
+            function("returns") {}
+            // Warm the cache
+            evaluate<Any?>(entry, asModule = true)
+            assertTrue(SharedModuleCache.size >= 1)
+            assertEquals(
+                setOf("entry", "shared-cache-leaf"),
+                resolveModuleGraph(compile(entry, filename = "entry", asModule = true)),
+            )
+            compileBundle(entry, filename = "entry")
+        }
+
+        // No loader, the bundle has all modules
+        quickJs {
+            var result: Any? = null
+            function("returns") { result = it.first() }
+            evaluateBundle<Any?>(bundle)
+            assertEquals(42L, result)
+        }
+    }
+
+    @Test
+    fun evictsLeastRecentlyUsedModules() = runTest {
+        val loaded = mutableListOf<String>()
+        val loader = moduleLoader {
+            load { name ->
+                loaded += name
+                ModuleContent.Source("export const value = 1;")
+            }
+        }
+        suspend fun importLeaf(name: String) {
+            quickJs(moduleLoader = loader) {
+                useSharedModuleCache = true
+                function("returns") {}
+                evaluate<Any?>("import { value } from \"$name\"; returns(value);", asModule = true)
+            }
+        }
+
+        importLeaf("leaf-a")
+        // Room for one leaf only
+        SharedModuleCache.maxBytes = SharedModuleCache.sizeInBytes * 3 / 2
+        importLeaf("leaf-b")
+        assertEquals(1, SharedModuleCache.size)
+
+        // leaf-a was evicted, leaf-b is still cached
+        importLeaf("leaf-b")
+        importLeaf("leaf-a")
+        assertEquals(listOf("leaf-a", "leaf-b", "leaf-a"), loaded)
+    }
+}
@@ -0,0 +1,87 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertContentEquals
+import kotlin.test.assertEquals
+
+class TypedArrayMappingTest {
+    @Test
+    fun mapPrimitiveArraysToTypedArrays() = runTest {
+        quickJs {
+            mapTypedArrays = true
+            function("values") {
+                listOf(
+                    intArrayOf(1, -2),
+                    longArrayOf(Long.MAX_VALUE),
+                    floatArrayOf(0.5f),
+                    doubleArrayOf(1.5, -0.25),
+                    intArrayOf(),
+                )
+            }
+            assertEquals(
+                "Int32Array:1,-2|BigInt64Array:9223372036854775807|Float32Array:0.5|" +
+                        "Float64Array:1.5,-0.25|Int32Array:",
+                evaluate(
+                    """
+                        values()
+                            .map((array) => array.constructor.name + ":" + array.join())
+                            .join("|");
+                    """.trimIndent()
+                )
+            )
+        }
+    }
+
+    @Test
+    fun mapTypedArraysToPrimitiveArrays() = runTest {
+        quickJs {
+            mapTypedArrays = true
+            assertContentEquals(intArrayOf(1, -2), evaluate<IntArray>("new Int32Array([1, -2])"))
+            assertContentEquals(
+                longArrayOf(Long.MIN_VALUE, 2),
+                evaluate<LongArray>("new BigInt64Array([-(2n ** 63n), 2n])")
+            )
+            assertContentEquals(
+                floatArrayOf(0.5f),
+                evaluate<FloatArray>("new Float32Array([0.5])")
+            )
+            assertContentEquals(
+                doubleArrayOf(2.0, 3.0),
+                evaluate<DoubleArray>("new Float64Array([1, 2, 3, 4]).subarray(1, 3)")
+            )
+        }
+    }
+
+    @Test
+    fun mapLargeArrays() = runTest {
+        quickJs {
+            mapTypedArrays = true
+            function("sum") { args -> (args[0] as DoubleArray).sum().toLong() }
+            assertEquals(499999500000L, evaluate("sum(new Float64Array(1000000).map((_, i) => i))"))
+
+            val doubles = DoubleArray(1000000) { it.toDouble() }
+            function("doubles") { doubles }
+            assertContentEquals(doubles, evaluate<DoubleArray>("doubles()"))
+        }
+    }
+
+    @Test
+    fun mapPlainArraysByDefault() = runTest {
+        quickJs {
+            function("ints") { intArrayOf(1, 2) }
+            assertEquals(true, evaluate("Array.isArray(ints())"))
+        }
+    }
+
+    @Test
+    fun keepMappingAfterReset() = runTest {
+        quickJs {
+            mapTypedArrays = true
+            reset()
+            assertContentEquals(intArrayOf(1), evaluate<IntArray>("new Int32Array([1])"))
+        }
+    }
+}
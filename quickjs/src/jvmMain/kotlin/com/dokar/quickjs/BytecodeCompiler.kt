@@ -0,0 +1,65 @@
+package com.dokar.quickjs
+
+import kotlinx.coroutines.Dispatchers
+import java.io.File
+import kotlin.system.exitProcess
+
+/**
+ * Build-time compiler of the `com.dokar.quickjs.bytecode` Gradle plugin.
+ *
+ * Every `.js` file of the source directory is compiled as a script, and every `.mjs` file
+ * is compiled as an ES module with its static imports, which are resolved relative to the
+ * source directory. Each file is written to the output directory as a bundle with the same
+ * relative path and a `.qjsb` suffix, to be evaluated by [QuickJs.evaluateBundle].
+ *
+ * Usage: `BytecodeCompiler <source dir> <output dir>`
+ */
+internal object BytecodeCompiler {
+    @JvmStatic
+    fun main(args: Array<String>) {
+        if (args.size != 2) {
+            System.err.println("Usage: BytecodeCompiler <source dir> <output dir>")
+            exitProcess(1)
+        }
+        val sourceDir = File(args[0]).canonicalFile
+        val outputDir = File(args[1])
+        try {
+            compileDir(sourceDir, outputDir)
+        } catch (e: QuickJsException) {
+            System.err.println(e.message)
+            exitProcess(1)
+        }
+    }
+
+    private fun compileDir(sourceDir: File, outputDir: File) {
+        val loader = moduleLoader {
+            load { name -> moduleFile(sourceDir, name)?.readText()?.let(ModuleContent::Source) }
+        }
+        val sources = sourceDir.walkTopDown()
+            .filter { it.isFile && (it.extension == "js" || it.extension == "mjs") }
+        for (file in sources) {
+            val name = file.relativeTo(sourceDir).invariantSeparatorsPath
+            // A new runtime per file, so bundles never share modules by accident
+            val bundle = quickJs(Dispatchers.Unconfined, loader) {
+                compileBundle(
+                    code = file.readText(),
+                    filename = name,
+                    asModule = file.extension == "mjs",
+                )
+            }
+            val outputFile = File(outputDir, "$name.qjsb")
+            outputFile.parentFile.mkdirs()
+            outputFile.writeBytes(bundle)
+        }
+    }
+
+    private fun moduleFile(sourceDir: File, name: String): File? {
+        val file = File(sourceDir, name).canonicalFile
+        // Imports are never resolved outside of the source directory
+        if (!file.path.startsWith(sourceDir.path + File.separator)) {
+            return null
+        }
+        return sequenceOf(file, File(file.path + ".mjs"), File(file.path + ".js"))
+            .firstOrNull { it.isFile }
+    }
+}
@@ -0,0 +1,3 @@
+import { name } from "./name.mjs";
+
+returns(`Hello, ${name}`);
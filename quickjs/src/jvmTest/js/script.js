@@ -0,0 +1,2 @@
+const values = [1, 2];
+values.reduce((sum, value) => sum + value, 0);
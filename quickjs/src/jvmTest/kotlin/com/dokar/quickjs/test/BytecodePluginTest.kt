@@ -0,0 +1,35 @@
+package com.dokar.quickjs.test
+
+import com.dokar.quickjs.binding.function
+import com.dokar.quickjs.quickJs
+import kotlinx.coroutines.test.runTest
+import kotlin.test.Test
+import kotlin.test.assertEquals
+
+/**
+ * Evaluate the bundles compiled from src/jvmTest/js by the bytecode plugin.
+ */
+class BytecodePluginTest {
+    @Test
+    fun evaluateCompiledScript() = runTest {
+        quickJs {
+            assertEquals(3L, evaluateBundle<Long>(readBundle("script.js")))
+        }
+    }
+
+    @Test
+    fun evaluateCompiledModule() = runTest {
+        quickJs {
+            var result: Any? = null
+            function("returns") { result = it.first() }
+            evaluateBundle<Any?>(readBundle("main.mjs"))
+            assertEquals("Hello, bundle", result)
+        }
+    }
+
+    private fun readBundle(name: String): ByteArray {
+        val stream = javaClass.getResourceAsStream("/$name.qjsb")
+            ?: error("Missing compiled bundle of '$name'.")
+        return stream.use { it.readBytes() }
+    }
+}
@@ -8,10 +8,18 @@ import com.dokar.quickjs.binding.ObjectBinding
 import com.dokar.quickjs.bridge.ExecuteJobResult
 import com.dokar.quickjs.bridge.JsPromise
 import com.dokar.quickjs.bridge.compile
+import com.dokar.quickjs.bridge.compileUtf8
 import com.dokar.quickjs.bridge.defineFunction
+import com.dokar.quickjs.bridge.callFunction
+import com.dokar.quickjs.bridge.callFunctionDouble
+import com.dokar.quickjs.bridge.callFunctionLong
 import com.dokar.quickjs.bridge.defineObject
 import com.dokar.quickjs.bridge.evaluate
+import com.dokar.quickjs.bridge.evaluateBundle
+import com.dokar.quickjs.bridge.evaluateSync
+import com.dokar.quickjs.bridge.evaluateUtf8
 import com.dokar.quickjs.bridge.executePendingJob
+import com.dokar.quickjs.bridge.getGlobalFunction
 import com.dokar.quickjs.bridge.invokeJsFunction
 import com.dokar.quickjs.bridge.ktMemoryUsage
 import com.dokar.quickjs.bridge.objectHandleToStableRef
@@ -22,6 +30,7 @@ import com.dokar.quickjs.converter.TypeConverter
 import com.dokar.quickjs.converter.TypeConverters
 import com.dokar.quickjs.converter.castValueOr
 import com.dokar.quickjs.converter.typeOfInstance
+import com.dokar.quickjs.internal.ModuleBundle
 import com.dokar.quickjs.internal.isInBindingCallback
 import com.dokar.quickjs.internal.withBindingCallback
 import com.dokar.quickjs.util.withLockSync
@@ -57,14 +66,20 @@ import quickjs.JS_GetRuntime
 import quickjs.JS_NewContext
 import quickjs.JS_NewRuntime
 import quickjs.JS_RunGC
+import quickjs.JS_SetContextOpaque
 import quickjs.JS_SetMaxStackSize
 import quickjs.JS_SetMemoryLimit
+import quickjs.JS_SetStripInfo
 import quickjs.JS_UpdateStackTop
 import quickjs.qjs_interrupt_fired
 import quickjs.qjs_interrupt_free
 import quickjs.qjs_interrupt_install
 import quickjs.qjs_interrupt_request
 import quickjs.qjs_interrupt_reset
+import quickjs.qjs_slab_free
+import quickjs.qjs_slab_new
+import quickjs.qjs_slab_new_runtime
+import quickjs.qjs_slab_trim
 import quickjs.quickjs_version
 import kotlin.concurrent.atomics.AtomicBoolean
 import kotlin.concurrent.atomics.ExperimentalAtomicApi
@@ -78,11 +93,27 @@ import kotlin.reflect.typeOf
 actual class QuickJs private constructor(
     private val jobDispatcher: CoroutineDispatcher,
     private val moduleLoader: ModuleLoader?,
+    /**
+     * The instance owning the runtime, null if this instance is not a realm.
+     */
+    private val owner: QuickJs? = null,
+    allocatorType: QuickJsAllocator = QuickJsAllocator.System,
 ) {
-    private val runtime: CPointer<JSRuntime> = JS_NewRuntime()
-        ?: qjsError("Failed to create js runtime.")
+    private val slabAllocator: COpaquePointer? =
+        if (owner == null && allocatorType == QuickJsAllocator.Slab) {
+            qjs_slab_new() ?: qjsError("Failed to create the slab allocator.")
+        } else {
+            null
+        }
 
-    private val context: CPointer<JSContext> = JS_NewContext(runtime)
+    private val runtime: CPointer<JSRuntime> = owner?.runtime
+        ?: (if (slabAllocator != null) qjs_slab_new_runtime(slabAllocator) else JS_NewRuntime())
+        ?: run {
+            slabAllocator?.let { qjs_slab_free(it) }
+            qjsError("Failed to create js runtime.")
+        }
+
+    private var context: CPointer<JSContext> = JS_NewContext(runtime)
         ?: qjsError("Failed to create js context.")
 
     private val ref = StableRef.create(this)
@@ -92,6 +123,11 @@ actual class QuickJs private constructor(
     private var evalException: Throwable? = null
     private var currentEvaluationSession: EvaluationSession? = null
 
+    /**
+     * Bumped by [reset], promise functions from older contexts must not be called.
+     */
+    private var contextGeneration = 0L
+
     private val exceptionHandler = CoroutineExceptionHandler { _, throwable ->
         if (evalException == null) {
             evalException = throwable
@@ -101,12 +137,34 @@ actual class QuickJs private constructor(
 
     private val objectBindings = mutableMapOf<Long, ObjectBinding>()
     private val globalFunctions = mutableMapOf<String, Binding>()
+    private val bindingDefinitions = mutableListOf<BindingDefinition>()
     private val nativeCloseHandlers = mutableListOf<(QuickJsNativeContext) -> Unit>()
+    private val realms = mutableListOf<QuickJs>()
 
     private val managedJsValues = mutableListOf<CValue<JSValue>>()
 
+    /**
+     * Resolve/reject functions of pending async function calls, removed once settled.
+     * Handles are never reused, so a settled handle can't reach another promise.
+     */
+    private val pendingPromises = mutableMapOf<Long, PromiseFunctions>()
+    private var nextPromiseHandle = 0L
+
+    /**
+     * Functions referenced by [getFunction], removed once released. Handles are never
+     * reused, so a released handle can't reach another function.
+     */
+    private val functionRefs = mutableMapOf<Long, CValue<JSValue>>()
+    private var nextFunctionHandle = 0L
+
     private val modules = mutableListOf<ByteArray>()
+    private val addedModules = mutableListOf<ByteArray>()
     private var resolvingModuleNames: LinkedHashSet<String>? = null
+    // Collects the bytecode of loaded modules while compiling a bundle
+    private var bundledModules: MutableMap<String, ByteArray>? = null
+    // Modules read into the context by bundles and the module loader, QuickJS can't look
+    // them up by name
+    private val contextModuleNames = mutableSetOf<String>()
     /** Suppresses parent notifications after a nested synchronous loader failure. */
     internal var moduleLoadFailureVersion = 0L
         private set
@@ -116,11 +174,13 @@ actual class QuickJs private constructor(
     private val activePromises = mutableListOf<JsPromise>()
 
     /**
-     * Avoid concurrent executions.
+     * Avoid concurrent executions. Shared by all realms of a runtime.
      */
-    private val jsMutex = Mutex()
-    private val interruptMutex = Mutex()
-    private val rootEvaluationMutex = Mutex()
+    private val jsMutex: Mutex = owner?.jsMutex ?: Mutex()
+    private val interruptMutex: Mutex = owner?.interruptMutex ?: Mutex()
+    private val rootEvaluationMutex: Mutex = owner?.rootEvaluationMutex ?: Mutex()
+    // Read by close() without the eval locks
+    private val isRootEvaluating = AtomicBoolean(false)
     private val runtimeProgress = MutableStateFlow(0L)
 
     @PublishedApi
@@ -158,6 +218,19 @@ actual class QuickJs private constructor(
             }
         }
 
+    // The strip level is a runtime setting, realms read and write the one of the owner
+    private var runtimeStripDebugInfo: StripDebugInfo = StripDebugInfo.None
+
+    actual var stripDebugInfo: StripDebugInfo
+        get() = (owner ?: this).runtimeStripDebugInfo
+        set(value) {
+            withJsLockSync {
+                ensureNotClosed()
+                (owner ?: this).runtimeStripDebugInfo = value
+                JS_SetStripInfo(runtime, value.flags)
+            }
+        }
+
     actual val memoryUsage: MemoryUsage
         get() = withJsLockSync {
             ensureNotClosed()
@@ -167,6 +240,8 @@ actual class QuickJs private constructor(
 
     actual var evaluationTimeoutMillis: Long = -1L
 
+    actual var compileCache: CompileCache? = null
+
     actual fun interruptEvaluation() {
         interruptMutex.withLockSync {
             ensureNotClosed()
@@ -196,11 +271,31 @@ actual class QuickJs private constructor(
         }
     }
 
+    @ExperimentalQuickJsApi
+    @Throws(QuickJsException::class)
+    actual fun openRealm(): QuickJs {
+        val root = owner ?: this
+        return withJsLockSync {
+            root.ensureNotClosed()
+            QuickJs(
+                jobDispatcher = jobDispatcher,
+                moduleLoader = root.moduleLoader,
+                owner = root,
+            ).also { root.realms += it }
+        }
+    }
+
     init {
-        interruptState = qjs_interrupt_install(runtime)
-        setPromiseRejectionHandler(ref, runtime)
-        if (moduleLoader != null) {
-            setModuleLoader(ref, runtime)
+        if (owner != null) {
+            interruptState = owner.interruptState
+            // Lets runtime-wide callbacks reach this realm instead of the owner
+            JS_SetContextOpaque(context, ref.asCPointer())
+        } else {
+            interruptState = qjs_interrupt_install(runtime)
+            setPromiseRejectionHandler(ref, runtime)
+            if (moduleLoader != null) {
+                setModuleLoader(ref, runtime)
+            }
         }
     }
 
@@ -222,6 +317,12 @@ actual class QuickJs private constructor(
                 binding = binding,
             )
             objectBindings[handle] = binding
+            bindingDefinitions += BindingDefinition.Object(
+                name = name,
+                binding = binding,
+                parent = parent.nativeHandle,
+                handle = handle,
+            )
             JsObjectHandle(handle)
         }
     }
@@ -240,6 +341,7 @@ actual class QuickJs private constructor(
                 isAsync = false,
             )
             globalFunctions[name] = binding
+            bindingDefinitions += BindingDefinition.Function(name, isAsync = false)
         }
     }
 
@@ -257,6 +359,7 @@ actual class QuickJs private constructor(
                 isAsync = true,
             )
             globalFunctions[name] = binding
+            bindingDefinitions += BindingDefinition.Function(name, isAsync = true)
         }
     }
 
@@ -264,7 +367,9 @@ actual class QuickJs private constructor(
     actual fun addModule(name: String, code: String) {
         withJsLockSync {
             ensureNotClosed()
-            modules.add(context.compile(code = code, filename = name, asModule = true))
+            val bytecode = context.compile(code = code, filename = name, asModule = true)
+            modules.add(bytecode)
+            addedModules.add(bytecode)
         }
     }
 
@@ -272,6 +377,7 @@ actual class QuickJs private constructor(
         withJsLockSync {
             ensureNotClosed()
             modules.add(bytecode)
+            addedModules.add(bytecode)
         }
     }
 
@@ -279,30 +385,110 @@ actual class QuickJs private constructor(
     actual fun compile(
         code: String,
         filename: String,
-        asModule: Boolean
+        asModule: Boolean,
+        stripDebugInfo: StripDebugInfo?,
     ): ByteArray {
         return withJsLockSync {
             ensureNotClosed()
-            return context.compile(code = code, filename = filename, asModule = asModule)
+            val runtimeStripInfo = this.stripDebugInfo
+            if (stripDebugInfo == null || stripDebugInfo == runtimeStripInfo) {
+                return context.compile(code = code, filename = filename, asModule = asModule)
+            }
+            JS_SetStripInfo(runtime, stripDebugInfo.flags)
+            try {
+                context.compile(code = code, filename = filename, asModule = asModule)
+            } finally {
+                JS_SetStripInfo(runtime, runtimeStripInfo.flags)
+            }
         }
     }
 
     @Throws(QuickJsException::class)
-    actual fun resolveModuleGraph(entryBytecode: ByteArray): Set<String> = withJsLockSync {
-        ensureNotClosed()
-        val graphContext = JS_NewContext(runtime)
-            ?: qjsError("Failed to create module graph context.")
-        val names = linkedSetOf<String>()
-        resolvingModuleNames = names
-        try {
-            names += graphContext.resolveModuleGraph(entryBytecode)
-            names
-        } finally {
-            resolvingModuleNames = null
-            JS_FreeContext(graphContext)
+    actual fun compileUtf8(
+        code: ByteArray,
+        length: Int,
+        filename: String,
+        asModule: Boolean,
+    ): ByteArray {
+        return withJsLockSync {
+            ensureNotClosed()
+            return context.compileUtf8(
+                code = code,
+                length = length,
+                filename = filename,
+                asModule = asModule,
+            )
+        }
+    }
+
+    @Throws(QuickJsException::class)
+    actual fun resolveModuleGraph(entryBytecode: ByteArray): Set<String> {
+        if (owner != null) {
+            // Module loading calls back to the runtime owner
+            ensureNotClosed()
+            return owner.resolveModuleGraph(entryBytecode)
+        }
+        return withJsLockSync {
+            ensureNotClosed()
+            val graphContext = JS_NewContext(runtime)
+                ?: qjsError("Failed to create module graph context.")
+            val names = linkedSetOf<String>()
+            resolvingModuleNames = names
+            try {
+                names += graphContext.resolveModuleGraph(entryBytecode)
+                names
+            } finally {
+                resolvingModuleNames = null
+                JS_FreeContext(graphContext)
+            }
         }
     }
 
+    @Throws(QuickJsException::class)
+    actual fun compileBundle(code: String, filename: String, asModule: Boolean): ByteArray {
+        if (owner != null) {
+            // Module loading calls back to the runtime owner
+            ensureNotClosed()
+            return owner.compileBundle(code, filename, asModule)
+        }
+        return withJsLockSync {
+            ensureNotClosed()
+            if (!asModule) {
+                val script = context.compile(code = code, filename = filename, asModule = false)
+                return@withJsLockSync ModuleBundle.write(filename, mapOf(filename to script), version)
+            }
+            val entry = context.compile(code = code, filename = filename, asModule = true)
+            val graphContext = JS_NewContext(runtime)
+                ?: qjsError("Failed to create module graph context.")
+            val modules = linkedMapOf(filename to entry)
+            bundledModules = modules
+            try {
+                graphContext.resolveModuleGraph(entry)
+            } finally {
+                bundledModules = null
+                JS_FreeContext(graphContext)
+            }
+            ModuleBundle.write(filename, modules, version)
+        }
+    }
+
+    @Throws(QuickJsException::class, CancellationException::class)
+    actual suspend inline fun <reified T> evaluateBundle(bundle: ByteArray): T {
+        return castValueOr(evalBundleInternal(bundle), typeOf<T>()) {
+            typeConverters.convert(
+                source = it,
+                sourceType = if (it is JsPromise) typeOf<JsPromise>() else typeOfInstance(typeConverters, it),
+                targetType = typeOf<T>()
+            )
+        }
+    }
+
+    @PublishedApi
+    @Throws(QuickJsException::class, CancellationException::class)
+    internal suspend fun evalBundleInternal(bundle: ByteArray): Any? = evalAndAwait {
+        context.evaluateBundle(bundle, version, contextModuleNames)
+    }
+
     @Throws(QuickJsException::class, CancellationException::class)
     actual suspend inline fun <reified T> evaluate(bytecode: ByteArray): T {
         return castValueOr(evalInternal(bytecode = bytecode), typeOf<T>()) {
@@ -332,6 +518,22 @@ actual class QuickJs private constructor(
         }
     }
 
+    @Throws(QuickJsException::class, CancellationException::class)
+    actual suspend inline fun <reified T> evaluateUtf8(
+        code: ByteArray,
+        length: Int,
+        filename: String,
+        asModule: Boolean,
+    ): T {
+        return castValueOr(evalUtf8Internal(code, length, filename, asModule), typeOf<T>()) {
+            typeConverters.convert(
+                source = it,
+                sourceType = if (it is JsPromise) typeOf<JsPromise>() else typeOfInstance(typeConverters, it),
+                targetType = typeOf<T>()
+            )
+        }
+    }
+
     @PublishedApi
     @Throws(QuickJsException::class, CancellationException::class)
     internal suspend fun evalInternal(bytecode: ByteArray): Any? = evalAndAwait {
@@ -344,8 +546,106 @@ actual class QuickJs private constructor(
         code: String,
         filename: String,
         asModule: Boolean
+    ): Any? {
+        val cache = compileCache
+        if (cache != null) {
+            val strip = stripDebugInfo
+            val bytecode = cache.getOrCompile(code, filename, asModule, strip) {
+                compile(code = code, filename = filename, asModule = asModule, stripDebugInfo = strip)
+            }
+            return evalInternal(bytecode = bytecode)
+        }
+        return evalAndAwait {
+            context.evaluate(code = code, filename = filename, asModule = asModule)
+        }
+    }
+
+    @PublishedApi
+    @Throws(QuickJsException::class, CancellationException::class)
+    internal suspend fun evalUtf8Internal(
+        code: ByteArray,
+        length: Int,
+        filename: String,
+        asModule: Boolean,
     ): Any? = evalAndAwait {
-        context.evaluate(code = code, filename = filename, asModule = asModule)
+        context.evaluateUtf8(code = code, length = length, filename = filename, asModule = asModule)
+    }
+
+    @Throws(QuickJsException::class)
+    actual inline fun <reified T> evaluateSync(
+        code: String,
+        filename: String,
+        asModule: Boolean,
+    ): T {
+        return castValueOr(evalSyncInternal(code, filename, asModule), typeOf<T>()) {
+            typeConverters.convert(
+                source = it,
+                sourceType = typeOfInstance(typeConverters, it),
+                targetType = typeOf<T>()
+            )
+        }
+    }
+
+    @Throws(QuickJsException::class)
+    actual inline fun <reified T> evaluateSync(bytecode: ByteArray): T {
+        return castValueOr(evalSyncInternal(bytecode), typeOf<T>()) {
+            typeConverters.convert(
+                source = it,
+                sourceType = typeOfInstance(typeConverters, it),
+                targetType = typeOf<T>()
+            )
+        }
+    }
+
+    @Throws(QuickJsException::class)
+    actual fun getFunction(name: String): JsFunctionRef = withJsLockSync {
+        ensureNotClosed()
+        val handle = nextFunctionHandle++
+        functionRefs[handle] = context.getGlobalFunction(name)
+        JsFunctionRef(this, handle)
+    }
+
+    @PublishedApi
+    @Throws(QuickJsException::class)
+    internal actual fun callFunctionInternal(handle: Long, args: Array<out Any?>): Any? =
+        evalSync {
+            context.callFunction(functionRef(handle), args)
+        }
+
+    @Throws(QuickJsException::class)
+    internal actual fun callFunctionDouble(handle: Long, args: DoubleArray): Double = evalSync {
+        context.callFunctionDouble(functionRef(handle), args)
+    }
+
+    @Throws(QuickJsException::class)
+    internal actual fun callFunctionLong(handle: Long, args: LongArray): Long = evalSync {
+        context.callFunctionLong(functionRef(handle), args)
+    }
+
+    private fun functionRef(handle: Long): CValue<JSValue> =
+        functionRefs[handle] ?: qjsError("Invalid or released function handle: $handle")
+
+    internal actual fun releaseFunction(handle: Long) {
+        withJsLockSync {
+            if (isClosed) return@withJsLockSync
+            functionRefs.remove(handle)?.let { JS_FreeValue(context, it) }
+        }
+    }
+
+    @PublishedApi
+    @Throws(QuickJsException::class)
+    internal fun evalSyncInternal(bytecode: ByteArray): Any? = evalSync {
+        context.evaluateSync(bytecode = bytecode)
+    }
+
+    @PublishedApi
+    @Throws(QuickJsException::class)
+    internal fun evalSyncInternal(
+        code: String,
+        filename: String,
+        asModule: Boolean,
+    ): Any? = evalSync {
+        context.evaluateSync(code = code, filename = filename, asModule = asModule)
     }
 
     actual fun gc() {
@@ -353,6 +653,124 @@ actual class QuickJs private constructor(
             ensureNotClosed()
             JS_UpdateStackTop(runtime)
             JS_RunGC(runtime)
+            slabAllocator?.let { qjs_slab_trim(it) }
+        }
+    }
+
+    @Throws(QuickJsException::class)
+    actual fun reset() {
+        if (isInBindingCallback(this)) {
+            qjsError("Cannot reset QuickJs from within a binding callback.")
+        }
+        if (owner != null) {
+            qjsError("Cannot reset a realm, close it and open a new one instead.")
+        }
+        if (!rootEvaluationMutex.tryLock()) {
+            qjsError("Cannot reset QuickJs while evaluating.")
+        }
+        try {
+            ensureNotClosed()
+            if (jsMutex.withLockSync { realms.isNotEmpty() }) {
+                qjsError("Cannot reset QuickJs with open realms.")
+            }
+            jobsMutex.withLockSync {
+                asyncJobs.forEach { it.job.cancel() }
+                asyncJobs.clear()
+            }
+            var nativeCleanupError: Throwable? = null
+            jsMutex.withLockSync {
+                ensureNotClosed()
+                JS_UpdateStackTop(runtime)
+                val newContext = JS_NewContext(runtime)
+                    ?: qjsError("Failed to create js context.")
+                nativeCloseHandlers.asReversed().forEach { cleanup ->
+                    try {
+                        cleanup(
+                            QuickJsNativeContext(
+                                contextAddress = context.toLong(),
+                                runtimeAddress = runtime.toLong(),
+                            )
+                        )
+                    } catch (error: Throwable) {
+                        if (nativeCleanupError == null) nativeCleanupError = error
+                    }
+                }
+                nativeCloseHandlers.clear()
+                // Bindings called by jobs still queued for the old context throw once it's
+                // replaced, loops that never end are aborted by the interrupt.
+                val oldContext = context
+                context = newContext
+                requestInterruptIfOpen()
+                try {
+                    for (i in 0 until RESET_MAX_DRAINED_JOBS) {
+                        // Errors of discarded jobs are dropped together with their context
+                        if (executePendingJob(runtime) == ExecuteJobResult.NoJobs) break
+                    }
+                } finally {
+                    resetInterruptState(0L)
+                }
+                contextGeneration++
+                evalException = null
+                contextModuleNames.clear()
+                managedJsValues.forEach { JS_FreeValue(oldContext, it) }
+                managedJsValues.clear()
+                pendingPromises.values.forEach { it.free(oldContext) }
+                pendingPromises.clear()
+                functionRefs.values.forEach { JS_FreeValue(oldContext, it) }
+                functionRefs.clear()
+                objectBindings.keys.forEach { handle ->
+                    objectHandleToStableRef(handle)?.let {
+                        JS_FreeValue(oldContext, it.get())
+                        it.dispose()
+                    }
+                }
+                objectBindings.clear()
+                JS_FreeContext(oldContext)
+                slabAllocator?.let { qjs_slab_trim(it) }
+
+                // Object handles are stable refs, map the parents to the new ones
+                val newHandles = mutableMapOf<Long, Long>()
+                val definitions = bindingDefinitions.toList()
+                bindingDefinitions.clear()
+                for (definition in definitions) {
+                    when (definition) {
+                        is BindingDefinition.Object -> {
+                            val parent = newHandles[definition.parent] ?: definition.parent
+                            val handle = context.defineObject(
+                                quickJsRef = ref,
+                                parentHandle = parent,
+                                name = definition.name,
+                                binding = definition.binding,
+                            )
+                            newHandles[definition.handle] = handle
+                            objectBindings[handle] = definition.binding
+                            bindingDefinitions += BindingDefinition.Object(
+                                name = definition.name,
+                                binding = definition.binding,
+                                parent = parent,
+                                handle = handle,
+                            )
+                        }
+
+                        is BindingDefinition.Function -> {
+                            context.defineFunction(
+                                quickJsRef = ref,
+                                parent = null,
+                                parentHandle = JsObjectHandle.globalThis.nativeHandle,
+                                name = definition.name,
+                                isAsync = definition.isAsync,
+                            )
+                            bindingDefinitions += definition
+                        }
+                    }
+                }
+                modules.clear()
+                modules.addAll(addedModules)
+            }
+            signalRuntimeProgress()
+            nativeCleanupError?.let { throw it }
+        } finally {
+            rootEvaluationMutex.unlock()
         }
     }
 
@@ -363,8 +781,11 @@ actual class QuickJs private constructor(
         if (!closed.compareAndSet(expectedValue = false, newValue = true)) return
         // A busy evaluation holds the JS lock until it returns, so interrupt it
         // first. Without this, closing while something like 'while(true){}' is
-        // running would wait forever.
-        requestInterruptIfOpen()
+        // running would wait forever. Realms share the interrupt, so they only
+        // interrupt their own evaluation.
+        if (owner == null || isRootEvaluating.load()) {
+            requestInterruptIfOpen()
+        }
         val promisesToFree = jobsMutex.withLockSync {
             evalException = null
             asyncJobs.forEach { it.job.cancel() }
@@ -375,6 +796,14 @@ actual class QuickJs private constructor(
         }
         signalRuntimeProgress()
         var nativeCleanupError: Throwable? = null
+        val openRealms = jsMutex.withLockSync { realms.toList() }
+        for (realm in openRealms) {
+            try {
+                realm.close()
+            } catch (error: Throwable) {
+                if (nativeCleanupError == null) nativeCleanupError = error
+            }
+        }
         jsMutex.withLockSync {
             JS_UpdateStackTop(runtime)
             nativeCloseHandlers.asReversed().forEach { cleanup ->
@@ -393,6 +822,10 @@ actual class QuickJs private constructor(
             promisesToFree.forEach { it.free(context) }
             managedJsValues.forEach { JS_FreeValue(context, it) }
             managedJsValues.clear()
+            pendingPromises.values.forEach { it.free(context) }
+            pendingPromises.clear()
+            functionRefs.values.forEach { JS_FreeValue(context, it) }
+            functionRefs.clear()
             // Dispose stable refs
             objectBindings.keys.forEach { handle ->
                 objectHandleToStableRef(handle)?.let {
@@ -402,14 +835,25 @@ actual class QuickJs private constructor(
             }
             objectBindings.clear()
             globalFunctions.clear()
+            bindingDefinitions.clear()
+            if (owner != null) {
+                // The runtime belongs to the owner
+                owner.realms.remove(this)
+                JS_SetContextOpaque(context, null)
+                JS_FreeContext(context)
+                interruptMutex.withLockSync { interruptState = null }
+                return@withLockSync
+            }
             JS_FreeContext(context)
             interruptMutex.withLockSync {
                 interruptState?.let { qjs_interrupt_free(runtime, it) }
                 interruptState = null
             }
             JS_FreeRuntime(runtime)
+            slabAllocator?.let { qjs_slab_free(it) }
         }
         modules.clear()
+        addedModules.clear()
         ref.dispose()
         nativeCleanupError?.let { throw it }
     }
@@ -421,27 +865,41 @@ actual class QuickJs private constructor(
     ) {
         if (isClosed) return
         val session = currentEvaluationSession
-            ?: qjsError("Async function was invoked outside an evaluation.")
-        val resolveFunc = args[0] as CValue<JSValue>
-        val rejectFunc = args[1] as CValue<JSValue>
+            ?: qjsError("Async functions can only be called from evaluate().")
+        val promiseHandle = args[0] as Long
+        val generation = contextGeneration
         val job = coroutineScope.launch(context = session, start = CoroutineStart.LAZY) {
+            var settled = false
             try {
-                val result = block(args.sliceArray(2..<args.size))
+                val result = block(args.sliceArray(1..<args.size))
                 jsMutex.withLock {
-                    if (isClosed) return@withLock
+                    if (isClosed || generation != contextGeneration) return@withLock
                     withEvaluationSession(session) {
-                        context.invokeJsFunction(resolveFunc, arrayOf(result))
+                        settlePromise(promiseHandle, reject = false, value = result)
+                        settled = true
                     }
                 }
                 signalRuntimeProgress()
             } catch (e: Throwable) {
+                if (settled) throw e
                 jsMutex.withLock {
-                    if (isClosed) return@withLock
+                    if (isClosed || generation != contextGeneration) return@withLock
                     withEvaluationSession(session) {
-                        context.invokeJsFunction(rejectFunc, arrayOf(e))
+                        settlePromise(promiseHandle, reject = true, value = e)
+                        settled = true
                     }
                 }
                 signalRuntimeProgress()
+            } finally {
+                if (!settled) {
+                    // Cancelled, the promise won't be settled but its functions must be freed
+                    withContext(NonCancellable) {
+                        jsMutex.withLock {
+                            if (isClosed || generation != contextGeneration) return@withLock
+                            releasePromise(promiseHandle)
+                        }
+                    }
+                }
             }
         }
         jobsMutex.withLockSync { asyncJobs += AsyncJob(job, session) }
@@ -461,6 +919,7 @@ actual class QuickJs private constructor(
             return evalInSession(inheritedSession, isRoot = false, block)
         }
         return rootEvaluationMutex.withLock {
+            isRootEvaluating.store(true)
             evalException = null
             resetInterruptState(evaluationTimeoutMillis)
             // Cancellation alone can't stop busy JavaScript, so hook it up
@@ -485,7 +944,53 @@ actual class QuickJs private constructor(
             } finally {
                 interruptOnCancel.complete()
                 resetInterruptState(0L)
+                isRootEvaluating.store(false)
+            }
+        }
+    }
+
+    private inline fun <T> evalSync(block: () -> T): T {
+        ensureNotClosed()
+        if (isInBindingCallback(this)) {
+            // The calling evaluation holds the locks
+            return runSyncEvaluation(block)
+        }
+        return rootEvaluationMutex.withLockSync {
+            isRootEvaluating.store(true)
+            resetInterruptState(evaluationTimeoutMillis)
+            try {
+                jsMutex.withLockSync { runSyncEvaluation(block) }
+            } catch (e: QuickJsException) {
+                if (isClosed) qjsError("Already closed.")
+                if (wasInterrupted()) {
+                    throw QuickJsInterruptedException(e.message)
+                }
+                throw e
+            } finally {
+                resetInterruptState(0L)
+                isRootEvaluating.store(false)
+            }
+        }
+    }
+
+    private inline fun <T> runSyncEvaluation(block: () -> T): T {
+        ensureNotClosed()
+        val previousSession = currentEvaluationSession
+        val previousException = evalException
+        // Without a session, unhandled rejections are reported to evalException
+        currentEvaluationSession = null
+        evalException = null
+        try {
+            for (module in modules) {
+                context.evaluate(module).free(context)
             }
+            modules.clear()
+            val result = block()
+            evalException?.let { throw it }
+            return result
+        } finally {
+            evalException = previousException
+            currentEvaluationSession = previousSession
         }
     }
 
@@ -617,11 +1122,23 @@ actual class QuickJs private constructor(
     /** Loads content from the runtime-scoped module loader. */
     internal fun loadModule(name: String): ModuleContent? {
         resolvingModuleNames?.add(name)
-        return moduleLoader?.load(name)
+        val content = moduleLoader?.load(name)
+        when (content) {
+            is ModuleContent.Bytecode -> bundledModules?.put(name, content.bytes)
+            is ModuleContent.BytecodeBuffer -> bundledModules?.put(name, content.toByteArray())
+            else -> {}
+        }
+        return content
+    }
+
+    /** Records a module the loader registered in the context of this instance. */
+    internal fun onModuleRegistered(name: String) {
+        contextModuleNames.add(name)
     }
 
     /** Delivers source-compiled bytecode to the runtime-scoped module loader. */
     internal fun onModuleCompiled(name: String, bytecode: ByteArray) {
+        bundledModules?.put(name, bytecode)
         moduleLoader?.onCompiled(name, bytecode)
     }
 
@@ -667,10 +1184,46 @@ actual class QuickJs private constructor(
         if (exception != null) throw exception
     }
 
+    /**
+     * Check if [ctx] is the live context of this instance, jobs left by a reset still
+     * run against the replaced one.
+     */
+    internal fun isCurrentContext(ctx: CPointer<JSContext>): Boolean = ctx == context
+
     internal fun addManagedJsValues(vararg value: CValue<JSValue>) {
         managedJsValues.addAll(value)
     }
 
+    /**
+     * Keep the resolve and reject functions of an async function call until it's settled.
+     *
+     * @return The promise handle.
+     */
+    internal fun addPendingPromise(
+        resolveFunc: CValue<JSValue>,
+        rejectFunc: CValue<JSValue>,
+    ): Long {
+        val handle = nextPromiseHandle++
+        pendingPromises[handle] = PromiseFunctions(resolveFunc, rejectFunc)
+        return handle
+    }
+
+    /**
+     * Free the functions of a pending promise without settling it.
+     */
+    internal fun releasePromise(handle: Long) {
+        pendingPromises.remove(handle)?.free(context)
+    }
+
+    private fun settlePromise(handle: Long, reject: Boolean, value: Any?) {
+        val functions = pendingPromises[handle]
+            ?: qjsError("Invalid or settled promise handle: $handle")
+        context.invokeJsFunction(if (reject) functions.reject else functions.resolve, arrayOf(value))
+        // Kept if mapping the value failed, so the promise can still be rejected
+        pendingPromises.remove(handle)
+        functions.free(context)
+    }
+
     internal fun onCallBindingGetter(
         parentHandle: Long,
         name: String,
@@ -757,6 +1310,30 @@ actual class QuickJs private constructor(
         runtimeProgress.update { it + 1 }
     }
 
+    private sealed interface BindingDefinition {
+        class Object(
+            val name: String,
+            val binding: ObjectBinding,
+            val parent: Long,
+            val handle: Long,
+        ) : BindingDefinition
+
+        class Function(
+            val name: String,
+            val isAsync: Boolean,
+        ) : BindingDefinition
+    }
+
+    private class PromiseFunctions(
+        val resolve: CValue<JSValue>,
+        val reject: CValue<JSValue>,
+    ) {
+        fun free(context: CPointer<JSContext>) {
+            JS_FreeValue(context, resolve)
+            JS_FreeValue(context, reject)
+        }
+    }
+
     private data class AsyncJob(
         val job: Job,
         val session: EvaluationSession,
@@ -793,5 +1370,21 @@ actual class QuickJs private constructor(
                 moduleLoader = moduleLoader,
             )
         }
+
+        @Throws(QuickJsException::class)
+        actual fun create(
+            jobDispatcher: CoroutineDispatcher,
+            moduleLoader: ModuleLoader?,
+            allocator: QuickJsAllocator,
+        ): QuickJs {
+            return QuickJs(
+                jobDispatcher = jobDispatcher,
+                moduleLoader = moduleLoader,
+                allocatorType = allocator,
+            )
+        }
     }
 }
+
+// Jobs run by reset() to let the old context settle, the rest are left to the runtime
+private const val RESET_MAX_DRAINED_JOBS = 100_000
@@ -1,7 +1,9 @@
 package com.dokar.quickjs.bridge
 
 import com.dokar.quickjs.QuickJs
+import com.dokar.quickjs.QuickJsException
 import kotlinx.cinterop.CPointer
+import kotlinx.cinterop.CValue
 import kotlinx.cinterop.ExperimentalForeignApi
 import kotlinx.cinterop.alloc
 import kotlinx.cinterop.asStableRef
@@ -14,7 +16,9 @@ import kotlinx.cinterop.value
 import platform.posix.int64_tVar
 import quickjs.JSContext
 import quickjs.JSValue
+import quickjs.JS_Throw
 import quickjs.JS_ToInt64Ext
+import quickjs.JsException
 
 internal data class BindingFunctionData(
     val name: String,
@@ -49,3 +53,13 @@ internal data class BindingFunctionData(
         }
     }
 }
+
+/**
+ * Throw a js error for a binding called by a context that was replaced by a reset,
+ * the object handles of the binding may be released already.
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun throwContextReset(ctx: CPointer<JSContext>): CValue<JSValue> {
+    JS_Throw(ctx, ktErrorToJsError(ctx, QuickJsException("QuickJs context was reset or closed.")))
+    return JsException()
+}
@@ -112,7 +112,7 @@ internal sealed interface ExecuteJobResult {
 }
 
 @OptIn(ExperimentalForeignApi::class)
-private fun CValue<JSValue>.unwrapIfWrapped(context: CPointer<JSContext>): CValue<JSValue> {
+internal fun CValue<JSValue>.unwrapIfWrapped(context: CPointer<JSContext>): CValue<JSValue> {
     if (JsValueGetNormTag(this) != JS_TAG_OBJECT || this.isPromise(context)) {
         return this
     }
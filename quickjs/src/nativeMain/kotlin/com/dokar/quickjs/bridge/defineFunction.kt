@@ -16,10 +16,10 @@ import kotlinx.cinterop.toLong
 import quickjs.JSContext
 import quickjs.JSValue
 import quickjs.JS_DefinePropertyValue
-import quickjs.JS_DupValue
 import quickjs.JS_FreeAtom
 import quickjs.JS_FreeValue
 import quickjs.JS_GetGlobalObject
+import quickjs.JS_IsException
 import quickjs.JS_NewAtom
 import quickjs.JS_NewBigInt64
 import quickjs.JS_NewCFunctionData
@@ -106,6 +106,9 @@ private fun invokeFunction(
     funcData ?: return@memScoped JsException()
 
     val (funcName, quickJs, objectHandle) = BindingFunctionData.fromJsValues(ctx, funcData)
+    if (!quickJs.isCurrentContext(ctx)) {
+        return@memScoped throwContextReset(ctx)
+    }
 
     try {
         val invokeArgs = Array(argc) { argv!![it].readValue().toKtValue(ctx) }
@@ -136,24 +139,29 @@ private fun invokeAsyncFunction(
     funcData ?: return@memScoped JsException()
 
     val (funcName, quickJs, objectHandle) = BindingFunctionData.fromJsValues(ctx, funcData)
+    if (!quickJs.isCurrentContext(ctx)) {
+        return@memScoped throwContextReset(ctx)
+    }
 
     val functions = allocArray<JSValue>(2)
     val promise = JS_NewPromiseCapability(ctx, functions)
+    if (JS_IsException(promise) == 1) {
+        return@memScoped promise
+    }
 
-    val resolveFunc = functions[0].readValue()
-    val rejectFunc = functions[1].readValue()
-
-    // Free these functions when closing
-    quickJs.addManagedJsValues(resolveFunc, rejectFunc, promise)
+    // The functions are freed once the promise is settled
+    val promiseHandle = quickJs.addPendingPromise(
+        resolveFunc = functions[0].readValue(),
+        rejectFunc = functions[1].readValue(),
+    )
 
-    val args: Array<Any?> = Array(2 + argc) { null }
-    args[0] = resolveFunc
-    args[1] = rejectFunc
+    val args: Array<Any?> = Array(1 + argc) { null }
+    args[0] = promiseHandle
 
     try {
         val invokeArgs = Array(argc) { argv!![it].readValue().toKtValue(ctx) }
         for (i in invokeArgs.indices) {
-            args[i + 2] = invokeArgs[i]
+            args[i + 1] = invokeArgs[i]
         }
         // Invoke binding
         quickJs.onCallBindingFunction(
@@ -162,9 +170,11 @@ private fun invokeAsyncFunction(
             args = args
         )
     } catch (e: Throwable) {
+        quickJs.releasePromise(promiseHandle)
+        JS_FreeValue(ctx, promise)
         JS_Throw(ctx, ktErrorToJsError(ctx, e))
         return@memScoped JsException()
     }
 
-    JS_DupValue(ctx, promise)
+    promise
 }
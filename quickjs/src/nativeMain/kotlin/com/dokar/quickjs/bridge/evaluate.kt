@@ -2,21 +2,32 @@ package com.dokar.quickjs.bridge
 
 import cnames.structs.JSModuleDef
 import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.internal.ModuleBundle
 import com.dokar.quickjs.qjsError
+import com.dokar.quickjs.util.isPromise
+import kotlinx.cinterop.ByteVar
 import kotlinx.cinterop.CPointer
 import kotlinx.cinterop.CValue
 import kotlinx.cinterop.CValues
+import kotlinx.cinterop.CValuesRef
 import kotlinx.cinterop.ExperimentalForeignApi
 import kotlinx.cinterop.UByteVar
+import kotlinx.cinterop.addressOf
+import kotlinx.cinterop.allocArray
 import kotlinx.cinterop.cstr
 import kotlinx.cinterop.memScoped
 import kotlinx.cinterop.reinterpret
+import kotlinx.cinterop.set
 import kotlinx.cinterop.toCValues
+import kotlinx.cinterop.usePinned
+import platform.posix.memcpy
 import quickjs.JSContext
+import quickjs.JSPromiseStateEnum
 import quickjs.JSValue
 import quickjs.JS_AtomToString
 import quickjs.JS_EVAL_FLAG_ASYNC
 import quickjs.JS_EVAL_FLAG_COMPILE_ONLY
+import quickjs.JS_EVAL_TYPE_GLOBAL
 import quickjs.JS_EVAL_TYPE_MODULE
 import quickjs.JS_Eval
 import quickjs.JS_EvalFunction
@@ -25,6 +36,9 @@ import quickjs.JS_FreeValue
 import quickjs.JS_GetException
 import quickjs.JS_GetModuleName
 import quickjs.JS_GetRuntime
+import quickjs.JS_IsError
+import quickjs.JS_PromiseResult
+import quickjs.JS_PromiseState
 import quickjs.JS_READ_OBJ_BYTECODE
 import quickjs.JS_READ_OBJ_REFERENCE
 import quickjs.JS_ReadObject
@@ -48,30 +62,79 @@ internal fun CPointer<JSContext>.compile(
     code: String,
     filename: String,
     asModule: Boolean
+): ByteArray {
+    val cStr = code.cstr
+    return compileSource(cStr, cStr.size - 1, filename, asModule)
+}
+
+@OptIn(ExperimentalForeignApi::class)
+@Throws(QuickJsException::class)
+internal fun CPointer<JSContext>.compileUtf8(
+    code: ByteArray,
+    length: Int,
+    filename: String,
+    asModule: Boolean
+): ByteArray = withUtf8Source(code, length) { input ->
+    compileSource(input, length, filename, asModule)
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private fun CPointer<JSContext>.compileSource(
+    input: CValuesRef<ByteVar>,
+    inputLength: Int,
+    filename: String,
+    asModule: Boolean
 ): ByteArray {
     var evalFlags = JS_EVAL_FLAG_COMPILE_ONLY or JS_EVAL_FLAG_ASYNC
     if (asModule) {
         evalFlags = evalFlags or JS_EVAL_TYPE_MODULE
     }
-    val cStr = code.cstr
     JS_UpdateStackTop(JS_GetRuntime(this))
     val result = JS_Eval(
         ctx = this,
-        input = cStr,
-        input_len = (cStr.size - 1).toULong(),
+        input = input,
+        input_len = inputLength.toULong(),
         filename = filename.cstr,
         eval_flags = evalFlags,
     )
     return result.use(context = this) {
-        checkContextException(this@compile)
+        checkContextException(this@compileSource)
         val tag = JsValueGetNormTag(result)
         if (tag != JS_TAG_FUNCTION_BYTECODE && tag != JS_TAG_MODULE) {
             qjsError("Failed to compile code, unsupported result type with tag: $tag")
         }
-        toKtValue(context = this@compile)
+        toKtValue(context = this@compileSource)
     } as? ByteArray ?: qjsError("Failed to read bytecode.")
 }
 
+/**
+ * Run [block] with UTF-8 source bytes as a zero-terminated string, which JS_Eval() requires.
+ *
+ * The array is pinned and used in place if the byte after the source is already 0,
+ * otherwise the bytes are copied once.
+ */
+@OptIn(ExperimentalForeignApi::class)
+private inline fun <R> withUtf8Source(
+    code: ByteArray,
+    length: Int,
+    block: (CPointer<ByteVar>) -> R,
+): R {
+    if (length < 0 || length > code.size) {
+        qjsError("Invalid source length: $length")
+    }
+    if (length < code.size && code[length] == 0.toByte()) {
+        return code.usePinned { block(it.addressOf(0)) }
+    }
+    return memScoped {
+        val buffer = allocArray<ByteVar>(length + 1)
+        if (length > 0) {
+            code.usePinned { memcpy(buffer, it.addressOf(0), length.toULong()) }
+        }
+        buffer[length] = 0
+        block(buffer)
+    }
+}
+
 /**
  * Resolves an ES module bytecode graph without evaluating it.
  *
@@ -118,17 +181,38 @@ internal fun CPointer<JSContext>.evaluate(
     filename: String,
     asModule: Boolean,
 ): JsPromise {
-    val context = this@evaluate
+    val cStr = code.cstr
+    return evaluateSource(cStr, cStr.size - 1, filename, asModule)
+}
+
+@OptIn(ExperimentalForeignApi::class)
+@Throws(QuickJsException::class)
+internal fun CPointer<JSContext>.evaluateUtf8(
+    code: ByteArray,
+    length: Int,
+    filename: String,
+    asModule: Boolean,
+): JsPromise = withUtf8Source(code, length) { input ->
+    evaluateSource(input, length, filename, asModule)
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private fun CPointer<JSContext>.evaluateSource(
+    input: CValuesRef<ByteVar>,
+    inputLength: Int,
+    filename: String,
+    asModule: Boolean,
+): JsPromise {
+    val context = this@evaluateSource
     var evalFlags = JS_EVAL_FLAG_ASYNC
     if (asModule) {
         evalFlags = evalFlags or JS_EVAL_TYPE_MODULE
     }
-    val cStr = code.cstr
     JS_UpdateStackTop(JS_GetRuntime(context))
     val result = JS_Eval(
         ctx = this,
-        input = cStr,
-        input_len = (cStr.size - 1).toULong(),
+        input = input,
+        input_len = inputLength.toULong(),
         filename = filename.cstr,
         eval_flags = evalFlags,
     )
@@ -169,6 +253,182 @@ internal fun CPointer<JSContext>.evaluate(
     handleEvalResult(context, result)
 }
 
+/**
+ * Read every module of a bundle into the context and evaluate the entry.
+ *
+ * Modules in [registeredModules] are already in the context and are skipped, the others
+ * are added once read.
+ */
+@OptIn(ExperimentalForeignApi::class)
+@Throws(QuickJsException::class)
+internal fun CPointer<JSContext>.evaluateBundle(
+    bundle: ByteArray,
+    version: String,
+    registeredModules: MutableSet<String>,
+): JsPromise {
+    val context = this@evaluateBundle
+    val index = ModuleBundle.read(bundle, version)
+    JS_UpdateStackTop(JS_GetRuntime(context))
+    bundle.usePinned { pinned ->
+        for (module in index.modules) {
+            if (module === index.entry || module.name in registeredModules) {
+                continue
+            }
+            val jsValue = JS_ReadObject(
+                ctx = context,
+                buf = pinned.addressOf(module.bytecodeOffset).reinterpret<UByteVar>(),
+                buf_len = module.bytecodeLength.toULong(),
+                flags = JS_READ_OBJ_BYTECODE or JS_READ_OBJ_REFERENCE,
+            )
+            // The module stays registered in the context
+            jsValue.use(context) {
+                checkContextException(context)
+                if (JsValueGetNormTag(this) != JS_TAG_MODULE) {
+                    qjsError("Module bundle entry '${module.name}' is not an ES module.")
+                }
+            }
+            registeredModules.add(module.name)
+        }
+    }
+    val entry = index.entry
+    return evaluate(
+        bytecode = bundle.copyOfRange(entry.bytecodeOffset, entry.bytecodeOffset + entry.bytecodeLength)
+    )
+}
+
+@OptIn(ExperimentalForeignApi::class)
+@Throws(QuickJsException::class)
+internal fun CPointer<JSContext>.evaluateSync(
+    code: String,
+    filename: String,
+    asModule: Boolean,
+): Any? {
+    val context = this@evaluateSync
+    val evalFlags = if (asModule) JS_EVAL_TYPE_MODULE else JS_EVAL_TYPE_GLOBAL
+    val cStr = code.cstr
+    JS_UpdateStackTop(JS_GetRuntime(context))
+    val result = JS_Eval(
+        ctx = this,
+        input = cStr,
+        input_len = (cStr.size - 1).toULong(),
+        filename = filename.cstr,
+        eval_flags = evalFlags,
+    )
+    return finishSyncEvaluation(context, result, asyncCompletion = false)
+}
+
+@OptIn(ExperimentalForeignApi::class)
+@Throws(QuickJsException::class)
+internal fun CPointer<JSContext>.evaluateSync(
+    bytecode: ByteArray
+): Any? = memScoped {
+    val context = this@evaluateSync
+
+    val buffer = bytecode.toBytecodeBuffer()
+    JS_UpdateStackTop(JS_GetRuntime(context))
+    val jsValue = JS_ReadObject(
+        ctx = context,
+        buf = buffer,
+        buf_len = buffer.size.toULong(),
+        flags = JS_READ_OBJ_BYTECODE or JS_READ_OBJ_REFERENCE,
+    )
+    try {
+        checkContextException(context)
+        if (JsValueGetNormTag(jsValue) == JS_TAG_MODULE &&
+            JS_ResolveModule(context, jsValue) < 0
+        ) {
+            checkContextException(context)
+            qjsError("Cannot resolve module bytecode.")
+        }
+    } catch (error: Throwable) {
+        JS_FreeValue(context, jsValue)
+        throw error
+    }
+    val result = JS_EvalFunction(
+        ctx = context,
+        fun_obj = jsValue,
+    )
+    // Compiled code always has the async flag
+    finishSyncEvaluation(context, result, asyncCompletion = true)
+}
+
+/**
+ * Drain pending jobs and convert the result, a promise result is unwrapped once the jobs
+ * are drained.
+ *
+ * @param asyncCompletion Whether the result is the completion promise of code compiled
+ * with the async eval flag.
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun finishSyncEvaluation(
+    context: CPointer<JSContext>,
+    result: CValue<JSValue>,
+    asyncCompletion: Boolean,
+): Any? = settleSyncResult(context, result, asyncCompletion).use(context) {
+    toKtValue(context)
+}
+
+/**
+ * Drain pending jobs and settle the result, the caller owns the returned value.
+ *
+ * @see finishSyncEvaluation
+ */
+@OptIn(ExperimentalForeignApi::class)
+internal fun settleSyncResult(
+    context: CPointer<JSContext>,
+    result: CValue<JSValue>,
+    asyncCompletion: Boolean,
+): CValue<JSValue> {
+    try {
+        checkContextException(context)
+        val runtime = JS_GetRuntime(context) ?: qjsError("Failed to get js runtime.")
+        while (true) {
+            when (val jobResult = executePendingJob(runtime)) {
+                ExecuteJobResult.NoJobs -> break
+                ExecuteJobResult.Success -> continue
+                is ExecuteJobResult.Failure -> throw jobResult.error
+            }
+        }
+        if (!result.isPromise(context)) {
+            return result
+        }
+    } catch (error: Throwable) {
+        JS_FreeValue(context, result)
+        throw error
+    }
+    return result.use(context) {
+        when (val state = JS_PromiseState(context, this)) {
+            JSPromiseStateEnum.JS_PROMISE_PENDING -> qjsError(
+                "The result promise is still pending, use evaluate() to await async functions."
+            )
+
+            JSPromiseStateEnum.JS_PROMISE_FULFILLED -> {
+                val value = JS_PromiseResult(context, this)
+                val realValue = if (asyncCompletion) value.unwrapIfWrapped(context) else value
+                try {
+                    checkContextException(context)
+                } catch (error: Throwable) {
+                    JS_FreeValue(context, realValue)
+                    throw error
+                }
+                realValue
+            }
+
+            JSPromiseStateEnum.JS_PROMISE_REJECTED -> {
+                JS_PromiseResult(context, this).use(context) {
+                    if (JS_IsError(context, this) == 1) {
+                        throw jsErrorToKtError(context, this)
+                    } else {
+                        throw QuickJsException(toKtString(context))
+                    }
+                }
+            }
+
+            else -> qjsError("Unknown promise state: $state")
+        }
+    }
+}
+
 @OptIn(ExperimentalForeignApi::class)
 private fun handleEvalResult(
     context: CPointer<JSContext>,
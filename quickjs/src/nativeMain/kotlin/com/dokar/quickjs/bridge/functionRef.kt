@@ -0,0 +1,159 @@
+package com.dokar.quickjs.bridge
+
+import com.dokar.quickjs.QuickJsException
+import com.dokar.quickjs.qjsError
+import com.dokar.quickjs.util.allocArrayOf
+import kotlinx.cinterop.CPointer
+import kotlinx.cinterop.CValue
+import kotlinx.cinterop.ExperimentalForeignApi
+import kotlinx.cinterop.alloc
+import kotlinx.cinterop.memScoped
+import kotlinx.cinterop.ptr
+import kotlinx.cinterop.value
+import platform.posix.double_tVar
+import platform.posix.int64_tVar
+import quickjs.JSContext
+import quickjs.JSValue
+import quickjs.JS_Call
+import quickjs.JS_DupValue
+import quickjs.JS_FreeValue
+import quickjs.JS_GetGlobalObject
+import quickjs.JS_GetPropertyStr
+import quickjs.JS_GetRuntime
+import quickjs.JS_IsFunction
+import quickjs.JS_NewFloat64
+import quickjs.JS_NewInt64
+import quickjs.JS_TAG_FLOAT64
+import quickjs.JS_TAG_INT
+import quickjs.JS_ToFloat64
+import quickjs.JS_ToInt64
+import quickjs.JS_UpdateStackTop
+import quickjs.JsNull
+import quickjs.JsUndefined
+import quickjs.JsValueGetNormTag
+
+/**
+ * Get a function of the global object, the caller owns the returned value.
+ */
+@OptIn(ExperimentalForeignApi::class)
+@Throws(QuickJsException::class)
+internal fun CPointer<JSContext>.getGlobalFunction(name: String): CValue<JSValue> {
+    val context = this@getGlobalFunction
+    JS_UpdateStackTop(JS_GetRuntime(context))
+    val globalThis = JS_GetGlobalObject(context)
+    val func = JS_GetPropertyStr(context, globalThis, name)
+    JS_FreeValue(context, globalThis)
+    try {
+        checkContextException(context)
+        if (JS_IsFunction(context, func) != 1) {
+            qjsError("'$name' is not a function.")
+        }
+    } catch (error: Throwable) {
+        JS_FreeValue(context, func)
+        throw error
+    }
+    return func
+}
+
+/**
+ * Call a function, drain pending jobs and return the converted result. A promise result
+ * is unwrapped once the jobs are drained, like [evaluateSync].
+ */
+@OptIn(ExperimentalForeignApi::class)
+@Throws(QuickJsException::class)
+internal fun CPointer<JSContext>.callFunction(
+    func: CValue<JSValue>,
+    args: Array<out Any?>,
+): Any? {
+    val context = this@callFunction
+
+    JS_UpdateStackTop(JS_GetRuntime(context))
+
+    val jsArgs = Array(args.size) { JsNull() }
+    for (i in jsArgs.indices) {
+        try {
+            jsArgs[i] = args[i].toJsValue(context)
+        } catch (e: Throwable) {
+            for (j in 0..<i) {
+                JS_FreeValue(context, jsArgs[j])
+            }
+            throw e
+        }
+    }
+
+    return callAndSettle(func, jsArgs).use(context) { toKtValue(context) }
+}
+
+/**
+ * Call a function with number arguments and return its number result.
+ */
+@OptIn(ExperimentalForeignApi::class)
+@Throws(QuickJsException::class)
+internal fun CPointer<JSContext>.callFunctionDouble(
+    func: CValue<JSValue>,
+    args: DoubleArray,
+): Double = memScoped {
+    val context = this@callFunctionDouble
+    JS_UpdateStackTop(JS_GetRuntime(context))
+    val jsArgs = Array(args.size) { JS_NewFloat64(context, args[it]) }
+    callAndSettle(func, jsArgs).use(context) {
+        requireNumber(context)
+        val out = alloc<double_tVar>()
+        JS_ToFloat64(context, out.ptr, this)
+        out.value
+    }
+}
+
+/**
+ * Call a function with number arguments and return its number result, truncated to an
+ * integer.
+ */
+@OptIn(ExperimentalForeignApi::class)
+@Throws(QuickJsException::class)
+internal fun CPointer<JSContext>.callFunctionLong(
+    func: CValue<JSValue>,
+    args: LongArray,
+): Long = memScoped {
+    val context = this@callFunctionLong
+    JS_UpdateStackTop(JS_GetRuntime(context))
+    val jsArgs = Array(args.size) { JS_NewInt64(context, args[it]) }
+    callAndSettle(func, jsArgs).use(context) {
+        requireNumber(context)
+        val out = alloc<int64_tVar>()
+        JS_ToInt64(context, out.ptr, this)
+        out.value
+    }
+}
+
+/**
+ * Call a function and settle its result, the arguments are freed and the caller owns the
+ * returned value.
+ */
+@OptIn(ExperimentalForeignApi::class)
+private fun CPointer<JSContext>.callAndSettle(
+    func: CValue<JSValue>,
+    jsArgs: Array<CValue<JSValue>>,
+): CValue<JSValue> = memScoped {
+    val context = this@callAndSettle
+    // The function can be released while it is running
+    val function = JS_DupValue(context, func)
+    val result = JS_Call(
+        ctx = context,
+        func_obj = function,
+        this_obj = JsUndefined(),
+        argc = jsArgs.size,
+        argv = allocArrayOf(*jsArgs),
+    )
+    jsArgs.forEach { JS_FreeValue(context, it) }
+    JS_FreeValue(context, function)
+
+    settleSyncResult(context, result, asyncCompletion = false)
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private fun CValue<JSValue>.requireNumber(context: CPointer<JSContext>) {
+    val tag = JsValueGetNormTag(this)
+    if (tag != JS_TAG_INT && tag != JS_TAG_FLOAT64) {
+        qjsError("The function result is not a number.")
+    }
+}
@@ -21,6 +21,7 @@ import kotlinx.cinterop.pointed
 import kotlinx.cinterop.ptr
 import kotlinx.cinterop.readBytes
 import kotlinx.cinterop.toKStringFromUtf8
+import kotlinx.cinterop.toLong
 import kotlinx.cinterop.value
 import platform.posix.double_tVar
 import platform.posix.int32_tVar
@@ -46,11 +47,9 @@ import quickjs.JS_GetPropertyStr
 import quickjs.JS_GetPropertyUint32
 import quickjs.JS_IsArray
 import quickjs.JS_IsError
-import quickjs.JS_IsException
 import quickjs.JS_IsFunction
 import quickjs.JS_IsString
 import quickjs.JS_IsUndefined
-import quickjs.JS_JSONStringify
 import quickjs.JS_TAG_BOOL
 import quickjs.JS_TAG_EXCEPTION
 import quickjs.JS_TAG_FLOAT64
@@ -70,13 +69,17 @@ import quickjs.JS_VALUE_IS_NAN
 import quickjs.JS_WRITE_OBJ_BYTECODE
 import quickjs.JS_WRITE_OBJ_REFERENCE
 import quickjs.JS_WriteObject
-import quickjs.JsUndefined
 import quickjs.JsValueGetNormTag
 import quickjs.JsValueGetPtr
 import quickjs.js_free
 
 @OptIn(ExperimentalForeignApi::class)
 internal fun CValue<JSValue>.toKtValue(context: CPointer<JSContext>): Any? {
+    return toKtValue(context, ConversionPath())
+}
+
+@OptIn(ExperimentalForeignApi::class)
+private fun CValue<JSValue>.toKtValue(context: CPointer<JSContext>, path: ConversionPath): Any? {
     val tag = JsValueGetNormTag(this)
     return when {
         tag == JS_TAG_NULL || tag == JS_TAG_UNDEFINED || tag == JS_TAG_UNINITIALIZED -> null
@@ -131,7 +134,7 @@ internal fun CValue<JSValue>.toKtValue(context: CPointer<JSContext>): Any? {
         }
 
         JS_IsArray(context, this) == 1 -> {
-            jsArrayToKtList(context, this)
+            path.visit(this) { jsArrayToKtList(context, this, path) }
         }
 
         JS_IsError(context, this) == 1 -> {
@@ -145,9 +148,15 @@ internal fun CValue<JSValue>.toKtValue(context: CPointer<JSContext>): Any? {
                     isPromise(context, globalThis) -> JsPromise(value = this)
                     isUint8Array(context, globalThis) -> jsUint8ArrayToKtUByteArray(context, this)
                     isInt8Array(context, globalThis) -> jsInt8ArrayToKtByteArray(context, this)
-                    isSet(context, globalThis) -> jsSetToKtSet(context, this)
-                    isMap(context, globalThis) -> jsMapToKtMap(context, this)
-                    else -> jsObjectToKtJsObject(context, this)
+                    isSet(context, globalThis) -> path.visit(this) {
+                        jsSetToKtSet(context, this, path)
+                    }
+
+                    isMap(context, globalThis) -> path.visit(this) {
+                        jsMapToKtMap(context, this, path)
+                    }
+
+                    else -> path.visit(this) { jsObjectToKtJsObject(context, this, path) }
                 }
             } finally {
                 JS_FreeValue(context, globalThis)
@@ -268,7 +277,8 @@ private fun jsInt8ArrayToKtByteArray(
 @OptIn(ExperimentalForeignApi::class)
 private fun jsArrayToKtList(
     context: CPointer<JSContext>,
-    array: CValue<JSValue>
+    array: CValue<JSValue>,
+    path: ConversionPath,
 ): List<Any?> = memScoped {
     val length = alloc<int64_tVar>()
     JS_GetPropertyStr(context, array, "length").use(context) {
@@ -277,10 +287,7 @@ private fun jsArrayToKtList(
 
     List(length.value.toInt()) {
         JS_GetPropertyUint32(context, array, it.toUInt()).use(context) {
-            if (this.isTheSameObject(array)) {
-                circularRefError()
-            }
-            toKtValue(context)
+            toKtValue(context, path)
         }
     }
 }
@@ -288,7 +295,8 @@ private fun jsArrayToKtList(
 @OptIn(ExperimentalForeignApi::class)
 private fun jsSetToKtSet(
     context: CPointer<JSContext>,
-    set: CValue<JSValue>
+    set: CValue<JSValue>,
+    path: ConversionPath,
 ): Set<Any?> {
     val result = mutableSetOf<Any?>()
 
@@ -303,15 +311,14 @@ private fun jsSetToKtSet(
             break
         }
         val key = JS_GetPropertyStr(context, entry, "value")
+        freeJsValues(context, done, entry)
 
-        if (key.isTheSameObject(set)) {
-            freeJsValues(context, key, done, entry)
+        try {
+            result.add(key.use(context) { toKtValue(context, path) })
+        } catch (e: Throwable) {
             freeJsValues(context, nextFunc, iterator, keysFunc)
-            circularRefError()
+            throw e
         }
-
-        result.add(key.use(context) { toKtValue(context) })
-        freeJsValues(context, done, entry)
     }
 
     freeJsValues(context, nextFunc, iterator, keysFunc)
@@ -321,7 +328,8 @@ private fun jsSetToKtSet(
 @OptIn(ExperimentalForeignApi::class)
 private fun jsMapToKtMap(
     context: CPointer<JSContext>,
-    set: CValue<JSValue>
+    set: CValue<JSValue>,
+    path: ConversionPath,
 ): Map<Any?, Any?> {
     val result = mutableMapOf<Any?, Any?>()
 
@@ -339,14 +347,16 @@ private fun jsMapToKtMap(
         val key = JS_GetPropertyUint32(context, entryVal, 0.toUInt())
         val value = JS_GetPropertyUint32(context, entryVal, 1.toUInt())
 
-        if (key.isTheSameObject(set) || value.isTheSameObject(set)) {
-            freeJsValues(context, value, key, entryVal, done, entry)
+        freeJsValues(context, entryVal, done, entry)
+
+        try {
+            result[key.toKtValue(context, path)] = value.toKtValue(context, path)
+        } catch (e: Throwable) {
             freeJsValues(context, nextFunc, iterator, entriesFunc)
-            circularRefError()
+            throw e
+        } finally {
+            freeJsValues(context, value, key)
         }
-
-        result[key.use(context) { toKtValue(context) }] = value.use(context) { toKtValue(context) }
-        freeJsValues(context, entryVal, done, entry)
     }
 
     freeJsValues(context, nextFunc, iterator, entriesFunc)
@@ -356,26 +366,9 @@ private fun jsMapToKtMap(
 @OptIn(ExperimentalForeignApi::class)
 private fun jsObjectToKtJsObject(
     context: CPointer<JSContext>,
-    jsObject: CValue<JSValue>
+    jsObject: CValue<JSValue>,
+    path: ConversionPath,
 ): JsObject = memScoped {
-    // Check circular refs
-    val json = JS_JSONStringify(context, jsObject, JsUndefined(), JsUndefined())
-    if (JS_IsException(json) == 1) {
-        val jsError = JS_GetException(context)
-        val jsErrorTag = JsValueGetNormTag(jsError)
-        val error = if (jsErrorTag != JS_TAG_NULL && jsErrorTag != JS_TAG_UNINITIALIZED) {
-            jsErrorToKtError(context, jsError)
-        } else {
-            null
-        }
-        freeJsValues(context, jsError, json)
-        if (error != null) {
-            throw error
-        }
-    } else {
-        freeJsValues(context, json)
-    }
-
     val result = mutableMapOf<String, Any?>()
 
     val props = allocArrayOfPointersTo<JSPropertyEnum>()
@@ -390,7 +383,8 @@ private fun jsObjectToKtJsObject(
 
     val propsPointer = props.pointed.value!!
 
-    for (i in 0..<propLen.value.toInt()) {
+    val propCount = propLen.value.toInt()
+    for (i in 0..<propCount) {
         val atom = propsPointer[i].atom
         val jsKey = JS_AtomToValue(context, atom)
         if (jsKey.isTheSameObject(jsObject)) {
@@ -407,13 +401,23 @@ private fun jsObjectToKtJsObject(
 
         val jsValue = JS_GetProperty(context, jsObject, atom)
         JS_FreeAtom(context, atom)
-        val value = if (jsValue.isTheSameObject(jsObject)) {
-            jsValue.use(context) { toKtString(context) }
-        } else if (JS_IsFunction(context, jsValue) == 1) {
+        val value = if (JS_IsFunction(context, jsValue) == 1) {
             freeJsValues(context, jsValue)
             "[Function]"
+        } else if (propsPointer[i].is_enumerable != 1 && path.contains(jsValue)) {
+            // Like JSON.stringify(), non-enumerable properties are not checked, avoid
+            // infinite recursion, e.g. globalThis.globalThis
+            jsValue.use(context) { toKtString(context) }
         } else {
-            jsValue.use(context) { toKtValue(context) }
+            try {
+                jsValue.use(context) { toKtValue(context, path) }
+            } catch (e: Throwable) {
+                for (j in i + 1..<propCount) {
+                    JS_FreeAtom(context, propsPointer[j].atom)
+                }
+                js_free(context, propsPointer)
+                throw e
+            }
         }
         result[key] = value
     }
@@ -429,3 +433,34 @@ private fun CValue<JSValue>.isTheSameObject(other: CValue<JSValue>): Boolean {
             JsValueGetNormTag(other) == JS_TAG_OBJECT &&
             JsValueGetPtr(this) == JsValueGetPtr(other)
 }
+
+/**
+ * The arrays and objects on the current conversion path, keyed by their pointers.
+ *
+ * Only containers on the path are tracked, an object that is shared by siblings is
+ * converted every time it's found.
+ */
+@OptIn(ExperimentalForeignApi::class)
+private class ConversionPath {
+    private var objects: HashSet<Long>? = null
+
+    fun contains(value: CValue<JSValue>): Boolean {
+        if (JsValueGetNormTag(value) != JS_TAG_OBJECT) return false
+        return objects?.contains(value.address()) == true
+    }
+
+    inline fun <T> visit(value: CValue<JSValue>, block: () -> T): T {
+        val address = value.address()
+        val objects = this.objects ?: HashSet<Long>().also { this.objects = it }
+        if (!objects.add(address)) {
+            circularRefError()
+        }
+        try {
+            return block()
+        } finally {
+            objects.remove(address)
+        }
+    }
+
+    fun CValue<JSValue>.address(): Long = JsValueGetPtr(this).toLong()
+}
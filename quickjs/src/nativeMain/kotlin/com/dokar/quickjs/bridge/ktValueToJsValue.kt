@@ -46,7 +46,7 @@ import kotlin.native.identityHashCode
 @OptIn(ExperimentalForeignApi::class)
 internal fun <T : Any?> T.toJsValue(
     context: CPointer<JSContext>,
-    visited: MutableSet<Int>? = null,
+    path: KtConversionPath? = null,
 ): CValue<JSValue> {
     val value = this ?: return JsNull()
     return when (value) {
@@ -61,11 +61,11 @@ internal fun <T : Any?> T.toJsValue(
         is String -> JS_NewString(context, value.cstr)
         is ByteArray -> ktByteArrayToJsInt8Array(context, value)
         is UByteArray -> ktUByteArrayToJsUint8Array(context, value)
-        is Array<*> -> ktArrayToJsArray(context, value, visited ?: mutableSetOf())
-        is Set<*> -> ktSetToJsSet(context, value, visited ?: mutableSetOf())
-        is JsObject -> ktMapToJsObject(context, value, visited ?: mutableSetOf())
-        is Map<*, *> -> ktMapToJsMap(context, value, visited ?: mutableSetOf())
-        is Iterable<*> -> ktIterableToJsArray(context, value, visited ?: mutableSetOf())
+        is Array<*> -> visit(path, value) { ktArrayToJsArray(context, value, it) }
+        is Set<*> -> visit(path, value) { ktSetToJsSet(context, value, it) }
+        is JsObject -> visit(path, value) { ktMapToJsObject(context, value, it) }
+        is Map<*, *> -> visit(path, value) { ktMapToJsMap(context, value, it) }
+        is Iterable<*> -> visit(path, value) { ktIterableToJsArray(context, value, it) }
         is Throwable -> ktErrorToJsError(context, value)
         else -> qjsError("Cannot convert kotlin type '${value::class.qualifiedName}' to a js value.")
     }
@@ -160,15 +160,13 @@ private fun freeJsArrayBuffer(
 private fun ktArrayToJsArray(
     context: CPointer<JSContext>,
     array: Array<*>,
-    visited: MutableSet<Int>,
+    path: KtConversionPath,
 ): CValue<JSValue> {
-    if (visited.isEmpty()) visit(visited, array)
     val jsArray = JS_NewArray(context)
     try {
         for (i in array.indices) {
             val element = array[i]
-            visitOrCircularRefError(visited, element)
-            val jsElement = element.toJsValue(context, visited)
+            val jsElement = element.toJsValue(context, path)
             JS_SetPropertyUint32(context, jsArray, i.toUInt(), jsElement)
         }
     } catch (e: Throwable) {
@@ -182,14 +180,12 @@ private fun ktArrayToJsArray(
 private fun ktIterableToJsArray(
     context: CPointer<JSContext>,
     iterable: Iterable<*>,
-    visited: MutableSet<Int>,
+    path: KtConversionPath,
 ): CValue<JSValue> {
-    if (visited.isEmpty()) visit(visited, iterable)
     val jsArray = JS_NewArray(context)
     try {
         for ((i, element) in iterable.withIndex()) {
-            visitOrCircularRefError(visited, element)
-            val jsElement = element.toJsValue(context, visited)
+            val jsElement = element.toJsValue(context, path)
             JS_SetPropertyUint32(context, jsArray, i.toUInt(), jsElement)
         }
     } catch (e: Throwable) {
@@ -203,14 +199,12 @@ private fun ktIterableToJsArray(
 private fun ktSetToJsSet(
     context: CPointer<JSContext>,
     set: Set<*>,
-    visited: MutableSet<Int>,
+    path: KtConversionPath,
 ): CValue<JSValue> = memScoped {
-    if (visited.isEmpty()) visit(visited, set)
     val elements = JS_NewArray(context)
     try {
         for ((i, element) in set.withIndex()) {
-            visitOrCircularRefError(visited, element)
-            val jsElement = element.toJsValue(context, visited)
+            val jsElement = element.toJsValue(context, path)
             JS_SetPropertyUint32(context, elements, i.toUInt(), jsElement)
         }
     } catch (e: Throwable) {
@@ -233,19 +227,16 @@ private fun ktSetToJsSet(
 private fun ktMapToJsMap(
     context: CPointer<JSContext>,
     map: Map<*, *>,
-    visited: MutableSet<Int>,
+    path: KtConversionPath,
 ): CValue<JSValue> = memScoped {
-    if (visited.isEmpty()) visit(visited, map)
     val elements = JS_NewArray(context)
     try {
         var index = 0
         for ((key, value) in map) {
-            visitOrCircularRefError(visited, key)
-            visitOrCircularRefError(visited, value)
             val entryArray = JS_NewArray(context)
             try {
-                JS_SetPropertyUint32(context, entryArray, 0u, key.toJsValue(context, visited))
-                JS_SetPropertyUint32(context, entryArray, 1u, value.toJsValue(context, visited))
+                JS_SetPropertyUint32(context, entryArray, 0u, key.toJsValue(context, path))
+                JS_SetPropertyUint32(context, entryArray, 1u, value.toJsValue(context, path))
                 JS_SetPropertyUint32(context, elements, index.toUInt(), entryArray)
             } catch (e: Throwable) {
                 freeJsValues(context, entryArray)
@@ -273,21 +264,19 @@ private fun ktMapToJsMap(
 private fun ktMapToJsObject(
     context: CPointer<JSContext>,
     map: Map<*, *>,
-    visited: MutableSet<Int>,
+    path: KtConversionPath,
 ): CValue<JSValue> = memScoped {
-    if (visited.isEmpty()) visit(visited, map)
     val jsObject = JS_NewObject(context)
     try {
         for ((key, value) in map) {
             if (key !is String) {
                 qjsError("Only maps with string keys can be mapped to js objects.")
             }
-            visitOrCircularRefError(visited, value)
-            visitOrCircularRefError(visited, key)
-            JS_SetPropertyStr(context, jsObject, key, value.toJsValue(context, visited))
+            JS_SetPropertyStr(context, jsObject, key, value.toJsValue(context, path))
         }
     } catch (e: Throwable) {
         freeJsValues(context, jsObject)
+        throw e
     }
     return jsObject
 }
@@ -310,36 +299,56 @@ private fun newJsObjectFromConstructor(
 }
 
 /**
- * [Any.identityHashCode] is used to identify objects because [Any.hashCode] will be an
- * infinite recursion on circular-referenced objects. Same for [visit].
+ * Convert a container while it's on the conversion [path]. Only the path is tracked, so a
+ * container that is shared by siblings is converted every time it's found.
  */
-@OptIn(ExperimentalNativeApi::class)
-private fun visitOrCircularRefError(
-    visited: MutableSet<Int>,
-    current: Any?,
-) {
-    current ?: return
-    if (current !is Array<*> &&
-        current !is Iterable<*> &&
-        current !is Set<*> &&
-        current !is Map<*, *> &&
-        current !is JsObject
-    ) {
-        return
-    }
-    val identityHashCode = current.identityHashCode()
-    if (visited.contains(identityHashCode)) {
+@OptIn(ExperimentalForeignApi::class)
+private inline fun visit(
+    path: KtConversionPath?,
+    current: Any,
+    block: (path: KtConversionPath) -> CValue<JSValue>,
+): CValue<JSValue> {
+    val currentPath = path ?: KtConversionPath()
+    if (!currentPath.add(current)) {
         circularRefError()
-    } else {
-        visited.add(identityHashCode)
+    }
+    try {
+        return block(currentPath)
+    } finally {
+        currentPath.remove(current)
     }
 }
 
+/**
+ * The containers on the current conversion path, keyed by their identity hash codes.
+ *
+ * [Any.identityHashCode] is used because [Any.hashCode] will be an infinite recursion on
+ * circular-referenced objects. Different objects can have the same identity hash code, so
+ * the objects of a code are compared by identity.
+ */
 @OptIn(ExperimentalNativeApi::class)
-private fun visit(
-    visited: MutableSet<Int>,
-    current: Any?
-) {
-    current ?: return
-    visited.add(current.identityHashCode())
+internal class KtConversionPath {
+    private val objects = HashMap<Int, MutableList<Any>>()
+
+    /**
+     * Add an object to the path, returns false if it's already on the path.
+     */
+    fun add(value: Any): Boolean {
+        val sameHash = objects.getOrPut(value.identityHashCode()) { ArrayList(1) }
+        if (sameHash.any { it === value }) {
+            return false
+        }
+        sameHash.add(value)
+        return true
+    }
+
+    fun remove(value: Any) {
+        val identityHashCode = value.identityHashCode()
+        val sameHash = objects[identityHashCode] ?: return
+        // The path is a stack, the object is the last one added
+        sameHash.removeAt(sameHash.lastIndex)
+        if (sameHash.isEmpty()) {
+            objects.remove(identityHashCode)
+        }
+    }
 }
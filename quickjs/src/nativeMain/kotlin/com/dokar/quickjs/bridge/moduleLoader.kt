@@ -25,6 +25,7 @@ import quickjs.JS_EVAL_FLAG_COMPILE_ONLY
 import quickjs.JS_EVAL_TYPE_MODULE
 import quickjs.JS_Eval
 import quickjs.JS_FreeAtom
+import quickjs.JS_GetContextOpaque
 import quickjs.JS_GetModuleName
 import quickjs.JS_IsException
 import quickjs.JS_READ_OBJ_BYTECODE
@@ -169,6 +170,12 @@ private fun loadModule(
         name = name,
         bytecode = content.bytes,
       )
+
+      is ModuleContent.BytecodeBuffer -> readBytecodeModule(
+        context = jsContext,
+        name = name,
+        bytecode = content.toByteArray(),
+      )
     }
   } catch (error: Throwable) {
     return throwModuleLoadFailure(
@@ -179,6 +186,11 @@ private fun loadModule(
       failureVersion = failureVersion,
     )
   }
+  if (definition != null) {
+    // Realm contexts carry their own instance
+    val contextOwner = JS_GetContextOpaque(jsContext)?.asStableRef<QuickJs>()?.get() ?: owner
+    contextOwner.onModuleRegistered(name)
+  }
   if (definition == null && failureVersion == owner.moduleLoadFailureVersion) {
     try {
       owner.onModuleLoadFailed(name)
@@ -12,6 +12,7 @@ import kotlinx.cinterop.toLong
 import quickjs.JSContext
 import quickjs.JSRuntime
 import quickjs.JSValue
+import quickjs.JS_GetContextOpaque
 import quickjs.JS_SetHostPromiseRejectionTracker
 import quickjs.JsValueGetPtr
 
@@ -24,7 +25,12 @@ private fun promiseRejectionHandler(
     isHandled: Int,
     opaque: COpaquePointer?,
 ) {
-    val quickJs = opaque!!.asStableRef<QuickJs>()
+    // Realm contexts carry their own instance, others report to the runtime owner
+    val quickJs = (JS_GetContextOpaque(context) ?: opaque)!!.asStableRef<QuickJs>()
+    if (!quickJs.get().isCurrentContext(context!!)) {
+        // Jobs left by a replaced context
+        return
+    }
     val promiseId = JsValueGetPtr(promise)!!.toLong()
     if (isHandled != 1) {
         quickJs.get().setUnhandledPromiseRejection(
@@ -0,0 +1,8 @@
+package com.dokar.quickjs.util
+
+import kotlin.experimental.ExperimentalNativeApi
+
+@OptIn(ExperimentalNativeApi::class)
+internal actual fun availableProcessors(): Int {
+    return Platform.getAvailableProcessors().coerceAtLeast(1)
+}